@@ -0,0 +1,277 @@
+/*
+    contrib/hosttest/accel_stream_test.c: libs/accel_stream.c on the host
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Feeds a simulated CMA3000 into the stream and checks the fixed point
+   stages against a straight computation, the overrun accounting and the
+   recovery of a sample whose data ready edge was skipped. Built twice,
+   with polled SPI reads and with CONFIG_ACCELEROMETER_DMA. */
+
+#define CONFIG_ACCELEROMETER
+
+#include "host.h"
+
+#include "../../drivers/dsp.c"
+#include "../../libs/accel_stream.c"
+
+struct As_Param as_config = { .range = 2 };
+
+/* the sensor, sample n reads as X=n, Y=-n, Z=56 (1g at 2g range) */
+static uint16_t sensor_next;
+static uint16_t sensor_reads;
+
+static void sensor_read(uint8_t *data)
+{
+	data[0] = sensor_next;
+	data[1] = -sensor_next;
+	data[2] = 56;
+	sensor_next++;
+	sensor_reads++;
+
+	/* reading the sample clears INT */
+	P2IN &= ~AS_INT_PIN;
+}
+
+void as_start(uint8_t mode)
+{
+}
+
+void as_stop(void)
+{
+}
+
+void as_get_data(uint8_t *data)
+{
+	sensor_read(data);
+}
+
+#ifdef CONFIG_ACCELEROMETER_DMA
+static uint8_t *dma_dest;
+static uint8_t (*dma_fn)(void);
+static uint8_t dma_refuse;
+
+uint8_t as_get_data_async(uint8_t *data, uint8_t (*done_fn)(void))
+{
+	if (dma_refuse || dma_fn) {
+		if (dma_refuse)
+			dma_refuse--;
+		return 1;
+	}
+
+	dma_dest = data;
+	dma_fn = done_fn;
+	return 0;
+}
+
+/* the DMA interrupt after the third frame, 1 if it wakes the main loop */
+static uint8_t dma_complete(void)
+{
+	uint8_t (*fn)(void) = dma_fn;
+
+	sensor_read(dma_dest);
+	dma_fn = NULL;
+	return fn();
+}
+#endif
+
+/* data ready, what the PORT2 ISR does */
+static uint8_t data_ready(void)
+{
+	uint8_t ret;
+
+	P2IN |= AS_INT_PIN;
+	TA0R += 164;
+	ret = accel_stream_isr();
+
+#ifdef CONFIG_ACCELEROMETER_DMA
+	/* only the wakeups the DMA interrupt asks for */
+	if (ret == ACCEL_STREAM_SMCLK)
+		ret = (dma_complete() ? ACCEL_STREAM_WAKE : ACCEL_STREAM_SLEEP);
+#endif
+
+	return ret;
+}
+
+static void drain(void)
+{
+	accel_stream_drain();
+#ifdef CONFIG_ACCELEROMETER_DMA
+	/* a recovered sample completes like any other */
+	if (dma_fn)
+		dma_complete();
+#endif
+}
+
+static struct accel_frame frames[64];
+static uint16_t nframes, nquarter;
+
+static void every_frame(const struct accel_frame *f)
+{
+	if (nframes < 64)
+		frames[nframes] = *f;
+	nframes++;
+}
+
+static void every_fourth(const struct accel_frame *f)
+{
+	nquarter++;
+}
+
+static void restart(void)
+{
+	accel_stream_start(SAMPLING_100_HZ);
+	sensor_next = 0;
+	sensor_reads = 0;
+	nframes = 0;
+	nquarter = 0;
+}
+
+/* the stages against a straight computation */
+static void test_pipeline(void)
+{
+	int16_t lp[3] = { 0, 0, 0 };
+	uint16_t n, i, wakes = 0;
+	int16_t mg;
+	int32_t sum;
+
+	restart();
+
+	for (n = 0; n < 40; n++) {
+		if (data_ready() == ACCEL_STREAM_WAKE) {
+			wakes++;
+			drain();
+		}
+	}
+	drain();
+
+	CHECK(nframes == 40);
+	CHECK(nquarter == 10);
+	CHECK(accel_stream_overruns == 0);
+	CHECK(wakes == 40 / ACCEL_STREAM_BATCH);
+
+	for (n = 0; n < 40; n++) {
+		sum = 0;
+		for (i = 0; i < 3; i++) {
+			mg = ((int32_t)(int8_t)(i == 0 ? n : i == 1 ? -n : 56)
+							* 4571) >> 8;
+			CHECK(frames[n].mg[i] == mg);
+			if (n == 0)
+				lp[i] = mg;
+			else
+				lp[i] += (mg - lp[i]) >> ACCEL_STREAM_IIR_SHIFT;
+			CHECK(frames[n].lp[i] == lp[i]);
+			sum += (int32_t)lp[i] * lp[i];
+		}
+		CHECK((uint32_t)frames[n].mag * frames[n].mag <= (uint32_t)sum);
+		CHECK((uint32_t)(frames[n].mag + 1) * (frames[n].mag + 1)
+							> (uint32_t)sum);
+		if (n)
+			CHECK((uint16_t)(frames[n].ts - frames[n - 1].ts) == 164);
+	}
+
+	/* 1g on Z */
+	CHECK(frames[0].mg[2] == 999);
+
+	accel_stream_stop();
+}
+
+/* a full ring still reads every sample, otherwise INT stays high */
+static void test_overrun(void)
+{
+	uint16_t n;
+
+	restart();
+
+	for (n = 0; n < 20; n++)
+		data_ready();
+
+	CHECK(sensor_reads == 20);
+	CHECK(accel_stream_overruns == 20 - (ACCEL_STREAM_LEN - 1));
+
+	drain();
+	CHECK(nframes == ACCEL_STREAM_LEN - 1);
+
+	data_ready();
+	drain();
+	CHECK(nframes == ACCEL_STREAM_LEN);
+
+	accel_stream_stop();
+}
+
+/* the main loop holds the SPI when data ready comes */
+static void test_spi_busy(void)
+{
+	restart();
+
+	PJOUT &= ~AS_CSN_PIN;
+	CHECK(data_ready() == ACCEL_STREAM_WAKE);
+	PJOUT |= AS_CSN_PIN;
+
+	CHECK(accel_stream_pending);
+	CHECK(accel_stream_overruns == 1);
+	CHECK(sensor_reads == 0);
+
+	/* INT is still high, the drain reads the sample */
+	drain();
+	CHECK(sensor_reads == 1);
+
+	data_ready();
+	drain();
+	CHECK(nframes == 2);
+
+	accel_stream_stop();
+}
+
+#ifdef CONFIG_ACCELEROMETER_DMA
+/* the DMA refuses the read, as while a blocking read runs */
+static void test_dma_refused(void)
+{
+	restart();
+
+	dma_refuse = 1;
+	CHECK(data_ready() == ACCEL_STREAM_WAKE);
+	CHECK(accel_stream_pending);
+	CHECK(accel_stream_overruns == 1);
+	CHECK(sensor_reads == 0);
+
+	drain();
+	CHECK(sensor_reads == 1);
+
+	data_ready();
+	drain();
+	CHECK(nframes == 2);
+
+	accel_stream_stop();
+}
+#endif
+
+int main(void)
+{
+	PJOUT |= AS_CSN_PIN;
+
+	accel_stream_subscribe(&every_frame, 1);
+	accel_stream_subscribe(&every_fourth, 4);
+
+	test_pipeline();
+	test_overrun();
+	test_spi_busy();
+#ifdef CONFIG_ACCELEROMETER_DMA
+	test_dma_refused();
+	return host_done("accel_stream (DMA)");
+#else
+	return host_done("accel_stream");
+#endif
+}
@@ -0,0 +1,319 @@
+/*
+    contrib/hosttest/altitude_kf_test.c: libs/altitude_kf.c on the host
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Flies a simulated climb profile (rest, climb 2m/s, sink 1m/s, a
+   thermal, rest) past a noisy barometer and a biased accelerometer and
+   runs the fixed point filter next to the same filter in doubles:
+
+   - the fixed point state stays within a few cm and cm/s of the float
+   - the climb rate beats differencing over a second of samples, which
+     is what the altitude module showed before, and the fused
+     accelerometer beats the constant speed model
+   - the accelerometer bias is found
+   - at one sample per minute the restart path still follows the climb
+
+   The gravity tracking of the accelerometer path is checked on its own
+   with a tilted watch at rest. */
+
+#include <math.h>
+
+#define CONFIG_ACCELEROMETER
+
+#include "host.h"
+
+#include "../../drivers/dsp.c"
+#include "../../libs/accel_stream.c"
+#include "../../libs/altitude_kf.c"
+
+struct As_Param as_config;
+
+void as_start(uint8_t mode)
+{
+}
+
+void as_stop(void)
+{
+}
+
+void as_get_data(uint8_t *data)
+{
+}
+
+/* deterministic noise, the same on every host */
+static uint32_t seed = 1;
+
+static double uniform(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return ((seed >> 8) + 1.0) / 16777218.0;
+}
+
+static double gauss(void)
+{
+	return sqrt(-2 * log(uniform())) * cos(2 * M_PI * uniform());
+}
+
+/* the same filter in doubles */
+static double fx[3], fp[3][3], fa, ft;
+static int facc;
+
+static void f_predict(double dt)
+{
+	double F[3][3] = {
+		{ 1, dt, facc ? -dt * dt / 2 : 0 },
+		{ 0, 1, facc ? -dt : 0 },
+		{ 0, 0, 1 } };
+	double G[3] = { dt * dt / 2, dt, 0 };
+	double q = facc ? 0.09 : 0.25;
+	double a = facc ? fa - fx[2] : 0;
+	double A[3][3], N[3][3];
+	int i, j, k;
+
+	fx[0] += dt * fx[1] + a * dt * dt / 2;
+	fx[1] += a * dt;
+
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+			for (A[i][j] = 0, k = 0; k < 3; k++)
+				A[i][j] += F[i][k] * fp[k][j];
+
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 3; j++) {
+			for (N[i][j] = 0, k = 0; k < 3; k++)
+				N[i][j] += A[i][k] * F[j][k];
+			N[i][j] += q * G[i] * G[j];
+		}
+	}
+
+	if (facc)
+		N[2][2] += 1e-4 * dt;
+
+	memcpy(fp, N, sizeof(fp));
+}
+
+static void f_advance(double t)
+{
+	double dt = t - ft;
+
+	if (dt <= 0)
+		return;
+
+	f_predict(dt);
+	ft = t;
+}
+
+static void f_update(double z, double r)
+{
+	double s = fp[0][0] + r, y = z - fx[0], k[3], N[3][3];
+	int i, j;
+
+	for (i = 0; i < 3; i++)
+		k[i] = fp[i][0] / s;
+
+	for (i = 0; i < 3; i++)
+		fx[i] += k[i] * y;
+
+	for (i = 0; i < 3; i++)
+		for (j = 0; j < 3; j++)
+			N[i][j] = fp[i][j] - k[i] * fp[0][j];
+
+	memcpy(fp, N, sizeof(fp));
+}
+
+struct flight {
+	double rms_kf;		/* climb rate error of the filter, m/s */
+	double rms_float;	/* of the float filter */
+	double rms_diff;	/* of differencing over a second */
+	double lag;		/* seconds until the filter shows 1m/s */
+	double dv, dh;		/* fixed against float, m/s and m */
+	double bias;		/* bias estimate, m/s^2 */
+};
+
+#define BARO_R		262144	/* (0.5m)^2, Q20 */
+#define ACCEL_BIAS	0.15	/* m/s^2 */
+
+/* baro_hz barometer samples per second, accel fused in or not */
+static void fly(double baro_hz, int accel, struct flight *res)
+{
+	double t, h = 500, v = 0, vt, at, am, z, vk;
+	double tb = 0, ta = 0.05, err_kf = 0, err_f = 0, err_d = 0;
+	double hist[64];
+	int first = 1, n = 0, span, hp = 0;
+
+	memset(res, 0, sizeof(*res));
+	memset(&altitude_kf, 0, sizeof(altitude_kf));
+	res->lag = -1;
+	altitude_kf.accel = accel;
+	facc = accel;
+	seed = 1;
+
+	span = baro_hz < 1 ? 1 : baro_hz;
+	for (hp = 0; hp < 64; hp++)
+		hist[hp] = h;
+	hp = 0;
+
+	for (t = 0; t < 600; t += 0.001) {
+		vt = t < 100 ? 0 : t < 300 ? 2.0 : t < 450 ? -1.0
+			: t < 500 ? 3.0 * sin((t - 450) / 3) : 0;
+		at = (vt - v) / 0.5;
+		if (fabs(at) > 3)
+			at = at > 0 ? 3 : -3;
+		v += at * 0.001;
+		h += v * 0.001;
+
+		TA0R = (uint16_t)(uint64_t)(t * 16384);
+		rtca_time.sys = (uint32_t)t;
+
+		/* 10Hz accelerometer, 2g range steps */
+		if (accel && t >= ta) {
+			ta += 0.1;
+			am = at + ACCEL_BIAS + 0.3 * gauss();
+			am = round(am / 0.176) * 0.176;
+			if (!first) {
+				kf_accel_input(lround(am * 1024), TA0R);
+				f_advance(t);
+				fa = am;
+			}
+		}
+
+		if (t < tb)
+			continue;
+
+		/* barometer, 1/16m steps */
+		tb += 1 / baro_hz;
+		z = round((h + 0.5 * gauss()) * 16) / 16;
+
+		if (first) {
+			altitude_kf_reset(lround(z * 1024), BARO_R);
+			memset(fx, 0, sizeof(fx));
+			memset(fp, 0, sizeof(fp));
+			fx[0] = z;
+			fp[0][0] = 0.25;
+			fp[1][1] = 1;
+			fp[2][2] = 0.09;
+			ft = t;
+			fa = 0;
+			first = 0;
+			continue;
+		}
+
+		altitude_kf_update(lround(z * 1024), BARO_R, TA0R);
+		f_advance(t);
+		f_update(z, 0.25);
+
+		hp = (hp + 1) % 64;
+		hist[hp] = z;
+		vk = altitude_kf.v / 1024.0;
+
+		if (t > 60) {
+			err_kf += (vk - v) * (vk - v);
+			err_f += (fx[1] - v) * (fx[1] - v);
+			z = (z - hist[(hp + 64 - span) % 64]) * baro_hz / span;
+			err_d += (z - v) * (z - v);
+			n++;
+
+			if (fabs(vk - fx[1]) > res->dv)
+				res->dv = fabs(vk - fx[1]);
+			if (fabs(altitude_kf.h / 1024.0 - fx[0]) > res->dh)
+				res->dh = fabs(altitude_kf.h / 1024.0 - fx[0]);
+		}
+
+		if (res->lag < 0 && t > 100 && vk > 1.0)
+			res->lag = t - 100;
+	}
+
+	res->rms_kf = sqrt(err_kf / n);
+	res->rms_float = sqrt(err_f / n);
+	res->rms_diff = sqrt(err_d / n);
+	res->bias = altitude_kf.b / 1024.0;
+
+	printf("  baro %5.2fHz%s: climb rms %.3f (float %.3f, difference "
+	       "%.3f) m/s, 1m/s after %.2fs, fixed-float %.4fm/s %.4fm\n",
+	       baro_hz, accel ? " + accel" : "        ", res->rms_kf,
+	       res->rms_float, res->rms_diff, res->lag, res->dv, res->dh);
+}
+
+static void test_flights(void)
+{
+	struct flight baro, fused, slow, sparse;
+
+	fly(20, 0, &baro);
+	fly(20, 1, &fused);
+	fly(1, 0, &slow);
+	fly(1 / 60.0, 0, &sparse);
+
+	/* fixed point against float */
+	CHECK(baro.dv < 0.02 && baro.dh < 0.02);
+	CHECK(fused.dv < 0.05 && fused.dh < 0.05);
+	CHECK(slow.dv < 0.02 && slow.dh < 0.02);
+
+	/* better than differencing, better still with the accelerometer */
+	CHECK(baro.rms_kf < baro.rms_diff * 0.6);
+	CHECK(slow.rms_kf < slow.rms_diff * 0.6);
+	CHECK(fused.rms_kf < baro.rms_kf * 0.5);
+	CHECK(fused.lag >= 0 && fused.lag < 1.0);
+	CHECK(baro.lag >= 0 && baro.lag < 3.0);
+
+	CHECK(fabs(fused.bias - ACCEL_BIAS) < 0.05);
+	CHECK(baro.bias == 0);
+
+	/* the restart path takes the speed from the last two samples, the
+	   float filter without restarts is no reference there */
+	CHECK(sparse.rms_kf <= sparse.rms_diff + 0.01);
+	CHECK(sparse.rms_kf < 0.6);
+}
+
+/* a tilted watch at rest reads no vertical acceleration */
+static void test_gravity(void)
+{
+	struct accel_frame f;
+	uint16_t n;
+
+	memset(&altitude_kf, 0, sizeof(altitude_kf));
+	rtca_time.sys = 0;
+	TA0R = 0;
+	altitude_kf_reset(0, BARO_R);
+	gravity_primed = 0;
+	altitude_kf.accel = 1;
+
+	memset(&f, 0, sizeof(f));
+	f.lp[0] = 342;
+	f.lp[1] = -171;
+	f.lp[2] = 924;
+
+	for (n = 0; n < 30; n++) {
+		TA0R += 1638;
+		f.ts = TA0R;
+		kf_accel(&f);
+		if (n % 10 == 9) {
+			rtca_time.sys++;
+			altitude_kf_update(0, BARO_R, TA0R);
+		}
+	}
+
+	/* |lp| is 1000mgrav, within a count of 1g */
+	CHECK(labs(altitude_kf.a) <= 11);
+	CHECK(labs(altitude_kf_climb()) <= 1);
+}
+
+int main(void)
+{
+	test_flights();
+	test_gravity();
+
+	return host_done("altitude_kf");
+}
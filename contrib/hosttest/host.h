@@ -0,0 +1,47 @@
+/*
+    contrib/hosttest/host.h: shared helpers of the host tests
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOSTTEST_HOST_H_
+#define HOSTTEST_HOST_H_
+
+/* A host test #defines the CONFIG_ options it needs, includes this file
+   and then the .c files under test, and runs them on the build machine.
+   Keep in mind that int is 32 bits wide here and 16 on the watch. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include <openchronos.h>
+
+static int host_failures;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		host_failures++; \
+	} \
+} while (0)
+
+static int host_done(const char *name)
+{
+	printf("%s: %s\n", name, host_failures ? "FAILED" : "ok");
+	return host_failures != 0;
+}
+
+#endif /* HOSTTEST_HOST_H_ */
@@ -0,0 +1,2 @@
+/* The host tests #define the CONFIG_ options they need before including
+   the sources under test, see contrib/hosttest/host.h */
@@ -0,0 +1,86 @@
+/*
+    contrib/hosttest/include/flash_model.h: drivers/flash.c for the host tests
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOSTTEST_FLASH_MODEL_H_
+#define HOSTTEST_FLASH_MODEL_H_
+
+/* Flash as NOR behaves: an erase sets a whole segment to 0xff, a write
+   can only clear bits. FLASH_REGION becomes a writable array the model
+   works on, a test may set FLASH_SEGMENT_SIZE first to model the 128
+   byte information segments.
+
+   Every byte written and every erase takes one step off
+   host_flash_budget. When it reaches zero the power fails: the write
+   stops short, an erase leaves some of the segment erased and the rest
+   as it was, and the model longjmp()s to host_flash_cut, where the test
+   reboots the code under test. */
+
+#include <setjmp.h>
+
+#ifndef FLASH_SEGMENT_SIZE
+#define FLASH_SEGMENT_SIZE 512
+#endif
+
+#define FLASH_REGION(name, size) \
+	uint8_t name[size] \
+		__attribute__((aligned(FLASH_SEGMENT_SIZE))) \
+		= { [0 ... (size) - 1] = 0xff }
+
+static long host_flash_erases;	/* segments erased */
+static long host_flash_writes;	/* bytes written */
+static long host_flash_budget = -1;	/* steps until the power fails, -1 never */
+static jmp_buf host_flash_cut;
+
+static void host_flash_step(void)
+{
+	if (host_flash_budget < 0)
+		return;
+
+	if (host_flash_budget-- == 0) {
+		host_flash_budget = -1;
+		longjmp(host_flash_cut, 1);
+	}
+}
+
+void flash_erase_segment(const volatile void *addr)
+{
+	uint8_t *seg = (uint8_t *)((uintptr_t)addr
+				   & ~(uintptr_t)(FLASH_SEGMENT_SIZE - 1));
+
+	if (host_flash_budget == 0)
+		memset(seg + rand() % (FLASH_SEGMENT_SIZE / 2), 0xff,
+		       FLASH_SEGMENT_SIZE / 4);
+	host_flash_step();
+
+	memset(seg, 0xff, FLASH_SEGMENT_SIZE);
+	host_flash_erases++;
+}
+
+void flash_write(const volatile void *dst, const void *src, uint16_t count)
+{
+	uint8_t *d = (uint8_t *)dst;
+	const uint8_t *s = src;
+	uint16_t i;
+
+	for (i = 0; i < count; i++) {
+		host_flash_step();
+		d[i] &= s[i];
+		host_flash_writes++;
+	}
+}
+
+#endif /* HOSTTEST_FLASH_MODEL_H_ */
@@ -0,0 +1,117 @@
+/*
+    contrib/hosttest/include/msp430.h: device header for the host tests
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef HOSTTEST_MSP430_H_
+#define HOSTTEST_MSP430_H_
+
+/* Stands in for the msp430-gcc device header. Every test is a single
+   translation unit, so the special function registers are defined right
+   here as plain variables and the intrinsics do nothing. */
+
+#include <stdint.h>
+
+#define BIT0 0x0001
+#define BIT1 0x0002
+#define BIT2 0x0004
+#define BIT3 0x0008
+#define BIT4 0x0010
+#define BIT5 0x0020
+#define BIT6 0x0040
+#define BIT7 0x0080
+#define BIT8 0x0100
+#define BIT9 0x0200
+#define BITA 0x0400
+#define BITB 0x0800
+#define BITC 0x1000
+#define BITD 0x2000
+#define BITE 0x4000
+#define BITF 0x8000
+
+#define GIE		BIT3
+#define CPUOFF		BIT4
+#define OSCOFF		BIT5
+#define SCG0		BIT6
+#define SCG1		BIT7
+#define LPM0_bits	(CPUOFF)
+#define LPM3_bits	(SCG1 + SCG0 + CPUOFF)
+
+/* interrupt handlers are plain functions the tests call */
+#define interrupt(vector) unused
+
+#define __disable_interrupt()
+#define __enable_interrupt()
+#define __no_operation()
+#define _BIS_SR(x)
+#define _BIC_SR(x)
+#define _BIC_SR_IRQ(x)
+#define _BIS_SR_IRQ(x)
+
+volatile uint8_t P1IN, P1OUT, P1DIR, P1IE, P1IES, P1IFG, P1REN, P1SEL;
+volatile uint8_t P2IN, P2OUT, P2DIR, P2IE, P2IES, P2IFG, P2REN, P2SEL;
+volatile uint8_t PJIN, PJOUT, PJDIR;
+volatile uint16_t TA0R, TA1R;
+
+/* RTC_A in calendar mode */
+volatile uint8_t RTCSEC, RTCMIN, RTCHOUR, RTCDAY, RTCDOW, RTCMON;
+volatile uint8_t RTCYEARL, RTCYEARH, RTCAMIN, RTCAHOUR;
+volatile uint16_t RTCCTL01, RTCIV;
+
+#define RTCRDYIE	0x0010
+#define RTCAIE		0x0020
+#define RTCTEVIE	0x0040
+#define RTCMODE		0x2000
+#define RTCHOLD		0x4000
+
+#define RTCIV_RTCRDYIFG	0x0002
+#define RTCIV_RTCTEVIFG	0x0004
+#define RTCIV_RTCAIFG	0x0006
+
+/* The CRC module, a write to CRCDI feeds a word and CRCINIRES holds the
+   CRC16-CCITT. The words are queued and only folded in when CRCINIRES
+   is accessed next, after the assignments have happened. */
+static uint16_t host_crc_res;
+static uint16_t host_crc_queue[256];
+static uint8_t host_crc_queued;
+
+static uint16_t *host_crc_di(void)
+{
+	return &host_crc_queue[host_crc_queued++];
+}
+
+static uint16_t *host_crc_result(void)
+{
+	uint8_t i, b;
+	uint16_t w;
+
+	for (i = 0; i < host_crc_queued; i++) {
+		w = host_crc_queue[i];
+		for (b = 0; b < 16; b++) {
+			if (((w >> (15 - b)) ^ (host_crc_res >> 15)) & 1)
+				host_crc_res = (host_crc_res << 1) ^ 0x1021;
+			else
+				host_crc_res <<= 1;
+		}
+	}
+	host_crc_queued = 0;
+
+	return &host_crc_res;
+}
+
+#define CRCDI		(*host_crc_di())
+#define CRCINIRES	(*host_crc_result())
+
+#endif /* HOSTTEST_MSP430_H_ */
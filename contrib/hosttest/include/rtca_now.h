@@ -0,0 +1,30 @@
+/*
+    contrib/hosttest/include/rtca_now.h: build time for drivers/rtca.c
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __RTCA_NOW_H__
+#define __RTCA_NOW_H__
+
+/* tools/update_rtca_now.sh writes the real one to drivers/, a fixed time
+   keeps the host tests the same from one build to the next */
+#define COMPILE_YEAR 2024
+#define COMPILE_MON 1
+#define COMPILE_DAY 1
+#define COMPILE_DOW 1
+#define COMPILE_HOUR 0
+#define COMPILE_MIN 0
+
+#endif
@@ -0,0 +1,345 @@
+/*
+    contrib/hosttest/infomem_test.c: drivers/infomem.c on the host
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Runs the log on three 128 byte segments of the flash model, the
+   information segments D to B of the watch, or built as
+   infomem_main_test on three 512 byte segments of main flash:
+
+   - random writes, deletes and flushes by four applications against a
+     copy kept in RAM, with reboots in between
+   - the same with the power failing at a random byte written or segment
+     erased: after the reboot every chunk holds one of the versions it had
+     since the last completed flush
+   - a segment still holding the single block layout is not taken for the
+     log
+   - the erases per one word change written back right away, the single
+     block layout erased a segment on every write. A change goes to the
+     log as a delta of four words, but every segment the log moves to
+     starts with a full record of each chunk changed, and every other
+     erase copies the chunks that do not change. On 128 byte segments
+     that leaves a 9x gain for the 44 words of this test, main flash
+     segments get the 10x the deltas were made for. */
+
+#define CONFIG_INFOMEM
+#define CONFIG_INFOMEM_MAIN_SEGMENTS 3
+#define INFOMEM_LOG_START 0
+#define INFOMEM_LOG_END 0
+#ifndef FLASH_SEGMENT_SIZE
+#define FLASH_SEGMENT_SIZE 128
+#endif
+
+#include "host.h"
+#include "flash_model.h"
+
+#include "../../drivers/infomem.c"
+
+#define APPS	4
+#define WORDS	256
+#define VERSIONS	64
+
+/* what the applications wrote */
+static uint16_t model[APPS][WORDS];
+static int msize[APPS];
+
+/* the states since the last completed flush */
+static uint16_t hist[VERSIONS][APPS][WORDS];
+static int hsize[VERSIONS][APPS];
+static int versions;
+
+static void snap(void)
+{
+	memcpy(hist[versions], model, sizeof(model));
+	memcpy(hsize[versions], msize, sizeof(msize));
+	versions++;
+}
+
+static void reboot(void)
+{
+	memset(&sInfomem, 0, sizeof(sInfomem));
+	CHECK(infomem_ready() >= 0);
+}
+
+static int get(uint8_t app, uint16_t *buf)
+{
+	int n = infomem_app_amount(app);
+
+	if (n > 0)
+		infomem_app_read(app, buf, n, 0);
+	return n;
+}
+
+static int same(uint8_t app)
+{
+	uint16_t buf[WORDS];
+	int n = get(app, buf);
+
+	return n == msize[app] && !memcmp(buf, model[app], 2 * n);
+}
+
+/* words of a chunk in an application of n words */
+static int chunk_words(int n, int c)
+{
+	n -= c * INFOMEM_CHUNK_WORDS;
+	return n <= 0 ? 0 : n > INFOMEM_CHUNK_WORDS ? INFOMEM_CHUNK_WORDS : n;
+}
+
+/* every chunk matches a version since the last flush, a chunk a version
+   did not have reads erased when a later one is present */
+static int versions_ok(uint8_t app, const uint16_t *buf, int n)
+{
+	int c, h, k, got, len, top = n;
+
+	for (h = 0; h < versions; h++)
+		if (hsize[h][app] > top)
+			top = hsize[h][app];
+
+	for (c = 0; c * INFOMEM_CHUNK_WORDS < top; c++) {
+		got = chunk_words(n, c);
+		for (h = 0; h < versions; h++) {
+			len = chunk_words(hsize[h][app], c);
+			if (got == len && !memcmp(buf + c * INFOMEM_CHUNK_WORDS,
+				hist[h][app] + c * INFOMEM_CHUNK_WORDS, 2 * got))
+				break;
+			for (k = 0; len == 0 && k < got; k++)
+				if (buf[c * INFOMEM_CHUNK_WORDS + k] != 0xffff)
+					break;
+			if (len == 0 && k == got)
+				break;
+		}
+		if (h == versions) {
+			printf("  app %u chunk %d matches no version\n", app, c);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static void format(void)
+{
+	memset(infomem_main, 0xff, sizeof(infomem_main));
+	memset(&sInfomem, 0, sizeof(sInfomem));
+	memset(model, 0, sizeof(model));
+	memset(msize, 0, sizeof(msize));
+	CHECK(infomem_ready() == -2);
+	CHECK(infomem_init() > 0);
+}
+
+/* reboot after a power failure, take over what survived */
+static int recover(void)
+{
+	uint16_t buf[WORDS];
+	int fails = 0, n;
+	uint8_t x;
+
+	reboot();
+	for (x = 0; x < APPS; x++) {
+		n = get(x, buf);
+		if (!versions_ok(x, buf, n))
+			fails++;
+		memcpy(model[x], buf, sizeof(buf));
+		msize[x] = n;
+	}
+
+	versions = 0;
+	snap();
+	return fails;
+}
+
+/* one random operation of one application, the new content in nm/ns */
+static int16_t random_op(uint8_t a, uint16_t *nm, int *ns)
+{
+	uint16_t d[24];
+	int i, op = rand() % 10, off, c;
+
+	for (i = 0; i < 24; i++)
+		d[i] = rand();
+
+	memcpy(nm, model[a], sizeof(model[a]));
+	*ns = msize[a];
+
+	if (op < 6 && msize[a]) {
+		off = rand() % (msize[a] + 1);
+		c = 1 + rand() % 3;
+		memcpy(&nm[off], d, 2 * c);
+		if (off + c > *ns)
+			*ns = off + c;
+		return infomem_app_modify(a, d, c, off);
+	}
+	if (op < 8 || !msize[a]) {
+		c = rand() % 24;
+		memcpy(nm, d, 2 * c);
+		*ns = c;
+		return infomem_app_replace(a, d, c);
+	}
+
+	*ns = rand() % msize[a];
+	return infomem_app_delete(a, *ns);
+}
+
+static void test_random(int cuts)
+{
+	/* static, they are read after the longjmp() */
+	static uint16_t nm[WORDS];
+	static int ns;
+	uint16_t buf[WORDS];
+	int i, n, fails = 0, lost = 0;
+	uint8_t a, x;
+	int16_t r;
+
+	srand(45 + cuts);
+	format();
+	versions = 0;
+	snap();
+
+	for (i = 0; i < 20000 && !fails; i++) {
+		a = rand() % APPS;
+
+		/* a full cache is written back by the change */
+		if (cuts && rand() % 4 == 0)
+			host_flash_budget = rand() % 300;
+
+		if (setjmp(host_flash_cut)) {
+			/* the change under way may be written in part */
+			memcpy(hist[versions], model, sizeof(model));
+			memcpy(hist[versions][a], nm, sizeof(nm));
+			memcpy(hsize[versions], msize, sizeof(msize));
+			hsize[versions][a] = ns;
+			versions++;
+			fails += recover();
+			lost++;
+			continue;
+		}
+
+		r = random_op(a, nm, &ns);
+		host_flash_budget = -1;
+
+		/* full: the chunks written so far are in */
+		if (r == -4) {
+			n = get(a, buf);
+			memcpy(hist[versions], model, sizeof(model));
+			memcpy(hist[versions][a], nm, sizeof(nm));
+			memcpy(hsize[versions], msize, sizeof(msize));
+			hsize[versions][a] = ns;
+			versions++;
+			if (!versions_ok(a, buf, n))
+				fails++;
+			versions--;
+			memcpy(model[a], buf, sizeof(buf));
+			msize[a] = n;
+			snap();
+			continue;
+		}
+		if (r < 0) {
+			printf("  operation failed: %d\n", r);
+			fails++;
+			break;
+		}
+
+		memcpy(model[a], nm, sizeof(nm));
+		msize[a] = ns;
+		snap();
+
+		for (x = 0; x < APPS; x++)
+			if (!same(x))
+				fails++;
+
+		if (rand() % 8 && versions < VERSIONS - 2)
+			continue;
+
+		if (cuts && rand() % 4 == 0)
+			host_flash_budget = rand() % 300;
+		if (setjmp(host_flash_cut)) {
+			fails += recover();
+			lost++;
+			continue;
+		}
+		CHECK(infomem_flush() >= 0);
+		host_flash_budget = -1;
+		versions = 0;
+		snap();
+
+		if (rand() % 4 == 0) {
+			reboot();
+			for (x = 0; x < APPS; x++)
+				if (!same(x))
+					fails++;
+		}
+	}
+
+	printf("  %d operations%s, %d power failures\n", i,
+	       cuts ? " with power failures" : "", lost);
+	CHECK(fails == 0);
+	CHECK(!cuts || lost > 100);
+}
+
+/* identifier, size and terminator of the single block layout */
+static void test_old_layout(void)
+{
+	uint16_t *w = (uint16_t *)infomem_main;
+
+	memset(infomem_main, 0xff, sizeof(infomem_main));
+	w[0] = 0x5a74;
+	w[1] = 0x0100;
+	w[2] = 0x0100;
+	w[3] = 0x0000;
+
+	memset(&sInfomem, 0, sizeof(sInfomem));
+	CHECK(infomem_ready() == -2);
+}
+
+static void test_erases(void)
+{
+	uint16_t buf[24], w;
+	long e0;
+	int i, n = 10000;
+	double rate;
+
+	format();
+	for (i = 0; i < 24; i++)
+		buf[i] = i;
+	infomem_app_replace(1, buf, 24);
+	infomem_app_replace(2, buf, 8);
+	infomem_flush();
+
+	srand(45);
+	e0 = host_flash_erases;
+	for (i = 0; i < n; i++) {
+		w = rand();
+		infomem_app_modify(1 + (i & 1), &w, 1, rand() % 8);
+		infomem_flush();
+	}
+
+	rate = (double)(host_flash_erases - e0) / n;
+	printf("  one word change: %.3f erases, %.1fx fewer than the single "
+	       "block layout\n", rate, 1 / rate);
+	CHECK(rate <= (FLASH_SEGMENT_SIZE > 128 ? 0.1 : 0.12));
+}
+
+int main(void)
+{
+	test_random(0);
+	test_random(1);
+	test_old_layout();
+	test_erases();
+
+#if FLASH_SEGMENT_SIZE > 128
+	return host_done("infomem (main flash)");
+#else
+	return host_done("infomem");
+#endif
+}
@@ -0,0 +1,283 @@
+/*
+    contrib/hosttest/otp_test.c: modules/otp.c on the host
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Checks the codes against the published test vectors:
+
+   - RFC 4226 appendix D, HOTP with the counter as the time window
+   - RFC 6238 appendix B, the SHA1 rows, all 8 digits and the last 6
+
+   rtca_seconds() is compared with gmtime() from 2000 to 2099, then the
+   test runs the RTC second handler over a few windows and compares the
+   code it keeps for the selected account with one computed right there.
+
+   Built with CONFIG_INFOMEM as otp_infomem_test, it checks that the
+   configuration seeds the stored accounts once, that the module then
+   runs from the store and keeps the selected account, and that other
+   seeds replace the store.
+
+   Last it times a code from the cached key midstates against one that
+   hashes the key blocks again, as the module did before. These are host
+   times, no cycle count was taken on the CC430. */
+
+#include <time.h>
+
+/* "12345678901234567890", the key of both RFCs */
+#define RFC_KEY "\x31\x32\x33\x34\x35\x36\x37\x38\x39\x30" \
+		"\x31\x32\x33\x34\x35\x36\x37\x38\x39\x30"
+
+#define CONFIG_MOD_OTP_KEY RFC_KEY
+#define CONFIG_MOD_OTP_OFFSET 0
+#define CONFIG_MOD_OTP_ACCOUNTS \
+	{ "  RFC", RFC_KEY, 20, 8, 30 }, \
+	{ " SHRT", "\x48\x65\x6c\x6c\x6f", 5, 7, 45 },
+
+#include "host.h"
+
+#ifdef CONFIG_INFOMEM
+#define CONFIG_INFOMEM_MAIN_SEGMENTS 3
+#define INFOMEM_LOG_START 0
+#define INFOMEM_LOG_END 0
+#define FLASH_SEGMENT_SIZE 128
+
+#include "flash_model.h"
+#include "../../drivers/infomem.c"
+#endif
+
+#include "../../drivers/rtca.c"
+#include "../../modules/otp.c"
+
+/* the rest of the system, as far as the module uses it */
+void menu_add_entry(char const *name, void (*up_btn_fn)(void),
+		    void (*down_btn_fn)(void), void (*num_btn_fn)(void),
+		    void (*lstar_btn_fn)(void), void (*lnum_btn_fn)(void),
+		    void (*updown_btn_fn)(void), void (*activate_fn)(void),
+		    void (*deactivate_fn)(void))
+{
+}
+
+void sys_messagebus_register(void (*callback)(enum sys_message),
+			     enum sys_message listens)
+{
+}
+
+void display_chars(uint8_t scr_nr, enum display_segment_array segments,
+		   char const *str, enum display_segstate state)
+{
+}
+
+void display_bits(uint8_t scr_nr, enum display_segment segment,
+		  uint8_t bits, enum display_segstate state)
+{
+}
+
+void display_clear(uint8_t scr_nr, uint8_t line)
+{
+}
+
+char *_sprintf(const char *fmt, int16_t n)
+{
+	return "";
+}
+
+static void test_hotp(void)
+{
+	static const uint32_t codes[10] = {
+		755224, 287082, 359152, 969429, 338314,
+		254676, 287922, 162583, 399871, 520489
+	};
+	uint32_t c;
+
+	for (c = 0; c < 10; c++)
+		CHECK(calculate_otp(0, c) == codes[c]);
+}
+
+static void test_totp(void)
+{
+	static const struct {
+		uint64_t t;
+		uint32_t code;
+	} rows[] = {
+		{ 59, 94287082 },
+		{ 1111111109, 7081804 },
+		{ 1111111111, 14050471 },
+		{ 1234567890, 89005924 },
+		{ 2000000000, 69279037 },
+		{ 20000000000ULL, 65353130 },
+	};
+	uint8_t i;
+
+	for (i = 0; i < sizeof(rows) / sizeof(rows[0]); i++) {
+		CHECK(calculate_otp(1, rows[i].t / 30) == rows[i].code);
+		CHECK(calculate_otp(0, rows[i].t / 30) == rows[i].code % 1000000);
+	}
+}
+
+static void set_clock(time_t t)
+{
+	struct tm *g = gmtime(&t);
+
+	rtca_time.year = g->tm_year + 1900;
+	rtca_time.mon = g->tm_mon + 1;
+	rtca_time.day = g->tm_mday;
+	rtca_time.hour = g->tm_hour;
+	rtca_time.min = g->tm_min;
+	rtca_time.sec = g->tm_sec;
+}
+
+static void test_clock(void)
+{
+	time_t t;
+	uint32_t bad = 0;
+
+	for (t = OTP_UNIX_2000; t < 4102444800LL; t += 7 * 86400 + 3607) {
+		set_clock(t);
+		if (rtca_seconds() != t - OTP_UNIX_2000)
+			bad++;
+	}
+
+	CHECK(bad == 0);
+}
+
+/* the code kept in the background is the one of the current window */
+static void test_background(void)
+{
+	time_t t = 1700000000;
+	uint32_t window;
+	uint8_t a, bad = 0;
+	int s;
+
+	for (s = 0; s < 400; s++, t++) {
+		set_clock(t);
+		if (s % 50 == 7)
+			otp_up();
+		if (s == 0)
+			otp_activated();
+		clock_event(SYS_MSG_RTC_SECOND);
+
+		CHECK(otp_now() == (uint32_t)t);
+
+		a = otp_selected;
+		window = t / otp_state[a].period;
+		if (otp_state[a].window != window
+		    || otp_state[a].code != calculate_otp(a, window))
+			bad++;
+	}
+
+	otp_deactivated();
+	CHECK(bad == 0);
+}
+
+#ifdef CONFIG_INFOMEM
+/* the module after a reset */
+static void reboot(void)
+{
+	memset(otp_state, 0, sizeof(otp_state));
+	otp_count = 0;
+	otp_selected = 0;
+	mod_otp_init();
+}
+
+static void test_store(void)
+{
+	uint16_t w;
+
+	/* seeded at the first boot */
+	CHECK(otp_count == 3);
+	CHECK(infomem_app_amount(OTP_INFOMEM_ID) == OTP_HEAD
+	      + OTP_REC_WORDS(20) * 2 + OTP_REC_WORDS(5));
+
+	/* the selected account is kept */
+	while (otp_selected != 2)
+		otp_up();
+	infomem_flush();
+	reboot();
+	CHECK(otp_selected == 2);
+	CHECK(!strcmp(otp_state[2].name, " SHRT"));
+
+	/* the module runs from the store: 6 digits for the RFC account */
+	w = 6 | 30 << 8;
+	infomem_app_modify(OTP_INFOMEM_ID, &w,
+			   1, OTP_HEAD + OTP_REC_WORDS(20) + OTP_REC_DIGITS / 2);
+	reboot();
+	CHECK(otp_state[1].digits == 6);
+	CHECK(calculate_otp(1, 59 / 30) == 287082);
+
+	/* seeds of another firmware replace it */
+	w = 0;
+	infomem_app_modify(OTP_INFOMEM_ID, &w, 1, 2);
+	reboot();
+	CHECK(otp_state[1].digits == 8);
+	CHECK(otp_selected == 2);
+
+	/* the single word of before, the selected account */
+	w = 1;
+	infomem_app_replace(OTP_INFOMEM_ID, &w, 1);
+	reboot();
+	CHECK(otp_count == 3 && otp_selected == 1);
+	CHECK(infomem_app_amount(OTP_INFOMEM_ID) > OTP_HEAD);
+}
+#endif
+
+static volatile uint32_t sink;
+
+static void bench(void)
+{
+	uint32_t inner[5], outer[5], c;
+	double cached, rekey;
+	clock_t t;
+	long n = 200000;
+
+	t = clock();
+	for (c = 0; c < n; c++)
+		sink += calculate_otp(0, c);
+	cached = (double)(clock() - t) * 1e9 / CLOCKS_PER_SEC / n;
+
+	t = clock();
+	for (c = 0; c < n; c++) {
+		hmac_sha1_key((const uint8_t *)RFC_KEY, 20, inner, outer);
+		memcpy(otp_state[0].inner, inner, sizeof(inner));
+		memcpy(otp_state[0].outer, outer, sizeof(outer));
+		sink += calculate_otp(0, c);
+	}
+	rekey = (double)(clock() - t) * 1e9 / CLOCKS_PER_SEC / n;
+
+	printf("  host code: %.0f ns from the midstates, %.0f ns hashing the "
+	       "key blocks (2 and 4 SHA1 blocks)\n", cached, rekey);
+}
+
+int main(void)
+{
+#ifdef CONFIG_INFOMEM
+	infomem_ready();
+	infomem_init();
+#endif
+	mod_otp_init();
+
+	test_hotp();
+	test_totp();
+	test_clock();
+	test_background();
+#ifdef CONFIG_INFOMEM
+	test_store();
+
+	return host_done("otp (infomem)");
+#else
+	bench();
+
+	return host_done("otp");
+#endif
+}
@@ -0,0 +1,173 @@
+/*
+    contrib/hosttest/pedometer_test.c: modules/pedometer.c on the host
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Plays the traces in vectors/ through the accelerometer stream into the
+   step detector and compares the count with the "# steps:" line of each
+   trace. Walks have to come within a step per ten, rest and single knocks
+   must not count at all. A trace with a "# rate:" other than 100Hz comes
+   in on a stream another user started at that rate, the detector has to
+   keep it. Also checks that the counter is off at boot. */
+
+#define CONFIG_ACCELEROMETER
+#define CONFIG_MOD_PEDOMETER_THRESHOLD 80
+
+#include "host.h"
+
+#include "../../drivers/dsp.c"
+#include "../../libs/accel_stream.c"
+#include "../../modules/pedometer.c"
+
+struct As_Param as_config;
+
+static uint8_t sensor[3];
+
+void as_start(uint8_t mode)
+{
+}
+
+void as_stop(void)
+{
+}
+
+void as_get_data(uint8_t *data)
+{
+	memcpy(data, sensor, 3);
+	P2IN &= ~AS_INT_PIN;
+}
+
+/* the rest of the system, as far as the module uses it */
+static void (*lstar_fn)(void);
+
+void menu_add_entry(char const *name, void (*up_btn_fn)(void),
+		    void (*down_btn_fn)(void), void (*num_btn_fn)(void),
+		    void (*lstar_btn_fn)(void), void (*lnum_btn_fn)(void),
+		    void (*updown_btn_fn)(void), void (*activate_fn)(void),
+		    void (*deactivate_fn)(void))
+{
+	lstar_fn = lstar_btn_fn;
+}
+
+void sys_messagebus_register(void (*callback)(enum sys_message),
+			     enum sys_message listens)
+{
+}
+
+void display_chars(uint8_t scr_nr, enum display_segment_array segments,
+		   char const *str, enum display_segstate state)
+{
+}
+
+void display_clear(uint8_t scr_nr, uint8_t line)
+{
+}
+
+char *_sprintf(const char *fmt, int16_t n)
+{
+	return "";
+}
+
+/* one trace from boot, returns the steps counted or -1 */
+static long play(const char *name, long *expect)
+{
+	char path[128], line[64];
+	unsigned x, y, z, rate = 100;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "vectors/%s", name);
+	f = fopen(path, "r");
+	if (!f) {
+		printf("%s: %s missing\n", __FILE__, path);
+		return -1;
+	}
+
+	*expect = -1;
+	memset(&pedo, 0, sizeof(pedo));
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "# steps: %ld", expect) == 1
+		    || sscanf(line, "# rate: %u", &rate) == 1 || line[0] == '#')
+			continue;
+		if (sscanf(line, "x: %u y: %u z: %u", &x, &y, &z) != 3)
+			continue;
+
+		if (!pedo.enabled) {
+			/* somebody else streams at the rate of the trace */
+			if (rate != 100) {
+				as_config.range = 2;
+				accel_stream_start(rate / 10);
+			}
+
+			/* long STAR switches it on */
+			lstar_fn();
+			CHECK(pedo.enabled && accel_stream_running());
+			CHECK(as_config.sampling * 10 == rate);
+		}
+
+		sensor[0] = x;
+		sensor[1] = y;
+		sensor[2] = z;
+
+		P2IN |= AS_INT_PIN;
+		TA0R += 16384 / rate;
+		if (accel_stream_isr() == ACCEL_STREAM_WAKE)
+			accel_stream_drain();
+	}
+	accel_stream_drain();
+	fclose(f);
+
+	lstar_fn();
+	CHECK(!pedo.enabled);
+	if (rate != 100)
+		accel_stream_stop();
+	CHECK(!accel_stream_running());
+	CHECK(accel_stream_overruns == 0);
+
+	return pedo.steps;
+}
+
+static void check_trace(const char *name)
+{
+	long expect, steps = play(name, &expect);
+
+	printf("  %-20s %3ld steps, expected %3ld\n", name, steps, expect);
+
+	CHECK(steps >= 0 && expect >= 0);
+	if (expect == 0)
+		CHECK(steps == 0);
+	else
+		CHECK(labs(steps - expect) * 10 <= expect);
+}
+
+int main(void)
+{
+	PJOUT |= AS_CSN_PIN;
+
+	mod_pedometer_init();
+
+	/* off at boot, so CONFIG_IDLE can arm the motion interrupt */
+	CHECK(!pedo.enabled);
+	CHECK(!accel_stream_running());
+
+	check_trace("pedometer_walk.txt");
+	check_trace("pedometer_run.txt");
+	check_trace("pedometer_rest.txt");
+	check_trace("pedometer_bumps.txt");
+	check_trace("pedometer_walk_40hz.txt");
+	check_trace("pedometer_run_40hz.txt");
+
+	return host_done("pedometer");
+}
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+#
+# contrib/hosttest/pedometer_vectors.py: accelerometer traces for the
+# pedometer host test
+#
+# Writes the traces in vectors/ in the format contrib/read_acceleration.py
+# prints, one "x: .. y: .. z: .." line per sample with the raw CMA3000
+# bytes at 2g range (two's complement, ~18mgrav per count). Lines
+# starting with '#' are comments, "# steps: n" is the step count the
+# test expects from a trace and "# rate: n" the sample rate in Hz, 100
+# if there is none.
+#
+# The traces are synthetic: a tilted gravity vector with a vertical
+# bounce per step, a sway at half the cadence and sensor noise. A trace
+# recorded from the watch drops in next to them once its steps were
+# counted by hand, read_acceleration.py polls over RF though, so the
+# recording has to be resampled to one of the rates of the sensor first.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+import math
+import os
+import random
+
+MG_PER_COUNT = 4571 / 256.0
+
+GRAVITY = (180.0, 120.0, 975.0)		# mgrav, watch slightly tilted
+
+
+def unit(v):
+	n = math.sqrt(sum(c * c for c in v))
+	return [c / n for c in v]
+
+
+def raw(mg):
+	c = int(round(mg / MG_PER_COUNT))
+	return max(-128, min(127, c)) & 0xff
+
+
+def trace(seconds, cadence=0.0, bounce=0.0, noise=25.0, bumps=(), rate=100):
+	"""cadence in steps/s, bounce in mgrav, bumps as (time, mgrav)"""
+	up = unit(GRAVITY)
+	side = unit((up[1], -up[0], 0.0))
+	out = []
+
+	for n in range(int(seconds * rate)):
+		t = n / float(rate)
+		v = bounce * math.sin(2 * math.pi * cadence * t)
+		v += 0.25 * bounce * math.sin(4 * math.pi * cadence * t + 0.7)
+		s = 0.3 * bounce * math.sin(math.pi * cadence * t)
+
+		for when, mg in bumps:
+			if when <= t < when + 0.06:
+				v += mg
+
+		out.append([GRAVITY[i] + v * up[i] + s * side[i] +
+			    random.gauss(0, noise) for i in range(3)])
+
+	return out
+
+
+def write(name, title, steps, samples, rate=100):
+	path = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+			    'vectors', name)
+	with open(path, 'w') as f:
+		f.write('# %s\n' % title)
+		f.write('# synthetic, generated by pedometer_vectors.py\n')
+		f.write('# steps: %d\n' % steps)
+		if rate != 100:
+			f.write('# rate: %d\n' % rate)
+		for x, y, z in samples:
+			f.write('x: %d y: %d z: %d\n' % (raw(x), raw(y), raw(z)))
+
+
+def main():
+	random.seed(28)
+
+	write('pedometer_walk.txt', 'walking, 108 steps/min for 20s', 36,
+	      trace(20, 1.8, 300))
+	write('pedometer_run.txt', 'running, 168 steps/min for 10s', 28,
+	      trace(10, 2.8, 650, noise=40))
+	write('pedometer_rest.txt', 'watch on the wrist, sitting for 10s', 0,
+	      trace(10, noise=35))
+	write('pedometer_bumps.txt', 'three knocks on the table in 10s', 0,
+	      trace(10, bumps=((1.0, 900), (4.5, 700), (8.2, 1100))))
+
+	# the stream started at 40Hz by modules/sleep.c
+	write('pedometer_walk_40hz.txt', 'walking, 108 steps/min for 20s, '
+	      'sampled at 40Hz', 36, trace(20, 1.8, 300, rate=40), 40)
+	write('pedometer_run_40hz.txt', 'running, 168 steps/min for 10s, '
+	      'sampled at 40Hz', 28, trace(10, 2.8, 650, noise=40, rate=40), 40)
+
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,247 @@
+/*
+    contrib/hosttest/ps_test.c: drivers/ps.c altitude conversion on the host
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Compares the fixed point update_pressure_table() and conv_pa_to_meter()
+   with the soft-float VTI reference code they replaced, over 300-1031hPa,
+   230-320K and a few reference altitudes:
+
+   - the recalibrated table within 1.5Pa (about 13cm) of the float one
+   - the altitude in 1/16m within 0.5m of the float result, so the rounded
+     metre is off by one at most
+
+   Then times both on the host. That is only a sanity check: the host has
+   a floating point unit, on the CC430 every float operation is a call
+   into the soft-float library, so it says nothing about the watch. */
+
+#include <math.h>
+#include <time.h>
+
+#include "host.h"
+
+#include "../../drivers/ps.c"
+
+void timer0_delay_callback(uint16_t duration, void (*cbfn)(void))
+{
+}
+
+/* the reference, drivers/ps.c before the fixed point rewrite. It returns
+   the altitude before the truncation to s16 and has the extrapolation
+   above p[0] fixed. */
+static float ref_p[17];
+
+static void ref_init(void)
+{
+	u8 i;
+
+	for (i = 0; i < 17; i++)
+		ref_p[i] = p0[i];
+}
+
+static void ref_update(s16 href, u32 p_meas, u16 t_meas)
+{
+	const float Invt00 = 0.003470415;
+	const float coefp = 0.00006;
+	volatile float p_fact;
+	volatile float p_noll;
+	volatile float hnoll;
+	volatile float h_low = 0;
+	volatile float t0;
+	u8 i;
+
+	volatile float fl_href = href;
+	volatile float fl_p_meas = (float)p_meas / 100;
+	volatile float fl_t_meas = (float)t_meas / 10;
+
+	t0 = fl_t_meas + (0.0065 * fl_href);
+
+	hnoll = fl_href / (t0 * Invt00);
+
+	for (i = 0; i <= 15; i++) {
+		if (h0[i] > hnoll)
+			break;
+		h_low = h0[i];
+	}
+
+	p_noll = (float)(hnoll - h_low) * (1 - (hnoll - (float)h0[i]) * coefp)
+		* ((float)p0[i] - (float)p0[i - 1]) / ((float)h0[i] - h_low)
+		+ (float)p0[i - 1];
+
+	p_fact = fl_p_meas / p_noll;
+
+	for (i = 0; i <= 16; i++)
+		ref_p[i] = p0[i] * p_fact;
+}
+
+static float ref_conv(u32 p_meas, u16 t_meas)
+{
+	const float coef2 = 0.0007;
+	const float Invt00 = 0.003470415;
+	volatile float hnoll;
+	volatile float t0;
+	volatile float p_low;
+	u8 i;
+
+	volatile float fl_p_meas = (float)p_meas / 100;
+	volatile float fl_t_meas = (float)t_meas / 10;
+
+	for (i = 0; i <= 16; i++) {
+		if (ref_p[i] < fl_p_meas)
+			break;
+		p_low = ref_p[i];
+	}
+
+	if (i == 0) {
+		/* the original dropped the h0[0] offset here */
+		hnoll = (float)(fl_p_meas - ref_p[0]) / (ref_p[1] - ref_p[0])
+			* ((float)(h0[1] - h0[0])) + h0[0];
+	} else if (i < 15) {
+		hnoll = (float)(fl_p_meas - p_low)
+			* (1 - (fl_p_meas - ref_p[i]) * coef2)
+			/ (ref_p[i] - p_low) * ((float)(h0[i] - h0[i - 1]))
+			+ h0[i - 1];
+	} else if (i == 15) {
+		hnoll = (float)(fl_p_meas - p_low) / (ref_p[i] - p_low)
+			* ((float)(h0[i] - h0[i - 1])) + h0[i - 1];
+	} else {
+		hnoll = (float)(fl_p_meas - ref_p[16]) / (ref_p[16] - ref_p[15])
+			* ((float)(h0[16] - h0[15])) + h0[16];
+	}
+
+	t0 = fl_t_meas / (1 - hnoll * Invt00 * 0.0065);
+	return Invt00 * t0 * hnoll;
+}
+
+/* href (m), pressure (Pa) and temperature (10*K) at the calibration,
+   the first entry keeps the standard table */
+static const int32_t refs[][3] = {
+	{ 0, 0, 0 },
+	{ 0, 101325, 2881 },
+	{ 500, 95000, 2780 },
+	{ 1500, 84000, 2700 },
+	{ -100, 103000, 3000 },
+	{ 3000, 70000, 2600 },
+};
+
+#define NREFS (sizeof(refs) / sizeof(refs[0]))
+
+static void calibrate(uint8_t r)
+{
+	init_pressure_table();
+	ref_init();
+
+	if (r) {
+		update_pressure_table(refs[r][0], refs[r][1], refs[r][2]);
+		ref_update(refs[r][0], refs[r][1], refs[r][2]);
+	}
+}
+
+static void test_table(void)
+{
+	uint8_t r, i;
+	double e, worst = 0;
+
+	for (r = 0; r < NREFS; r++) {
+		calibrate(r);
+		for (i = 0; i < 17; i++) {
+			e = fabs(p[i] - ref_p[i] * 100.0);
+			if (e > worst)
+				worst = e;
+		}
+	}
+
+	printf("  table: max |fixed - float| %.2f Pa\n", worst);
+	CHECK(worst <= 1.5);
+}
+
+static void test_altitude(void)
+{
+	uint8_t r;
+	u32 pa;
+	u16 t;
+	double e, worst;
+	int32_t h;
+
+	for (r = 0; r < NREFS; r++) {
+		calibrate(r);
+		worst = 0;
+
+		for (pa = 30000; pa <= ref_p[0] * 100; pa += 7) {
+			for (t = 2300; t <= 3200; t += 50) {
+				h = conv_pa_to_altitude(pa, t);
+				e = fabs(h / 16.0 - ref_conv(pa, t));
+				if (e > worst)
+					worst = e;
+				CHECK(conv_pa_to_meter(pa, t) == (h + 8) >> 4);
+			}
+		}
+
+		printf("  reference %u: max |fixed - float| %.3f m\n", r, worst);
+		CHECK(worst < 0.5);
+	}
+}
+
+/* above the first entry the line continues from h0[0] at p[0] */
+static void test_extrapolation(void)
+{
+	u32 pa;
+
+	calibrate(0);
+
+	for (pa = 102000; pa <= 106000; pa += 100)
+		CHECK(fabs(conv_pa_to_altitude(pa, 2881) / 16.0
+			   - ref_conv(pa, 2881)) < 0.5);
+}
+
+static volatile int32_t sink;
+
+static double ns_per_call(uint8_t fixed)
+{
+	clock_t c = clock();
+	u32 pa;
+	u16 t;
+	long n = 0;
+
+	for (pa = 30000; pa <= 103000; pa += 3) {
+		for (t = 2300; t <= 3200; t += 300) {
+			if (fixed)
+				sink = conv_pa_to_meter(pa, t);
+			else
+				sink = (s16)ref_conv(pa, t);
+			n++;
+		}
+	}
+
+	return (double)(clock() - c) * 1e9 / CLOCKS_PER_SEC / n;
+}
+
+static void bench(void)
+{
+	calibrate(2);
+
+	printf("  host conv_pa_to_meter: fixed %.0f ns, float %.0f ns\n",
+	       ns_per_call(1), ns_per_call(0));
+}
+
+int main(void)
+{
+	test_table();
+	test_altitude();
+	test_extrapolation();
+	bench();
+
+	return host_done("ps");
+}
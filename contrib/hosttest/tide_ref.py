@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+#
+# contrib/hosttest/tide_ref.py: reference predictions for the tide host
+# test
+#
+# Predicts the tide of a station from its harmonic constants in floating
+# point, the astronomical arguments in degrees from their mean rates at
+# J2000 and the nodal factors from the series of the IHO tables, and
+# writes vectors/tide_<name>.txt:
+#
+#   # constituents: M2:580:330,...	the station, as in [TIDE_CONSTITUENTS]
+#   # datum: 1000			Z0 in mm, as in [TIDE_DATUM]
+#   # offset: 1			hours the times are ahead of UTC
+#   2024-01-01 00:00 1523		the level in mm, every hour
+#   2024-01-01 04:37 1934 H		high and low water, to the minute
+#
+# A published prediction of a real station drops in next to it in the
+# same layout, its times and heights taken from the tables of the
+# hydrographic office and its constants from the same source.
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+import datetime
+import math
+import os
+
+# multiples of T, s, h, p, constant phase in degrees, nodal row, power
+CONSTITUENTS = {
+	'M2':  ((2, -2, 2, 0), 0, 'M2', 1),
+	'S2':  ((2, 0, 0, 0), 0, None, 1),
+	'N2':  ((2, -3, 2, 1), 0, 'M2', 1),
+	'K2':  ((2, 0, 2, 0), 0, 'K2', 1),
+	'K1':  ((1, 0, 1, 0), -90, 'K1', 1),
+	'O1':  ((1, -2, 1, 0), 90, 'O1', 1),
+	'P1':  ((1, 0, -1, 0), 90, None, 1),
+	'Q1':  ((1, -3, 1, 1), 90, 'O1', 1),
+	'M4':  ((4, -4, 4, 0), 0, 'M2', 2),
+	'MS4': ((4, -2, 2, 0), 0, 'M2', 1),
+}
+
+# f = c0 + c1 cos N + c2 cos 2N + c3 cos 3N, u = d1 sin N + ... degrees
+NODAL = {
+	'M2': ((1.0004, -0.0373, 0.0002, 0.0), (-2.14, 0.0, 0.0)),
+	'K2': ((1.0241, 0.2863, 0.0083, -0.0015), (-17.74, 0.68, -0.04)),
+	'K1': ((1.0060, 0.1150, -0.0088, 0.0006), (-8.86, 0.68, -0.07)),
+	'O1': ((1.0089, 0.1871, -0.0147, 0.0014), (10.80, -1.34, 0.19)),
+}
+
+EPOCH = datetime.datetime(2000, 1, 1)
+
+
+def arguments(m):
+	"""T, s, h, p and N in degrees at UTC minute m since 2000"""
+	d = m / 1440.0 - 0.5
+	t = 180.0 + 360.0 * (m % 1440) / 1440.0
+	return ((t, 218.3165 + 13.17639648 * d, 280.4661 + 0.98564736 * d,
+		 83.3535 + 0.11140353 * d), 125.0445 - 0.05295377 * d)
+
+
+def level(station, datum, m):
+	"""height in mm at UTC minute m since 2000"""
+	a, n = arguments(m)
+	n = math.radians(n)
+	h = float(datum)
+
+	for name, (amplitude, phase) in station:
+		arg, q, nodal, power = CONSTITUENTS[name]
+		v = sum(c * x for c, x in zip(arg, a)) + q
+		f, u = 1.0, 0.0
+		if nodal:
+			c, d = NODAL[nodal]
+			f = c[0] + sum(c[i] * math.cos(i * n) for i in (1, 2, 3))
+			u = sum(d[i - 1] * math.sin(i * n) for i in (1, 2, 3))
+			f, u = f ** power, u * power
+		h += f * amplitude * math.cos(math.radians(v + u - phase))
+
+	return h
+
+
+def write(name, title, station, datum, offset, start, days):
+	path = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+			    'vectors', 'tide_%s.txt' % name)
+	m0 = int((start - EPOCH).total_seconds()) // 60 - offset * 60
+	hs = [level(station, datum, m0 + i) for i in range(-1, days * 1440 + 1)]
+
+	with open(path, 'w') as f:
+		f.write('# %s\n' % title)
+		f.write('# synthetic, generated by tide_ref.py\n')
+		f.write('# constituents: %s\n' % ','.join('%s:%g:%g' % (n, a, p)
+			for n, (a, p) in station))
+		f.write('# datum: %d\n' % datum)
+		f.write('# offset: %d\n' % offset)
+
+		for i in range(days * 1440):
+			h, prev, nxt = hs[i + 1], hs[i], hs[i + 2]
+			if h > prev and h >= nxt:
+				tag = ' H'
+			elif h < prev and h <= nxt:
+				tag = ' L'
+			elif i % 60 == 0:
+				tag = ''
+			else:
+				continue
+			when = start + datetime.timedelta(minutes=i)
+			f.write('%s %d%s\n' % (when.strftime('%Y-%m-%d %H:%M'),
+					       round(h), tag))
+
+
+def main():
+	station = (('M2', (580, 330)), ('S2', (135, 335)), ('N2', (120, 305)),
+		   ('K2', (37, 330)), ('K1', (370, 105)), ('O1', (230, 90)),
+		   ('P1', (115, 103)), ('Q1', (40, 85)), ('M4', (50, 10)),
+		   ('MS4', (30, 40)))
+
+	write('mixed', 'mixed semidiurnal tide, 60 days in UTC+1', station,
+	      1000, 1, datetime.datetime(2024, 1, 1), 60)
+
+
+if __name__ == '__main__':
+	main()
@@ -0,0 +1,271 @@
+/*
+    contrib/hosttest/tide_test.c: modules/tide.c on the host
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Runs the minute tick of the module over the predictions in vectors/,
+   with the watch on the local time of the file:
+
+   - the station of the file is the one the test is built with
+   - the level is within 10mm of the one every hour and at every high
+     and low water of the file
+   - every high and low water of the file is shown within 10 minutes,
+     and no other one
+
+   vectors/tide_mixed.txt comes from tide_ref.py, a floating point
+   prediction that shares no code with the module. */
+
+#include <time.h>
+
+/* the station of vectors/tide_mixed.txt */
+#define TIDE_STATION "M2:580:330,S2:135:335,N2:120:305,K2:37:330," \
+	"K1:370:105,O1:230:90,P1:115:103,Q1:40:85,M4:50:10,MS4:30:40"
+
+#define CONFIG_MOD_TIDE_CONSTITUENTS \
+	[TIDE_M2] = { 580, 33000 }, [TIDE_S2] = { 135, 33500 }, \
+	[TIDE_N2] = { 120, 30500 }, [TIDE_K2] = { 37, 33000 }, \
+	[TIDE_K1] = { 370, 10500 }, [TIDE_O1] = { 230, 9000 }, \
+	[TIDE_P1] = { 115, 10300 }, [TIDE_Q1] = { 40, 8500 }, \
+	[TIDE_M4] = { 50, 1000 }, [TIDE_MS4] = { 30, 4000 },
+#define CONFIG_MOD_TIDE_DATUM 1000
+#define CONFIG_MOD_TIDE_OFFSET 1
+
+#include "host.h"
+
+#include "../../drivers/rtca.c"
+#include "../../modules/tide.c"
+
+/* the rest of the system, as far as the module uses it */
+void menu_add_entry(char const *name, void (*up_btn_fn)(void),
+		    void (*down_btn_fn)(void), void (*num_btn_fn)(void),
+		    void (*lstar_btn_fn)(void), void (*lnum_btn_fn)(void),
+		    void (*updown_btn_fn)(void), void (*activate_fn)(void),
+		    void (*deactivate_fn)(void))
+{
+}
+
+void sys_messagebus_register(void (*callback)(enum sys_message),
+			     enum sys_message listens)
+{
+}
+
+void display_chars(uint8_t scr_nr, enum display_segment_array segments,
+		   char const *str, enum display_segstate state)
+{
+}
+
+void display_symbol(uint8_t scr_nr, enum display_segment symbol,
+		    enum display_segstate state)
+{
+}
+
+void display_clear(uint8_t scr_nr, uint8_t line)
+{
+}
+
+void lcd_screens_create(uint8_t nr)
+{
+}
+
+void lcd_screens_destroy(void)
+{
+}
+
+void lcd_screen_activate(uint8_t scr_nr)
+{
+}
+
+char *_sprintf(const char *fmt, int16_t n)
+{
+	return "";
+}
+
+#define LEVEL_MM	10
+#define TURN_MINUTES	10
+
+#define MAXROWS	4096
+#define MAXTURNS	1024
+
+/* the rows of the file, local minutes since 1970 */
+static struct {
+	long minute;
+	long level;
+	char tag;
+} rows[MAXROWS];
+static int nrows;
+
+/* the high and low waters the module showed, UTC minutes since 2000 */
+static uint32_t shown[2][MAXTURNS];
+static int nshown[2];
+
+static int load(const char *name)
+{
+	char path[128], line[256], station[200], tag;
+	int y, mo, d, h, mi, n;
+	long datum = -1, offset = -1, lv;
+	struct tm tm;
+	FILE *f;
+
+	snprintf(path, sizeof(path), "vectors/%s", name);
+	f = fopen(path, "r");
+	if (!f) {
+		printf("%s: %s missing\n", __FILE__, path);
+		return 0;
+	}
+
+	station[0] = 0;
+	nrows = 0;
+	while (fgets(line, sizeof(line), f) && nrows < MAXROWS) {
+		if (sscanf(line, "# constituents: %199s", station) == 1
+		    || sscanf(line, "# datum: %ld", &datum) == 1
+		    || sscanf(line, "# offset: %ld", &offset) == 1
+		    || line[0] == '#')
+			continue;
+
+		tag = 0;
+		n = sscanf(line, "%d-%d-%d %d:%d %ld %c", &y, &mo, &d, &h, &mi,
+			   &lv, &tag);
+		if (n < 6)
+			continue;
+
+		memset(&tm, 0, sizeof(tm));
+		tm.tm_year = y - 1900;
+		tm.tm_mon = mo - 1;
+		tm.tm_mday = d;
+		tm.tm_hour = h;
+		tm.tm_min = mi;
+		rows[nrows].minute = timegm(&tm) / 60;
+		rows[nrows].level = lv;
+		rows[nrows].tag = tag;
+		nrows++;
+	}
+	fclose(f);
+
+	/* the module is built for one station */
+	CHECK(!strcmp(station, TIDE_STATION));
+	CHECK(datum == CONFIG_MOD_TIDE_DATUM);
+	CHECK(offset == CONFIG_MOD_TIDE_OFFSET);
+
+	return nrows > 0;
+}
+
+static void set_clock(long minute)
+{
+	time_t t = minute * 60;
+	struct tm *g = gmtime(&t);
+
+	rtca_time.year = g->tm_year + 1900;
+	rtca_time.mon = g->tm_mon + 1;
+	rtca_time.day = g->tm_mday;
+	rtca_time.hour = g->tm_hour;
+	rtca_time.min = g->tm_min;
+	rtca_time.sec = 0;
+}
+
+static void keep(int k, uint32_t m)
+{
+	if (m == TIDE_NONE || (nshown[k] && shown[k][nshown[k] - 1] == m))
+		return;
+	if (nshown[k] < MAXTURNS)
+		shown[k][nshown[k]++] = m;
+}
+
+/* the shown turn closest to a UTC minute, in minutes */
+static long closest(int k, uint32_t m)
+{
+	long d, best = 1L << 30;
+	int i;
+
+	for (i = 0; i < nshown[k]; i++) {
+		d = labs((long)shown[k][i] - (long)m);
+		if (d < best)
+			best = d;
+	}
+
+	return best;
+}
+
+static void check_station(const char *name)
+{
+	long m, utc, d, last, level_err = 0, turn_err = 0;
+	int i, r = 0, k, turns = 0, missed = 0, extra = 0;
+
+	if (!load(name)) {
+		CHECK(0);
+		return;
+	}
+
+	memset(&tide, 0, sizeof(tide));
+	nshown[0] = nshown[1] = 0;
+
+	for (m = rows[0].minute; m <= rows[nrows - 1].minute; m++) {
+		set_clock(m);
+		minuteTick();
+		keep(0, tide.high);
+		keep(1, tide.low);
+
+		for (; r < nrows && rows[r].minute == m; r++) {
+			d = labs(tide.level - rows[r].level);
+			if (d > level_err)
+				level_err = d;
+		}
+	}
+
+	/* UTC minutes since 2000 of a row */
+	utc = 946684800 / 60 + CONFIG_MOD_TIDE_OFFSET * 60;
+	last = rows[nrows - 1].minute - utc;
+
+	for (i = 0; i < nrows; i++) {
+		if (!rows[i].tag)
+			continue;
+		k = rows[i].tag == 'L';
+		d = closest(k, rows[i].minute - utc);
+		if (d > TURN_MINUTES)
+			missed++;
+		else if (d > turn_err)
+			turn_err = d;
+		turns++;
+	}
+
+	/* past the end of the file the turns are not known */
+	for (k = 0; k < 2; k++) {
+		for (i = 0; i < nshown[k]; i++) {
+			if ((long)shown[k][i] > last)
+				continue;
+			for (r = 0; r < nrows; r++)
+				if (rows[r].tag == (k ? 'L' : 'H')
+				    && labs(rows[r].minute - utc
+					    - (long)shown[k][i]) <= TURN_MINUTES)
+					break;
+			if (r == nrows)
+				extra++;
+		}
+	}
+
+	printf("  %-16s level within %ldmm, %d turns within %ld min, "
+	       "%d missed, %d extra\n", name, level_err, turns, turn_err,
+	       missed, extra);
+
+	CHECK(turns > 0);
+	CHECK(level_err <= LEVEL_MM);
+	CHECK(missed == 0 && extra == 0);
+}
+
+int main(void)
+{
+	check_station("tide_mixed.txt");
+
+	return host_done("tide");
+}
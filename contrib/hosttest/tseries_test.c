@@ -0,0 +1,216 @@
+/*
+    contrib/hosttest/tseries_test.c: libs/tseries.c on the host
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/* Appends numbered records to streams on the flash model:
+
+   - a stream of 4 segments read back in full every now and then: the
+     records come in the order they were appended, with their times, and
+     the newest one is there, also after resets and power failures
+   - one erase per full segment, 84 records of 4 bytes
+   - on 32 segments seeks agree with a linear scan of the records, and
+     take a fraction of its time. The time is host time, the number that
+     counts on the watch is the flash read, which the ratio stands in for */
+
+#include <time.h>
+
+#include "host.h"
+#include "flash_model.h"
+
+#include "../../libs/tseries.c"
+
+#define SIZE	4
+
+TSERIES(small, SIZE, 4, 0);
+TSERIES(large, SIZE, 32, 0);
+
+/* every record appended, the payload starts with its number */
+#define MAXN	100000
+static uint32_t mt[MAXN];
+static int mn;
+
+static void reset(struct tseries *ts, const volatile uint8_t *log,
+		  uint8_t segments)
+{
+	struct tseries x = { log, segments, SIZE, 0 };
+
+	*ts = x;
+	tseries_init(ts);
+}
+
+static uint32_t rec_number(const uint8_t *r)
+{
+	return r[0] | r[1] << 8 | (uint32_t)r[2] << 16;
+}
+
+static int append(struct tseries *ts, uint32_t t)
+{
+	uint8_t r[SIZE];
+
+	r[0] = mn;
+	r[1] = mn >> 8;
+	r[2] = mn >> 16;
+	r[3] = rand();
+
+	if (!tseries_append(ts, t, r))
+		return 0;
+
+	mt[mn++] = t;
+	return 1;
+}
+
+/* the records read back were appended in this order and end with the
+   newest one, a power failure only loses records */
+static int read_all(const struct tseries *ts)
+{
+	struct tseries_cursor c;
+	uint32_t t, n, last = 0;
+	uint8_t r[SIZE];
+	int first = 1;
+
+	if (!tseries_seek(ts, &c, 0))
+		return 0;
+
+	while (tseries_read(ts, &c, &t, r)) {
+		n = rec_number(r);
+		if (n >= mn || (!first && n <= last) || t != mt[n])
+			return 0;
+		last = n;
+		first = 0;
+	}
+
+	return !first && last == mn - 1;
+}
+
+/* first record at or after t by a linear scan */
+static int scan(const struct tseries *ts, uint32_t q, uint32_t *t,
+		uint8_t *r)
+{
+	struct tseries_cursor c;
+
+	if (!tseries_seek(ts, &c, 0))
+		return 0;
+
+	while (tseries_read(ts, &c, t, r))
+		if (*t >= q)
+			return 1;
+
+	return 0;
+}
+
+static int seek(const struct tseries *ts, uint32_t q, uint32_t *t,
+		uint8_t *r)
+{
+	struct tseries_cursor c;
+
+	return tseries_seek(ts, &c, q) && tseries_read(ts, &c, t, r);
+}
+
+static void test_small(int cuts)
+{
+	uint32_t t = 600000000;
+	long e0 = host_flash_erases;
+	int i, lost = 0, bad = 0;
+
+	srand(47 + cuts);
+	memset(small_log, 0xff, sizeof(small_log));
+	reset(&small, small_log, 4);
+	mn = 0;
+
+	for (i = 0; i < MAXN / 2; i++) {
+		t += rand() % 120;
+
+		if (cuts && rand() % 200 == 0)
+			host_flash_budget = rand() % (SIZE + 8);
+		if (setjmp(host_flash_cut)) {
+			lost++;
+			reset(&small, small_log, 4);
+			continue;
+		}
+		if (!append(&small, t))
+			bad++;
+		host_flash_budget = -1;
+
+		if (rand() % 50 == 0)
+			reset(&small, small_log, 4);
+		if (rand() % 100 == 0 && !read_all(&small))
+			bad++;
+	}
+
+	printf("  4 segments: %d records, %.1f per erase, %d power failures\n",
+	       mn, (double)mn / (host_flash_erases - e0), lost);
+	CHECK(bad == 0);
+
+	/* a torn record closes its segment early */
+	if (!cuts)
+		CHECK((host_flash_erases - e0) * 84 <= mn);
+	else
+		CHECK(lost > 100);
+}
+
+static void test_seek(void)
+{
+	uint32_t t = 600000000, q, ta, tb;
+	uint8_t a[SIZE], b[SIZE];
+	double t_seek, t_scan;
+	clock_t c;
+	int i, ha, hb, bad = 0;
+	volatile int sink = 0;
+
+	srand(4747);
+	reset(&large, large_log, 32);
+	mn = 0;
+
+	/* around the ring three times */
+	for (i = 0; i < 3 * 32 * 84; i++) {
+		t += 1 + rand() % 600;
+		append(&large, t);
+	}
+
+	for (i = 0; i < 2000; i++) {
+		q = mt[0] - 1000 + rand() % (t - mt[0] + 2000);
+		ha = seek(&large, q, &ta, a);
+		hb = scan(&large, q, &tb, b);
+		if (ha != hb || (ha && (ta != tb || memcmp(a, b, SIZE))))
+			bad++;
+	}
+	CHECK(bad == 0);
+
+	c = clock();
+	for (i = 0; i < 200000; i++)
+		sink += seek(&large, mt[0] + (uint32_t)i * 7919 % (t - mt[0]),
+			     &ta, a);
+	t_seek = (double)(clock() - c) * 1e9 / CLOCKS_PER_SEC / 200000;
+
+	c = clock();
+	for (i = 0; i < 2000; i++)
+		sink += scan(&large, mt[0] + (uint32_t)i * 7919 % (t - mt[0]),
+			     &tb, b);
+	t_scan = (double)(clock() - c) * 1e9 / CLOCKS_PER_SEC / 2000;
+
+	printf("  32 segments: seek %.0f ns, linear scan %.0f ns on the host\n",
+	       t_seek, t_scan);
+	CHECK(t_seek * 20 < t_scan);
+}
+
+int main(void)
+{
+	test_small(0);
+	test_small(1);
+	test_seek();
+
+	return host_done("tseries");
+}
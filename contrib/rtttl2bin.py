@@ -1,4 +1,4 @@
-#!/usr/bin/env python3.2
+#!/usr/bin/env python3
 #
 # Copyright (C) 2012 Aljaž Srebrnič <a2piratesoft@gmail.com>
 #
@@ -16,15 +16,14 @@
 # along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 import re
-
-notes_translate = ('p', 'a', 'a#', 'b', 'c', 'c#', 'd', 'd#', 'e', 'f', 'f#', 'g', 'g#')
+import sys
 
 
 def parse_note(note, default_duration, default_octave):
     """
         This parses a note into a tuple of (duration, pitch, octave)
     """
-    note = re.match('(^[0-9]{0,2})([a-gp]#?)([4-9]?)(\.?)', note.strip(), flags=re.IGNORECASE).groups()
+    note = re.match(r'(^[0-9]{0,2})([a-gp]#?)([4-9]?)(\.?)', note.strip(), flags=re.IGNORECASE).groups()
     duration = note[0] == '' and default_duration or int(note[0])
     duration *= (note[3] == '' and [1] or [1.5])[0]
     return (duration, note[1].lower(), note[2] == '' and default_octave or int(note[2]))
@@ -37,11 +36,11 @@ def parse_ringtone(ringtone):
         melody: a list of tuple notes, as parsed by parse_note
         whole: The duration in ms of the "whole" note
     """
-    match = re.match('([a-zA-Z]+):\s*d=([0-9]{1,3}),o=([0-9]{1,3}),b=([0-9]{1,3}):(.*)', ringtone)
+    match = re.match(r'([a-zA-Z]+):\s*d=([0-9]{1,3}),o=([0-9]{1,3}),b=([0-9]{1,3}):(.*)', ringtone)
     default_duration = int(match.group(2))
     default_octave = int(match.group(3))
     bpm = int(match.group(4))
-    whole = (60 * 1000 / bpm) * 4
+    whole = (60 * 1000 // bpm) * 4
     notes = [parse_note(note, default_duration, default_octave) for note in match.group(5).split(',')]
     return {"title": match.group(1), "melody": notes, "whole": whole}
 
@@ -63,14 +62,264 @@ def generate_binary_note(note, whole_note):
     """
         This method converts a tuple note as parsed by parse_note to the binary representation.
     """
-    duration = whole_note / note[0]
+    duration = note_duration(note, whole_note)
+    if note[1] == 'p':
+        return duration << 6
+    code = note_code(note)
+    return (duration << 6) | ((code // 12) << 4) | (code % 12 + 1)
+
+
+def note_duration(note, whole_note):
+    """
+        The duration of a tuple note in ms
+    """
+    duration = int(whole_note // note[0])
     if duration > 1023:
         raise Exception("note duration too long")
-    tone = notes_translate.index(note[1])
-    octave = note[2] - 4
-    return (duration << 6) | (octave << 2) | tone
-    
-    
+    return duration
+
+
+# The driver counts semitones from D#6 (1244Hz) at concert pitch, in four
+# octaves of pitches 1-12. Above B8 (code 32) the half period is shorter
+# than two ACLK ticks, CONFIG_BUZZER_ACLK plays those at 8192Hz.
+SEMITONES = ('c', 'c#', 'd', 'd#', 'e', 'f', 'f#', 'g', 'g#', 'a', 'a#', 'b')
+LOWEST = 6 * 12 + SEMITONES.index('d#')
+HIGHEST = 47
+ACLK_HIGHEST = 32
+
+
+def note_code(note):
+    """
+        Semitones of a tuple note above the lowest one the driver plays
+    """
+    code = note[2] * 12 + SEMITONES.index(note[1]) - LOWEST
+    if not 0 <= code <= HIGHEST:
+        raise Exception("note %s%d out of range d#6-d10, transpose the melody"
+                        % (note[1], note[2]))
+    return code
+
+
+# Melody byte-code, as decoded by drivers/buzzer.c:
+#
+#   header      three durations in units of 4ms, most common first
+#   0x00-0xbf   note: duration index in bits 7-6, octave * 12 + pitch - 1
+#               in bits 5-0, 48 is a rest
+#   0xfc b l    repeat: play the l bytes starting b bytes before the
+#               opcode once more
+#   0xfd n l    loop: play the l bytes before the opcode n more times
+#   0xfe lo hi  a note type value, for durations not in the header
+#   0xff        end
+#
+# Repeated and looped bytes are notes only, they do not nest.
+OP_REPEAT = 0xfc
+OP_LOOP = 0xfd
+OP_NOTE = 0xfe
+OP_END = 0xff
+REST = 48
+DURATIONS = 3
+
+
+def encode_notes(ringtone):
+    """
+        Encodes the notes of a ringtone as parsed by parse_ringtone into
+        a list of byte strings, one per note, and the duration header
+    """
+    notes = list()
+    for note in ringtone["melody"]:
+        code = REST if note[1] == 'p' else note_code(note)
+        notes.append((note_duration(note, ringtone["whole"]), code))
+
+    # the most common durations, ties in the order they appear
+    quarters = [(duration + 2) // 4 for duration, code in notes]
+    header = list()
+    for quarter in quarters:
+        if quarter not in header and quarter <= 255:
+            header.append(quarter)
+    header.sort(key=lambda q: -quarters.count(q))
+    header = header[:DURATIONS]
+    header += [0] * (DURATIONS - len(header))
+
+    encoded = list()
+    for duration, code in notes:
+        quarter = (duration + 2) // 4
+        if quarter in header:
+            encoded.append((header.index(quarter) << 6 | code,))
+        else:
+            tone = 0 if code == REST else code % 12 + 1
+            value = (duration << 6) | ((code // 12 if tone else 0) << 4) | tone
+            encoded.append((OP_NOTE, value & 0xff, value >> 8))
+
+    return header, encoded
+
+
+def compress(encoded):
+    """
+        Folds back to back repetitions of note sequences into loops and
+        sequences that were played before into repeats
+    """
+    out = list()
+    literal = list()   # (note, offset in out, run of notes without opcodes)
+    run = 0
+    i = 0
+
+    while i < len(encoded):
+        best = (0, None)
+
+        # loop: the same notes back to back
+        for length in range(1, (len(encoded) - i) // 2 + 1):
+            body = encoded[i:i + length]
+            size = sum(len(note) for note in body)
+            if size > 255:
+                break
+            count = 1
+            while count < 255 and \
+                    encoded[i + count * length:i + (count + 1) * length] == body:
+                count += 1
+            saving = size * (count - 1) - 3
+            if count > 1 and saving > best[0]:
+                best = (saving, ('loop', length, count, size))
+
+        # repeat: notes that are in the output already
+        for start in range(len(literal)):
+            back = len(out) - literal[start][1]
+            if back > 255:
+                continue
+            length = size = 0
+            while i + length < len(encoded) and start + length < len(literal):
+                note, offset, note_run = literal[start + length]
+                if note_run != literal[start][2] or note != encoded[i + length] \
+                        or size + len(note) > 255:
+                    break
+                size += len(note)
+                length += 1
+            if size - 3 > best[0]:
+                best = (size - 3, ('repeat', length, back, size))
+
+        if best[1] is None:
+            literal.append((encoded[i], len(out), run))
+            out.extend(encoded[i])
+            i += 1
+        elif best[1][0] == 'loop':
+            op, length, count, size = best[1]
+            for note in encoded[i:i + length]:
+                literal.append((note, len(out), run))
+                out.extend(note)
+            out.extend((OP_LOOP, count - 1, size))
+            run += 1
+            i += length * count
+        else:
+            op, length, back, size = best[1]
+            out.extend((OP_REPEAT, back, size))
+            run += 1
+            i += length
+
+    out.append(OP_END)
+    return out
+
+
+def generate_bytecode(ringtone):
+    """
+        Compiles a ringtone as parsed by parse_ringtone into the melody
+        byte-code, a list of byte values
+    """
+    header, encoded = encode_notes(ringtone)
+    return header + compress(encoded)
+
+
+def decode_bytecode(code):
+    """
+        Expands melody byte-code into the note type values the driver
+        plays, the way drivers/buzzer.c does
+    """
+    header = code[:DURATIONS]
+    notes = list()
+    pc = DURATIONS
+    loop = 0
+    end = ret = None
+
+    while True:
+        if pc == end:
+            pc, end = ret, None
+        op = code[pc]
+        pc += 1
+        if op < 0xc0:
+            c = op & 0x3f
+            duration = header[op >> 6] << 8
+            notes.append(duration if c == REST else
+                         duration | (c // 12) << 4 | (c % 12 + 1))
+        elif op == OP_NOTE:
+            notes.append(code[pc] | code[pc + 1] << 8)
+            pc += 2
+        elif op == OP_LOOP:
+            if not loop:
+                loop = code[pc] + 1
+            loop -= 1
+            pc = pc - 1 - code[pc + 1] if loop else pc + 2
+        elif op == OP_REPEAT:
+            ret = pc + 2
+            end = pc - 1 - code[pc] + code[pc + 1]
+            pc = pc - 1 - code[pc]
+        else:
+            return notes
+
+
+def generate_melody_header(ringtones):
+    """
+        Generates the C header with the byte-code of each ringtone and a
+        table of all of them for modules/music.c
+    """
+    lines = ["/* generated by contrib/rtttl2bin.py, do not edit */", "",
+             "#ifndef __MELODIES_H__", "#define __MELODIES_H__", ""]
+    table = list()
+
+    for ringtone in ringtones:
+        name = re.sub('[^a-z0-9_]', '_', ringtone["title"].lower())
+        code = generate_bytecode(ringtone)
+        lines.append("/* %s: %d notes in %d bytes, %d as note arrays */" %
+                     (ringtone["title"], len(ringtone["melody"]), len(code),
+                      2 * len(ringtone["melody"]) + 2))
+        lines.append("static const uint8_t melody_%s[] = {" % name)
+        for i in range(0, len(code), 12):
+            lines.append("\t" + ", ".join("0x%02x" % b for b in code[i:i + 12]) + ",")
+        lines.append("};")
+        lines.append("")
+        aclk = [n for n in ringtone["melody"]
+                if n[1] != 'p' and note_code(n) > ACLK_HIGHEST]
+        if aclk:
+            sys.stderr.write("rtttl2bin: warning: %s has %d notes above b8, "
+                             "CONFIG_BUZZER_ACLK plays them at 8192Hz\n"
+                             % (ringtone["title"], len(aclk)))
+        table.append('\t{ "%5.5s", melody_%s },' % (ringtone["title"].upper(), name))
+
+    lines.append("static const struct {")
+    lines.append("\tchar name[6];")
+    lines.append("\tconst uint8_t *melody;")
+    lines.append("} melodies[] = {")
+    lines.extend(table)
+    lines.append("};")
+    lines.append("")
+    lines.append("#define MELODIES_COUNT %d" % len(ringtones))
+    lines.append("")
+    lines.append("#endif /* __MELODIES_H__ */")
+    return "\n".join(lines) + "\n"
+
+
 if __name__ == '__main__':
-    import sys
-    print(generate_binary_ringtone(parse_ringtone(sys.argv[1])))
+    import argparse
+
+    parser = argparse.ArgumentParser(description="Converts RTTTL ringtones")
+    parser.add_argument('-o', dest='output',
+                        help="compile RTTTL files into a melody header")
+    parser.add_argument('ringtones', nargs='+',
+                        help="a ringtone, or files of one ringtone each with -o")
+    args = parser.parse_args()
+
+    if args.output is None:
+        print(generate_binary_ringtone(parse_ringtone(args.ringtones[0])))
+    else:
+        ringtones = list()
+        for path in args.ringtones:
+            with open(path) as f:
+                ringtones.append(parse_ringtone(f.read().strip()))
+        with open(args.output, 'w') as f:
+            f.write(generate_melody_header(ringtones))
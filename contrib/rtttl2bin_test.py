@@ -16,18 +16,34 @@
 # along with this program.  If not, see <http://www.gnu.org/licenses/>.
 
 
+import contextlib
+import glob
+import io
+import os
+import re
 import unittest
 import rtttl2bin
 
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+
 class RTTTLTests(unittest.TestCase):
 	def test_generate_binary_note(self):
 		"""Testing if generate_binary_note generates binary notes correctly"""
-		self.assertEqual(rtttl2bin.generate_binary_note((8, 'e',  4), 2664), 21320)
+		self.assertEqual(rtttl2bin.generate_binary_note((8, 'e',  7), 2664), 21330)
+
+	def test_generate_binary_note_octave(self):
+		"""Testing if the octave lands in bits 5-4, counted from d#6"""
+		self.assertEqual(rtttl2bin.generate_binary_note((8, 'e',  8), 2664), 21346)
+		self.assertEqual(rtttl2bin.generate_binary_note((8, 'd#', 6), 2664), 21313)
+		self.assertEqual(rtttl2bin.generate_binary_note((8, 'd',  7), 2664), 21324)
+		self.assertEqual(rtttl2bin.generate_binary_note((8, 'p',  7), 2664), 21312)
+		self.assertRaises(Exception, rtttl2bin.generate_binary_note, (8, 'd', 6), 2664)
+		self.assertRaises(Exception, rtttl2bin.generate_binary_note, (8, 'e', 10), 2664)
 
 	def test_generate_binary_ringtone(self):
 		self.assertEqual(rtttl2bin.generate_binary_ringtone(
-			{'title': 'welcome', 'melody': [(16, 'a', 4), (16, 'c', 4), (16, 'e', 4)], 'whole': 1600}),
-			"note welcome[4] = {0x1901, 0x1904, 0x1908, 0x000F};")
+			{'title': 'welcome', 'melody': [(16, 'd#', 7), (16, 'f#', 7), (16, 'a#', 7)], 'whole': 1600}),
+			"note welcome[4] = {0x1911, 0x1914, 0x1918, 0x000F};")
 
 	def test_parse_note(self):
 		"""Testing if parse_note parses notes correctly"""
@@ -63,8 +79,113 @@ class RTTTLTests(unittest.TestCase):
 	def test_ringtone_generation(self):
 		"""This tests the complete generation sequence"""
 		self.assertEqual(rtttl2bin.generate_binary_ringtone(rtttl2bin.parse_ringtone(
-			"welcome: d=16,o=4,b=150: a, c, e")),
-			"note welcome[4] = {0x1901, 0x1904, 0x1908, 0x000F};")
+			"welcome: d=16,o=7,b=150: d#, f#, a#")),
+			"note welcome[4] = {0x1911, 0x1914, 0x1918, 0x000F};")
+
+class BytecodeTests(unittest.TestCase):
+	def played(self, rtttl):
+		"""The notes the driver plays for a ringtone, durations in the
+		header are rounded to 4ms"""
+		ringtone = rtttl2bin.parse_ringtone(rtttl)
+		code = rtttl2bin.generate_bytecode(ringtone)
+		notes = list()
+		for note in ringtone["melody"]:
+			value = rtttl2bin.generate_binary_note(note, ringtone["whole"])
+			if not value & 0x0f:
+				value &= ~0x30
+			quarter = ((value >> 6) + 2) // 4
+			if quarter in code[:rtttl2bin.DURATIONS]:
+				value = (value & 0x3f) | quarter << 8
+			notes.append(value)
+		return code, notes
+
+	def test_roundtrip(self):
+		"""Testing if decoding gives back the notes of the ringtone"""
+		for rtttl in ("welcome: d=16,o=7,b=150: d#, f#, a#",
+			      "Test: d=8,o=7,b=90: 2d#8., 4d, p, 32g8, 4c.",
+			      "smb:d=4,o=7,b=100:16b,16b,32p,8b,16g,8b,8d8,8p,8d,8p,8g,16p,8d,16p,8b6,16p,8e,8f#,16f,8e,16d.,16b,16d8,8e8,16c8,8d8,8b,16g,16a,8f#,16p,8g,16p,8d,16p,8b6,16p,8e,8f#,16f,8e,16d.,16b,16d8,8e8,16c8,8d8,8b,16g,16a,8f#,8p"):
+			code, notes = self.played(rtttl)
+			self.assertEqual(rtttl2bin.decode_bytecode(code), notes)
+
+	def test_one_byte_notes(self):
+		"""Testing if notes of the three common durations take a byte"""
+		code, notes = self.played("welcome: d=16,o=7,b=150: d#, f#, a#, 8d#, 4f#8, 2p")
+		self.assertEqual(code, [25, 50, 100, 0x0c, 0x0f, 0x13, 0x4c, 0x9b, 0xfe, 0x00, 0xc8, 0xff])
+
+	def test_loop(self):
+		"""Testing if back to back repetitions become a loop"""
+		code, notes = self.played("alarm: d=16,o=6,b=200: c7,p,c7,p,c7,p,c7,p,c7,p,c7,p")
+		self.assertEqual(code[3:], [0x09, 0x30, rtttl2bin.OP_LOOP, 5, 2, rtttl2bin.OP_END])
+		self.assertEqual(rtttl2bin.decode_bytecode(code), notes)
+
+	def test_repeat(self):
+		"""Testing if a phrase played before becomes a repeat"""
+		code, notes = self.played("r: d=8,o=7,b=120: c,d,e,f,g,4p,c,d,e,f,a")
+		self.assertEqual(code[3:], [0x09, 0x0b, 0x0d, 0x0e, 0x10, 0x70,
+					    rtttl2bin.OP_REPEAT, 6, 4, 0x12, rtttl2bin.OP_END])
+		self.assertEqual(rtttl2bin.decode_bytecode(code), notes)
+
+	def test_melody_header(self):
+		"""Testing if the header lists every ringtone"""
+		header = rtttl2bin.generate_melody_header([
+			rtttl2bin.parse_ringtone("welcome: d=16,o=7,b=150: d#, f#, a#"),
+			rtttl2bin.parse_ringtone("Ring: d=16,o=7,b=150: d#, f#")])
+		self.assertIn("static const uint8_t melody_welcome[] = {", header)
+		self.assertIn('{ "WELCO", melody_welcome },', header)
+		self.assertIn('{ " RING", melody_ring },', header)
+		self.assertIn("#define MELODIES_COUNT 2", header)
+
+	def test_aclk_warning(self):
+		"""Testing if notes above the ACLK range are warned about"""
+		for rtttl, warned in (("hi: d=8,o=8,b=120: c, b", False),
+				      ("hi: d=8,o=8,b=120: c, b, c9", True)):
+			err = io.StringIO()
+			with contextlib.redirect_stderr(err):
+				rtttl2bin.generate_melody_header([rtttl2bin.parse_ringtone(rtttl)])
+			self.assertEqual("warning" in err.getvalue(), warned)
+
+class PitchTests(unittest.TestCase):
+	"""The notes as the driver plays them, from base_notes[] in
+	drivers/buzzer.c with TA1 on the 12MHz SMCLK in toggle mode"""
+
+	SMCLK = 367 * 32768
+
+	@classmethod
+	def setUpClass(cls):
+		with open(os.path.join(ROOT, "drivers", "buzzer.c")) as f:
+			body = re.search(r"^uint16_t base_notes\[13\] = \{(.*?)\};",
+					 f.read(), re.M | re.S).group(1)
+		cls.base_notes = [int(n) for n in re.findall(r"^\s*(\d+)", body, re.M)]
+
+	def frequency(self, value):
+		ccr = self.base_notes[value & 0x0f] >> ((value >> 4) & 3)
+		return self.SMCLK / (2.0 * (ccr + 1))
+
+	def test_concert_pitch(self):
+		"""Testing if every note plays at concert pitch"""
+		for octave in range(6, 10):
+			for i, pitch in enumerate(rtttl2bin.SEMITONES):
+				if octave * 12 + i < rtttl2bin.LOWEST:
+					continue
+				hz = 440 * 2 ** ((octave * 12 + i - 57) / 12.0)
+				value = rtttl2bin.generate_binary_note((4, pitch, octave), 1000)
+				self.assertAlmostEqual(self.frequency(value) / hz, 1, delta=0.003)
+
+	def test_bundled_melodies(self):
+		"""Testing if the bundled melodies stay between 1.9 and 5.3kHz"""
+		for path in glob.glob(os.path.join(ROOT, "melodies", "*.rtttl")):
+			with open(path) as f:
+				ringtone = rtttl2bin.parse_ringtone(f.read().strip())
+			played = [n for n in rtttl2bin.decode_bytecode(
+					rtttl2bin.generate_bytecode(ringtone)) if n & 0x0f]
+			hz = [self.frequency(n) for n in played]
+			self.assertTrue(played, path)
+			self.assertGreaterEqual(min(hz), 1900, path)
+			self.assertLessEqual(max(hz), 5300, path)
+			for note in ringtone["melody"]:
+				if note[1] != 'p':
+					self.assertLessEqual(rtttl2bin.note_code(note),
+							     rtttl2bin.ACLK_HIGHEST, path)
 
 if __name__ == '__main__':
 	unittest.main()
@@ -0,0 +1,106 @@
+#!/usr/bin/env python3
+#
+# Decodes the movement log of modules/sleep.c into CSV, one row per
+# minute with the session it belongs to.
+#
+# Dump the log from the watch with mspdebug, the address and size come
+# from the symbol table of the firmware:
+#
+#   msp430-nm -S openchronos.elf | grep sleep_minutes_log
+#   mspdebug rf2500 "save_raw 0x<address> 0x<size> sleep.bin"
+#   contrib/sleep2csv.py sleep.bin > sleep.csv
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+import datetime
+import struct
+import sys
+
+SEGMENT_SIZE = 512
+
+# the stream, see TSERIES() in modules/sleep.c and libs/tseries.h
+HEADER = 6
+PAYLOAD = 2
+SHIFT = 0
+DT_TORN = 0xff00
+
+NONE = 0xff
+EPOCH = datetime.datetime(2000, 1, 1)
+
+
+def decode_segment(seg):
+    """
+        Returns the (seconds since 2000, scores) records of one flash
+        segment, or None if the segment holds no header
+    """
+    lo, hi, check = struct.unpack_from('<HHH', seg, 0)
+    if check == 0xffff or check != ~(lo ^ hi) & 0xffff:
+        return None
+
+    t0 = lo | hi << 16
+    records = []
+    for i in range(HEADER, SEGMENT_SIZE - PAYLOAD - 1, PAYLOAD + 2):
+        dt, = struct.unpack_from('<H', seg, i + PAYLOAD)
+        if dt >= DT_TORN:
+            break
+        records.append((t0 + (dt << SHIFT), seg[i:i + PAYLOAD]))
+
+    return (t0, records)
+
+
+def decode(data):
+    """
+        Decodes a dump of sleep_minutes_log into (time, score) minutes,
+        oldest first
+    """
+    segments = []
+    for start in range(0, len(data), SEGMENT_SIZE):
+        seg = decode_segment(bytearray(data[start:start + SEGMENT_SIZE]))
+        if seg:
+            segments.append(seg)
+
+    # the log is a ring, the header of a segment is its first record
+    segments.sort()
+    minutes = []
+    for t0, records in segments:
+        for t, scores in records:
+            for k, score in enumerate(scores):
+                if score != NONE:
+                    minutes.append((t + 60 * k, score))
+
+    return minutes
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.stderr.write("usage: %s sleep.bin\n" % sys.argv[0])
+        sys.exit(1)
+
+    with open(sys.argv[1], 'rb') as f:
+        data = f.read()
+
+    print("session,time,score")
+    session = 0
+    last = None
+    for t, score in decode(data):
+        # a session starts where the minutes are not back to back
+        if last is None or t - last > 120:
+            session += 1
+        last = t
+        when = EPOCH + datetime.timedelta(seconds=t)
+        print("%d,%s,%d" % (session, when.strftime('%Y-%m-%d %H:%M'), score))
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,140 @@
+#!/usr/bin/env python3
+#
+# Decodes the altitude track of modules/track.c into CSV.
+#
+# Dump the log from the watch with mspdebug, the address and size come
+# from the symbol table of the firmware:
+#
+#   msp430-nm -S openchronos.elf | grep track_flash
+#   mspdebug rf2500 "save_raw 0x<address> 0x<size> track.bin"
+#   contrib/track2csv.py track.bin > track.csv
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+import datetime
+import sys
+
+SEGMENT_SIZE = 512
+
+ZERO_RUN = 0xe0
+KEY = 0xf0
+DELTA = 0xf1
+TEMP = 0xf2
+ERASED = 0xff
+NO_TEMP = -0x8000
+
+
+def s16(lo, hi):
+    v = lo | (hi << 8)
+    return v - 0x10000 if v & 0x8000 else v
+
+
+def unzigzag(z):
+    return -(z >> 1) - 1 if z & 1 else z >> 1
+
+
+def get_varint(seg, i):
+    """
+        Returns the zigzag decoded varint at seg[i] and the index after it
+    """
+    z = shift = 0
+    while True:
+        b = seg[i]
+        i += 1
+        z |= (b & 0x7f) << shift
+        shift += 7
+        if not b & 0x80:
+            return unzigzag(z), i
+
+
+def decode_segment(seg):
+    """
+        Decodes the records of one flash segment into a list of
+        (datetime, altitude in m, temperature in degC or None)
+    """
+    samples = []
+    i = 0
+    when = alt = temp = step = None
+
+    while i < len(seg) and seg[i] != ERASED:
+        tag = seg[i]
+        n = 1
+
+        if tag == KEY:
+            yy, mm, dd, hh, mi = seg[i + 1:i + 6]
+            when = datetime.datetime(2000 + yy, mm, dd, hh, mi)
+            alt = s16(seg[i + 6], seg[i + 7])
+            temp = s16(seg[i + 8], seg[i + 9])
+            temp = None if temp == NO_TEMP else temp / 10.0
+            step = datetime.timedelta(minutes=seg[i + 10])
+            i += 11
+            samples.append((when, alt, temp))
+            continue
+
+        if when is None:
+            # segment without a key, the log is damaged
+            break
+
+        if tag == DELTA:
+            d, i = get_varint(seg, i + 1)
+            alt += d
+        elif tag == TEMP:
+            d, i = get_varint(seg, i + 1)
+            temp += d / 10.0
+            continue
+        elif tag >= ZERO_RUN:
+            n = tag - ZERO_RUN + 2
+            i += 1
+        else:
+            alt += unzigzag(tag)
+            i += 1
+
+        for k in range(n):
+            when += step
+            samples.append((when, alt, temp))
+
+    return samples
+
+
+def decode(data):
+    """
+        Decodes a dump of track_flash, oldest sample first
+    """
+    segments = []
+    for start in range(0, len(data), SEGMENT_SIZE):
+        samples = decode_segment(bytearray(data[start:start + SEGMENT_SIZE]))
+        if samples:
+            segments.append(samples)
+
+    # the log is a ring, every segment begins with a keyframe
+    segments.sort(key=lambda s: s[0][0])
+    return [s for seg in segments for s in seg]
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.stderr.write("usage: %s track.bin\n" % sys.argv[0])
+        sys.exit(1)
+
+    with open(sys.argv[1], 'rb') as f:
+        data = f.read()
+
+    print("time,altitude,temperature")
+    for when, alt, temp in decode(data):
+        print("%s,%d,%s" % (when.strftime('%Y-%m-%d %H:%M'), alt,
+                            '' if temp is None else '%.1f' % temp))
+
+
+if __name__ == '__main__':
+    main()
@@ -44,85 +44,197 @@
 
 // driver
 #include "adc12.h"
-#include "timer.h"
 
 
 // *************************************************************************************************
-// Prototypes section
+// Defines section
 
+// Requests that can be queued at the same time
+#define ADC12_QUEUE_LEN		(4)
 
-// *************************************************************************************************
-// Defines section
+// Conversion memories, a sequence holding more samples is repeated
+#define ADC12_SLOTS		(16)
 
 
 // *************************************************************************************************
 // Global Variable section
-uint16_t adc12_result;
-uint8_t  adc12_data_ready;
+volatile uint8_t adc12_last_event;
+
+struct adc12_req
+{
+	uint8_t channel;
+	uint8_t oversample;             // log2 of the number of samples
+	void (*fn)(uint16_t result);
+};
+
+// Requests waiting for the next sequence
+static struct adc12_req adc12_queue[ADC12_QUEUE_LEN];
+static uint8_t adc12_queued;
+
+// Sequence being converted, the ISR sums up the samples of each request
+static struct adc12_req adc12_batch[ADC12_QUEUE_LEN];
+static uint8_t adc12_batch_len;
+static uint8_t adc12_slots;
+static uint8_t adc12_slot_req[ADC12_SLOTS];
+static uint8_t adc12_rounds_log2;
+static volatile uint8_t adc12_rounds_left;
+static volatile uint32_t adc12_sum[ADC12_QUEUE_LEN];
 
 
 // *************************************************************************************************
-// Extern section
+// @fn          adc12_slots_of
+// @brief       Conversion memories per round for a request
+// @param       uint8_t i               Request in adc12_batch
+//              uint8_t rounds_log2     log2 of the number of rounds
+// @return      uint8_t                 Memories, a power of two
+// *************************************************************************************************
+static uint8_t adc12_slots_of(uint8_t i, uint8_t rounds_log2)
+{
+	uint8_t os = adc12_batch[i].oversample;
 
+	return (os > rounds_log2 ? 1 << (os - rounds_log2) : 1);
+}
 
 // *************************************************************************************************
-// @fn          adc12_single_conversion
-// @brief       Init ADC12. Do single conversion. Turn off ADC12.
+// @fn          adc12_start
+// @brief       Convert all queued requests in one sequence-of-channels run under a single
+//              reference on time. Oversamples take several memories of the sequence, if they
+//              do not fit into the 16 memories the sequence is repeated (repeat-sequence mode)
+//              and summed up round by round in the ISR.
+//              The first sample period (512 ADC12OSC cycles, ~100us) is longer than the 75us
+//              settling time of the reference, so the conversion can start right away and
+//              nothing waits on the CPU.
 // @param       none
 // @return      none
 // *************************************************************************************************
-uint16_t adc12_single_conversion(uint16_t ref, uint16_t sht, uint16_t channel)
+static void adc12_start(void)
 {
-	// Initialize the shared reference module
-	REFCTL0 |= REFMSTR + ref + REFON;    		// Enable internal reference (1.5V or 2.5V)
+	uint8_t i, j, n;
 
-	// Initialize ADC12_A
-	ADC12CTL0 = sht + ADC12ON;					// Set sample time
-	ADC12CTL1 = ADC12SHP;                     	// Enable sample timer
-	ADC12MCTL0 = ADC12SREF_1 + channel;  		// ADC input channel
-	ADC12IE = 0x001;                          	// ADC_IFG upon conv result-ADCMEMO
-
-	// Wait 2 ticks (66us) to allow internal reference to settle
-	timer0_delay(66,LPM3_bits);
-
-	// Start ADC12
-	ADC12CTL0 |= ADC12ENC;
+	for (i = 0; i < adc12_queued; i++)
+	{
+		adc12_batch[i] = adc12_queue[i];
+		adc12_sum[i] = 0;
+	}
+	adc12_batch_len = adc12_queued;
+	adc12_queued = 0;
+
+	// Fewest rounds that fit, every request gets at least one memory per round
+	for (adc12_rounds_log2 = 0; ; adc12_rounds_log2++)
+	{
+		n = 0;
+		for (i = 0; i < adc12_batch_len; i++)
+			n += adc12_slots_of(i, adc12_rounds_log2);
+		if (n <= ADC12_SLOTS)
+			break;
+	}
 
-	// Clear data ready flag
-	adc12_data_ready = 0;
+	// Internal reference, also powers the temperature sensor
+	REFCTL0 |= REFMSTR + ADC12_REF + REFON;
+
+	// Each conversion triggered by the previous one
+	ADC12CTL0 = ADC12SHT0_10 + ADC12SHT1_10 + ADC12MSC + ADC12ON;
+	ADC12CTL1 = ADC12SHP + (adc12_rounds_log2 ? ADC12CONSEQ_3 : ADC12CONSEQ_1);
+
+	adc12_slots = 0;
+	for (i = 0; i < adc12_batch_len; i++)
+	{
+		n = adc12_slots_of(i, adc12_rounds_log2);
+		for (j = 0; j < n; j++)
+		{
+			(&ADC12MCTL0)[adc12_slots] = ADC12SREF_1 + adc12_batch[i].channel;
+			adc12_slot_req[adc12_slots++] = i;
+		}
+	}
+	(&ADC12MCTL0)[adc12_slots - 1] |= ADC12EOS;
+	adc12_rounds_left = 1 << adc12_rounds_log2;
 
-	// Sampling and conversion start
-	ADC12CTL0 |= ADC12SC;
+	// Interrupt at the end of every round
+	ADC12IFG = 0;
+	ADC12IE = 1 << (adc12_slots - 1);
 
-	// Wait until ADC12 has finished
-	timer0_delay(170, LPM3_bits);
+	ADC12CTL0 |= ADC12ENC + ADC12SC;
+}
 
-	uint8_t loops = 0;
+// *************************************************************************************************
+// @fn          adc12_request
+// @brief       Queue a conversion. Returns right away, the requests of one main loop pass are
+//              converted together by adc12_flush(). fn is called from the main loop with the
+//              average of the samples.
+// @param       uint8_t channel         ADC12INCH_x
+//              uint8_t oversample      log2 of the number of samples to average, 0..6
+//              fn                      Completion callback, gets the average against
+//                                      ADC12_REF in 1/16 LSB (4095 * 16 is full scale)
+// @return      uint8_t                 0 if the queue is full
+// *************************************************************************************************
+uint8_t adc12_request(uint8_t channel, uint8_t oversample, void (*fn)(uint16_t result))
+{
+	uint8_t i;
 
-	//We were going away and the watchdog was tripping - this should reduce the instances of that.
-	while (!adc12_data_ready && loops++ < 30) {
-		timer0_delay(66, LPM3_bits);
+	for (i = 0; i < adc12_queued; i++)
+	{
+		if (adc12_queue[i].channel == channel && adc12_queue[i].fn == fn)
+			return (1);
 	}
 
-	// Shut down ADC12
-	ADC12CTL0 &= ~(ADC12ENC | ADC12SC | sht);
-	ADC12CTL0 &= ~ADC12ON;
+	if (adc12_queued == ADC12_QUEUE_LEN)
+		return (0);
 
-	// Shut down reference voltage
-	REFCTL0 &= ~(REFMSTR + ref + REFON);
+	adc12_queue[adc12_queued].channel = channel;
+	adc12_queue[adc12_queued].oversample = oversample;
+	adc12_queue[adc12_queued].fn = fn;
+	adc12_queued++;
 
-	ADC12IE = 0;
+	return (1);
+}
 
-	// Return ADC result
-	return (adc12_result);
+// *************************************************************************************************
+// @fn          adc12_flush
+// @brief       Start converting the queued requests unless a sequence is still running.
+//              Called at the end of every main loop pass.
+// @param       none
+// @return      none
+// *************************************************************************************************
+void adc12_flush(void)
+{
+	if (adc12_queued && !adc12_batch_len)
+		adc12_start();
 }
 
+// *************************************************************************************************
+// @fn          adc12_dispatch
+// @brief       Deliver the results of the finished sequence. Called from the main loop when
+//              adc12_last_event is set.
+// @param       none
+// @return      none
+// *************************************************************************************************
+void adc12_dispatch(void)
+{
+	struct adc12_req batch[ADC12_QUEUE_LEN];
+	uint16_t results[ADC12_QUEUE_LEN];
+	uint8_t i, len = adc12_batch_len;
+	uint8_t n, shift;
+
+	for (i = 0; i < len; i++)
+	{
+		// Samples taken are a power of two, the average is a shift
+		batch[i] = adc12_batch[i];
+		shift = adc12_rounds_log2;
+		for (n = adc12_slots_of(i, adc12_rounds_log2); n > 1; n >>= 1)
+			shift++;
+		results[i] = (adc12_sum[i] << 4) >> shift;
+	}
+	adc12_batch_len = 0;
 
+	for (i = 0; i < len; i++)
+		batch[i].fn(results[i]);
+}
 
 
 // *************************************************************************************************
 // @fn          ADC12ISR
-// @brief       Store ADC12 conversion result. Set flag to indicate data ready.
+// @brief       Add up the samples of a round. After the last round power down ADC12 and
+//              reference and wake up the main loop.
 // @param       none
 // @return      none
 // *************************************************************************************************
@@ -135,7 +247,9 @@ __interrupt
 #endif
 void ADC12ISR(void)
 {
-	switch (__even_in_range(ADC12IV, 34)) {
+	uint8_t i;
+
+	switch (__even_in_range(ADC12IV, 36)) {
 	case  0:
 		break;                           // Vector  0:  No interrupt
 
@@ -145,57 +259,26 @@ void ADC12ISR(void)
 	case  4:
 		break;                           // Vector  4:  ADC timing overflow
 
-	case  6:                                  // Vector  6:  ADC12IFG0
-		adc12_result = ADC12MEM0;                       // Move results, IFG is cleared
-		adc12_data_ready = 1;
-		_BIC_SR_IRQ(LPM3_bits);   						// Exit active CPU
-		break;
-
-	case  8:
-		break;                           // Vector  8:  ADC12IFG1
-
-	case 10:
-		break;                           // Vector 10:  ADC12IFG2
-
-	case 12:
-		break;                           // Vector 12:  ADC12IFG3
-
-	case 14:
-		break;                           // Vector 14:  ADC12IFG4
-
-	case 16:
-		break;                           // Vector 16:  ADC12IFG5
-
-	case 18:
-		break;                           // Vector 18:  ADC12IFG6
-
-	case 20:
-		break;                           // Vector 20:  ADC12IFG7
-
-	case 22:
-		break;                           // Vector 22:  ADC12IFG8
-
-	case 24:
-		break;                           // Vector 24:  ADC12IFG9
-
-	case 26:
-		break;                           // Vector 26:  ADC12IFG10
-
-	case 28:
-		break;                           // Vector 28:  ADC12IFG11
-
-	case 30:
-		break;                           // Vector 30:  ADC12IFG12
-
-	case 32:
-		break;                           // Vector 32:  ADC12IFG13
-
-	case 34:
-		break;                           // Vector 34:  ADC12IFG14
-
-	default:
+	default:                                  // Vector  6+: ADC12IFG of the last memory
+		// The next round is already sampling memory 0, ~100us to read them all
+		for (i = 0; i < adc12_slots; i++)
+			adc12_sum[adc12_slot_req[i]] += (&ADC12MEM0)[i];    // IFGs are cleared
+
+		// Repeat-sequence mode stops at the end of the sequence once ENC is cleared
+		if (--adc12_rounds_left == 1)
+			ADC12CTL0 &= ~ADC12ENC;
+		if (adc12_rounds_left)
+			break;
+
+		// Shut down ADC12 and reference voltage
+		ADC12IE = 0;
+		ADC12CTL0 &= ~(ADC12ENC | ADC12SC);
+		ADC12CTL0 = 0;
+		REFCTL0 &= ~(REFMSTR + ADC12_REF + REFON);
+
+		adc12_last_event = 1;
+		_BIC_SR_IRQ(LPM3_bits);                 // Exit active CPU
 		break;
 	}
 }
 
-
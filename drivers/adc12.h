@@ -44,25 +44,25 @@
 
 // *************************************************************************************************
 // Prototypes section
-extern uint16_t adc12_single_conversion(uint16_t ref, uint16_t sht, uint16_t channel);
+extern uint8_t adc12_request(uint8_t channel, uint8_t oversample,
+			     void (*fn)(uint16_t result));
+extern void adc12_flush(void);
+extern void adc12_dispatch(void);
 
 // *************************************************************************************************
 // Defines section
 
-//// Reference settling time
-//#define ADC12_REFERENCE_SETTLING_TIME_USEC		(4*34u)
-//
-//// Delay for temperature measurement
-//#define ADC12_TEMP_CONVERSION_TIME_USEC			(10*34u)
-//
-//// Delay for battery voltage measurement
-//#define ADC12_BATT_CONVERSION_TIME_USEC			(10*34u)
+// All channels of a sequence share one reference: 2.0V, so AVCC/2 of a fresh
+// battery still fits. Results are 12 bit against this voltage.
+#define ADC12_REF			(REFVSEL_1)
+#define ADC12_REF_MV			(2000u)
 
 
 // *************************************************************************************************
 // Global Variable section
-extern uint16_t adc12_result;
-extern uint8_t  adc12_data_ready;
+
+// Set by the ISR when a sequence has finished, see adc12_dispatch()
+extern volatile uint8_t adc12_last_event;
 
 
 // *************************************************************************************************
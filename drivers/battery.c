@@ -58,6 +58,217 @@
 #include "ports.h"
 #include "adc12.h"
 
+#ifdef CONFIG_INFOMEM
+#include "infomem.h"
+#endif
+
+#ifdef CONFIG_BATTERY_GAUGE
+#include "rtca.h"
+#include "temperature.h"
+#endif
+
+uint8_t battery_last_event;
+
+#ifdef CONFIG_BATTERY_GAUGE
+
+/* Fuel gauge: the voltage says how much charge is left, the time each
+   load was switched on says how fast it goes. The charge is counted down
+   hourly and pulled towards the voltage estimate, gently on the plateau
+   of the discharge curve where the voltage hardly moves, harder below
+   the knee. */
+
+/* nominal capacity of a CR2032, uAh */
+#define GAUGE_CAPACITY_UAH	225000UL
+
+/* LPM3 with RTC and LCD, the sensors in standby, uA */
+#define GAUGE_SLEEP_UA		5
+
+/* charges are kept in Q5 uAh */
+#define GAUGE_Q			5
+
+/* the per day figures average ~32 hourly samples */
+#define GAUGE_DAY_SHIFT		5
+
+/* weight of the voltage estimate, per hour */
+#define GAUGE_KNEE		280	/* 10mV */
+#define GAUGE_TRUST_PLATEAU	5
+#define GAUGE_TRUST_KNEE	2
+
+/* typical current of each load while switched on, uA */
+static const uint16_t gauge_load_ua[BATTERY_LOADS] = {
+	3000,	/* CPU, active mode at 12MHz */
+#ifdef CONFIG_BUZZER_ACLK
+	2300,	/* buzzer, from ACLK */
+#else
+	2500,	/* buzzer, SMCLK keeps the DCO on in LPM1 */
+#endif
+	16000,	/* radio, receiving */
+	650,	/* pressure sensor converting */
+	70,	/* accelerometer at 100Hz */
+};
+
+/* Capacity left against the voltage at rest and 20 degC, from the
+   published discharge curves of the CR2032 at light load */
+static const struct {
+	uint16_t v;	/* 10mV */
+	uint8_t pct;
+} gauge_curve[] = {
+	{ 300, 100 },
+	{ 295, 90 },
+	{ 292, 80 },
+	{ 290, 70 },
+	{ 288, 60 },
+	{ 286, 50 },
+	{ 284, 40 },
+	{ 281, 30 },
+	{ 277, 20 },
+	{ 270, 10 },
+	{ 260, 5 },
+	{ 240, 2 },
+	{ 220, 0 },
+};
+
+#define GAUGE_POINTS	(sizeof(gauge_curve) / sizeof(gauge_curve[0]))
+
+struct battery_gauge battery_gauge;
+
+static struct {
+	uint32_t sys[BATTERY_LOADS];	/* rtca_time.sys when switched on */
+	uint16_t ts[BATTERY_LOADS];	/* TA0R when switched on */
+	uint32_t ticks[BATTERY_LOADS];	/* on time this hour, 1/16384s */
+	uint8_t on[BATTERY_LOADS];
+	uint32_t day[BATTERY_LOADS];	/* charge per day, Q5 uAh */
+	uint32_t left;			/* Q5 uAh */
+	uint8_t hours;			/* updates so far, up to 2 */
+	uint8_t pending;
+} gauge;
+
+/* Ticks of 1/16384s since the load was switched on, see kf_elapsed()
+   in libs/altitude_kf.c */
+static int32_t gauge_elapsed(uint8_t load)
+{
+	uint32_t secs = rtca_time.sys - gauge.sys[load];
+	uint16_t d = TA0R - gauge.ts[load];
+
+	return ((int32_t)secs << 14)
+		+ (int16_t)(d - (uint16_t)(secs << 14));
+}
+
+void battery_load_start(enum battery_load load)
+{
+	if (gauge.on[load])
+		return;
+
+	gauge.sys[load] = rtca_time.sys;
+	gauge.ts[load] = TA0R;
+	gauge.on[load] = 1;
+}
+
+void battery_load_stop(enum battery_load load)
+{
+	int32_t t;
+
+	if (!gauge.on[load])
+		return;
+
+	gauge.on[load] = 0;
+	t = gauge_elapsed(load);
+	if (t > 0)
+		gauge.ticks[load] += t;
+}
+
+void battery_gauge_request(void)
+{
+	/* the temperature is converted ahead of the voltage */
+	temperature_measurement(NULL);
+	gauge.pending = 1;
+}
+
+/* capacity left at voltage v (10mV, at rest and 20 degC), permille */
+static uint16_t gauge_permille(int16_t v)
+{
+	uint8_t i;
+
+	if (v >= (int16_t)gauge_curve[0].v)
+		return 1000;
+
+	for (i = 1; i < GAUGE_POINTS; i++) {
+		if (v >= (int16_t)gauge_curve[i].v)
+			return gauge_curve[i].pct * 10
+				+ (v - gauge_curve[i].v)
+				* (gauge_curve[i - 1].pct - gauge_curve[i].pct) * 10
+				/ (gauge_curve[i - 1].v - gauge_curve[i].v);
+	}
+
+	return 0;
+}
+
+static void gauge_update(void)
+{
+	uint32_t per_day = (uint32_t)GAUGE_SLEEP_UA * 24 << GAUGE_Q;
+	uint32_t used = (uint32_t)GAUGE_SLEEP_UA << GAUGE_Q;
+	uint32_t ticks, q, v_left;
+	int16_t v, t;
+	uint8_t i;
+
+	gauge.pending = 0;
+
+	for (i = 0; i < BATTERY_LOADS; i++) {
+		/* the buzzer and the sensors switch from interrupts */
+		__disable_interrupt();
+		if (gauge.on[i]) {
+			battery_load_stop(i);
+			battery_load_start(i);
+		}
+		ticks = gauge.ticks[i];
+		gauge.ticks[i] = 0;
+		__enable_interrupt();
+
+		/* charge per day at the rate of this hour, Q5 uAh:
+		   ticks * uA * 24 * 32 / (16384 * 3600) */
+		q = (uint64_t)ticks * gauge_load_ua[i] / 76800;
+		used += q / 24;
+
+		/* the first update closes a partial hour */
+		if (gauge.hours == 1)
+			gauge.day[i] = q;
+		else if (gauge.hours > 1)
+			gauge.day[i] += (int32_t)(q - gauge.day[i])
+							>> GAUGE_DAY_SHIFT;
+
+		per_day += gauge.day[i];
+		q = gauge.day[i] >> GAUGE_Q;
+		battery_gauge.uah[i] = (q > 9999 ? 9999 : q);
+	}
+
+	/* Li/MnO2 cells lose ~2mV/degC below room temperature, more of it
+	   under load. What the radio and the buzzer pull never gets here,
+	   see battery_done(). */
+	t = temperature.value + temperature.offset;
+	v = battery_info.voltage + (200 - t) / 50;
+	v_left = gauge_permille(v)
+		* ((GAUGE_CAPACITY_UAH / 1000) << GAUGE_Q);
+
+	if (!gauge.hours) {
+		gauge.left = v_left;
+	} else {
+		gauge.left = (gauge.left > used ? gauge.left - used : 0);
+		gauge.left += (int32_t)(v_left - gauge.left)
+			>> (v < GAUGE_KNEE ? GAUGE_TRUST_KNEE
+					   : GAUGE_TRUST_PLATEAU);
+	}
+
+	battery_gauge.percent = gauge.left * 100
+		/ (GAUGE_CAPACITY_UAH << GAUGE_Q);
+
+	if (gauge.hours)
+		battery_gauge.days = gauge.left / per_day;
+	if (gauge.hours < 2)
+		gauge.hours++;
+}
+
+#endif /* CONFIG_BATTERY_GAUGE */
+
 void battery_init(void)
 {
 	/* Start with battery voltage estimate of full and avoid low
@@ -65,39 +276,62 @@ void battery_init(void)
 	battery_info.voltage = BATTERY_FULL_THRESHOLD;
 }
 
-
-void battery_measurement(void)
+static void battery_done(uint16_t voltage)
 {
-	/* Convert external battery voltage (ADC12INCH_11=AVCC-AVSS/2)
-	voltage = adc12_single_conversion(REFVSEL_2, ADC12SHT0_10,
-	      ADC12SSEL_0, ADC12SREF_1, ADC12INCH_11,
-			ADC12_BATT_CONVERSION_TIME_USEC); */
-	uint16_t voltage = adc12_single_conversion(REFVSEL_1,
-			ADC12SHT0_10, ADC12INCH_11);
+#ifdef CONFIG_BATTERY_GAUGE
+	/* a few mA drop the voltage by tens of mV, keep the last estimate
+	   and leave the gauge update for the next measurement */
+	uint8_t loaded = gauge.on[BATTERY_LOAD_BUZZER]
+			|| gauge.on[BATTERY_LOAD_RADIO];
+#else
+	uint8_t loaded = 0;
+#endif
 
-	/* Convert ADC value to "x.xx V"
-	 Ideally we have A11=0->AVCC=0V ... A11=4095(2^12-1)->AVCC=4V
-	 --> (A11/4095)*4V=AVCC --> AVCC=(A11*4)/4095 */
-	voltage = (voltage << 2) / 41;
+	if (!loaded) {
+		/* Convert ADC value (1/16 LSB) to "x.xx V"
+		 Ideally we have A11=0->AVCC=0V ... A11=4095(2^12-1)->AVCC=4V
+		 --> (A11/4095)*4V=AVCC --> AVCC=(A11*4)/4095 = A11*16/164 */
+		voltage = (voltage + 82) / 164;
 
-	/* Correct measured voltage with calibration value */
-	voltage += battery_info.offset;
+		/* Correct measured voltage with calibration value */
+		voltage += battery_info.offset;
 
-	/* Discard values that are clearly outside the measurement range */
-	if (voltage > BATTERY_HIGH_THRESHOLD)
-		voltage = battery_info.voltage;
+		/* Discard values that are clearly outside the measurement range */
+		if (voltage > BATTERY_HIGH_THRESHOLD)
+			voltage = battery_info.voltage;
 
 #ifndef CONFIG_BATTERY_DISABLE_FILTER
-	/* Filter battery voltage */
-	battery_info.voltage = ((voltage << 1)
-			+ (battery_info.voltage << 3)) / 10;
+		/* Filter battery voltage */
+		battery_info.voltage = ((voltage << 1)
+				+ (battery_info.voltage << 3)) / 10;
 #else
-	/* Get it raw instead for testing */
-	battery_info.voltage = voltage;
+		/* Get it raw instead for testing */
+		battery_info.voltage = voltage;
 #endif
+	}
 
 	/* Display blinking battery symbol if low */
-	if (battery_info.voltage < BATTERY_LOW_THRESHOLD)
+	if (battery_info.voltage < BATTERY_LOW_THRESHOLD) {
 		display_symbol(0, LCD_SYMB_BATTERY, SEG_ON | BLINK_ON);
+
+#ifdef CONFIG_INFOMEM
+		/* the cell may not last until the next write back */
+		infomem_flush();
+#endif
+	}
+
+#ifdef CONFIG_BATTERY_GAUGE
+	if (gauge.pending && !loaded)
+		gauge_update();
+#endif
+
+	battery_last_event = 1;
+}
+
+void battery_measurement(void)
+{
+	/* Convert external battery voltage (ADC12INCH_11=AVCC-AVSS/2),
+	   SYS_MSG_BATT follows once the result is in */
+	adc12_request(ADC12INCH_11, 0, &battery_done);
 }
 
@@ -41,6 +41,44 @@
 void battery_init(void);
 void battery_measurement(void);
 
+/* Consumers counted by the fuel gauge, in seconds they are switched on.
+   The sleep current of the watch is a constant on top of them. */
+enum battery_load {
+	BATTERY_LOAD_CPU = 0,	/* main loop awake */
+	BATTERY_LOAD_BUZZER,
+	BATTERY_LOAD_RADIO,
+	BATTERY_LOAD_PRESSURE,	/* conversion running */
+	BATTERY_LOAD_ACCEL,	/* sensor powered */
+	BATTERY_LOADS
+};
+
+#ifdef CONFIG_BATTERY_GAUGE
+/* start and stop the clock of a load, both may be called repeatedly
+   and from interrupts */
+void battery_load_start(enum battery_load load);
+void battery_load_stop(enum battery_load load);
+
+/* recomputes the gauge on the next measurement, called hourly */
+void battery_gauge_request(void);
+
+struct battery_gauge {
+	/* capacity left, % */
+	uint8_t percent;
+	/* at the consumption of the last day or so, 0 while unknown */
+	uint16_t days;
+	/* charge per day of each load, uAh */
+	uint16_t uah[BATTERY_LOADS];
+};
+
+extern struct battery_gauge battery_gauge;
+#else
+#define battery_load_start(load)
+#define battery_load_stop(load)
+#endif
+
+/* set when a measurement has completed, becomes SYS_MSG_BATT */
+extern uint8_t battery_last_event;
+
 /* Battery high voltage threshold */
 #define BATTERY_HIGH_THRESHOLD			(360u)
 
@@ -45,6 +45,7 @@
 #include "bmp_ps.h"
 #include "ps.h"
 #include "timer.h"
+#include "rtca.h"
 
 // *************************************************************************************************
 // Prototypes section
@@ -59,6 +60,14 @@
 bmp_085_calibration_param_t bmp_cal_param;
 // Paramater used by temperature and pressure measurement
 long bmp_param_b5;
+// Oversampling setting of the running pressure conversion
+static u8 bmp_oss;
+// Temperature dependent pressure coefficients, updated by bmp_ps_get_temp()
+static s32 bmp_b3_base;         // AC1 * 4 + X3, B3 before the oversampling shift
+static u32 bmp_b4;
+static u8 bmp_cache_valid;
+static u32 bmp_cache_time;      // rtca_time.sys of the last temperature reading
+static u32 bmp_last_pa;         // last pressure read, kept when a burst read fails
 
 // *************************************************************************************************
 // Extern section
@@ -74,6 +83,7 @@ void bmp_ps_init(void)
     volatile u8 status;
 
     ps_init();
+    bmp_cache_valid = 0;
 
     // Read ChipID to check if communication is working
     status = bmp_ps_read_register(BMP_085_CHIP_ID_REG, PS_I2C_8BIT_ACCESS);
@@ -95,22 +105,16 @@ void bmp_ps_init(void)
 // *************************************************************************************************
 void bmp_ps_get_cal_param(void)
 {
-  /*parameters AC1-AC6*/
-  bmp_cal_param.ac1 = bmp_ps_read_register(BMP_085_PROM_START_ADDR + 0, PS_I2C_16BIT_ACCESS);
-  bmp_cal_param.ac2 = bmp_ps_read_register(BMP_085_PROM_START_ADDR + 2, PS_I2C_16BIT_ACCESS);
-  bmp_cal_param.ac3 = bmp_ps_read_register(BMP_085_PROM_START_ADDR + 4, PS_I2C_16BIT_ACCESS);
-  bmp_cal_param.ac4 = bmp_ps_read_register(BMP_085_PROM_START_ADDR + 6, PS_I2C_16BIT_ACCESS);
-  bmp_cal_param.ac5 = bmp_ps_read_register(BMP_085_PROM_START_ADDR + 8, PS_I2C_16BIT_ACCESS);
-  bmp_cal_param.ac6 = bmp_ps_read_register(BMP_085_PROM_START_ADDR + 10,PS_I2C_16BIT_ACCESS);
-  
-  /*parameters B1,B2*/
-  bmp_cal_param.b1 = bmp_ps_read_register(BMP_085_PROM_START_ADDR + 12, PS_I2C_16BIT_ACCESS);
-  bmp_cal_param.b2 = bmp_ps_read_register(BMP_085_PROM_START_ADDR + 14, PS_I2C_16BIT_ACCESS);
-  
-  /*parameters MB,MC,MD*/
-  bmp_cal_param.mb = bmp_ps_read_register(BMP_085_PROM_START_ADDR + 16, PS_I2C_16BIT_ACCESS);
-  bmp_cal_param.mc = bmp_ps_read_register(BMP_085_PROM_START_ADDR + 18, PS_I2C_16BIT_ACCESS);
-  bmp_cal_param.md = bmp_ps_read_register(BMP_085_PROM_START_ADDR + 20, PS_I2C_16BIT_ACCESS);
+  u8 raw[22];
+  s16 *param = (s16 *) &bmp_cal_param;
+  u8 i;
+
+  /*parameters AC1-AC6, B1, B2, MB, MC, MD in one 22 byte burst, MSB first*/
+  if (!ps_read_burst(BMP_085_I2C_ADDR << 1, BMP_085_PROM_START_ADDR, raw, sizeof(raw)))
+    return;
+
+  for (i = 0; i < 11; i++)
+    param[i] = ((u16) raw[2 * i] << 8) | raw[2 * i + 1];
 }
 
 // *************************************************************************************************
@@ -125,6 +129,18 @@ void bmp_ps_start(void)
     bmp_ps_write_register(BMP_085_CTRL_MEAS_REG, BMP_085_T_MEASURE);
 }
 
+// *************************************************************************************************
+// @fn          bmp_ps_start_pa
+// @brief       Start a pressure conversion
+// @param       u8 oss                  Oversampling setting 0..3, kept for bmp_ps_get_pa()
+// @return      none
+// *************************************************************************************************
+void bmp_ps_start_pa(u8 oss)
+{
+    bmp_oss = oss;
+    bmp_ps_write_register(BMP_085_CTRL_MEAS_REG, BMP_085_P_MEASURE + (oss << 6));
+}
+
 // *************************************************************************************************
 // @fn          bmp_ps_stop
 // @brief       Power down pressure sensor
@@ -161,40 +177,73 @@ u16 bmp_ps_read_register(u8 address, u8 mode)
 }
 
 // *************************************************************************************************
-// @fn          bmp_ps_get_pa
-// @brief       Read out pressure. Format is Pa. Range is 30000 .. 120000 Pa.
+// @fn          bmp_ps_update_cache
+// @brief       Precompute the temperature dependent part of the pressure compensation
+//              (B6 squared term, B3, B4), so a pressure sample needs no new temperature.
 // @param       none
-// @return      u32                     15-bit pressure sensor value (Pa)
+// @return      none
 // *************************************************************************************************
-u32 bmp_ps_get_pa(void)
+static void bmp_ps_update_cache(void)
 {
-    u16 up;			// uncompensated pressure
-    s32 pressure, x1, x2, x3, b3, b6;
-   	u32 result, b4, b7;
+    s32 x1, x2, x3, b6, b6_sq;
 
-    // Add Compensation and convert decimal value to Pa
-  
    b6 = bmp_param_b5 - 4000;
-   //*****calculate B3************
-   x1 = (b6 * b6) >> 12;	 	 
-   x1 = (bmp_cal_param.b2 * x1) / 2048;
+   b6_sq = (b6 * b6) >> 12;
 
+   //*****calculate B3************
+   x1 = (bmp_cal_param.b2 * b6_sq) / 2048;
    x2 = (bmp_cal_param.ac2 * b6) / 2048;
-
    x3 = x1 + x2;
-
-   b3 = (((((long) bmp_cal_param.ac1) * 4 + x3)) + 2) / 4;
+   bmp_b3_base = ((long) bmp_cal_param.ac1) * 4 + x3;
 
    //*****calculate B4************
    x1 = (bmp_cal_param.ac3 * b6) / 8192;
-   x2 = (bmp_cal_param.b1 * ((b6 * b6) >> 12)) / 65536;
+   x2 = (bmp_cal_param.b1 * b6_sq) / 65536;
    x3 = ((x1 + x2) + 2) / 4;
-   b4 = (bmp_cal_param.ac4 * (u32) (x3 + 32768)) / 32768;
+   bmp_b4 = (bmp_cal_param.ac4 * (u32) (x3 + 32768)) / 32768;
+
+   bmp_cache_valid = 1;
+   bmp_cache_time = rtca_time.sys;
+}
+
+// *************************************************************************************************
+// @fn          bmp_ps_need_temp
+// @brief       Check if the temperature has to be measured before the next pressure sample.
+//              Ambient temperature changes slowly, so it is only refreshed every
+//              BMP_085_TEMP_INTERVAL seconds.
+// @param       none
+// @return      u8                      1=start a temperature conversion first
+// *************************************************************************************************
+u8 bmp_ps_need_temp(void)
+{
+    return (!bmp_cache_valid || rtca_time.sys - bmp_cache_time >= BMP_085_TEMP_INTERVAL);
+}
+
+// *************************************************************************************************
+// @fn          bmp_ps_get_pa
+// @brief       Read out pressure. Format is Pa. Range is 30000 .. 120000 Pa.
+// @param       none
+// @return      u32                     15-bit pressure sensor value (Pa), the last one
+//                                      read if the I2C transfer fails
+// *************************************************************************************************
+u32 bmp_ps_get_pa(void)
+{
+    u8 raw[3];
+    u32 up;			// uncompensated pressure
+    s32 pressure, x1, x2, b3;
+   	u32 result, b4, b7;
+
+    // Add Compensation and convert decimal value to Pa
+    // B3 and B4 come from the cache filled by bmp_ps_get_temp()
+   b3 = ((bmp_b3_base << bmp_oss) + 2) / 4;
+   b4 = bmp_b4;
      
-   // Get MSB from ADC_OUT_MSB_REG
-   up = bmp_ps_read_register(BMP_085_ADC_OUT_MSB_REG, PS_I2C_16BIT_ACCESS);
+   // Get MSB, LSB and XLSB from ADC_OUT registers in one transaction
+   if (!ps_read_burst(BMP_085_I2C_ADDR << 1, BMP_085_ADC_OUT_MSB_REG, raw, 3))
+     return (bmp_last_pa);
+   up = (((u32) raw[0] << 16) | ((u16) raw[1] << 8) | raw[2]) >> (8 - bmp_oss);
 
-   b7 = ((u32)(up - b3) * 50000);   
+   b7 = ((u32)(up - b3) * (50000 >> bmp_oss));   
    if (b7 < 0x80000000)
    {
      pressure = (b7 * 2) / b4;
@@ -209,6 +258,7 @@ u32 bmp_ps_get_pa(void)
    x1 = (x1 * BMP_SMD500_PARAM_MG) / 65536;
    x2 = (pressure * BMP_SMD500_PARAM_MH) / 65536;
    result = pressure + (x1 + x2 + BMP_SMD500_PARAM_MI) / 16;	// pressure in Pa
+   bmp_last_pa = result;
 
    return (result);
 }
@@ -233,6 +283,8 @@ u16 bmp_ps_get_temp(void)
 	x1 = (((long) ut - (long) bmp_cal_param.ac6) * (long) bmp_cal_param.ac5) / 32768;
     x2 = ((long) bmp_cal_param.mc * 2048) / (x1 + bmp_cal_param.md);
     bmp_param_b5 = x1 + x2;
+
+    bmp_ps_update_cache();
     
     temperature = ((bmp_param_b5 + 8) / 16);  // temperature in 0.1C
 
@@ -50,6 +50,8 @@ typedef int32_t s32;
 extern void bmp_ps_init(void);
 extern void bmp_ps_get_cal_param(void);
 extern void bmp_ps_start(void);
+extern void bmp_ps_start_pa(u8 oss);
+extern u8 bmp_ps_need_temp(void);
 extern void bmp_ps_stop(void);
 extern u16 bmp_ps_read_register(u8 address, u8 mode);
 extern u8 bmp_ps_write_register(u8 address, u8 data);
@@ -71,6 +73,7 @@ extern u16 bmp_ps_get_temp(void);
 #define BMP_085_CTRL_MEAS_REG (0xF4)
 #define BMP_085_ADC_OUT_MSB_REG	(0xF6)
 #define BMP_085_ADC_OUT_LSB_REG	(0xF7)
+#define BMP_085_ADC_OUT_XLSB_REG (0xF8)
 
 #define BMP_085_SOFT_RESET_REG (0xE0)
 
@@ -78,6 +81,7 @@ extern u16 bmp_ps_get_temp(void);
 #define BMP_085_P_MEASURE    (0x34)				 // pressure measurement
 
 #define BMP_085_TEMP_CONVERSION_TIME (5)		 // TO be spec'd by GL or SB
+#define BMP_085_TEMP_INTERVAL (10)			 // seconds between temperature readings
 
 #define BMP_SMD500_PARAM_MG  (3038)              //calibration parameter
 #define BMP_SMD500_PARAM_MH  (-7357)             //calibration parameter
@@ -24,37 +24,100 @@
 
 #include "buzzer.h"
 #include "timer.h"
+#include "battery.h"
 
 #define DURATION(note) (note >> 6)
 #define OCTAVE(note) ((note >> 4) & 0x0003)
 #define PITCH(note) (note & 0x000F)
 
+/* Octave 0 runs from D#6 (1244Hz) to D7, at concert pitch. Octave 3 is
+   beyond what the buzzer and ACLK play well, contrib/rtttl2bin.py keeps
+   the melodies between about 2 and 5kHz. */
+#ifdef CONFIG_BUZZER_ACLK
+/* Half periods in ACLK ticks, Q8. SMCLK runs at 367 ACLK ticks, so these
+   are the SMCLK counts below plus one, divided by 367: the melodies keep
+   their pitch. */
+static const uint16_t base_notes[13] = {
+	0,    /* 0: P  */
+	3371, /* 1: D# */
+	3181, /* 2: E  */
+	3002, /* 3: F  */
+	2834, /* 4: F# */
+	2675, /* 5: G  */
+	2525, /* 6: G# */
+	2383, /* 7: A  */
+	2250, /* 8: A# */
+	2123, /* 9: B  */
+	2004, /* A: C  */
+	1892, /* B: C# */
+	1785  /* C: D  */
+};
+
+#define BUZZER_TASSEL TASSEL__ACLK
+#else
 uint16_t base_notes[13] = {
 	0,    /* 0: P  */
-	2383, /* 1: A  */
-	2249, /* 2: A# */
-	2123, /* 3: B  */
-	2003, /* 4: C  */
-	1891, /* 5: C# */
-	1785, /* 6: D  */
-	1685, /* 7: D# */
-	1590, /* 8: E  */
-	1501, /* 9: F  */
-	1417, /* A: F# */
-	1337, /* B: G  */
-	1262  /* C: G# */
+	4831, /* 1: D# */
+	4559, /* 2: E  */
+	4303, /* 3: F  */
+	4062, /* 4: F# */
+	3834, /* 5: G  */
+	3619, /* 6: G# */
+	3415, /* 7: A  */
+	3224, /* 8: A# */
+	3043, /* 9: B  */
+	2872, /* A: C  */
+	2711, /* B: C# */
+	2558  /* C: D  */
 };
 
+#define BUZZER_TASSEL TASSEL__SMCLK
+#endif
+
+#ifdef CONFIG_BUZZER_ACLK_DITHER
+/* TA1CCR0 and the fraction of a tick of the note playing, the half
+   periods are dithered between TA1CCR0 and TA1CCR0 + 1 */
+static uint16_t buzzer_ccr;
+static uint8_t buzzer_frac;
+static uint8_t buzzer_acc;
+#endif
+
+/* Melodies are played from the TA0CCR2 callback, one note per call.
+   Those waiting are kept by priority, first come first served within
+   one. A melody of higher priority cuts the one playing short. */
+#define BUZZER_QUEUE_LEN 4
+
+static struct {
+	const uint8_t *src;	/* note array or byte-code */
+	uint8_t prio;
+	uint8_t bytecode;
+} buzzer_queue[BUZZER_QUEUE_LEN];
+
+static uint8_t buzzer_queued;
+
+/* position in the melody playing, NULL while idle */
+static const uint8_t * volatile buzzer_pc;
+static uint8_t buzzer_prio;
+static uint8_t buzzer_bytecode;
+
+/* byte-code state: the first note, the repeat playing and the loop */
+static const uint8_t *buzzer_code;
+static const uint8_t *buzzer_end;
+static const uint8_t *buzzer_ret;
+static uint8_t buzzer_loop;
+
+uint8_t buzzer_last_event;
+
 inline void buzzer_init(void)
 {
-	/* Reset TA1R, TA1 runs from 32768Hz ACLK */
-	TA1CTL = TACLR | TASSEL__SMCLK | MC__STOP;
+	/* Reset TA1R, TA1 runs from SMCLK or the 32768Hz ACLK */
+	TA1CTL = TACLR | BUZZER_TASSEL | MC__STOP;
 
 	/* Enable IRQ, set output mode "toggle" */
 	TA1CCTL0 = OUTMOD_4;
 
-	/* Play "welcome" chord: A major */
-	note welcome[4] = {0x1901, 0x1904, 0x1908, 0x000F};
+	/* Play "welcome" chord: D# minor */
+	static note welcome[4] = {0x1911, 0x1914, 0x1918, 0x000F};
 	buzzer_play(welcome);
 }
 
@@ -69,35 +132,270 @@ inline void buzzer_stop(void)
 
 	/* Clear PWM timer interrupt */
 	TA1CCTL0 &= ~CCIE;
+
+	battery_load_stop(BATTERY_LOAD_BUZZER);
 }
 
-void buzzer_play(note *notes)
+static void buzzer_begin(const uint8_t *src, uint8_t prio, uint8_t bytecode)
 {
+	buzzer_prio = prio;
+	buzzer_bytecode = bytecode;
+
+	if (bytecode) {
+		src += BUZZER_DURATIONS;
+		buzzer_code = src;
+		buzzer_end = NULL;
+		buzzer_loop = 0;
+	}
+	buzzer_pc = src;
+
+	/* buzzer_tone() may have left TA1 running from ACLK */
+	TA1CTL = TACLR | BUZZER_TASSEL | MC__STOP;
+	TA1CCTL0 = OUTMOD_4;
 
 	/* Allow buzzer PWM output on P2.7 */
 	P2SEL |= BIT7;
 
-	/* 0x000F is the "stop bit" */
-	while (PITCH(*notes) != 0x000F) {
-		if (PITCH(*notes) == 0) {
-			/* Stop the timer! We are playing a rest */
-			TA1CTL &= ~MC_3;
+	battery_load_start(BATTERY_LOAD_BUZZER);
+}
+
+/* next note of byte-code, see buzzer.h */
+static note buzzer_decode(void)
+{
+	const uint8_t *pc = buzzer_pc;
+	uint8_t op, c;
+	note n;
+
+	while (1) {
+		if (pc == buzzer_end) {
+			pc = buzzer_ret;
+			buzzer_end = NULL;
+		}
+
+		op = *pc++;
+
+		if (op < 0xC0) {
+			/* the header sits right before the first note */
+			n = buzzer_code[(op >> 6) - BUZZER_DURATIONS] << 8;
+			c = op & 0x3f;
+			if (c != BUZZER_REST)
+				n |= ((c / 12) << 4) | (c % 12 + 1);
+			break;
+		}
+
+		if (op == BUZZER_OP_NOTE) {
+			n = pc[0] | (pc[1] << 8);
+			pc += 2;
+			break;
+		}
+
+		if (op == BUZZER_OP_LOOP) {
+			if (!buzzer_loop)
+				buzzer_loop = pc[0] + 1;
+			if (--buzzer_loop)
+				pc -= 1 + pc[1];
+			else
+				pc += 2;
+			continue;
+		}
+
+		if (op == BUZZER_OP_REPEAT) {
+			buzzer_ret = pc + 2;
+			buzzer_end = pc - 1 - pc[0] + pc[1];
+			pc -= 1 + pc[0];
+			continue;
+		}
+
+		/* BUZZER_OP_END or reserved, stay on it */
+		return 0x000F;
+	}
+
+	buzzer_pc = pc;
+	return n;
+}
+
+#ifdef CONFIG_BUZZER_ACLK
+/* A few ACLK ticks per half period leave the pitch up to half a tick off,
+   a semitone or more. Dithering gets it right on average, at the cost of
+   an interrupt per half period. Up mode stops at TA1CCR0 = 0, the highest
+   tone is 8192Hz: everything above B8 plays at that, contrib/rtttl2bin.py
+   warns about such melodies. */
+static void buzzer_pitch(note n)
+{
+	uint16_t q = base_notes[PITCH(n)] >> OCTAVE(n);
+
+#ifdef CONFIG_BUZZER_ACLK_DITHER
+	buzzer_ccr = (q >> 8) - 1;
+	buzzer_frac = q;
+	if (q < 0x200) {
+		buzzer_ccr = 1;
+		buzzer_frac = 0;
+	}
+
+	TA1CCR0 = buzzer_ccr;
+	if (buzzer_frac)
+		TA1CCTL0 |= CCIE;
+	else
+		TA1CCTL0 &= ~CCIE;
+#else
+	q = (q + 0x80) >> 8;
+	TA1CCR0 = (q < 2 ? 2 : q) - 1;
+#endif
+}
+#else
+static void buzzer_pitch(note n)
+{
+	TA1CCR0 = base_notes[PITCH(n)] >> OCTAVE(n);
+}
+#endif
+
+/* runs from the TA0CCR2 interrupt, or with interrupts disabled */
+static void buzzer_step(void)
+{
+	note n;
+	uint8_t i;
+
+	while (1) {
+		if (buzzer_bytecode) {
+			n = buzzer_decode();
 		} else {
-			/* Set PWM frequency */
-			TA1CCR0 = base_notes[PITCH(*notes)] >> OCTAVE(*notes);
+			n = *(const note *)buzzer_pc;
+			buzzer_pc += sizeof(note);
+		}
+
+		/* 0x000F is the "stop bit" */
+		if (PITCH(n) != 0x000F)
+			break;
 
-			/* Start the timer */
-			TA1CTL |= MC__UP;
+		buzzer_last_event = 1;
+		timer0_delay_callback_wake();
+
+		if (!buzzer_queued) {
+			buzzer_stop();
+			buzzer_pc = NULL;
+			return;
 		}
 
-		/* Delay for DURATION(*notes) milliseconds,
-		   use LPM1 because we need SMCLK for tone generation */
-		timer0_delay(DURATION(*notes), LPM1_bits);
+		buzzer_begin(buzzer_queue[0].src, buzzer_queue[0].prio,
+			     buzzer_queue[0].bytecode);
+		buzzer_queued--;
+		for (i = 0; i < buzzer_queued; i++)
+			buzzer_queue[i] = buzzer_queue[i + 1];
+	}
+
+	if (PITCH(n) == 0) {
+		/* Stop the timer! We are playing a rest */
+		TA1CTL &= ~MC_3;
+	} else {
+		/* Set PWM frequency */
+		buzzer_pitch(n);
 
-		/* Advance to the next note */
-		notes++;
+		/* Start the timer */
+		TA1CTL |= MC__UP;
 	}
 
-	/* Stop buzzer */
-	buzzer_stop();
+	/* Advance to the next note once this one has been played */
+	timer0_delay_callback(DURATION(n), &buzzer_step);
+}
+
+static uint8_t buzzer_enqueue_src(const uint8_t *src, uint8_t prio,
+				  uint8_t bytecode)
+{
+	uint16_t sr = __read_status_register();
+	uint8_t i, ok = 1;
+
+	__dint();
+
+	if (!buzzer_pc || prio > buzzer_prio) {
+		/* a melody cut short ends as well */
+		if (buzzer_pc)
+			buzzer_last_event = 1;
+
+		buzzer_begin(src, prio, bytecode);
+		buzzer_step();
+	} else {
+		/* behind those of the same or a higher priority, a full
+		   queue drops the last one if it is of a lower one */
+		i = buzzer_queued;
+		if (i == BUZZER_QUEUE_LEN) {
+			if (buzzer_queue[i - 1].prio >= prio)
+				ok = 0;
+			else
+				i--;
+		} else {
+			buzzer_queued++;
+		}
+
+		for (; ok && i > 0 && buzzer_queue[i - 1].prio < prio; i--)
+			buzzer_queue[i] = buzzer_queue[i - 1];
+
+		if (ok) {
+			buzzer_queue[i].src = src;
+			buzzer_queue[i].prio = prio;
+			buzzer_queue[i].bytecode = bytecode;
+		}
+	}
+
+	__write_status_register(sr);
+
+	return ok;
+}
+
+uint8_t buzzer_enqueue(note *notes, uint8_t prio)
+{
+	return buzzer_enqueue_src((const uint8_t *)notes, prio, 0);
+}
+
+uint8_t buzzer_enqueue_melody(const uint8_t *melody, uint8_t prio)
+{
+	return buzzer_enqueue_src(melody, prio, 1);
+}
+
+void buzzer_play(note *notes)
+{
+	buzzer_enqueue(notes, BUZZER_PRIO_NORMAL);
+}
+
+uint8_t buzzer_playing(void)
+{
+	return (buzzer_pc != NULL);
+}
+
+void buzzer_tone(uint16_t freq)
+{
+	/* a melody takes precedence */
+	if (buzzer_pc)
+		return;
+
+	if (!freq) {
+		buzzer_stop();
+		return;
+	}
+
+	/* ACLK keeps running in LPM3, the tone needs no CPU at all. Toggle
+	   mode halves the rate, so the period is 16384Hz / freq. A period
+	   below the count rolls the timer over to zero, no glitch. */
+	TA1CCR0 = 16384 / freq - 1;
+
+	if ((TA1CTL & (TASSEL_3 | MC_3)) != (TASSEL__ACLK | MC__UP)) {
+		TA1CTL = TACLR | TASSEL__ACLK | MC__STOP;
+		TA1CCTL0 = OUTMOD_4;
+		P2SEL |= BIT7;
+		TA1CTL |= MC__UP;
+		battery_load_start(BATTERY_LOAD_BUZZER);
+	}
+}
+
+#ifdef CONFIG_BUZZER_ACLK_DITHER
+/* interrupt vector for TA1CCR0, at the end of every half period */
+__attribute__((interrupt(TIMER1_A0_VECTOR)))
+void timer1_A0_ISR(void)
+{
+	/* one tick longer whenever the fraction carries over, up mode
+	   takes the new TA1CCR0 at once and TA1R has only just restarted */
+	uint8_t acc = buzzer_acc + buzzer_frac;
+
+	TA1CCR0 = buzzer_ccr + (acc < buzzer_acc);
+	buzzer_acc = acc;
 }
+#endif
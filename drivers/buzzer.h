@@ -28,15 +28,93 @@
  */
 typedef uint16_t note;
 
+/*!
+ * \brief Melody byte-code.
+ * \details Compiled from RTTTL by contrib/rtttl2bin.py, the melodies
+ * in melodies/ end up in modules/melodies.h. A header of
+ * #BUZZER_DURATIONS note lengths in units of 4ms, the most common one
+ * first, is followed by:
+ * - 0x00-0xBF: a note, the length index in bits 7-6 and
+ *   octave * 12 + pitch - 1 in bits 5-0, #BUZZER_REST for a rest.
+ * - #BUZZER_OP_REPEAT back len: play the len bytes starting back bytes
+ *   before the opcode once more.
+ * - #BUZZER_OP_LOOP count len: play the len bytes before the opcode
+ *   count more times.
+ * - #BUZZER_OP_NOTE lo hi: a #note of any length.
+ * - #BUZZER_OP_END.
+ *
+ * Repeated and looped bytes hold notes only, they do not nest.
+ */
+#define BUZZER_DURATIONS	3
+#define BUZZER_REST		48
+#define BUZZER_OP_REPEAT	0xFC
+#define BUZZER_OP_LOOP		0xFD
+#define BUZZER_OP_NOTE		0xFE
+#define BUZZER_OP_END		0xFF
+
 /*!
  * \brief Initialize buzzer subsystem.
  */
 void buzzer_init(void);
 
+/*!
+ * \brief Melody priorities, a higher one cuts a lower one short.
+ */
+enum buzzer_prio {
+	BUZZER_PRIO_CLICK = 0,	/*!< key clicks and other feedback */
+	BUZZER_PRIO_NORMAL,	/*!< melodies played on request */
+	BUZZER_PRIO_ALARM,	/*!< alarms and timers */
+};
+
+/*!
+ * \brief Queue a sequence of notes.
+ * \details Returns right away, the notes are played from the timer
+ * interrupt and must stay in memory until then. A melody of a higher
+ * priority than the one playing replaces it, otherwise it waits behind
+ * those of the same or a higher priority. SYS_MSG_BUZZER is sent when
+ * a melody ends. Can be called from interrupt context.
+ * \param notes An array of notes to play.
+ * \param prio One of #buzzer_prio.
+ * \return 0 if the queue was full.
+ */
+uint8_t buzzer_enqueue(note *notes, uint8_t prio);
+
+/*!
+ * \brief Queue a byte-code melody, see buzzer_enqueue().
+ * \details It is decoded while it plays and may stay in flash.
+ * \param melody Byte-code as described above.
+ * \param prio One of #buzzer_prio.
+ * \return 0 if the queue was full.
+ */
+uint8_t buzzer_enqueue_melody(const uint8_t *melody, uint8_t prio);
+
 /*!
  * \brief Play a sequence of notes using the buzzer.
+ * \details Same as buzzer_enqueue() with #BUZZER_PRIO_NORMAL.
  * \param notes An array of notes to play.
  */
 void buzzer_play(note *notes);
 
+/*!
+ * \brief Returns non-zero while a melody is playing.
+ * \details Tones need SMCLK, the main loop sleeps in LPM1 meanwhile,
+ * unless CONFIG_BUZZER_ACLK plays them from ACLK in LPM3.
+ */
+uint8_t buzzer_playing(void);
+
+/*!
+ * \brief Set when a melody has ended, becomes SYS_MSG_BUZZER.
+ */
+extern uint8_t buzzer_last_event;
+
+/*!
+ * \brief Start, change or stop a continuous tone.
+ * \details Returns right away, the tone runs from ACLK and keeps
+ * playing in LPM3 until changed or stopped. It can be called from
+ * interrupt context, e.g. to key beeps from a timer callback. While
+ * a melody plays the call is ignored.
+ * \param freq Frequency in Hz between 64 and 8192, 0 stops the tone.
+ */
+void buzzer_tone(uint16_t freq);
+
 #endif /*BUZZER_H_*/
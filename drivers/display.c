@@ -673,6 +673,20 @@ void display_chars(uint8_t scr_nr,
 	}
 }
 
+// *************************************************************************************************
+// @fn          lcd_power
+// @brief       Switch the LCD_B controller on or off, display memory is kept.
+// @param       on	0 to blank the display
+// @return      none
+// *************************************************************************************************
+void lcd_power(uint8_t on)
+{
+	if (on)
+		LCDBCTL0 |= LCDON;
+	else
+		LCDBCTL0 &= ~LCDON;
+}
+
 // *************************************************************************************************
 // @fn          start_blink
 // @brief       Start blinking.
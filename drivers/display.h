@@ -194,6 +194,7 @@ void lcd_screen_activate(
 uint8_t lcd_screen_currentscreen(void);
 
 /* Not to be used by modules */
+void lcd_power(uint8_t on);
 void start_blink(void);
 void stop_blink(void);
 void clear_blink_mem(void);
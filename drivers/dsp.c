@@ -46,3 +46,30 @@ int16_t mult_scale15(int16_t a, int16_t b)
 	ff <<= 1;
 	return (int16_t)((ff + HALF) >> 16);
 }
+
+// *************************************************************************************************
+// @fn          isqrt32
+// @brief       Integer square root, bit by bit (16 iterations, no multiplies)
+// @param       x radicand
+// @return      floor(sqrt(x))
+// *************************************************************************************************
+uint16_t isqrt32(uint32_t x)
+{
+	uint32_t res = 0;
+	uint32_t bit = (uint32_t)1 << 30;
+
+	while (bit > x)
+		bit >>= 2;
+
+	while (bit) {
+		if (x >= res + bit) {
+			x -= res + bit;
+			res = (res >> 1) + bit;
+		} else {
+			res >>= 1;
+		}
+		bit >>= 2;
+	}
+
+	return (uint16_t)res;
+}
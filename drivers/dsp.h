@@ -16,5 +16,6 @@
 // Prototypes section
 extern int16_t mult_scale16(int16_t a, int16_t b); // returns (int16_t)((int32_t)a*b + 0x8000) >> 16
 extern int16_t mult_scale15(int16_t a, int16_t b); // returns (int16_t)(((int32_t)a*b << 1) + 0x8000) >> 16
+extern uint16_t isqrt32(uint32_t x); // returns floor(sqrt(x))
 
 #endif /*DSP_H_*/
@@ -0,0 +1,96 @@
+/*
+    drivers/flash.c: main flash erase/program helpers
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <openchronos.h>
+
+#include "flash.h"
+
+#define flash_waitbusy() \
+	while (FCTL3 & BUSY)
+
+/* the information memory is locked by LOCKINFO as well */
+static uint8_t flash_is_info(const volatile void *addr)
+{
+	return ((uint16_t)addr >= FLASH_INFO_START
+		&& (uint16_t)addr < FLASH_INFO_END);
+}
+
+static void flash_unlock(const volatile void *addr)
+{
+#ifdef USE_WATCHDOG
+	/* hold watch dog timer */
+	WDTCTL = (WDTCTL & 0xff) | WDTPW | WDTHOLD;
+#endif
+
+	flash_waitbusy();
+
+	/* remove LOCK bit, LOCKA stays set and keeps segment A out */
+	FCTL3 = FWKEY;
+
+	/* remove LOCKINFO bit */
+	if (flash_is_info(addr))
+		FCTL4 = FWKEY;
+}
+
+static void flash_lock(void)
+{
+	/* leave write/erase mode */
+	FCTL1 = FWKEY;
+
+	/* set LOCKINFO bit */
+	FCTL4 = FWKEY | (FCTL4 & 0xff) | LOCKINFO;
+
+	/* set LOCK bit */
+	FCTL3 = FWKEY | (FCTL3 & 0xff) | LOCK;
+
+#ifdef USE_WATCHDOG
+	/* restart and reset watchdog timer */
+	WDTCTL = (WDTCTL & 0xff & ~WDTHOLD) | WDTPW | WDTCNTCL;
+#endif
+}
+
+void flash_erase_segment(const volatile void *addr)
+{
+	uint16_t size = flash_is_info(addr) ?
+			FLASH_INFO_SEGMENT_SIZE : FLASH_SEGMENT_SIZE;
+	volatile uint16_t *seg = (volatile uint16_t *)((uint16_t)addr & ~(size - 1));
+
+	flash_unlock(addr);
+
+	/* a dummy write starts the erase */
+	FCTL1 = FWKEY | ERASE;
+	*seg = 0;
+	flash_waitbusy();
+
+	flash_lock();
+}
+
+void flash_write(const volatile void *dst, const void *src, uint16_t count)
+{
+	volatile uint8_t *d = (volatile uint8_t *)dst;
+	const uint8_t *s = (const uint8_t *)src;
+
+	flash_unlock(dst);
+
+	FCTL1 = FWKEY | WRT;
+	while (count--) {
+		*d++ = *s++;
+		flash_waitbusy();
+	}
+
+	flash_lock();
+}
@@ -0,0 +1,74 @@
+/*
+    drivers/flash.h: main flash erase/program helpers
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __FLASH_H__
+#define __FLASH_H__
+
+/*!
+	\brief Size of a main flash segment, the smallest erasable unit.
+*/
+#ifndef FLASH_SEGMENT_SIZE
+#define FLASH_SEGMENT_SIZE 512
+#endif
+
+/*!
+	\brief Information memory, segments D to A of 128 bytes.
+	\details The helpers below work on segments D to B as well, segment A holds calibration data and stays locked.
+*/
+#define FLASH_INFO_START 0x1800
+#define FLASH_INFO_END 0x1A00
+#define FLASH_INFO_SEGMENT_SIZE 128
+
+/*!
+	\brief Reserves \b size bytes of erased main flash for a module.
+	\details The region is aligned to a segment, so \b size should be a multiple of #FLASH_SEGMENT_SIZE. It is a plain const array in the .rodata.flashlog section, which the linker script places in main flash with the rest of .rodata; a volatile object would go to .data, that is RAM. Read it through #FLASH_PTR() so the compiler does not fold reads into the 0xff initializer. Example:<br />
+	static FLASH_REGION(mylog_flash, 2 * FLASH_SEGMENT_SIZE);<br />
+	static const volatile uint8_t *const mylog = FLASH_PTR(mylog_flash);
+	\note The host tests bring their own writable one, see contrib/hosttest/include/flash_model.h.
+*/
+#ifndef FLASH_REGION
+#define FLASH_REGION(name, size) \
+	const uint8_t name[size] \
+		__attribute__((section(".rodata.flashlog"), \
+			       aligned(FLASH_SEGMENT_SIZE))) \
+		= { [0 ... (size) - 1] = 0xff }
+#endif
+
+/*!
+	\brief The contents of a #FLASH_REGION(), as the flash controller changes them.
+*/
+#define FLASH_PTR(name) ((const volatile uint8_t *)(name))
+
+/*!
+	\brief Erases the main or information flash segment containing \b addr.
+	\note The CPU is halted for the duration of the erase (~25ms), the watchdog is held meanwhile.
+*/
+void flash_erase_segment(
+	const volatile void *addr /*!< any address inside the segment */
+);
+
+/*!
+	\brief Programs \b count bytes at \b dst.
+	\details Flash can only turn bits from 1 to 0, the destination has to be erased or the data has to be a bitwise subset of the current content.
+*/
+void flash_write(
+	const volatile void *dst, /*!< destination in flash */
+	const void *src,   /*!< source data in RAM */
+	uint16_t count     /*!< number of bytes */
+);
+
+#endif /* __FLASH_H__ */
@@ -10,409 +10,1037 @@
 #ifdef CONFIG_INFOMEM
 
 #include "infomem.h"
+#include "flash.h"
 
-struct infomem sInfomem;
+#ifndef CONFIG_INFOMEM_MAIN_SEGMENTS
+#define CONFIG_INFOMEM_MAIN_SEGMENTS 0
+#endif
+
+//information memory D to B, segment A holds calibration data
+#ifndef INFOMEM_LOG_START
+#define INFOMEM_LOG_START INFOMEM_D
+#define INFOMEM_LOG_END INFOMEM_A
+#endif
+#define INFOMEM_SEGMENTS_MAX ((INFOMEM_LOG_END - INFOMEM_LOG_START) / INFOMEM_SEGMENT_SIZE + CONFIG_INFOMEM_MAIN_SEGMENTS)
+
+//segment header: identifier and sequence number
+#define INFOMEM_SEG_HEADER 2
+
+//record: app id and chunk, word count of the chunk and mask of the words carried, payload
+//and CRC16. A full record carries the whole chunk and leaves the mask erased, as records
+//did before deltas, a delta only the words that changed.
+#define INFOMEM_REC_HEADER 2
+#define INFOMEM_REC_WORDS(count) (INFOMEM_REC_HEADER + (count) + 1)
+#define INFOMEM_REC_APP(rec) (((uint8_t *)(rec))[0])
+#define INFOMEM_REC_CHUNK(rec) (((uint8_t *)(rec))[1])
+#define INFOMEM_REC_COUNT(rec) (((uint8_t *)(rec))[2])
+#define INFOMEM_REC_MASK(rec) (((uint8_t *)(rec))[3])
+#define INFOMEM_REC_FULL 0xFF
+
+#define INFOMEM_CHUNKS(words) (((words) + INFOMEM_CHUNK_WORDS - 1) / INFOMEM_CHUNK_WORDS)
+
+struct infomem_segment {
+	uint16_t *start;	//segment header
+	uint16_t *end;		//first word after the segment
+	uint16_t *head;		//first erased word, NULL while the segment is free
+	uint16_t seq;		//sequence number, the newest segment has the highest
+};
+
+//newest record of a chunk, also of deleted ones until their segment is collected, and the
+//full record its deltas apply to, in the same segment
+struct infomem_index {
+	uint8_t app;
+	uint8_t chunk;
+	uint16_t *rec;
+	uint16_t *base;
+};
+
+static struct {
+	struct infomem_segment seg[INFOMEM_SEGMENTS_MAX];
+	struct infomem_index index[INFOMEM_INDEX_SIZE];
+	//records written by the applications and not yet appended, the CRC is added then
+	uint16_t cache[INFOMEM_CACHE_SIZE][INFOMEM_REC_WORDS(INFOMEM_CHUNK_WORDS)];
+	uint8_t cached;		//bit mask of the cache slots in use
+	uint8_t entries;
+	uint8_t head;		//segment records are appended to
+	uint16_t live;		//words of indexed records
+	uint16_t capacity;	//words of records the segments can hold
+	uint8_t collecting;
+	volatile uint8_t not_lock;  //memory is not locked for write
+	uint8_t sane;  //sanity check passed
+} sInfomem;
+
+#if CONFIG_INFOMEM_MAIN_SEGMENTS > 0
+static FLASH_REGION(infomem_main, CONFIG_INFOMEM_MAIN_SEGMENTS * FLASH_SEGMENT_SIZE);
+#endif
+
+// *************************************************************************************************
+// @fn          infomem_setup
+// @brief       fill in the segment table and the capacity
+//				FOR INTERNAL USE ONLY
+// @param       none
+// @return      none
+// *************************************************************************************************
+static void infomem_setup(void)
+{
+	struct infomem_segment *s = sInfomem.seg;
+	uint16_t addr;
+	uint16_t largest = 0;
 
-void infomem_write_flash_segment(uint16_t *start, uint16_t *data, uint8_t erase);
-void infomem_insert_delete_modify(uint16_t *start, uint16_t *data, uint8_t del_count, uint8_t ins_count, uint16_t **mod_addr, uint16_t *mod_data, uint8_t mod_count, uint16_t *free_start, uint16_t *free_stop);
-void infomem_write_data(uint16_t *start, uint16_t *data, uint8_t count);
-uint16_t *infomem_get_app_addr(uint8_t identifier);
+	sInfomem.capacity = 0;
 
-#define infomem_waitbusy() \
-	while(1) \
-	{ \
-		if(!(FCTL3 & BUSY)) \
-			break; \
+	for (addr = INFOMEM_LOG_START; addr < INFOMEM_LOG_END; addr += INFOMEM_SEGMENT_SIZE, s++) {
+		s->start = (uint16_t *)addr;
+		s->end = (uint16_t *)(addr + INFOMEM_SEGMENT_SIZE);
 	}
 
-// write one complete flash segment
-//        FOR INTERNAL USE ONLY
-//
-// erases segment when needed. Only writes to a long word if data has changed
-//data has size of at least 128 Byte
-//erase 0: do not erase; 1: test if need to erase; 2: erase without test
-void infomem_write_flash_segment(uint16_t *start, uint16_t *data, uint8_t erase)
+#if CONFIG_INFOMEM_MAIN_SEGMENTS > 0
+	for (addr = 0; addr < CONFIG_INFOMEM_MAIN_SEGMENTS; addr++, s++) {
+		s->start = (uint16_t *)&infomem_main[addr * FLASH_SEGMENT_SIZE];
+		s->end = s->start + FLASH_SEGMENT_SIZE / 2;
+	}
+#endif
+
+	//the records of the oldest segment have to fit elsewhere to collect it, the end of a
+	//segment may be too short for the next record and the old version of a chunk stays
+	//until the new one is written
+	for (s = sInfomem.seg; s < sInfomem.seg + INFOMEM_SEGMENTS_MAX; s++) {
+		addr = s->end - s->start - INFOMEM_SEG_HEADER - (INFOMEM_REC_WORDS(INFOMEM_CHUNK_WORDS) - 1);
+		sInfomem.capacity += addr;
+		if (addr > largest) {
+			largest = addr;
+		}
+	}
+	sInfomem.capacity -= largest + INFOMEM_REC_WORDS(INFOMEM_CHUNK_WORDS);
+}
+
+// *************************************************************************************************
+// @fn          infomem_crc
+// @brief       CRC16 of a record, computed by the CRC module
+//				FOR INTERNAL USE ONLY
+// @param       uint16_t* rec		record header
+//				uint8_t count		payload words
+// @return      CRC16-CCITT of header and payload
+// *************************************************************************************************
+static uint16_t infomem_crc(const uint16_t *rec, uint8_t count)
 {
-	int i;
+	uint8_t i;
 
-	//check if we need to erase
-	if (erase == 1) {
-		for (i = 0; i < INFOMEM_SEGMENT_WORDS; i++) {
-			//we have to erase if the new data has bits 1 that are 0 already
-			if ((start[i] | data[i]) != start[i]) {
-				erase = 2;
-				break;
-			}
+	CRCINIRES = 0xFFFF;
+	for (i = 0; i < INFOMEM_REC_HEADER + count; i++) {
+		CRCDI = rec[i];
+	}
+
+	return CRCINIRES;
+}
+
+// *************************************************************************************************
+// @fn          infomem_payload
+// @brief       payload words of a record
+//				FOR INTERNAL USE ONLY
+// @param       uint16_t* rec		record header
+// @return      words
+// *************************************************************************************************
+static uint8_t infomem_payload(const uint16_t *rec)
+{
+	uint8_t mask = INFOMEM_REC_MASK(rec);
+	uint8_t words = 0;
+
+	if (mask == INFOMEM_REC_FULL) {
+		return INFOMEM_REC_COUNT(rec);
+	}
+
+	for (; mask; mask >>= 1) {
+		words += mask & 1;
+	}
+
+	return words;
+}
+
+// *************************************************************************************************
+// @fn          infomem_find
+// @brief       look up the newest record of a chunk
+//				FOR INTERNAL USE ONLY
+// @param       uint8_t identifier	Identifier byte for application
+//				uint8_t chunk		chunk number
+// @return      NULL chunk never written
+//				index entry
+// *************************************************************************************************
+static struct infomem_index *infomem_find(uint8_t identifier, uint8_t chunk)
+{
+	struct infomem_index *e;
+
+	for (e = sInfomem.index; e < sInfomem.index + sInfomem.entries; e++) {
+		if (e->app == identifier && e->chunk == chunk) {
+			return e;
 		}
 	}
 
-#ifdef USE_WATCHDOG
-	//hold watch dog timer
-	WDTCTL = (WDTCTL & 0xff) | WDTPW | WDTHOLD;
-#endif
+	return NULL;
+}
 
-	infomem_waitbusy()
+// *************************************************************************************************
+// @fn          infomem_index_set
+// @brief       point the index to a record, newer than the one indexed for its chunk, the live
+//				words count the chunk as one full record
+//				FOR INTERNAL USE ONLY
+// @param       uint16_t* rec		record in flash
+// @return      0 index full
+//				1 done
+// *************************************************************************************************
+static uint8_t infomem_index_set(uint16_t *rec)
+{
+	struct infomem_index *e = infomem_find(INFOMEM_REC_APP(rec), INFOMEM_REC_CHUNK(rec));
 
-	//remove LOCK and LOCKA bit if needed (LOCKA is toggled if it is written as 1)
-	if (start == (uint16_t *)INFOMEM_A && (FCTL3 & LOCKA)) {
-		FCTL3 = FWKEY | LOCKA;
+	//a delta without the version it applies to
+	if (INFOMEM_REC_MASK(rec) != INFOMEM_REC_FULL
+	    && (e == NULL || INFOMEM_REC_COUNT(e->rec) != INFOMEM_REC_COUNT(rec))) {
+		return 1;
+	}
+
+	if (e != NULL) {
+		sInfomem.live -= INFOMEM_REC_WORDS(INFOMEM_REC_COUNT(e->rec));
 	} else {
-		FCTL3 = FWKEY;
+		if (sInfomem.entries == INFOMEM_INDEX_SIZE) {
+			return 0;
+		}
+
+		e = &sInfomem.index[sInfomem.entries++];
+		e->app = INFOMEM_REC_APP(rec);
+		e->chunk = INFOMEM_REC_CHUNK(rec);
 	}
 
-	//remove LOCKINFO bit
-	FCTL4 = FWKEY ;
+	e->rec = rec;
+	if (INFOMEM_REC_MASK(rec) == INFOMEM_REC_FULL) {
+		e->base = rec;
+	}
+	sInfomem.live += INFOMEM_REC_WORDS(INFOMEM_REC_COUNT(rec));
+	return 1;
+}
+
+// *************************************************************************************************
+// @fn          infomem_cached
+// @brief       look up the cache slot of a chunk
+//				FOR INTERNAL USE ONLY
+// @param       uint8_t identifier	Identifier byte for application
+//				uint8_t chunk		chunk number
+// @return      INFOMEM_CACHE_SIZE chunk not cached
+//				slot
+// *************************************************************************************************
+static uint8_t infomem_cached(uint8_t identifier, uint8_t chunk)
+{
+	uint8_t i;
 
-	if (erase == 2) {
-		FCTL1 = FWKEY | ERASE;
-		*start = 0;
-		infomem_waitbusy()
+	for (i = 0; i < INFOMEM_CACHE_SIZE; i++) {
+		if ((sInfomem.cached & (1 << i))
+		    && sInfomem.cache[i][0] == (identifier | ((uint16_t)chunk << 8))) {
+			break;
+		}
 	}
 
-	//set long-word write mode
-	FCTL1 = FWKEY | BLKWRT;
+	return i;
+}
 
-	//write long words if the new data is different from the old
-	for (i = 0; i < INFOMEM_SEGMENT_WORDS; i += 2) {
-		if (start[i] != data[i] || start[i + 1] != data[i + 1]) {
-			start[i  ] = data[i  ];
-			start[i + 1] = data[i + 1];
-			infomem_waitbusy()
+// *************************************************************************************************
+// @fn          infomem_load
+// @brief       the newest version of a chunk in the log as a full record: its base with the
+//				deltas after it applied, which follow it in the same segment
+//				FOR INTERNAL USE ONLY
+// @param       struct infomem_index* e	index entry of the chunk
+//				uint16_t* buf		room for a full record, used if there are deltas
+// @return      full record, without CRC if it was put together in buf
+// *************************************************************************************************
+static const uint16_t *infomem_load(const struct infomem_index *e, uint16_t *buf)
+{
+	const uint16_t *rec = e->base;
+	uint8_t n = INFOMEM_REC_COUNT(rec);
+	uint8_t i, k, words;
+
+	if (e->rec == e->base) {
+		return e->base;
+	}
+
+	for (i = 0; i < INFOMEM_REC_HEADER + n; i++) {
+		buf[i] = rec[i];
+	}
+
+	//step over the records as infomem_scan did, it found e->rec this way
+	rec += INFOMEM_REC_WORDS(n);
+	while (rec <= e->rec) {
+		if (INFOMEM_REC_COUNT(rec) > INFOMEM_CHUNK_WORDS) {
+			rec += INFOMEM_REC_HEADER;
+			continue;
+		}
+
+		words = infomem_payload(rec);
+		if (rec[0] == buf[0] && INFOMEM_REC_MASK(rec) != INFOMEM_REC_FULL && INFOMEM_REC_COUNT(rec) == n
+		    && rec[INFOMEM_REC_HEADER + words] == infomem_crc(rec, words)) {
+			for (i = 0, k = 0; i < n; i++) {
+				if (INFOMEM_REC_MASK(rec) & (1 << i)) {
+					buf[INFOMEM_REC_HEADER + i] = rec[INFOMEM_REC_HEADER + k++];
+				}
+			}
 		}
+
+		rec += INFOMEM_REC_WORDS(words);
 	}
 
-	//leave write mode
-	FCTL1 = FWKEY;
-	//set LOCKINFO bit
-	FCTL4 = FWKEY | (FCTL4 & 0xff) | LOCKINFO;
+	return buf;
+}
 
-	//set LOCK bit
-	FCTL3 = FWKEY | (FCTL3 & 0xff) | LOCK;
+// *************************************************************************************************
+// @fn          infomem_newest
+// @brief       look up the newest version of a chunk, in the cache or in the log
+//				FOR INTERNAL USE ONLY
+// @param       uint8_t identifier	Identifier byte for application
+//				uint8_t chunk		chunk number
+//				uint16_t* buf		room for a full record, NULL if only the word count is of
+//									interest
+// @return      NULL chunk never written
+//				record
+// *************************************************************************************************
+static const uint16_t *infomem_newest(uint8_t identifier, uint8_t chunk, uint16_t *buf)
+{
+	struct infomem_index *e;
+	uint8_t i = infomem_cached(identifier, chunk);
 
-#ifdef USE_WATCHDOG
-	//restart and reset watchdog timer
-	WDTCTL = (WDTCTL & 0xff & ~WDTHOLD) | WDTPW | WDTCNTCL;
-#endif
+	if (i < INFOMEM_CACHE_SIZE) {
+		return sInfomem.cache[i];
+	}
+
+	e = infomem_find(identifier, chunk);
+	if (e == NULL) {
+		return NULL;
+	}
+
+	return buf ? infomem_load(e, buf) : e->rec;
 }
 
+// *************************************************************************************************
+// @fn          infomem_growth
+// @brief       words the log takes more once a record replaces the indexed version of its chunk,
+//				a shrinking record frees nothing before it is written
+//				FOR INTERNAL USE ONLY
+// @param       struct infomem_index* e	index entry of the chunk or NULL
+//				uint8_t count		payload words of the new record
+// @return      words
+// *************************************************************************************************
+static int16_t infomem_growth(struct infomem_index *e, uint8_t count)
+{
+	int16_t grow;
+
+	//a chunk deleted before it was ever written back
+	if (e == NULL && count == 0) {
+		return 0;
+	}
 
-//write count words at address start
-void infomem_write_data(uint16_t *start, uint16_t *data, uint8_t count)
+	grow = INFOMEM_REC_WORDS(count) - (e ? INFOMEM_REC_WORDS(INFOMEM_REC_COUNT(e->rec)) : 0);
+	return grow > 0 ? grow : 0;
+}
+
+// *************************************************************************************************
+// @fn          infomem_pending
+// @brief       sum up what writing back the cache takes
+//				FOR INTERNAL USE ONLY
+// @param       uint8_t* entries	incremented by the index entries needed
+// @return      words the log grows by
+// *************************************************************************************************
+static int16_t infomem_pending(uint8_t *entries)
 {
-	infomem_insert_delete_modify(start, data, count, count, NULL, NULL, 0, sInfomem.startaddr + 3 + sInfomem.size, sInfomem.startaddr + 3 + sInfomem.maxsize);
+	struct infomem_index *e;
+	int16_t grow = 0;
+	uint8_t i;
+
+	for (i = 0; i < INFOMEM_CACHE_SIZE; i++) {
+		if (sInfomem.cached & (1 << i)) {
+			e = infomem_find(INFOMEM_REC_APP(sInfomem.cache[i]), INFOMEM_REC_CHUNK(sInfomem.cache[i]));
+			if (e == NULL) {
+				(*entries)++;
+			}
+			grow += infomem_growth(e, INFOMEM_REC_COUNT(sInfomem.cache[i]));
+		}
+	}
+
+	return grow;
 }
 
-// function to do nearly anything with memory
-//
-//        FOR INTERNAL USE ONLY
-//
-// mod_addr[n] < mod_addr[n+1]
-// the mod always precedes data (data is not read in that case and can point to invalid memory location)
-// mod_addr<free_start+ins_count-del_count
-// when data is NULL and ins_count>0, INFOMEM_ERASED_WORD will be inserted instead
-// memory right of free_stop is never changed
-// free_start is the first address after the meaningful data (BEFORE any insert or delete)
-// mod_addr are addresses AFTER the insert/delete
-void infomem_insert_delete_modify(uint16_t *start, uint16_t *data, uint8_t del_count, uint8_t ins_count, uint16_t **mod_addr, uint16_t *mod_data, uint8_t mod_count, uint16_t *free_start, uint16_t *free_stop)
+// *************************************************************************************************
+// @fn          infomem_scan
+// @brief       index the records of a segment, older segments have to be scanned first
+//				FOR INTERNAL USE ONLY
+// @param       struct infomem_segment* s	segment in use
+// @return      0 index full
+//				1 done
+// *************************************************************************************************
+static uint8_t infomem_scan(struct infomem_segment *s)
 {
-	int i;
-	uint8_t next_mod;
-	int more = ins_count - del_count;
+	uint16_t *rec = s->start + INFOMEM_SEG_HEADER;
+	uint8_t count;
+
+	while (rec < s->end && *rec != INFOMEM_ERASED_WORD) {
+		count = INFOMEM_REC_COUNT(rec);
+
+		//A record cut short by a power failure. Flash is programmed byte by byte and
+		//a byte cut short has more bits set, so it ends within the word count and mask
+		//read, nothing beyond the header was written without them.
+		if (count > INFOMEM_CHUNK_WORDS) {
+			rec += INFOMEM_REC_HEADER;
+			continue;
+		}
+		count = infomem_payload(rec);
+		if (rec + INFOMEM_REC_WORDS(count) > s->end) {
+			rec = s->end;
+			break;
+		}
 
-	//beginning of segment that is the first (address wise) to be modified
-	uint16_t *segment_first;
-	//beginning of the segment that is the last (address wise) to be modified
-	uint16_t *segment_last;
+		if (rec[INFOMEM_REC_HEADER + count] == infomem_crc(rec, count) && !infomem_index_set(rec)) {
+			return 0;
+		}
 
-	//find first modified flash segment
-	if ((mod_count > 0) && (mod_addr[0] < start)) {
-		segment_first = (uint16_t *)((uint16_t) mod_addr[0] & ~(INFOMEM_SEGMENT_SIZE - 1));
-	} else {
-		segment_first = (uint16_t *)((uint16_t) start & ~(INFOMEM_SEGMENT_SIZE - 1));
+		rec += INFOMEM_REC_WORDS(count);
 	}
 
-	//find last modified flash segment
-	if (more == 0) {
-		if ((mod_count > 0) && (mod_addr[mod_count - 1] >= start + ins_count)) {
-			segment_last = (uint16_t *)((uint16_t) mod_addr[mod_count - 1] & ~(INFOMEM_SEGMENT_SIZE - 1));
-		} else {
-			segment_last = (uint16_t *)((uint16_t)(start + ins_count - 1) & ~(INFOMEM_SEGMENT_SIZE - 1));
+	s->head = rec < s->end ? rec : s->end;
+	return 1;
+}
+
+// *************************************************************************************************
+// @fn          infomem_open
+// @brief       start appending to a free segment
+//				FOR INTERNAL USE ONLY
+// @param       uint8_t i			free segment
+// @return      none
+// *************************************************************************************************
+static void infomem_open(uint8_t i)
+{
+	struct infomem_segment *s = &sInfomem.seg[i];
+	uint16_t header[INFOMEM_SEG_HEADER] = {INFOMEM_IDENTIFIER, sInfomem.seg[sInfomem.head].seq + 1};
+	uint16_t *addr;
+
+	//a torn erase or header leaves the segment neither in use nor blank
+	for (addr = s->start; addr < s->end; addr++) {
+		if (*addr != INFOMEM_ERASED_WORD) {
+			flash_erase_segment(s->start);
+			break;
 		}
-	} else if (more > 0) {
-		segment_last = (uint16_t *)((uint16_t)(free_start + more - 1) & ~(INFOMEM_SEGMENT_SIZE - 1));
-	} else { //more<0
-		segment_last = (uint16_t *)((uint16_t)(free_start - 1) & ~(INFOMEM_SEGMENT_SIZE - 1));
 	}
 
-	//we need buffer memory to store a flash page while it is erased and rewritten
-	uint16_t buf[INFOMEM_SEGMENT_WORDS];
+	//the identifier goes last, a segment is part of the log only with a complete sequence number
+	flash_write(&s->start[1], &header[1], sizeof(header[1]));
+	flash_write(s->start, &header[0], sizeof(header[0]));
 
-	//position of the newly to insert data relative to the beginning of the segment
-	int data_offset;
+	s->seq = header[1];
+	s->head = s->start + INFOMEM_SEG_HEADER;
+	sInfomem.head = i;
+}
 
-	//we insert data, so start with the last segment and make your way to the beginning
-	if (more > 0) {
-		//start with the last mod
-		next_mod = mod_count;
+// *************************************************************************************************
+// @fn          infomem_retire
+// @brief       erase a segment, its identifier is cleared first so that a torn erase does not
+//				bring back old records
+//				FOR INTERNAL USE ONLY
+// @param       struct infomem_segment* s	segment in use
+// @return      none
+// *************************************************************************************************
+static void infomem_retire(struct infomem_segment *s)
+{
+	uint16_t zero = 0;
 
-		//while we have not processed all modified flash segments
-		while (segment_first <= segment_last) {
-			data_offset = ((uint16_t)start - (uint16_t)segment_last) / 2;
+	flash_write(s->start, &zero, sizeof(zero));
+	flash_erase_segment(s->start);
+	s->head = NULL;
+}
 
-			for (i = INFOMEM_SEGMENT_WORDS - 1; i >= 0; i--) {
-				//data we need to preserve
-				if ((segment_last + i) >= free_stop) {
-					buf[i] = segment_last[i];
-				}
-				//data to change with single modify
-				else if (next_mod != 0 && (segment_last + i) == mod_addr[next_mod - 1]) {
-					buf[i] = mod_data[next_mod - 1];
-					next_mod --;
-				}
-				//data we do not care about (leave erased)
-				else if ((segment_last + i) >= (free_start + more)) {
-					buf[i] = INFOMEM_ERASED_WORD;
-				}
-				//data not to change
-				else if ((segment_last + i) < start) {
-					buf[i] = segment_last[i];
-				}
-				//data following the data we insert
-				else if ((segment_last + i) >= (start + ins_count)) {
-					buf[i] = segment_last[i - more];
-				}
-				//data to insert
-				else { // if( (segment_last+i) >= start &&  (segment_last+i) < (start+ins_count) )
-					if (data == NULL) {
-						buf[i] = INFOMEM_ERASED_WORD;
-					} else {
-						buf[i] = data[i - data_offset];
-					}
-				}
-			}
+static uint16_t *infomem_append(const uint16_t *rec, uint8_t words);
 
-			//write buffer to flash
-			infomem_write_flash_segment(segment_last, buf, 1);
-			//we have processed the last segment, process the next in the next loop run
-			segment_last -= INFOMEM_SEGMENT_WORDS;
+// *************************************************************************************************
+// @fn          infomem_live_words
+// @brief       words of the records in a segment the index still points to
+//				FOR INTERNAL USE ONLY
+// @param       struct infomem_segment* s	segment in use
+//				uint8_t oldest		records of deleted chunks are dropped
+// @return      words to copy when the segment is collected
+// *************************************************************************************************
+static uint16_t infomem_live_words(struct infomem_segment *s, uint8_t oldest)
+{
+	struct infomem_index *e;
+	uint16_t words = 0;
+
+	for (e = sInfomem.index; e < sInfomem.index + sInfomem.entries; e++) {
+		if (e->rec >= s->start && e->rec < s->end && !(oldest && INFOMEM_REC_COUNT(e->rec) == 0)) {
+			words += INFOMEM_REC_WORDS(INFOMEM_REC_COUNT(e->rec));
 		}
 	}
-	//start with the first segment
-	else { //if more<0
-		//start with the first mod
-		next_mod = 0;
 
-		while (segment_first <= segment_last) {
-			data_offset = ((uint16_t)start - (uint16_t)segment_first) / 2;
+	return words;
+}
 
-			for (i = 0; i < INFOMEM_SEGMENT_WORDS; i++) {
-				//data we need to preserve
-				if ((segment_first + i) >= free_stop) {
-					buf[i] = segment_first[i];
-				}
-				//data to change with single modify
-				else if (next_mod != mod_count && (segment_first + i) == mod_addr[next_mod]) {
-					buf[i] = mod_data[next_mod];
-					next_mod++;
-				}
-				//data we do not care about (leave erased)
-				else if ((segment_first + i) >= (free_start + more)) {
-					buf[i] = INFOMEM_ERASED_WORD;
-				}
-				//data not to change
-				else if ((segment_first + i) < start) {
-					buf[i] = segment_first[i];
-				}
-				//data following the data we insert
-				else if ((segment_first + i) >= (start + ins_count)) {
-					buf[i] = segment_first[i - more];
-				}
-				//data to insert
-				else { // if( (segment_first+i) >= start &&  (segment_first+i) < (start+ins_count) )
-					if (data == NULL) {
-						buf[i] = INFOMEM_ERASED_WORD;
-					} else {
-						buf[i] = data[i - data_offset];
-					}
-				}
-			}
+// *************************************************************************************************
+// @fn          infomem_collect
+// @brief       garbage collect the oldest segment whose live records fit into a free one: copy
+//				them there and erase the segment. Only the oldest segment holds all older
+//				versions of the chunks deleted in it, its records of deleted chunks are dropped.
+//				Until the segment is erased no other segment is free and the new one holds
+//				nothing but copies, see infomem_ready.
+//				FOR INTERNAL USE ONLY
+// @param       none
+// @return      0 nothing to collect
+//				1 collected
+// *************************************************************************************************
+static uint8_t infomem_collect(void)
+{
+	struct infomem_segment *s;
+	struct infomem_segment *oldest = NULL;
+	struct infomem_segment *victim = NULL;
+	struct infomem_index *e;
+	uint16_t buf[INFOMEM_REC_WORDS(INFOMEM_CHUNK_WORDS)];
+	const uint16_t *full;
+	uint16_t room, live, copy = 0;
+	uint16_t *rec;
+	uint8_t i, n;
+
+	for (i = 0; i < INFOMEM_SEGMENTS_MAX; i++) {
+		if (sInfomem.seg[i].head == NULL) {
+			break;
+		}
+	}
+
+	if (i == INFOMEM_SEGMENTS_MAX) {
+		return 0;
+	}
+
+	room = sInfomem.seg[i].end - sInfomem.seg[i].start - INFOMEM_SEG_HEADER;
+
+	for (s = sInfomem.seg; s < sInfomem.seg + INFOMEM_SEGMENTS_MAX; s++) {
+		if (s->head != NULL && (oldest == NULL || (int16_t)(s->seq - oldest->seq) < 0)) {
+			oldest = s;
+		}
+	}
 
-			infomem_write_flash_segment(segment_first, buf, 1);
-			segment_first += INFOMEM_SEGMENT_WORDS;
+	for (s = sInfomem.seg; s < sInfomem.seg + INFOMEM_SEGMENTS_MAX; s++) {
+		if (s->head == NULL) {
+			continue;
 		}
+
+		live = infomem_live_words(s, s == oldest);
+
+		//nothing to copy, this also frees a head left full by a torn record
+		if (live == 0) {
+			victim = s;
+			copy = 0;
+			break;
+		}
+
+		if ((victim == NULL || (int16_t)(s->seq - victim->seq) < 0) && live <= room) {
+			victim = s;
+			copy = live;
+		}
+	}
+
+	if (victim == NULL) {
+		return 0;
+	}
+
+	sInfomem.collecting = 1;
+	if (copy > 0) {
+		infomem_open(i);
 	}
+
+	for (e = sInfomem.index; e < sInfomem.index + sInfomem.entries; e++) {
+		if (e->rec < victim->start || e->rec >= victim->end) {
+			continue;
+		}
+
+		if (victim == oldest && INFOMEM_REC_COUNT(e->rec) == 0) {
+			sInfomem.live -= INFOMEM_REC_WORDS(0);
+			*e-- = sInfomem.index[--sInfomem.entries];
+			continue;
+		}
+
+		//a chunk with deltas is copied as one full record, copies of the same version are
+		//alike, if the power fails now either one is fine
+		n = INFOMEM_REC_COUNT(e->rec);
+		full = infomem_load(e, buf);
+		if (full == buf) {
+			buf[INFOMEM_REC_HEADER + n] = infomem_crc(buf, n);
+		}
+
+		rec = infomem_append(full, INFOMEM_REC_WORDS(n));
+		if (rec == NULL) {
+			sInfomem.collecting = 0;
+			return 0;
+		}
+		e->rec = rec;
+		e->base = rec;
+	}
+
+	sInfomem.collecting = 0;
+	infomem_retire(victim);
+	return 1;
 }
 
 // *************************************************************************************************
-// @fn          infomem_get_app_addr
-// @brief       return the address of the header for an address
+// @fn          infomem_append
+// @brief       write a record to the end of the log, opening or collecting segments as needed
 //				FOR INTERNAL USE ONLY
-// @param       uint8_t identifier	Identifier byte for application
-// @return		NULL not present
-//				n address of identifier byte
+// @param       uint16_t* rec		record in RAM or flash
+//				uint8_t words		size of the record
+// @return      NULL no space left
+//				address of the written record
 // *************************************************************************************************
-uint16_t *infomem_get_app_addr(uint8_t identifier)
+static uint16_t *infomem_append(const uint16_t *rec, uint8_t words)
 {
-	//start at the first word of payload
-	uint16_t *addr = sInfomem.startaddr + 2;
+	struct infomem_segment *s;
+	uint8_t tries, i, free, spare = 0;
 
-	//while we have not reached the end
-	while (addr < sInfomem.startaddr + 2 + sInfomem.size) {
-		//application found, return address
-		if (((uint8_t *)addr)[0] == identifier) {
+	for (tries = 0; tries <= INFOMEM_SEGMENTS_MAX; tries++) {
+		s = &sInfomem.seg[sInfomem.head];
+
+		if (s->head != NULL && s->head + words <= s->end) {
+			uint16_t *addr = s->head;
+
+			flash_write(addr, rec, words * 2);
+			s->head += words;
 			return addr;
 		}
-		//step to header of next application
-		else {
-			addr += ((uint8_t *)addr)[1] + 1;
+
+		free = 0;
+		for (i = 0; i < INFOMEM_SEGMENTS_MAX; i++) {
+			if (sInfomem.seg[i].head == NULL) {
+				spare = i;
+				free++;
+			}
+		}
+
+		//one segment is kept free to collect into
+		if (free > 1) {
+			infomem_open(spare);
+		} else if (sInfomem.collecting || !infomem_collect()) {
+			return NULL;
 		}
 	}
 
-	//application not found
 	return NULL;
 }
 
 // *************************************************************************************************
-// @fn          infomem_ready
-// @brief       check if infomem is initialized and in sane state, return amount of data present
-// @param		none
-// @return		-2 no memory structure present
-//				-3,-4,-5 data structure error
-//				>=0 size of data present
+// @fn          infomem_log_size
+// @brief       size of the application data in the log, without the cache
+//				FOR INTERNAL USE ONLY
+// @param       uint8_t identifier	Identifier byte for application
+// @return      words
 // *************************************************************************************************
-int16_t infomem_ready()
+static uint8_t infomem_log_size(uint8_t identifier)
 {
-	uint8_t found_beg = 0;
-
-	//already checked, trust that and just return size
-	if (sInfomem.sane == INFOMEM_SANE) {
-		return sInfomem.size;
+	struct infomem_index *e;
+	uint8_t size = 0;
+	uint8_t count;
+
+	for (e = sInfomem.index; e < sInfomem.index + sInfomem.entries; e++) {
+		count = INFOMEM_REC_COUNT(e->rec);
+		if (e->app == identifier && count > 0 && e->chunk * INFOMEM_CHUNK_WORDS + count > size) {
+			size = e->chunk * INFOMEM_CHUNK_WORDS + count;
+		}
 	}
 
-	//if address is already set and in right range, look if it is correct, otherwise reset it
-	if ((((uint16_t)(sInfomem.startaddr)) >= INFOMEM_START) && (((uint16_t)(sInfomem.startaddr)) < (INFOMEM_START + 4 * INFOMEM_SEGMENT_SIZE))) {
-		if (*(sInfomem.startaddr) == INFOMEM_IDENTIFIER) {
-			found_beg = 1;
-		} else {
-			sInfomem.startaddr = NULL;
+	return size;
+}
+
+// *************************************************************************************************
+// @fn          infomem_writeback
+// @brief       append the cached records to the log, like infomem_write does an application that
+//				shrinks from the end and one that grows from the start
+//				FOR INTERNAL USE ONLY
+// @param       none
+// @return      0 no space left
+//				1 done
+// *************************************************************************************************
+static uint8_t infomem_writeback(void)
+{
+	uint16_t buf[INFOMEM_REC_WORDS(INFOMEM_CHUNK_WORDS)];
+	uint16_t delta[INFOMEM_REC_WORDS(INFOMEM_CHUNK_WORDS)];
+	struct infomem_segment *s;
+	struct infomem_index *e;
+	const uint16_t *old;
+	uint16_t *rec;
+	uint16_t *addr;
+	uint8_t i, n, k, next, shrink = 0;
+
+	while (sInfomem.cached) {
+		next = INFOMEM_CACHE_SIZE;
+		for (i = 0; i < INFOMEM_CACHE_SIZE; i++) {
+			if (!(sInfomem.cached & (1 << i))) {
+				continue;
+			}
+
+			rec = sInfomem.cache[i];
+			if (next == INFOMEM_CACHE_SIZE) {
+				next = i;
+				shrink = infomem_app_amount(INFOMEM_REC_APP(rec)) < infomem_log_size(INFOMEM_REC_APP(rec));
+			} else if (INFOMEM_REC_APP(rec) == INFOMEM_REC_APP(sInfomem.cache[next])
+				   && (INFOMEM_REC_CHUNK(rec) > INFOMEM_REC_CHUNK(sInfomem.cache[next])) == shrink) {
+				next = i;
+			}
+		}
+
+		rec = sInfomem.cache[next];
+		n = INFOMEM_REC_COUNT(rec);
+		rec[INFOMEM_REC_HEADER + n] = infomem_crc(rec, n);
+		k = n;
+
+		//only the changed words if the base of the chunk is in the segment written to
+		//and the delta fits there, a delta never carries all words of a chunk
+		e = infomem_find(INFOMEM_REC_APP(rec), INFOMEM_REC_CHUNK(rec));
+		s = &sInfomem.seg[sInfomem.head];
+		if (e != NULL && n > 0 && INFOMEM_REC_COUNT(e->rec) == n && s->head != NULL
+		    && e->base >= s->start && e->base < s->end) {
+			old = infomem_load(e, buf);
+			delta[0] = rec[0];
+			delta[1] = n;
+			for (i = 0, k = 0; i < n; i++) {
+				if (rec[INFOMEM_REC_HEADER + i] != old[INFOMEM_REC_HEADER + i]) {
+					delta[1] |= 1 << (8 + i);
+					delta[INFOMEM_REC_HEADER + k++] = rec[INFOMEM_REC_HEADER + i];
+				}
+			}
+			if (k > 0 && k < n && s->head + INFOMEM_REC_WORDS(k) <= s->end) {
+				delta[INFOMEM_REC_HEADER + k] = infomem_crc(delta, k);
+				rec = delta;
+			} else {
+				k = n;
+			}
+		}
+
+		addr = infomem_append(rec, INFOMEM_REC_WORDS(k));
+		if (addr == NULL) {
+			return 0;
 		}
+		infomem_index_set(addr);
+		sInfomem.cached &= ~(1 << next);
 	}
 
-	//search for identifier word of information memory by looping over memory
-	if (found_beg == 0) {
-		uint16_t *addr;
+	return 1;
+}
 
-		for (addr = (uint16_t *)INFOMEM_START; addr < (uint16_t *)(INFOMEM_START + 4 * INFOMEM_SEGMENT_SIZE); addr++) {
-			if (*addr == INFOMEM_IDENTIFIER) {
-				sInfomem.startaddr = addr;
-				found_beg = 1;
+// *************************************************************************************************
+// @fn          infomem_cache_put
+// @brief       take the new version of a chunk into the cache, writing back the cache if it is full
+//				FOR INTERNAL USE ONLY
+// @param       uint16_t* rec		record without CRC
+// @return      0 no space left
+//				1 done
+// *************************************************************************************************
+static uint8_t infomem_cache_put(const uint16_t *rec)
+{
+	uint16_t buf[INFOMEM_REC_WORDS(INFOMEM_CHUNK_WORDS)];
+	struct infomem_index *e = infomem_find(INFOMEM_REC_APP(rec), INFOMEM_REC_CHUNK(rec));
+	const uint16_t *old;
+	uint8_t n = INFOMEM_REC_COUNT(rec);
+	uint8_t slot = infomem_cached(INFOMEM_REC_APP(rec), INFOMEM_REC_CHUNK(rec));
+	uint8_t same = (e == NULL && n == 0);
+	uint8_t i;
+
+	//changed back to what the log holds, or deleted before it was ever written back
+	if (e != NULL && n == INFOMEM_REC_COUNT(e->rec)) {
+		old = infomem_load(e, buf);
+		for (i = 0; i < n; i++) {
+			if (rec[INFOMEM_REC_HEADER + i] != old[INFOMEM_REC_HEADER + i]) {
 				break;
 			}
 		}
+		same = (i == n);
+	}
+	if (same) {
+		if (slot < INFOMEM_CACHE_SIZE) {
+			sInfomem.cached &= ~(1 << slot);
+		}
+		return 1;
 	}
 
-	//give up searching
-	if (found_beg == 0) {
-		return -2;
+	if (slot == INFOMEM_CACHE_SIZE) {
+		if (sInfomem.cached == (1 << INFOMEM_CACHE_SIZE) - 1 && !infomem_writeback()) {
+			return 0;
+		}
+
+		for (slot = 0; sInfomem.cached & (1 << slot); slot++);
+		sInfomem.cached |= 1 << slot;
 	}
 
-	//read size and maxsize
-	sInfomem.size = ((uint8_t *)(sInfomem.startaddr))[2];
-	sInfomem.maxsize = ((uint8_t *)(sInfomem.startaddr))[3];
+	for (i = 0; i < INFOMEM_REC_HEADER + n; i++) {
+		sInfomem.cache[slot][i] = rec[i];
+	}
 
-	//check size and maxsize for plausibility
-	if (sInfomem.size > sInfomem.maxsize || sInfomem.maxsize > (INFOMEM_START + 4 * INFOMEM_SEGMENT_SIZE - 6 - (uint16_t)sInfomem.startaddr) / 2) {
-		return -3;
+	return 1;
+}
+
+// *************************************************************************************************
+// @fn          infomem_data_size
+// @brief       sum up the data of all applications
+//				FOR INTERNAL USE ONLY
+// @param       none
+// @return      words of data present
+// *************************************************************************************************
+static int16_t infomem_data_size(void)
+{
+	struct infomem_index *e;
+	int16_t size = 0;
+	uint8_t i;
+
+	for (e = sInfomem.index; e < sInfomem.index + sInfomem.entries; e++) {
+		size += INFOMEM_REC_COUNT(infomem_newest(e->app, e->chunk, NULL));
 	}
 
-	//loop through applications towards the end of the memory
-	uint16_t *addr = sInfomem.startaddr + 2;
+	//chunks not written back yet
+	for (i = 0; i < INFOMEM_CACHE_SIZE; i++) {
+		if ((sInfomem.cached & (1 << i))
+		    && infomem_find(INFOMEM_REC_APP(sInfomem.cache[i]), INFOMEM_REC_CHUNK(sInfomem.cache[i])) == NULL) {
+			size += INFOMEM_REC_COUNT(sInfomem.cache[i]);
+		}
+	}
+
+	return size;
+}
 
-	while (addr < sInfomem.startaddr + 2 + sInfomem.size) {
-		addr += ((uint8_t *)addr)[1] + 1;
+// *************************************************************************************************
+// @fn          infomem_write
+// @brief       overwrite count words from offset and set the size of the application data,
+//				the chunks that change go to the cache
+//				FOR INTERNAL USE ONLY
+// @param       uint8_t identifier	Identifier byte for application
+//				uint16_t* data		Data array
+//				uint8_t count		number of words
+//				uint8_t offset		word offset of data, at most the current size
+//				uint8_t size		new size of the application data
+// @return      -2 temporary error (try again later)
+//				-4 not enough memory
+//				0 done
+// *************************************************************************************************
+static int16_t infomem_write(uint8_t identifier, uint16_t *data, uint8_t count, uint8_t offset, uint8_t size)
+{
+	uint16_t rec[INFOMEM_REC_WORDS(INFOMEM_CHUNK_WORDS)];
+	uint16_t buf[INFOMEM_REC_WORDS(INFOMEM_CHUNK_WORDS)];
+	const uint16_t *old;
+	struct infomem_index *e;
+	uint8_t old_size = infomem_app_amount(identifier);
+	uint8_t lo = offset;
+	uint8_t hi = offset + count;
+	uint8_t chunk, k, n, old_n, i, w, slot;
+	int16_t grow;
+	uint8_t entries = sInfomem.entries;
+
+	//a changed size touches the chunks between the old and the new end
+	if (size != old_size) {
+		if (size < lo || count == 0) {
+			lo = size < old_size ? size : old_size;
+		}
+		if (old_size > hi) {
+			hi = old_size;
+		}
 	}
 
-	//return when the sum of the application sizes does not match the total size
-	if (addr != sInfomem.startaddr + sInfomem.size + 2) {
+	if (lo >= hi) {
+		return 0;
+	}
+
+	//check that the new records and the cached ones fit before taking any of them
+	grow = infomem_pending(&entries);
+	for (chunk = lo / INFOMEM_CHUNK_WORDS; chunk < INFOMEM_CHUNKS(hi); chunk++) {
+		e = infomem_find(identifier, chunk);
+		slot = infomem_cached(identifier, chunk);
+		n = size > chunk * INFOMEM_CHUNK_WORDS ? size - chunk * INFOMEM_CHUNK_WORDS : 0;
+		if (n > INFOMEM_CHUNK_WORDS) {
+			n = INFOMEM_CHUNK_WORDS;
+		}
+
+		if (e == NULL && slot == INFOMEM_CACHE_SIZE && n > 0) {
+			entries++;
+		}
+		grow += infomem_growth(e, n);
+		if (slot < INFOMEM_CACHE_SIZE) {
+			grow -= infomem_growth(e, INFOMEM_REC_COUNT(sInfomem.cache[slot]));
+		}
+	}
+
+	if (entries > INFOMEM_INDEX_SIZE || (int16_t)sInfomem.live + grow > (int16_t)sInfomem.capacity) {
 		return -4;
 	}
 
+	if (sInfomem.not_lock == 0) {
+		return -2;
+	}
+
+	sInfomem.not_lock = 0;
 
-	//check if terminator word is in place
-	if (sInfomem.startaddr[sInfomem.size + 2] != INFOMEM_TERMINATOR) {
-		return -5;
+	//shrink from the end and grow from the start, so that a power failure in between
+	//leaves no hole in the data
+	for (k = INFOMEM_CHUNKS(hi) - lo / INFOMEM_CHUNK_WORDS; k > 0; k--) {
+		chunk = size < old_size ? lo / INFOMEM_CHUNK_WORDS + k - 1 : INFOMEM_CHUNKS(hi) - k;
+		old = infomem_newest(identifier, chunk, buf);
+		old_n = old ? INFOMEM_REC_COUNT(old) : 0;
+		n = size > chunk * INFOMEM_CHUNK_WORDS ? size - chunk * INFOMEM_CHUNK_WORDS : 0;
+		if (n > INFOMEM_CHUNK_WORDS) {
+			n = INFOMEM_CHUNK_WORDS;
+		}
+
+		//nothing to delete
+		if (old == NULL && n == 0) {
+			continue;
+		}
+
+		rec[0] = identifier | ((uint16_t)chunk << 8);
+		rec[1] = n | 0xFF00;
+
+		//old content overlaid with the new data
+		for (i = 0; i < n; i++) {
+			w = chunk * INFOMEM_CHUNK_WORDS + i;
+			if (w >= offset && w < offset + count) {
+				rec[INFOMEM_REC_HEADER + i] = data[w - offset];
+			} else if (i < old_n) {
+				rec[INFOMEM_REC_HEADER + i] = old[INFOMEM_REC_HEADER + i];
+			} else {
+				rec[INFOMEM_REC_HEADER + i] = INFOMEM_ERASED_WORD;
+			}
+		}
+
+		//unchanged, leave the cache alone
+		if (old != NULL && n == old_n) {
+			for (i = 0; i < n; i++) {
+				if (rec[INFOMEM_REC_HEADER + i] != old[INFOMEM_REC_HEADER + i]) {
+					break;
+				}
+			}
+			if (i == n) {
+				continue;
+			}
+		}
+
+		if (!infomem_cache_put(rec)) {
+			sInfomem.not_lock = 1;
+			return -4;
+		}
 	}
 
-	//exerything seems to be OK
-	sInfomem.sane = INFOMEM_SANE;
 	sInfomem.not_lock = 1;
-	return sInfomem.size;
+	return 0;
 }
 
-
 // *************************************************************************************************
-// @fn          infomem_init
-// @brief       write infomem data structure
-// @param		uint16_t	start		(word) address of first word of used memory
-//				uint16_t	end			(word) address of first word of NOT used memory
-// @return		-1 infomem already present
-//				-2 addresses not word addresses or out of range
-//				-3 memory not empty
-//				>0 new maximum size
+// @fn          infomem_ready
+// @brief       check if infomem is initialized and in sane state, return amount of data present
+// @param		none
+// @return		-2 no memory structure present
+//				-5 more chunks than the index holds
+//				>=0 size of data present
 // *************************************************************************************************
-int16_t infomem_init(uint16_t start, uint16_t end)
+int16_t infomem_ready()
 {
+	struct infomem_segment *s;
+	struct infomem_segment *next;
+	uint8_t used = 0;
+
+	//already checked, trust that and just return size
 	if (sInfomem.sane == INFOMEM_SANE) {
-		return -1;
+		return infomem_data_size();
 	}
 
-	uint16_t numwords = (end - start) / 2;
+	infomem_setup();
+	sInfomem.entries = 0;
+	sInfomem.live = 0;
+
+	for (s = sInfomem.seg; s < sInfomem.seg + INFOMEM_SEGMENTS_MAX; s++) {
+		s->head = NULL;
+		if (s->start[0] == INFOMEM_IDENTIFIER) {
+			s->seq = s->start[1];
+			used++;
+		}
+	}
 
-	//check if address boundaries are usable
-	if (start & 0x1 || end & 0x1 || end < start || numwords < 10 || start < INFOMEM_START || end > INFOMEM_START + 4 * INFOMEM_SEGMENT_SIZE) {
+	//give up searching
+	if (used == 0) {
 		return -2;
 	}
 
+	//scan from the oldest to the newest segment, later records replace earlier ones
+	while (used--) {
+		next = NULL;
+		for (s = sInfomem.seg; s < sInfomem.seg + INFOMEM_SEGMENTS_MAX; s++) {
+			if (s->start[0] == INFOMEM_IDENTIFIER && s->head == NULL
+			    && (next == NULL || (int16_t)(s->seq - next->seq) < 0)) {
+				next = s;
+			}
+		}
 
-	int i;
+		if (!infomem_scan(next)) {
+			return -5;
+		}
+		sInfomem.head = next - sInfomem.seg;
+	}
 
-	//check if memory area is empty
-	for (i = 0; i < numwords; i++) {
-		if (((uint16_t *)start)[i] != INFOMEM_ERASED_WORD) {
-			return -3;
+	//A collection cut short by a power failure leaves no segment free. The newest one holds
+	//copies of records still found in the segment being collected, drop it and start over.
+	for (s = sInfomem.seg; s < sInfomem.seg + INFOMEM_SEGMENTS_MAX; s++) {
+		if (s->head == NULL) {
+			break;
 		}
 	}
+	if (s == sInfomem.seg + INFOMEM_SEGMENTS_MAX) {
+		infomem_retire(&sInfomem.seg[sInfomem.head]);
+		return infomem_ready();
+	}
 
-	//init struct with standard values
-	sInfomem.startaddr = (uint16_t *) start;
-	sInfomem.size = 0;
-	sInfomem.maxsize = (end - start - 6) / 2;
-	sInfomem.not_lock = 0;
+	//everything seems to be OK
+	sInfomem.sane = INFOMEM_SANE;
+	sInfomem.not_lock = 1;
+	return infomem_data_size();
+}
 
-	//prepare the three words of the initial structure
-	uint16_t buf[3] = {INFOMEM_IDENTIFIER, ((numwords - 3) & 0xFF) << 8, INFOMEM_TERMINATOR};
 
-	//write the initial structure to memory
-	infomem_write_data((uint16_t *)start, buf, 3);
+// *************************************************************************************************
+// @fn          infomem_init
+// @brief       erase the managed segments and start an empty log
+// @param		none
+// @return		-1 infomem already present
+//				>0 words of records the log holds
+// *************************************************************************************************
+int16_t infomem_init(void)
+{
+	struct infomem_segment *s;
+
+	if (sInfomem.sane == INFOMEM_SANE) {
+		return -1;
+	}
+
+	infomem_setup();
+
+	for (s = sInfomem.seg; s < sInfomem.seg + INFOMEM_SEGMENTS_MAX; s++) {
+		s->head = NULL;
+	}
+
+	sInfomem.entries = 0;
+	sInfomem.live = 0;
+	sInfomem.cached = 0;
+	sInfomem.head = 0;
+	sInfomem.seg[0].seq = 0;
+	infomem_open(0);
 
 	//make structure usable
 	sInfomem.sane = INFOMEM_SANE;
 	sInfomem.not_lock = 1;
 
-	return sInfomem.maxsize;
-
-};
+	return sInfomem.capacity;
+}
 
 // *************************************************************************************************
 // @fn          infomem_space
 // @brief       return amount of free space
 // @param		none
 // @return		<0 see infomem_ready
-//				>=0 available free space (in words)
+//				>=0 free words in the log, each chunk of data takes 3 more
 // *************************************************************************************************
 int16_t infomem_space()
 {
 	int16_t ret;
+	uint8_t entries = 0;
 
 	if (sInfomem.sane != INFOMEM_SANE) {
 		if ((ret = infomem_ready()) < 0) {
@@ -420,81 +1048,40 @@ int16_t infomem_space()
 		}
 	}
 
-	return sInfomem.maxsize - sInfomem.size;
+	return sInfomem.capacity - sInfomem.live - infomem_pending(&entries);
 }
 
 // *************************************************************************************************
-// @fn          infomem_relocate
-// @brief       change start and end address of data storage (can change size)
-// @param		uint16_t	start		(word) address of first word of used memory
-//				uint16_t	end			(word) address of first word of NOT used memory
+// @fn          infomem_flush
+// @brief       write back the data the applications changed since the last call
+// @param		none
 // @return		-1 data structure error or memory not initialized
 //				-2 temporary error (try again later)
-//				-3 address not word addresses
-//				-4 addresses out of range
-//				-5 new space too small
-//				>0 new maximum size
+//				-4 not enough memory
+//				0 done
 // *************************************************************************************************
-int16_t infomem_relocate(uint16_t start, uint16_t end)
+int16_t infomem_flush(void)
 {
-	//check if we really have word addresses
-	if ((start & 0x1) || (end & 0x1)) {
-		return -3;
-	}
+	uint8_t ok;
 
 	if (sInfomem.sane != INFOMEM_SANE) {
 		return -1;
 	}
 
-	//check if range is within memory
-	if (end > INFOMEM_START + 4 * INFOMEM_SEGMENT_SIZE || start < INFOMEM_START) {
-		return -4;
-	}
-
-	//check if new memory range is big enough
-	if ((uint16_t *)end < (uint16_t *)start + sInfomem.size + 3) {
-		return -5;
+	//nothing changed, leave the flash alone
+	if (sInfomem.cached == 0) {
+		return 0;
 	}
 
-	//try to avoid conflicts while writing
 	if (sInfomem.not_lock == 0) {
 		return -2;
 	}
 
 	sInfomem.not_lock = 0;
-
-
-	uint16_t *old_end = sInfomem.startaddr + sInfomem.maxsize + 3;
-
-	sInfomem.maxsize = (uint16_t *)end - (uint16_t *)start - 3;
-
-	//new address of size word
-	uint16_t *mod_addr = (uint16_t *)start + 1;
-
-	//prepare new size word
-	uint16_t buf;
-	((uint8_t *)(&buf))[0] = sInfomem.size;
-	((uint8_t *)(&buf))[1] = sInfomem.maxsize;
-
-	//no relocation, just resize
-	if ((uint16_t *)start == sInfomem.startaddr) {
-		infomem_write_data(mod_addr, &buf, 1);
-	}
-	//left shift (might be with resize)
-	else if ((uint16_t *)start < sInfomem.startaddr) {
-		//delete bytes before information memory
-		infomem_insert_delete_modify((uint16_t *)start, NULL, (uint8_t)(sInfomem.startaddr - (uint16_t *)start), 0, &mod_addr, &buf, 1, sInfomem.startaddr + 3 + sInfomem.size, old_end);
-	}
-	//right shift
-	else {
-		//insert empty bytes before information memory
-		infomem_insert_delete_modify(sInfomem.startaddr, NULL, 0, (uint8_t)((uint16_t *)start - sInfomem.startaddr), &mod_addr, &buf, 1, sInfomem.startaddr + 3 + sInfomem.size, (uint16_t *)start + 3 + sInfomem.maxsize);
-	}
-
-	sInfomem.startaddr = (uint16_t *)start;
-
+	ok = infomem_writeback();
 	sInfomem.not_lock = 1;
-	return sInfomem.maxsize;
+
+	return ok ? 0 : -4;
 }
 
 // *************************************************************************************************
@@ -506,17 +1093,22 @@ int16_t infomem_relocate(uint16_t start, uint16_t end)
 // *************************************************************************************************
 int16_t infomem_delete_all(void)
 {
+	struct infomem_segment *s;
+
 	if (sInfomem.sane != INFOMEM_SANE) {
 		return -1;
 	}
 
-	//overwrite complete previously reserved memory with erased bytes
-	infomem_insert_delete_modify(sInfomem.startaddr, NULL, sInfomem.maxsize + 3, sInfomem.maxsize + 3, NULL, NULL, 0, sInfomem.startaddr + 3 + sInfomem.size, sInfomem.startaddr + 3 + sInfomem.maxsize);
+	for (s = sInfomem.seg; s < sInfomem.seg + INFOMEM_SEGMENTS_MAX; s++) {
+		if (s->head != NULL) {
+			infomem_retire(s);
+		}
+	}
 
 	sInfomem.sane = 0;
-	sInfomem.startaddr = NULL;
-	sInfomem.size = 0;
-	sInfomem.maxsize = 0;
+	sInfomem.entries = 0;
+	sInfomem.live = 0;
+	sInfomem.cached = 0;
 	return 0;
 }
 
@@ -530,17 +1122,35 @@ int16_t infomem_delete_all(void)
 // *************************************************************************************************
 int16_t infomem_app_amount(uint8_t identifier)
 {
+	struct infomem_index *e;
+	int16_t size = 0;
+	uint8_t count, i;
+
 	if (sInfomem.sane != INFOMEM_SANE) {
 		return -1;
 	}
 
-	uint16_t *addr = infomem_get_app_addr(identifier);
+	//chunks are full but the last one
+	for (e = sInfomem.index; e < sInfomem.index + sInfomem.entries; e++) {
+		if (e->app == identifier) {
+			count = INFOMEM_REC_COUNT(infomem_newest(e->app, e->chunk, NULL));
+			if (count > 0 && e->chunk * INFOMEM_CHUNK_WORDS + count > size) {
+				size = e->chunk * INFOMEM_CHUNK_WORDS + count;
+			}
+		}
+	}
 
-	if (addr == NULL) {
-		return 0;
+	//chunks not written back yet
+	for (i = 0; i < INFOMEM_CACHE_SIZE; i++) {
+		if ((sInfomem.cached & (1 << i)) && INFOMEM_REC_APP(sInfomem.cache[i]) == identifier) {
+			count = INFOMEM_REC_COUNT(sInfomem.cache[i]);
+			if (count > 0 && INFOMEM_REC_CHUNK(sInfomem.cache[i]) * INFOMEM_CHUNK_WORDS + count > size) {
+				size = INFOMEM_REC_CHUNK(sInfomem.cache[i]) * INFOMEM_CHUNK_WORDS + count;
+			}
+		}
 	}
 
-	return ((uint8_t *)addr)[1];
+	return size;
 }
 
 
@@ -552,26 +1162,20 @@ int16_t infomem_app_amount(uint8_t identifier)
 //				uint8_t count		number of words to read
 //				uint8_t offset		word offset of data to read
 // @return		-1 data structure error or memory not initialized
-//				-2 temporary error (try again later)
 //				0 offset to big or app not present
 //				n number of words read
 // *************************************************************************************************
 int16_t infomem_app_read(uint8_t identifier, uint16_t *data, uint8_t count, uint8_t offset)
 {
-	if (sInfomem.sane != INFOMEM_SANE) {
-		return -1;
-	}
+	uint16_t buf[INFOMEM_REC_WORDS(INFOMEM_CHUNK_WORDS)];
+	const uint16_t *rec = NULL;
+	int16_t size = infomem_app_amount(identifier);
+	uint8_t i, w;
 
-	//find application
-	uint16_t *addr = infomem_get_app_addr(identifier);
-
-	if (addr == NULL) {
-		return 0;
+	if (size < 0) {
+		return size;
 	}
 
-	//read application size
-	uint8_t size = ((uint8_t *)addr)[1];
-
 	//check if offset is still within application memory
 	if (offset >= size) {
 		return 0;
@@ -582,14 +1186,17 @@ int16_t infomem_app_read(uint8_t identifier, uint16_t *data, uint8_t count, uint
 		count = size - offset;
 	}
 
-	//set address to read from
-	addr += offset + 1;
-
-	int i;
-
 	//copy data
 	for (i = 0; i < count; i++) {
-		data[i] = addr[i];
+		w = offset + i;
+		if (i == 0 || w % INFOMEM_CHUNK_WORDS == 0) {
+			rec = infomem_newest(identifier, w / INFOMEM_CHUNK_WORDS, buf);
+		}
+		if (rec != NULL && w % INFOMEM_CHUNK_WORDS < INFOMEM_REC_COUNT(rec)) {
+			data[i] = rec[INFOMEM_REC_HEADER + w % INFOMEM_CHUNK_WORDS];
+		} else {
+			data[i] = INFOMEM_ERASED_WORD;
+		}
 	}
 
 	return count;
@@ -608,73 +1215,17 @@ int16_t infomem_app_read(uint8_t identifier, uint16_t *data, uint8_t count, uint
 // *************************************************************************************************
 int16_t infomem_app_replace(uint8_t identifier, uint16_t *data, uint8_t count)
 {
-	//delete app completely if we have to replace it with zero content.
-	if (count == 0) {
-		return infomem_app_delete(identifier, 0);
-	}
+	int16_t ret;
 
 	if (sInfomem.sane != INFOMEM_SANE) {
 		return -1;
 	}
 
-	if (sInfomem.not_lock == 0) {
-		return -2;
-	}
-
-	sInfomem.not_lock = 0;
-
-	uint8_t old_size = 0;
-	//get address of application
-	uint16_t *addr = infomem_get_app_addr(identifier);
-
-	//application is already present, really replace memory content
-	if (addr != NULL) {
-		old_size = ((uint8_t *)addr)[1];
-
-		//check if new data does fit
-		if ((int16_t)sInfomem.size + (int16_t) count - (int16_t)old_size > sInfomem.maxsize) {
-			sInfomem.not_lock = 1;
-			return -4;
-		}
-
-		//set global header and application header to be modified
-		uint16_t *mod_addr[2] = {sInfomem.startaddr + 1, addr};
-		uint16_t mod_data[2];
-		((uint8_t *)mod_data)[0] = sInfomem.size + count - old_size;
-		((uint8_t *)mod_data)[1] = sInfomem.maxsize;
-		((uint8_t *)mod_data)[2] = identifier;
-		((uint8_t *)mod_data)[3] = count;
-
-		//delete old_size words and write count new words instead, also replace headers
-		infomem_insert_delete_modify(addr + 1, data, old_size, count, mod_addr, mod_data, 2, sInfomem.startaddr + 3 + sInfomem.size, sInfomem.startaddr + 3 + sInfomem.maxsize);
-		//store new size
-		sInfomem.size = ((uint8_t *)mod_data)[0];
-	}
-	//application not present, add it at the end of the information memory
-	else {
-		//check if new data does fit
-		if ((int16_t)sInfomem.size + (int16_t) count + 1 > sInfomem.maxsize) {
-			sInfomem.not_lock = 1;
-			return -4;
-		}
-
-		//prepare header words
-		uint16_t *mod_addr[2] = {sInfomem.startaddr + 1, sInfomem.startaddr + 2 + sInfomem.size};
-		uint16_t mod_data[2];
-		((uint8_t *)mod_data)[0] = sInfomem.size + count + 1;
-		((uint8_t *)mod_data)[1] = sInfomem.maxsize;
-		((uint8_t *)mod_data)[2] = identifier;
-		((uint8_t *)mod_data)[3] = count;
-
-		//hack: to write the application header and size add it to mod, increase count and decrease data pointer. the first data word at data-1 will not be read
-		//this avoids copying data to add a header
-		infomem_insert_delete_modify(sInfomem.startaddr + 2 + sInfomem.size, data - 1, 0, count + 1, mod_addr, mod_data, 2, sInfomem.startaddr + 3 + sInfomem.size, sInfomem.startaddr + 3 + sInfomem.maxsize);
-		//store size
-		sInfomem.size = ((uint8_t *)mod_data)[0];
+	if ((ret = infomem_write(identifier, data, count, 0, count)) < 0) {
+		return ret;
 	}
 
-	sInfomem.not_lock = 1;
-	return sInfomem.size;
+	return infomem_data_size();
 }
 
 // *************************************************************************************************
@@ -705,65 +1256,23 @@ int16_t infomem_app_clear(uint8_t identifier)
 // *************************************************************************************************
 int16_t infomem_app_delete(uint8_t identifier, uint8_t offset)
 {
-	if (sInfomem.sane != INFOMEM_SANE) {
-		return -1;
-	}
-
-	if (sInfomem.not_lock == 0) {
-		return -2;
-	}
-
-	sInfomem.not_lock = 0;
-
-	//get address of application
-	uint16_t *addr = infomem_get_app_addr(identifier);
+	int16_t size = infomem_app_amount(identifier);
+	int16_t ret;
 
-	if (addr == NULL) {
-		sInfomem.not_lock = 1;
-		return 0;
+	if (size <= 0) {
+		return size;
 	}
 
-	//get old size of application
-	uint8_t old_size = ((uint8_t *)addr)[1];
-
-	//delete application completely
-	if (offset == 0) {
-		//prepare global size header
-		uint16_t *mod_addr[1] = {sInfomem.startaddr + 1};
-		uint16_t mod_data[1];
-		((uint8_t *)mod_data)[0] = sInfomem.size - old_size - 1;
-		((uint8_t *)mod_data)[1] = sInfomem.maxsize;
-
-		infomem_insert_delete_modify(addr, NULL, old_size + 1, 0, mod_addr, mod_data, 1, sInfomem.startaddr + 3 + sInfomem.size, sInfomem.startaddr + 3 + sInfomem.maxsize);
-		//store new size
-		sInfomem.size = ((uint8_t *)mod_data)[0];
+	//check if offset is in range
+	if (offset >= size) {
+		return -3;
 	}
-	//let some data be present
-	else {
-		//check if offset is in range
-		if (offset >= old_size) {
-			sInfomem.not_lock = 1;
-			return -3;
-		}
-
-		//determine count of data to be deleted
-		uint8_t count_delete = old_size - offset;
 
-		//prepare new size headers
-		uint16_t *mod_addr[2] = {sInfomem.startaddr + 1, addr};
-		uint16_t mod_data[2];
-		((uint8_t *)mod_data)[0] = sInfomem.size - count_delete;
-		((uint8_t *)mod_data)[1] = sInfomem.maxsize;
-		((uint8_t *)mod_data)[2] = identifier;
-		((uint8_t *)mod_data)[3] = old_size - count_delete;
-
-		infomem_insert_delete_modify(addr + 1 + offset, NULL, count_delete, 0, mod_addr, mod_data, 2, sInfomem.startaddr + 3 + sInfomem.size, sInfomem.startaddr + 3 + sInfomem.maxsize);
-		//store new size
-		sInfomem.size = ((uint8_t *)mod_data)[0];
+	if ((ret = infomem_write(identifier, NULL, 0, offset, offset)) < 0) {
+		return ret;
 	}
 
-	sInfomem.not_lock = 1;
-	return sInfomem.size;
+	return infomem_data_size();
 }
 
 // *************************************************************************************************
@@ -783,63 +1292,26 @@ int16_t infomem_app_delete(uint8_t identifier, uint8_t offset)
 // *************************************************************************************************
 int16_t infomem_app_modify(uint8_t identifier, uint16_t *data, uint8_t count, uint8_t offset)
 {
-	if (sInfomem.sane != INFOMEM_SANE) {
-		return -1;
-	}
-
-	if (sInfomem.not_lock == 0) {
-		return -2;
-	}
-
-	sInfomem.not_lock = 0;
-
-	uint16_t *addr = infomem_get_app_addr(identifier);
+	int16_t size = infomem_app_amount(identifier);
+	int16_t ret;
 
-	if (addr == NULL) {
-		sInfomem.not_lock = 1;
-		return 0;
+	if (size <= 0) {
+		return size;
 	}
 
-	uint8_t old_size = ((uint8_t *)addr)[1];
-
-	if (offset > old_size) {
-		sInfomem.not_lock = 1;
+	if (offset > size) {
 		return -3;
 	}
 
-	//new data does fit in old data, just modify the selected words
-	if (count + offset <= old_size) {
-		infomem_write_data(addr + 1 + offset, data, count);
-		sInfomem.not_lock = 1;
-		return old_size;
+	if (offset + count > size) {
+		size = offset + count;
 	}
-	//new data does not fit, increase size of application's storage
-	else {
-		//calculate number of words that are overwritten
-		uint8_t count_delete = old_size - offset;
 
-		//check if new data does fit into memory
-		if ((int16_t)sInfomem.size - (int16_t)count_delete + (int16_t) count > sInfomem.maxsize) {
-			sInfomem.not_lock = 1;
-			return -4;
-		}
-
-		//prepare new headers with size
-		uint16_t *mod_addr[2] = {sInfomem.startaddr + 1, addr};
-		uint16_t mod_data[2];
-		((uint8_t *)mod_data)[0] = sInfomem.size - count_delete + count;
-		((uint8_t *)mod_data)[1] = sInfomem.maxsize;
-		((uint8_t *)mod_data)[2] = identifier;
-		((uint8_t *)mod_data)[3] = old_size - count_delete + count;
-
-		infomem_insert_delete_modify(addr + 1 + offset, data, count_delete, count, mod_addr, mod_data, 2, sInfomem.startaddr + 3 + sInfomem.size, sInfomem.startaddr + 3 + sInfomem.maxsize);
-
-		//store new size
-		sInfomem.size = ((uint8_t *)mod_data)[0];
-
-		sInfomem.not_lock = 1;
-		return offset + count;
+	if ((ret = infomem_write(identifier, data, count, offset, size)) < 0) {
+		return ret;
 	}
+
+	return size;
 }
 
 #endif
@@ -4,8 +4,6 @@
  * use as desired but do not remove this notice
  */
 
-#include "project.h"
-
 #ifndef INFOMEM_H_
 #define INFOMEM_H_
 
@@ -21,24 +19,46 @@
  * the rest of the functions should be used only in the global part of the firmware
  * (or in a dedicated application which's function it is to do memory maintenance tasks).
  *
- * Use infomem_app_replace() with count>0 to initialize memory for application. This has
- * to be redone if data of size zero was present and the application header was therefore
- * also removed (replace with zero count, clear, delete with zero offset or modify with
- * zero count and offset).
- *
  * All pointers and addresses have to be word addresses (even numbers) and all counts
  * are given in units of words (two bytes).
+ *
+ * The data is kept as a log over the segments D to B of the information memory and
+ * CONFIG_INFOMEM_MAIN_SEGMENTS spare segments of main flash, segment A is left alone.
+ * The data of an application is split into chunks of INFOMEM_CHUNK_WORDS, a write
+ * appends a record with the new content of each chunk it touches:
+ *
+ *   app id, chunk number, word count, mask of the words carried, payload, CRC16
+ *
+ * A full record carries all words of the chunk and leaves the mask erased. When
+ * the chunk keeps its size and its last full record is in the segment being
+ * appended to, a delta carries only the words that changed, four words for a one
+ * word change; the newest version is the full record with the deltas after it
+ * applied. A segment the log moves to starts over with a full record. A record of
+ * zero words deletes the chunk. Segments carry a sequence number, the position in
+ * the log tells the versions of a chunk apart and a RAM index points to the newest
+ * one. When the log runs out of segments, the oldest one is garbage collected: the
+ * chunks still live in it are copied to a fresh segment before it is erased, so one
+ * segment is always kept erased. A record cut short
+ * by a power failure fails the CRC and the previous version stays valid. A write
+ * spanning several chunks is safe per chunk only.
+ *
+ * Writes do not touch the flash right away, the new chunks are kept in a cache of
+ * INFOMEM_CACHE_SIZE records in RAM and reads see them there. infomem_flush() appends
+ * them to the log, this happens every CONFIG_INFOMEM_FLUSH_HOURS, on a low battery,
+ * before a reset and whenever the cache is full. A chunk changed back before that
+ * costs nothing and repeated edits of one end up as one record. Changes not written
+ * back are lost on a power failure.
  */
 
 
 //check if infomem is initialized and in sane state, return amount of data present
 extern int16_t infomem_ready();
-//write infomem data structure
-extern int16_t infomem_init(uint16_t start, uint16_t end);
+//erase the managed segments and start an empty log
+extern int16_t infomem_init(void);
 //return amount of free space
 extern int16_t infomem_space();
-//change start and end address of data storage (can change size)
-extern int16_t infomem_relocate(uint16_t start, uint16_t end);
+//write back cached application data
+extern int16_t infomem_flush(void);
 //delete complete data storage (only managed space)
 extern int16_t infomem_delete_all(void);
 
@@ -56,19 +76,8 @@ extern int16_t infomem_app_delete(uint8_t identifier, uint8_t offset);
 extern int16_t infomem_app_modify(uint8_t identifier, uint16_t *data, uint8_t count, uint8_t offset);
 
 
-
-struct infomem {
-	uint16_t		*startaddr; //starting address (position of header)
-	uint8_t			size;  //size of payload in words
-	uint8_t			maxsize;  //maximum size of payload in words
-	volatile uint8_t	not_lock;  //memory is not locked for write
-	uint8_t			sane;  //sanity check passed
-};
-// extern struct infomem sInfomem;
-
-
-#define INFOMEM_IDENTIFIER 0x5a74
-#define INFOMEM_TERMINATOR 0xdaf4
+//segment header of the log, the single block layout before it used 0x5a74
+#define INFOMEM_IDENTIFIER 0x5a6c
 #define INFOMEM_SANE 0xda
 
 #define INFOMEM_START 0x1800
@@ -80,5 +89,12 @@ struct infomem {
 #define INFOMEM_SEGMENT_WORDS INFOMEM_SEGMENT_SIZE/2
 #define INFOMEM_ERASED_WORD 0xFFFF
 
+//words of application data per record
+#define INFOMEM_CHUNK_WORDS 8
+//chunks of all applications the RAM index can hold
+#define INFOMEM_INDEX_SIZE 32
+//chunks kept in RAM until they are written back, at most 8
+#define INFOMEM_CACHE_SIZE 4
+
 
-#endif /*INFOMEM_H_*/
\ No newline at end of file
+#endif /*INFOMEM_H_*/
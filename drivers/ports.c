@@ -26,9 +26,11 @@
 #include "timer.h"
 
 #include "display.h"
+#include "ps.h"
 
 #ifdef CONFIG_ACCELEROMETER
 #include "vti_as.h"
+#include "libs/accel_stream.h"
 #endif
 
 #define ALL_BUTTONS				0x1F
@@ -127,6 +129,14 @@ void ports_buttons_clear(void)
 	ports_pressed_btns = 0;
 }
 
+/*
+  any button press or release waiting to be handled by the menu
+*/
+uint8_t ports_buttons_pending(void)
+{
+	return (ports_down_btns | ports_pressed_btns) != 0;
+}
+
 /*
   Interrupt service routine for
     - buttons
@@ -150,10 +160,33 @@ void PORT2_ISR(void)
 	/* Handle accelerometer */
 	#ifdef CONFIG_ACCELEROMETER
 	/* Check if accelerometer interrupt flag */
-	if ((P2IFG & AS_INT_PIN) == AS_INT_PIN)
-		as_last_interrupt = 1;
+	if ((P2IFG & AS_INT_PIN) == AS_INT_PIN) {
+		/* in streaming mode INT is data ready, read it right away */
+		if (accel_stream_running()) {
+			switch (accel_stream_isr()) {
+			case ACCEL_STREAM_WAKE:
+				_BIC_SR_IRQ(LPM3_bits);
+				break;
+			case ACCEL_STREAM_SMCLK:
+				_BIC_SR_IRQ(SCG1 + SCG0);
+				break;
+			}
+		} else {
+			as_last_interrupt = 1;
+			/* give execution back to mainloop right away */
+			_BIC_SR_IRQ(LPM3_bits);
+		}
+	}
 	#endif
 
+	/* pressure sensor end of conversion */
+	if (P2IFG & P2IE & PS_INT_PIN) {
+		P2IFG &= ~PS_INT_PIN;
+		ps_last_interrupt = 1;
+		/* give execution back to mainloop right away */
+		_BIC_SR_IRQ(LPM3_bits);
+	}
+
 	/* A write to the interrupt vector, automatically clears the
 	 latest interrupt */
 	P2IV = 0x00;
@@ -60,11 +60,15 @@ const s16 h0[17] =
 const u16 p0[17] =
 { 1031, 1013, 1000, 950, 900, 850, 800, 750, 700, 650, 600, 550, 500, 450, 400, 350, 300 };
 
-float p[17];
+// p0 scaled to the reference altitude (Pa)
+u32 p[17];
 
 // Global flag for proper pressure sensor operation
 u8 ps_ok;
 
+// Pressure sensor signalled end of conversion
+volatile u8 ps_last_interrupt;
+
 // *************************************************************************************************
 // Extern section
 
@@ -234,8 +238,287 @@ u8 ps_i2c_read(u8 ack)
     return (data);
 }
 
+#ifdef CONFIG_PRESSURE_I2C_ISR
+// *************************************************************************************************
+// ISR clocked transactions: Timer0 CCR1 steps SCL/SDA one phase per tick while the CPU sleeps in
+// LPM3. A transaction is a script of op/argument byte pairs ending with PS_I2C_OP_STOP.
+// *************************************************************************************************
+
+static struct
+{
+    const u8 *op;               // current op/argument pair
+    u8 phase;                   // phase within the current op
+    u8 shift;                   // byte being shifted in or out
+    u8 *rx;                     // receive buffer
+    u8 rx_left;                 // bytes still to receive
+    u8 ok;                      // 0 if the device did not ACK
+    volatile u8 busy;
+} ps_xfer;
+
+// *************************************************************************************************
+// @fn          ps_i2c_tick
+// @brief       Advance the running transaction by one bus phase. Called from the Timer0 ISR.
+// @param       none
+// @return      u8                      1=transaction finished, wake up the main loop
 // *************************************************************************************************
-// @fn          as_write_register
+static u8 ps_i2c_tick(void)
+{
+    u8 op = ps_xfer.op[0];
+    u8 ph = ps_xfer.phase++;
+    u8 nack;
+
+    switch (op)
+    {
+    case PS_I2C_OP_START:
+        // SCL and SDA are high, SDA 1-0 then SCL 1-0
+        if (ph == 0)
+        {
+            PS_I2C_SDA_OUT;
+            PS_I2C_SDA_LO;
+            return 0;
+        }
+        PS_I2C_SCL_LO;
+        break;
+
+    case PS_I2C_OP_RESTART:
+        // SCL is low, release SDA, SCL 0-1, SDA 1-0, SCL 1-0
+        if (ph == 0)
+        {
+            PS_I2C_SDA_OUT;
+            PS_I2C_SDA_HI;
+            return 0;
+        }
+        if (ph == 1)
+        {
+            PS_I2C_SCL_HI;
+            return 0;
+        }
+        if (ph == 2)
+        {
+            PS_I2C_SDA_LO;
+            return 0;
+        }
+        PS_I2C_SCL_LO;
+        break;
+
+    case PS_I2C_OP_TX:
+    case PS_I2C_OP_TX_NOACK:
+        if (ph == 0)
+            ps_xfer.shift = ps_xfer.op[1];
+
+        if (ph < 16)
+        {
+            // Even phase: SCL=0 and set SDA, odd phase: SCL=1
+            if (ph & 1)
+            {
+                PS_I2C_SCL_HI;
+            }
+            else
+            {
+                PS_I2C_SCL_LO;
+                PS_I2C_SDA_OUT;
+                if (ps_xfer.shift & 0x80)
+                {
+                    PS_I2C_SDA_HI;
+                }
+                else
+                {
+                    PS_I2C_SDA_LO;
+                }
+                ps_xfer.shift <<= 1;
+            }
+            return 0;
+        }
+        if (ph == 16)
+        {
+            PS_I2C_SCL_LO;
+            PS_I2C_SDA_IN;
+            return 0;
+        }
+        if (ph == 17)
+        {
+            PS_I2C_SCL_HI;
+            return 0;
+        }
+
+        // ACK = SDA during ack clock pulse
+        nack = PS_I2C_IN & PS_SDA_PIN;
+        PS_I2C_SCL_LO;
+
+        if (nack && op == PS_I2C_OP_TX)
+        {
+            // Abort, skip to the stop condition
+            ps_xfer.ok = 0;
+            while (ps_xfer.op[0] != PS_I2C_OP_STOP)
+                ps_xfer.op += 2;
+            ps_xfer.phase = 0;
+            return 0;
+        }
+        break;
+
+    case PS_I2C_OP_RX:
+        if (ph == 0)
+        {
+            if (!ps_xfer.rx_left)
+                ps_xfer.rx_left = ps_xfer.op[1];
+            ps_xfer.shift = 0;
+        }
+
+        if (ph < 16)
+        {
+            // Even phase: SCL=0, odd phase: SCL=1 and capture SDA
+            if (ph & 1)
+            {
+                PS_I2C_SCL_HI;
+                ps_xfer.shift <<= 1;
+                if (PS_I2C_IN & PS_SDA_PIN)
+                    ps_xfer.shift |= BIT0;
+            }
+            else
+            {
+                PS_I2C_SCL_LO;
+                PS_I2C_SDA_IN;
+            }
+            return 0;
+        }
+        if (ph == 16)
+        {
+            // Master ACK to continue, NACK after the last byte
+            PS_I2C_SCL_LO;
+            PS_I2C_SDA_OUT;
+            if (ps_xfer.rx_left > 1)
+            {
+                PS_I2C_SDA_LO;
+            }
+            else
+            {
+                PS_I2C_SDA_HI;
+            }
+            return 0;
+        }
+        if (ph == 17)
+        {
+            PS_I2C_SCL_HI;
+            return 0;
+        }
+
+        PS_I2C_SCL_LO;
+        *ps_xfer.rx++ = ps_xfer.shift;
+        if (--ps_xfer.rx_left)
+        {
+            ps_xfer.phase = 0;
+            return 0;
+        }
+        break;
+
+    default:    // PS_I2C_OP_STOP
+        // SDA 0-1 transition while SCL=1
+        if (ph == 0)
+        {
+            PS_I2C_SCL_LO;
+            PS_I2C_SDA_OUT;
+            PS_I2C_SDA_LO;
+            return 0;
+        }
+        if (ph == 1)
+        {
+            PS_I2C_SCL_HI;
+            return 0;
+        }
+        PS_I2C_SDA_HI;
+        ps_xfer.busy = 0;
+        return 1;
+    }
+
+    // Next op
+    ps_xfer.op += 2;
+    ps_xfer.phase = 0;
+    return 0;
+}
+
+// *************************************************************************************************
+// @fn          ps_i2c_run
+// @brief       Run a transaction script, sleeping in LPM3 until it has finished.
+// @param       const u8 *script        op/argument pairs, ending with PS_I2C_OP_STOP
+//              u8 *rx                  Buffer for PS_I2C_OP_RX data
+// @return      u8                      1=ACK, 0=NACK
+// *************************************************************************************************
+static u8 ps_i2c_run(const u8 *script, u8 *rx)
+{
+    ps_xfer.op = script;
+    ps_xfer.phase = 0;
+    ps_xfer.rx = rx;
+    ps_xfer.rx_left = 0;
+    ps_xfer.ok = 1;
+    ps_xfer.busy = 1;
+
+    timer0_create_tick(PS_I2C_TICKS, &ps_i2c_tick);
+
+    while (ps_xfer.busy)
+    {
+        // Don't miss the wake-up between checking busy and going to sleep
+        __disable_interrupt();
+        if (ps_xfer.busy)
+            _BIS_SR(LPM3_bits + GIE);
+        else
+            __enable_interrupt();
+    }
+
+    timer0_destroy_tick();
+
+    return (ps_xfer.ok);
+}
+
+// *************************************************************************************************
+// @fn          ps_write_register
+// @brief       Write a byte to the pressure sensor
+// @param       u8 device               Device address
+//              u8 address              Register address
+//              u8 data                 Data to write
+// @return      u8
+// *************************************************************************************************
+u8 ps_write_register(u8 device, u8 address, u8 data)
+{
+    // Slave does not send the ACK after the data byte
+    u8 script[] = {
+        PS_I2C_OP_START, 0,
+        PS_I2C_OP_TX, device | PS_I2C_WRITE,
+        PS_I2C_OP_TX, address,
+        PS_I2C_OP_TX_NOACK, data,
+        PS_I2C_OP_STOP, 0,
+    };
+
+    return (ps_i2c_run(script, NULL));
+}
+
+// *************************************************************************************************
+// @fn          ps_read_burst
+// @brief       Read consecutive registers from the pressure sensor in a single transaction
+// @param       u8 device               Device address
+//              u8 address              First register address
+//              u8 *data                Destination, MSB first as sent by the device
+//              u8 len                  Number of bytes, at least 1
+// @return      u8                      1=ACK, 0=NACK
+// *************************************************************************************************
+u8 ps_read_burst(u8 device, u8 address, u8 *data, u8 len)
+{
+    u8 script[] = {
+        PS_I2C_OP_START, 0,
+        PS_I2C_OP_TX, device | PS_I2C_WRITE,
+        PS_I2C_OP_TX, address,
+        PS_I2C_OP_RESTART, 0,
+        PS_I2C_OP_TX, device | PS_I2C_READ,
+        PS_I2C_OP_RX, len,
+        PS_I2C_OP_STOP, 0,
+    };
+
+    return (ps_i2c_run(script, data));
+}
+
+#else /* CONFIG_PRESSURE_I2C_ISR */
+
+// *************************************************************************************************
+// @fn          ps_write_register
 // @brief       Write a byte to the pressure sensor
 // @param       u8 device               Device address
 //              u8 address              Register address
@@ -269,17 +552,17 @@ u8 ps_write_register(u8 device, u8 address, u8 data)
 }
 
 // *************************************************************************************************
-// @fn          ps_read_register
-// @brief       Read a byte from the pressure sensor
+// @fn          ps_read_burst
+// @brief       Read consecutive registers from the pressure sensor in a single transaction
 // @param       u8 device               Device address
-//              u8 address              Register address
-//              u8 mode                 PS_I2C_8BIT_ACCESS, PS_I2C_16BIT_ACCESS
-// @return      u16                     Register content
+//              u8 address              First register address
+//              u8 *data                Destination, MSB first as sent by the device
+//              u8 len                  Number of bytes, at least 1
+// @return      u8                      1=ACK, 0=NACK
 // *************************************************************************************************
-u16 ps_read_register(u8 device, u8 address, u8 mode)
+u8 ps_read_burst(u8 device, u8 address, u8 *data, u8 len)
 {
     u8 success;
-    u16 data = 0;
 
     ps_i2c_sda(PS_I2C_SEND_START);               // Generate start condition
 
@@ -300,19 +583,39 @@ u16 ps_read_register(u8 device, u8 address, u8 mode)
     if (!success)
         return (0);
 
+    // The register address auto-increments, ACK all but the last byte
+    while (len--)
+        *data++ = ps_i2c_read(len != 0);
+
+    ps_i2c_sda(PS_I2C_SEND_STOP);                // Generate stop condition
+
+    return (1);
+}
+
+#endif /* CONFIG_PRESSURE_I2C_ISR */
+
+// *************************************************************************************************
+// @fn          ps_read_register
+// @brief       Read a byte from the pressure sensor
+// @param       u8 device               Device address
+//              u8 address              Register address
+//              u8 mode                 PS_I2C_8BIT_ACCESS, PS_I2C_16BIT_ACCESS
+// @return      u16                     Register content
+// *************************************************************************************************
+u16 ps_read_register(u8 device, u8 address, u8 mode)
+{
+    u8 data[2];
+
     if (mode == PS_I2C_16BIT_ACCESS)
     {
-        data = ps_i2c_read(1) << 8;              // Read MSB 8bit data from register
-        data |= ps_i2c_read(0);                  // Read LSB 8bit data from register
-    }
-    else
-    {
-        data = ps_i2c_read(0);                   // Read 8bit data from register
+        if (!ps_read_burst(device, address, data, 2))
+            return (0);
+        return (((u16) data[0] << 8) | data[1]);
     }
 
-    ps_i2c_sda(PS_I2C_SEND_STOP);                // Generate stop condition
-
-    return (data);
+    if (!ps_read_burst(device, address, data, 1))
+        return (0);
+    return (data[0]);
 }
 
 // *************************************************************************************************
@@ -326,24 +629,37 @@ void ps_i2c_delay(void)
     asm ("	nop");
 }
 
+// *************************************************************************************************
+// @fn          mul_q16
+// @brief       Multiply a signed value with an unsigned Q16 factor using 32-bit arithmetic only.
+// @param       s32 a                   Value, |a| < 2^20
+//              u32 f                   Factor (Q16), f < 2^19
+// @return      s32                     a * f / 65536, rounded
+// *************************************************************************************************
+static int32_t mul_q16(int32_t a, u32 f)
+{
+    return (a * (int32_t) (f >> 8) + ((a * (int32_t) (f & 0xFF) + 128) >> 8) + 128) >> 8;
+}
+
 // *************************************************************************************************
 // @fn          init_pressure_table
 // @brief       Init pressure table with constants
-// @param       u32 p                           Pressure (Pa)
-// @return      u16                             Altitude (m)
+// @param       none
+// @return      none
 // *************************************************************************************************
 void init_pressure_table(void)
 {
     u8 i;
 
     for (i = 0; i < 17; i++)
-        p[i] = p0[i];
+        p[i] = (u32) p0[i] * 100;
 }
 
 // *************************************************************************************************
 // @fn          update_pressure_table
 // @brief       Calculate pressure table for reference altitude.
-//              Implemented straight from VTI reference code.
+//              Fixed point version of the VTI reference code, altitudes are
+//              handled in 1/16 m and temperatures in 0.01 K.
 // @param       s16 href                Reference height
 //              u32 p_meas              Pressure (Pa)
 //              u16 t_meas              Temperature (10*K)
@@ -351,107 +667,93 @@ void init_pressure_table(void)
 // *************************************************************************************************
 void update_pressure_table(s16 href, u32 p_meas, u16 t_meas)
 {
-    const float Invt00 = 0.003470415;
-    const float coefp = 0.00006;
-    volatile float p_fact;
-    volatile float p_noll;
-    volatile float hnoll;
-    volatile float h_low = 0;
-    volatile float t0;
+    int32_t hnoll, frac, corr, p_noll;
+    u32 q, d;
     u8 i;
 
-    // Typecast arguments
-    volatile float fl_href = href;
-    volatile float fl_p_meas = (float)p_meas / 100;     // Convert from Pa to hPa
-    volatile float fl_t_meas = (float)t_meas / 10;      // Convert from 10 K to 1 K
-
-    t0 = fl_t_meas + (0.0065 * fl_href);
+    // Altitude in the standard atmosphere: href * T00 / (t_meas + 0.0065 * href)
+    d = (int32_t) t_meas * 10 + ((int32_t) href * 13) / 20;
+    q = (((u32) 28815 << 16) + d / 2) / d;
+    hnoll = mul_q16((int32_t) href * 16, q);
 
-    hnoll = fl_href / (t0 * Invt00);
-
-    for (i = 0; i <= 15; i++)
+    for (i = 1; i < 16; i++)
     {
-        if (h0[i] > hnoll)
+        if ((int32_t) h0[i] * 16 > hnoll)
             break;
-        h_low = h0[i];
     }
 
-    p_noll =
-        (float)(hnoll -
-                h_low) *
-        (1 -
-         (hnoll -
-          (float)h0[i]) *
-         coefp) * ((float)p0[i] - (float)p0[i - 1]) / ((float)h0[i] - h_low) + (float)p0[i - 1];
+    // Interpolate between p0[i - 1] and p0[i], the quadratic term is (1 - (hnoll - h0[i]) * 0.00006)
+    frac = ((hnoll - (int32_t) h0[i - 1] * 16) << 15) / ((int32_t) (h0[i] - h0[i - 1]) * 16);
+    corr = 32768 + (((int32_t) h0[i] * 16 - hnoll) * 2013 >> 14);
+    frac = (frac * corr) >> 15;
 
-    // Calculate multiplicator
-    p_fact = fl_p_meas / p_noll;
+    // Pressure at hnoll in 1/16 Pa
+    p_noll = (int32_t) p0[i - 1] * 1600 + ((frac * ((int32_t) p0[i] - p0[i - 1]) * 25) >> 9);
 
-    // Apply correction factor to pressure table
+    // Apply correction factor p_meas / p_noll to pressure table, rounded to 1 Pa
     for (i = 0; i <= 16; i++)
     {
-        p[i] = p0[i] * p_fact;
+        q = (u32) p0[i] * p_meas;
+        p[i] = (q / p_noll) * 1600 + ((q % p_noll) * 1600 + p_noll / 2) / p_noll;
     }
 }
 
 // *************************************************************************************************
-// @fn          conv_pa_to_meter
-// @brief       Convert pressure (Pa) to altitude (m) using a conversion table
-//              Implemented straight from VTI reference code.
+// @fn          conv_pa_to_altitude
+// @brief       Convert pressure (Pa) to altitude (1/16 m) using a conversion table
+//              Fixed point version of the VTI reference code, altitudes are
+//              handled in 1/16 m and temperatures in 0.01 K.
+//              Three 32-bit divisions dominate the cost, roughly 1500 cycles
+//              against several thousand for the soft-float version.
 // @param       u32 p_meas              Pressure (Pa)
 //              u16 t_meas              Temperature (10*K)
-// @return      s16                     Altitude (m)
+// @return      int32_t                 Altitude (1/16 m)
 // *************************************************************************************************
-s16 conv_pa_to_meter(u32 p_meas, u16 t_meas)
+int32_t conv_pa_to_altitude(u32 p_meas, u16 t_meas)
 {
-    const float coef2 = 0.0007;
-    const float Invt00 = 0.003470415;
-    volatile float hnoll;
-    volatile float t0;
-    volatile float p_low;
-    volatile float fl_h;
-    volatile s16 h;
-    u8 i;
-
-    // Typecast arguments
-    volatile float fl_p_meas = (float)p_meas / 100;     // Convert from Pa to hPa
-    volatile float fl_t_meas = (float)t_meas / 10;      // Convert from 10 K to 1 K
+    int32_t hnoll, frac, corr;
+    u32 q, d, r;
+    u8 i, j;
 
     for (i = 0; i <= 16; i++)
     {
-        if (p[i] < fl_p_meas)
+        if (p[i] < p_meas)
             break;
-        p_low = p[i];
     }
 
-    if (i == 0)
-    {
-        hnoll = (float)(fl_p_meas - p[0]) / (p[1] - p[0]) * ((float)(h0[1] - h0[0]));
-    }
-    else if (i < 15)
-    {
-        hnoll =
-            (float)(fl_p_meas -
-                    p_low) *
-            (1 -
-             (fl_p_meas -
-              p[i]) * coef2) / (p[i] - p_low) * ((float)(h0[i] - h0[i - 1])) + h0[i - 1];
-    }
-    else if (i == 15)
-    {
-        hnoll =
-            (float)(fl_p_meas - p_low) / (p[i] - p_low) * ((float)(h0[i] - h0[i - 1])) + h0[i - 1];
-    }
-    else                        // i==16
+    // Segment p[j] >= p_meas > p[j + 1], extrapolate beyond both ends
+    j = (i == 0) ? 0 : (i > 16) ? 15 : i - 1;
+
+    frac = ((int32_t) (p[j] - p_meas) << 15) / (int32_t) (p[j] - p[j + 1]);
+
+    // Quadratic term (1 - (p_meas - p[i]) * 0.0007 / hPa) inside the table
+    if (i > 0 && i < 15)
     {
-        hnoll = (float)(fl_p_meas - p[16]) / (p[16] - p[15]) * ((float)(h0[16] - h0[15])) + h0[16];
+        corr = 32768 - (int32_t) (((p_meas - p[i]) * 15033) >> 16);
+        frac = (frac * corr) >> 15;
     }
 
-    // Compensate temperature error
-    t0 = fl_t_meas / (1 - hnoll * Invt00 * 0.0065);
-    fl_h = Invt00 * t0 * hnoll;
-    h = (u16) fl_h;
+    hnoll = (int32_t) h0[j] * 16 + ((frac * (h0[j + 1] - h0[j]) + 1024) >> 11);
 
-    return (h);
+    // Compensate temperature error: hnoll * T / (T00 - 0.0065 * hnoll)
+    // The divisor is kept in 1/16 of 0.01 K, q = (T << 20) / d is done in two
+    // steps to stay within 32 bits
+    d = (u32) 28815 * 16 - (hnoll * 13) / 20;
+    q = ((u32) t_meas * 10) << 11;
+    r = q % d;
+    q = ((q / d) << 9) + ((r << 9) + d / 2) / d;
+
+    return (mul_q16(hnoll, q));
 }
 
+// *************************************************************************************************
+// @fn          conv_pa_to_meter
+// @brief       Convert pressure (Pa) to altitude (m) using a conversion table
+// @param       u32 p_meas              Pressure (Pa)
+//              u16 t_meas              Temperature (10*K)
+// @return      s16                     Altitude (m)
+// *************************************************************************************************
+s16 conv_pa_to_meter(u32 p_meas, u16 t_meas)
+{
+    return ((s16) ((conv_pa_to_altitude(p_meas, t_meas) + 8) >> 4));
+}
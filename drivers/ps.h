@@ -55,8 +55,10 @@ extern void ps_i2c_write(u8 data);
 extern u8 ps_i2c_read(u8 ack);
 extern u8 ps_write_register(u8 device, u8 address, u8 data);
 extern u16 ps_read_register(u8 device, u8 address, u8 mode);
+extern u8 ps_read_burst(u8 device, u8 address, u8 *data, u8 len);
 extern void init_pressure_table(void);
 extern void update_pressure_table(s16 href, u32 p_meas, u16 t_meas);
+extern int32_t conv_pa_to_altitude(u32 p_meas, u16 t_meas);
 extern s16 conv_pa_to_meter(u32 p_meas, u16 t_meas);
 extern void fakecallback(void);
 
@@ -93,6 +95,17 @@ extern void fakecallback(void);
 #define PS_I2C_8BIT_ACCESS   (0u)
 #define PS_I2C_16BIT_ACCESS  (1u)
 
+// Script ops of the ISR clocked I2C engine (CONFIG_PRESSURE_I2C_ISR)
+#define PS_I2C_OP_START      (0u)
+#define PS_I2C_OP_RESTART    (1u)
+#define PS_I2C_OP_TX         (2u)         // send byte, abort on NACK
+#define PS_I2C_OP_TX_NOACK   (3u)         // send byte, ignore NACK
+#define PS_I2C_OP_RX         (4u)         // receive n bytes
+#define PS_I2C_OP_STOP       (5u)
+
+// Timer0 ticks (1/16384 s) per bus phase, two phases per SCL period
+#define PS_I2C_TICKS         (2u)
+
 #define PS_I2C_SCL_HI        { PS_I2C_OUT |=  PS_SCL_PIN; }
 #define PS_I2C_SCL_LO        { PS_I2C_OUT &= ~PS_SCL_PIN; }
 #define PS_I2C_SDA_HI        { PS_I2C_OUT |=  PS_SDA_PIN; }
@@ -108,6 +121,9 @@ extern void fakecallback(void);
 
 // Global flag for pressure sensor initialisation status
 extern u8 ps_ok;
+
+// Set by the PORT2 ISR on a rising EOC/DRDY edge
+extern volatile u8 ps_last_interrupt;
 extern u8 bmp_used;
 
 
@@ -40,6 +40,7 @@
 
 // driver
 #include "rf1a.h"
+#include "battery.h"
 
 // *************************************************************************************************
 // Extern section
@@ -121,6 +122,9 @@ void open_radio(void)
 	// Reset radio core
 	radio_reset();
 
+	// Count the radio as switched on for the fuel gauge
+	battery_load_start(BATTERY_LOAD_RADIO);
+
 	// Enable radio IRQ
 	RF1AIFG &= ~BIT4;                         // Clear a pending interrupt
 	RF1AIE  |= BIT4;                          // Enable the interrupt
@@ -146,6 +150,8 @@ void close_radio(void)
 
 	// Put radio to sleep
 	radio_powerdown();
+
+	battery_load_stop(BATTERY_LOAD_RADIO);
 }
 
 
@@ -110,6 +110,22 @@ uint8_t rtca_get_max_days(uint8_t month, uint16_t year)
 	return 0;
 }
 
+uint32_t rtca_seconds(void)
+{
+	static const uint16_t before[12] = {
+		0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334
+	};
+	uint16_t y = rtca_time.year - 2000;
+	uint16_t days = y * 365 + (y + 3) / 4
+			+ before[rtca_time.mon - 1] + rtca_time.day - 1;
+
+	if (!(y & 3) && rtca_time.mon > 2)
+		days++;
+
+	return ((uint32_t)days * 24 + rtca_time.hour) * 3600
+		+ rtca_time.min * 60 + rtca_time.sec;
+}
+
 void rtca_set_time()
 {
 	/* Stop RTC timekeeping for a while */
@@ -151,6 +167,18 @@ void rtca_disable_alarm()
 	RTCCTL01 &= ~RTCAIE;
 }
 
+void rtca_enable_second(void)
+{
+#ifdef CONFIG_RTC_IRQ
+	RTCCTL01 |= RTCRDYIE;
+#endif
+}
+
+void rtca_disable_second(void)
+{
+	RTCCTL01 &= ~RTCRDYIE;
+}
+
 void rtca_set_date()
 {
 	uint8_t dow;
@@ -247,6 +275,10 @@ void RTC_A_ISR(void)
 		ev |= RTCA_EV_MINUTE;
 		rtca_time.min = RTCMIN;
 
+		/* the seconds of the minute had no interrupt of their own */
+		if (!(RTCCTL01 & RTCRDYIE))
+			rtca_time.sys += 59;
+
 		if (rtca_time.min != 0)		/* Hour changed */
 			goto finish;
 
@@ -57,6 +57,9 @@ void rtca_init(void);
 
 uint8_t rtca_get_max_days(uint8_t month, uint16_t year);
 
+/* seconds since 2000-01-01 00:00 of rtca_time, valid up to 2099 */
+uint32_t rtca_seconds(void);
+
 void rtca_set_time();
 void rtca_set_date();
 
@@ -66,6 +69,11 @@ void rtca_set_alarm(uint8_t hour, uint8_t min);
 void rtca_enable_alarm();
 void rtca_disable_alarm();
 
+/* the second interrupt, the system stops it while the watch is idle.
+   rtca_time.sys then counts on a minute at a time */
+void rtca_enable_second(void);
+void rtca_disable_second(void);
+
 /* exclusive use by openchronos system */
 volatile enum rtca_tevent rtca_last_event;
 
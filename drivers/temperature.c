@@ -55,65 +55,97 @@
 #include "ports.h"
 #include "display.h"
 #include "adc12.h"
-#include "timer.h"
 
-/* The code below is optimized to this value, DO NOT CHANGE */
-#define TEMPORAL_FILTER_WINDOW 4
+/* 64 samples in 4 rounds of 16 conversions, ~7ms in a single wake */
+#define TEMPERATURE_OVERSAMPLE	6
+
+/* ADC12_A calibration in the device descriptors (TLV): gain, offset,
+   then the sensor reading at 30 and 85 degC for each reference */
+#ifndef TLV_START
+#define TLV_START		0x1A08
+#define TLV_END			0x1AFF
+#define TLV_ADC12CAL		0x11
+#endif
+#define TLV_ADC12CAL_T30	(2 + (ADC12_REF_MV - 1500) / 250)
+#define TLV_ADC12CAL_T85	(TLV_ADC12CAL_T30 + 1)
+
+/* without calibration data: 680mV at 0 degC, 2.25mV/degC (slas554f
+   page 67), in 1/16 LSB against ADC12_REF */
+#define TEMPERATURE_T30_TYP \
+	((uint16_t)((680 + 30 * 2.25) * 4096 * 16 / ADC12_REF_MV))
+#define TEMPERATURE_T85_TYP \
+	((uint16_t)((680 + 85 * 2.25) * 4096 * 16 / ADC12_REF_MV))
+
+/* sensor readings at 30 and 85 degC, 1/16 LSB */
+static uint16_t temperature_t30;
+static uint16_t temperature_t85;
+
+static void (*temperature_done_fn)(void);
+
+/* data of a TLV tag, NULL if the device has none */
+static const uint16_t *temperature_tlv(uint8_t tag)
+{
+	const uint8_t *p = (const uint8_t *)TLV_START;
+
+	while (p < (const uint8_t *)TLV_END && p[0] != 0xff) {
+		if (p[0] == tag)
+			return (const uint16_t *)(p + 2);
+		p += p[1] + 2;
+	}
+
+	return NULL;
+}
+
+static void temperature_done(uint16_t value)
+{
+	void (*fn)(void) = temperature_done_fn;
 
-static uint8_t adcresult[TEMPORAL_FILTER_WINDOW];
-static uint8_t adcresult_idx = 0;
+	/* straight line through the two calibration points */
+	temperature.value = 300 + ((int32_t)value - temperature_t30) * 550
+		/ (int16_t)(temperature_t85 - temperature_t30);
+
+	temperature_done_fn = NULL;
+	if (fn)
+		fn();
+}
 
 void temperature_init(void)
 {
-	temperature.value = adc12_single_conversion(REFVSEL_0,
-						ADC12SHT0_8, ADC12INCH_10);
+	const uint16_t *cal = temperature_tlv(TLV_ADC12CAL);
+
 	temperature.offset = CONFIG_TEMPERATURE_OFFSET;
 
-	adcresult[0] = temperature.value;
-	adcresult[1] = temperature.value;
-	adcresult[2] = temperature.value;
-	adcresult[3] = temperature.value;
+	if (cal && cal[TLV_ADC12CAL_T30] != 0xffff
+	    && cal[TLV_ADC12CAL_T85] > cal[TLV_ADC12CAL_T30]) {
+		temperature_t30 = cal[TLV_ADC12CAL_T30] << 4;
+		temperature_t85 = cal[TLV_ADC12CAL_T85] << 4;
+	} else {
+		temperature_t30 = TEMPERATURE_T30_TYP;
+		temperature_t85 = TEMPERATURE_T85_TYP;
+	}
+
+	temperature_measurement(NULL);
 }
 
 
-void temperature_measurement(void)
+void temperature_measurement(void (*done_fn)(void))
 {
-	/* Convert internal temperature diode voltage */
-	adcresult[adcresult_idx++] = adc12_single_conversion(REFVSEL_0,
-						ADC12SHT0_8, ADC12INCH_10);
-	if (adcresult_idx == TEMPORAL_FILTER_WINDOW)
-		adcresult_idx = 0;
-
-	/* Calculate temporal mean value */
-	temperature.value = (temperature.value & 0xff00)
-		| (((uint16_t)adcresult[0] + (uint16_t)adcresult[1]
-		+ (uint16_t)adcresult[2] + (uint16_t)adcresult[3]) >> 2);
+	/* Convert internal temperature diode voltage, a request without
+	   callback leaves the one of a pending request alone */
+	if (done_fn)
+		temperature_done_fn = done_fn;
+	adc12_request(ADC12INCH_10, TEMPERATURE_OVERSAMPLE, &temperature_done);
 }
 
 
 void temperature_get_C(int16_t *temp)
 {
-	/* from page 67, slas554f.pdf:
-	((A10/4096*1500mV) - 680mV)*(1/2.25mV)
-	   = (A10/4096*667) - 302
-	   = (A10 - 1855) * (667 / 4096) */
-	*temp = (((int32_t)temperature.value + temperature.offset - 1855)
-		* 667 * 10) / 4096;
+	*temp = temperature.value + temperature.offset;
 }
 
 void temperature_get_F(int16_t *temp)
 {
-	/* from page 67 (slas554f.pdf):
-	offset:
-	  680mV is 0C with 2.25mV/C
-	  if 0F is -17.78C then 0F = (680-17.78*2.25) = 640mV
-	scale:
-	  if 2.25mV/C then 2.25*(5/9)=1.25mV/F
-
-	((A10/4096*1500mV) - 640mV)*(1/1.25mV) =
-	  = (A10/4096*1200) - 512
-	  = (A10 - 1748) * (1200 / 4096) */
-	*temp = (((int32_t)temperature.value + temperature.offset - 1748)
-		* 1200 * 10) / 4096;
+	/* 0.1 degF from 0.1 degC */
+	*temp = ((int32_t)(temperature.value + temperature.offset) * 9) / 5
+		+ 320;
 }
-
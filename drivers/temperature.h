@@ -23,12 +23,17 @@
 #include <openchronos.h>
 
 void temperature_init(void);
-void temperature_measurement(void);
+/* returns right away, done_fn (may be NULL) is called from the main
+   loop once temperature.value is updated. Requests while one is pending
+   share its conversion. */
+void temperature_measurement(void (*done_fn)(void));
 void temperature_get_C(int16_t *temp);
 void temperature_get_F(int16_t *temp);
 
 struct {
-	uint16_t value;
+	/* 0.1 degC, from the factory calibration of the sensor */
+	int16_t value;
+	/* user correction, 0.1 degC */
 	int16_t offset;
 } temperature;
 
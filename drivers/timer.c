@@ -54,8 +54,8 @@
 
 /* HARDWARE TIMER ASSIGNMENT:
 	 TA0CCR0: 20Hz timer
-	 TA0CCR1: Unused
-	 TA0CCR2: callback timer (for buzzer)
+	 TA0CCR1: fast tick (bit-banged buses)
+	 TA0CCR2: one-shot callbacks (buzzer sequencer, vario, sensor init)
 	 TA0CCR3: programable timer
 	 TA0CCR4: delay timer
 	OVERFLOW: 0.244Hz timer ~ 4.1ms */
@@ -74,8 +74,21 @@ static uint16_t timer0_20hz_ticks;
 
 /* programable timer */
 static uint16_t timer0_prog_ticks;
+static uint8_t timer0_prog_suspended;
 
-static void (*delay_callback)(void) = NULL;
+/* one-shot callbacks on TA0CCR2, the earliest one is armed */
+#define TIMER0_CALLBACKS 3
+
+static struct {
+	void (*fn)(void);
+	uint16_t due;	/* TA0R */
+} delay_callbacks[TIMER0_CALLBACKS];
+
+static uint8_t delay_wake;
+
+/* fast tick */
+static uint16_t timer0_tick_ticks;
+static uint8_t (*tick_callback)(void);
 
 void timer0_init(void)
 {
@@ -128,36 +141,116 @@ void timer0_delay(uint16_t duration, uint16_t LPM_bits)
 	TA0CCTL4 &= ~CCIE;
 }
 
+/* program TA0CCR2 for the earliest pending callback, called with
+   interrupts disabled */
+static void timer0_delay_callback_arm(void)
+{
+	uint16_t now = TA0R;
+	uint16_t next = 0xffff;
+	uint16_t d;
+	uint8_t i;
+
+	for (i = 0; i < TIMER0_CALLBACKS; i++) {
+		if (!delay_callbacks[i].fn)
+			continue;
+
+		/* two ticks at least, a compare value already passed
+		   would take a wrap of TA0R to match */
+		d = delay_callbacks[i].due - now;
+		if ((int16_t)d < 2)
+			d = 2;
+		if (d < next)
+			next = d;
+	}
+
+	if (next == 0xffff) {
+		TA0CCTL2 = 0;
+		return;
+	}
+
+	/* writing CCTL also clears a stale match */
+	TA0CCR2 = now + next;
+	TA0CCTL2 = CCIE;
+}
+
 void timer0_delay_callback_destroy(void)
 {
-	/* abort a delay without calling callback */
-	/* disable interrupt */
-	TA0CCTL4 &= ~CCIE;
-	//TA0CCTL2 &= ~CCIE;
+	uint16_t sr = __read_status_register();
+	uint8_t i;
+
+	/* abort delays without calling callbacks, timer0_delay() on
+	   TA0CCR4 may be waiting in the foreground and stays untouched */
+	__dint();
 	TA0CCTL2 = 0;
+	for (i = 0; i < TIMER0_CALLBACKS; i++)
+		delay_callbacks[i].fn = NULL;
+	__write_status_register(sr);
+}
 
-	/* clear callback */
-	delay_callback = NULL;
- }
+void timer0_delay_callback_cancel(void (*cbfn)(void))
+{
+	uint16_t sr = __read_status_register();
+	uint8_t i;
+
+	__dint();
+	for (i = 0; i < TIMER0_CALLBACKS; i++) {
+		if (delay_callbacks[i].fn == cbfn)
+			delay_callbacks[i].fn = NULL;
+	}
+	timer0_delay_callback_arm();
+	__write_status_register(sr);
+}
 
 void timer0_delay_callback(uint16_t duration, void(*cbfn)(void))
 {
-	timer0_delay_callback_destroy();
+	/* may be called from a callback, i.e. with interrupts disabled */
+	uint16_t sr = __read_status_register();
+	uint8_t i, slot = TIMER0_CALLBACKS;
 
-	/* setup where to go on completion */
-	delay_callback = cbfn;
+	__dint();
 
-	/* Set next CCR match */
-	TA0CCR2 = TA0R + TIMER0_TICKS_FROM_MS(duration);
+	/* a pending cbfn is moved, otherwise it takes a free slot. With
+	   all of them taken the first one is lost. */
+	for (i = 0; i < TIMER0_CALLBACKS; i++) {
+		if (delay_callbacks[i].fn == cbfn) {
+			slot = i;
+			break;
+		}
+		if (!delay_callbacks[i].fn && slot == TIMER0_CALLBACKS)
+			slot = i;
+	}
+	if (slot == TIMER0_CALLBACKS)
+		slot = 0;
 
-	/* clear any pending interrupt? */
-	TA0CCTL2 = 0;
+	delay_callbacks[slot].fn = cbfn;
+	delay_callbacks[slot].due = TA0R + TIMER0_TICKS_FROM_MS(duration);
+	timer0_delay_callback_arm();
 
-	/* enable interrupt */
-	//TA0CCTL2 |= CCIE;
-	TA0CCTL2 = CCIE;
+	__write_status_register(sr);
+}
+
+void timer0_delay_callback_wake(void)
+{
+	delay_wake = 1;
+}
+
+
+/* fast tick: ticks is in timer periods, two at least so a late ISR
+   never programs a compare value that was already passed */
+void timer0_create_tick(uint16_t ticks, uint8_t (*fn)(void))
+{
+	timer0_tick_ticks = ticks;
+	tick_callback = fn;
+
+	TA0CCR1 = TA0R + ticks;
+	TA0CCTL1 = CCIE;
 }
 
+void timer0_destroy_tick(void)
+{
+	TA0CCTL1 = 0;
+	tick_callback = NULL;
+}
 
 /* programable timer:
 	duration is in miliseconds, min=1, max=1000 */
@@ -176,6 +269,35 @@ void timer0_destroy_prog_timer()
 {
 	/* disable timer */
 	TA0CCTL3 &= ~CCIE;
+	timer0_prog_suspended = 0;
+}
+
+void timer0_suspend(void)
+{
+#ifdef CONFIG_TIMER_4S_IRQ
+	TA0CTL &= ~TAIE;
+#endif
+
+	if (TA0CCTL3 & CCIE) {
+		TA0CCTL3 &= ~CCIE;
+		timer0_prog_suspended = 1;
+	}
+}
+
+void timer0_resume(void)
+{
+#ifdef CONFIG_TIMER_4S_IRQ
+	/* the counter wrapped while suspended, the flag is stale */
+	TA0CTL &= ~TAIFG;
+	TA0CTL |= TAIE;
+#endif
+
+	if (timer0_prog_suspended) {
+		timer0_prog_suspended = 0;
+		TA0CCR3 = TA0R + timer0_prog_ticks;
+		TA0CCTL3 &= ~CCIFG;
+		TA0CCTL3 |= CCIE;
+	}
 }
 
 
@@ -205,6 +327,16 @@ void timer0_A1_ISR(void)
 	/* reading TA0IV automatically resets the interrupt flag */
 	uint8_t flag = TA0IV;
 
+	/* fast tick */
+	if (flag == TA0IV_TA0CCR1) {
+		TA0CCR1 = TA0R + timer0_tick_ticks;
+
+		if (tick_callback && tick_callback())
+			goto exit_lpm3;
+
+		return;
+	}
+
 	/* programable timer */
 	if (flag == TA0IV_TA0CCR3) {
 		/* setup timer for next time */
@@ -224,19 +356,29 @@ void timer0_A1_ISR(void)
 
 	/* one-shot delay timer with callback */
 	if (flag == TA0IV_TA0CCR2) {
-		/* disable interrupt */
-		TA0CCTL2 &= ~CCIE;
-
-		/* maybe call vector */
-		if (delay_callback) {
-			void (*tmpfn)(void) = delay_callback;
-			/* reset timer so it's not called again */
-			delay_callback = NULL;
-			/* but then it may be re-set by callback fn */
+		uint16_t now = TA0R;
+		uint8_t i;
+
+		for (i = 0; i < TIMER0_CALLBACKS; i++) {
+			void (*tmpfn)(void) = delay_callbacks[i].fn;
+
+			if (!tmpfn || (int16_t)(now - delay_callbacks[i].due) < 0)
+				continue;
+
+			/* reset slot so it's not called again, but then it
+			   may be re-set by callback fn */
+			delay_callbacks[i].fn = NULL;
 			tmpfn();
 		}
 
-		/* return to LPM3 (don't mess with SR bits) */
+		timer0_delay_callback_arm();
+
+		if (delay_wake) {
+			delay_wake = 0;
+			goto exit_lpm3;
+		}
+
+		/* return to the LPM we came from (don't mess with SR bits) */
 		return;
 	}
 
@@ -58,7 +58,7 @@ void timer0_delay(
 
 /*!
 	\brief 1ms - 1s programmable delay to callback
-	\details schedules a callback to the provided function after \b duration milliseconds.  Does not suspend other interrupts.
+	\details schedules a callback to the provided function after \b duration milliseconds.  Does not suspend other interrupts. The callback runs in interrupt context. Up to three callbacks can be pending, scheduling a pending \b cbfn again moves it. Can be called from a callback.
  */
 void timer0_delay_callback(
 	uint16_t duration, /*!< delay duration in ms */
@@ -66,10 +66,56 @@ void timer0_delay_callback(
 );
 
 /*!
-	\brief abort any pending delay callback
+	\brief abort a pending delay callback
+ */
+void timer0_delay_callback_cancel(
+	void(*cbfn)(void) /*!< function passed to timer0_delay_callback() */
+);
+
+/*!
+	\brief abort all pending delay callbacks
  */
 void timer0_delay_callback_destroy(void);
 
+/*!
+	\brief wake up the main loop once the running callback returns
+	\details For callbacks that leave an event for the main loop. Callbacks otherwise return to the low power mode they interrupted.
+ */
+void timer0_delay_callback_wake(void);
+
+/*!
+	\brief fast periodic tick in interrupt context
+	\details Calls \b fn from the timer interrupt every \b ticks periods of the 16384Hz timer clock, the CPU stays in LPM3 in between. It is meant for bit timing of software driven buses, \b fn has to be short. The main loop is woken up when \b fn returns non-zero.
+	\note There is a single tick timer, it is owned by whoever created it last.
+	\sa timer0_destroy_tick
+*/
+void timer0_create_tick(
+	uint16_t ticks,        /*!< period in 1/16384s, at least 2 */
+	uint8_t (*fn)(void)    /*!< called on every tick */
+);
+
+/*!
+	\brief stops the tick timer
+	\sa timer0_create_tick
+*/
+void timer0_destroy_tick(void);
+
+/*!
+	\brief stops the 4s and the programmable timer events
+	\details The system calls this while the watch is idle, the programmable timer keeps its period.
+	\note Modules are strictly forbidden to call this function.
+	\sa timer0_resume
+	\internal
+*/
+void timer0_suspend(void);
+
+/*!
+	\brief restarts the events stopped by #timer0_suspend
+	\note Modules are strictly forbidden to call this function.
+	\internal
+*/
+void timer0_resume(void);
+
 /*!
 	\brief Bitfield of events produced by this driver
 */
@@ -61,6 +61,7 @@
 #include <openchronos.h>
 #include "vti_as.h"
 #include "timer.h"
+#include "battery.h"
 
 #ifndef CONFIG_ACCELEROMETER
 void as_disconnect(void)
@@ -311,6 +312,8 @@ void as_start(uint8_t mode)
 	/* then select modality */
 	change_mode(mode);
 
+	battery_load_start(BATTERY_LOAD_ACCEL);
+
 }
 
 /******************************************************************************/
@@ -340,6 +343,8 @@ void as_stop(void)
 	as_write_register(0x04, 0x0A);
 	as_write_register(0x04, 0x04);
 #endif
+
+	battery_load_stop(BATTERY_LOAD_ACCEL);
 }
 
 /******************************************************************************/
@@ -457,6 +462,159 @@ uint8_t as_write_register(uint8_t bAddress, uint8_t bData)
 	return bResult;
 }
 
+#ifdef CONFIG_ACCELEROMETER_DMA
+/******************************************************************************/
+/* DMA driven X/Y/Z read out */
+/******************************************************************************/
+/* The CMA3000 answers one register per 16 bit frame and needs CSN to go
+   high between frames, so a X/Y/Z read is three address/data frames.
+   DMA channel 0 drains UCA0RXBUF and channel 1 feeds UCA0TXBUF; the DMA
+   interrupt closes a frame and opens the next one, so the CPU only runs
+   for the setup and three short ISR passes while SPI shifts in LPM0.
+
+   Approximate cost per X/Y/Z sample with SMCLK=12MHz, AS_BR_DIVIDER=30:
+     polled as_read_register() x3 : ~1500 active CPU cycles (busy-waiting
+                                    on AS_RX_IFG for 6 bytes @ 240 cycles)
+     DMA sequence                 : ~220 active CPU cycles (setup + 3 ISR
+                                    passes), the rest is spent in LPM0 */
+
+static uint8_t as_dma_tx[2];
+static uint8_t as_dma_rx[2];
+static uint8_t *as_dma_dest;
+static uint8_t as_dma_frame;
+static uint8_t (*as_dma_callback)(void);
+static volatile uint8_t as_dma_busy;
+static volatile uint8_t as_dma_waiting;
+
+static void as_dma_start_frame(void)
+{
+	/* register address for X, Y or Z, RW bit reset */
+	as_dma_tx[0] = (0x06 + as_dma_frame) << 2;
+	as_dma_tx[1] = 0;
+
+	/* channel 0: UCA0RXBUF -> as_dma_rx[], 2 bytes */
+	DMA0SA = (uint16_t) &AS_RX_BUFFER;
+	DMA0DA = (uint16_t) as_dma_rx;
+	DMA0SZ = 2;
+	DMA0CTL = DMADT_0 | DMADSTINCR_3 | DMASRCINCR_0 | DMADSTBYTE | DMASRCBYTE
+		| DMAEN | DMAIE;
+
+	/* channel 1: as_dma_tx[] -> UCA0TXBUF, 2 bytes */
+	DMA1SA = (uint16_t) as_dma_tx;
+	DMA1DA = (uint16_t) &AS_TX_BUFFER;
+	DMA1SZ = 2;
+	DMA1CTL = DMADT_0 | DMADSTINCR_0 | DMASRCINCR_3 | DMADSTBYTE | DMASRCBYTE
+		| DMAEN;
+
+	AS_CSN_OUT &= ~AS_CSN_PIN; /* Select acceleration sensor */
+
+	/* DMA triggers are edge sensitive, toggle TXIFG to kick the first byte */
+	AS_IRQ_REG &= ~(AS_TX_IFG | AS_RX_IFG);
+	AS_IRQ_REG |= AS_TX_IFG;
+}
+
+/******************************************************************************/
+/* @fn          as_get_data_async */
+/* @brief       Start a DMA read of X/Y/Z into data[0..2], returns at once. */
+/* @param       data	destination, must stay valid until completion */
+/*		done_fn	called from the DMA interrupt on completion, can be NULL,
+			returns 1 to wake the main loop */
+/* @return      0 if the transfer was started */
+/******************************************************************************/
+uint8_t as_get_data_async(uint8_t *data, uint8_t (*done_fn)(void))
+{
+	/* Exit if sensor is not powered up or a transfer is in progress */
+	if (!as_ok || as_dma_busy || (AS_PWR_OUT & AS_PWR_PIN) != AS_PWR_PIN)
+		return 1;
+
+	as_dma_busy = 1;
+	as_dma_dest = data;
+	as_dma_frame = 0;
+	as_dma_callback = done_fn;
+
+	DMACTL0 = (AS_DMA_TX_TRIGGER << 8) | AS_DMA_RX_TRIGGER;
+
+	AS_SPI_REN &= ~AS_SDI_PIN; /* Pulldown on SDI pin not required */
+	as_dma_start_frame();
+
+	return 0;
+}
+
+/******************************************************************************/
+/* @fn          as_get_data */
+/* @brief       Read acceleration values, sleeping in LPM0 during transfer. */
+/* @param       data	destination for X/Y/Z */
+/* @return      none */
+/******************************************************************************/
+void as_get_data(uint8_t *data)
+{
+	uint8_t started;
+
+	/* SMCLK must keep running for the SPI clock, so LPM0 is as deep as
+	   we can go. Interrupts are disabled around the checks so a completion
+	   between the test and the sleep does not get lost */
+	__disable_interrupt();
+	as_dma_waiting = 1;
+
+	/* a stream read may be running, ours starts after it */
+	while (as_dma_busy) {
+		_BIS_SR(LPM0_bits + GIE);
+		__disable_interrupt();
+	}
+
+	started = !as_get_data_async(data, NULL);
+	while (started && as_dma_busy) {
+		_BIS_SR(LPM0_bits + GIE);
+		__disable_interrupt();
+	}
+
+	as_dma_waiting = 0;
+	__enable_interrupt();
+}
+
+/* the last byte of a frame is in */
+static void as_dma_rx_done(void)
+{
+	uint8_t wake;
+
+	AS_CSN_OUT |= AS_CSN_PIN; /* Deselect acceleration sensor */
+
+	as_dma_dest[as_dma_frame] = as_dma_rx[1];
+
+	if (++as_dma_frame < 3) {
+		as_dma_start_frame();
+		return;
+	}
+
+	AS_SPI_REN |= AS_SDI_PIN; /* Pulldown on SDI pin required again */
+	as_dma_busy = 0;
+
+	/* give execution back to as_get_data(), or to the main loop once the
+	   callback has a batch of reads for it */
+	wake = as_dma_waiting;
+	if (as_dma_callback && as_dma_callback())
+		wake = 1;
+
+	if (wake)
+		_BIC_SR_IRQ(LPM3_bits);
+}
+
+__attribute__((interrupt(DMA_VECTOR)))
+void DMA_ISR(void)
+{
+	/* reading DMAIV clears the flag it reports, only channel 0 (RX) has
+	   its interrupt enabled so far */
+	switch (DMAIV) {
+	case DMAIV_DMA0IFG:
+		as_dma_rx_done();
+		break;
+	default:
+		break;
+	}
+}
+
+#else /* CONFIG_ACCELEROMETER_DMA */
+
 /******************************************************************************/
 /* @fn          as_get_data */
 /* @brief       Service routine to read acceleration values. */
@@ -475,6 +633,8 @@ void as_get_data(uint8_t *data)
 	*(data + 2) = as_read_register(0x08);
 }
 
+#endif /* CONFIG_ACCELEROMETER_DMA */
+
 uint8_t as_get_x(void)
 {
 	if ((AS_PWR_OUT & AS_PWR_PIN) != AS_PWR_PIN)
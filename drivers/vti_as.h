@@ -71,6 +71,9 @@ extern void as_stop(void);
 extern uint8_t as_read_register(uint8_t bAddress);
 extern uint8_t as_write_register(uint8_t bAddress, uint8_t bData);
 extern void as_get_data(uint8_t *data);
+#ifdef CONFIG_ACCELEROMETER_DMA
+extern uint8_t as_get_data_async(uint8_t *data, uint8_t (*done_fn)(void));
+#endif
 extern uint8_t as_get_x(void);
 extern uint8_t as_get_y(void);
 extern uint8_t as_get_z(void);
@@ -127,6 +130,10 @@ extern void write_FFTHR(uint8_t mgrav);
 #define AS_INT_IFG          (P2IFG)
 #define AS_INT_PIN          (BIT5)
 
+/* DMA trigger sources of USCI_A0 on the CC430F613x (see DMACTLx TSEL table) */
+#define AS_DMA_RX_TRIGGER   (16u)
+#define AS_DMA_TX_TRIGGER   (17u)
+
 /* SPI timeout to detect sensor failure */
 #define SPI_TIMEOUT	    (1000u)
 
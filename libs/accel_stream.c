@@ -0,0 +1,253 @@
+/*
+    libs/accel_stream.c: interrupt fed accelerometer sample stream
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <openchronos.h>
+
+#include "libs/accel_stream.h"
+#include "drivers/vti_as.h"
+#include "drivers/dsp.h"
+
+#ifdef CONFIG_ACCELEROMETER
+
+/* CPU budget per sample at 100Hz, SMCLK=12MHz (estimated from the code,
+   not measured):
+	ISR, polled SPI read      ~1500 cycles
+	ISR, DMA SPI read         ~250 cycles (see drivers/vti_as.c)
+	drain: scale, IIR, |v|    ~350 cycles (hardware multiplier, isqrt32)
+   which is 1.5% (polled) or 0.5% (DMA) of the CPU at 100Hz, plus
+   whatever the subscribers do at their decimated rate. */
+
+struct accel_sample {
+	uint16_t ts;
+	uint8_t xyz[3];
+};
+
+static struct accel_sample ring[ACCEL_STREAM_LEN];
+static volatile uint8_t ring_head;
+static volatile uint8_t ring_tail;
+
+static struct accel_stream_subscriber *subscribers;
+
+/* mgrav per LSB in Q8 for the active range (1/56g and 1/14g) */
+static uint16_t mg_scale;
+
+static int16_t lp[3];
+static uint8_t lp_primed;
+
+/* number of accel_stream_start() calls not yet stopped */
+static uint8_t running;
+
+/* a data ready edge was skipped while the SPI was in use, INT stays
+   high until the sample is read so no further edge will come */
+static volatile uint8_t stalled;
+
+volatile uint8_t accel_stream_pending;
+uint16_t accel_stream_overruns;
+
+#ifdef CONFIG_ACCELEROMETER_DMA
+static uint8_t scratch[3];
+static uint8_t dropping;
+#endif
+
+void accel_stream_start(uint8_t sampling)
+{
+	/* already streaming for somebody else, keep its configuration */
+	if (running++)
+		return;
+
+	ring_head = ring_tail = 0;
+	lp_primed = 0;
+	stalled = 0;
+	accel_stream_pending = 0;
+	accel_stream_overruns = 0;
+
+	mg_scale = (as_config.range == 2 ? 4571 : 18286);
+
+	as_config.sampling = sampling;
+	as_config.mode = MEASUREMENT_MODE;
+
+	as_start(MEASUREMENT_MODE);
+}
+
+void accel_stream_stop(void)
+{
+	if (!running || --running)
+		return;
+
+	as_stop();
+}
+
+uint8_t accel_stream_running(void)
+{
+	return (running > 0);
+}
+
+int16_t accel_stream_to_mg(uint8_t raw)
+{
+	return ((int32_t)(int8_t)raw * mg_scale) >> 8;
+}
+
+void accel_stream_subscribe(void (*fn)(const struct accel_frame *),
+			    uint8_t decimation)
+{
+	struct accel_stream_subscriber **p = &subscribers;
+
+	while (*p)
+		p = &(*p)->next;
+
+	*p = malloc(sizeof(struct accel_stream_subscriber));
+	(*p)->fn = fn;
+	(*p)->decimation = decimation;
+	(*p)->count = 0;
+	(*p)->next = NULL;
+}
+
+void accel_stream_unsubscribe(void (*fn)(const struct accel_frame *))
+{
+	struct accel_stream_subscriber *p = subscribers, *pp = NULL;
+
+	while (p) {
+		if (p->fn == fn) {
+			if (!pp)
+				subscribers = p->next;
+			else
+				pp->next = p->next;
+
+			free(p);
+			return;
+		}
+
+		pp = p;
+		p = p->next;
+	}
+}
+
+static uint8_t push(void)
+{
+	ring_head = (ring_head + 1) & (ACCEL_STREAM_LEN - 1);
+
+	if (((ring_head - ring_tail) & (ACCEL_STREAM_LEN - 1))
+						>= ACCEL_STREAM_BATCH) {
+		accel_stream_pending = 1;
+		return 1;
+	}
+
+	return 0;
+}
+
+#ifdef CONFIG_ACCELEROMETER_DMA
+/* from the DMA interrupt, 1 to wake the main loop */
+static uint8_t dma_done(void)
+{
+	if (dropping) {
+		accel_stream_overruns++;
+		return 0;
+	}
+
+	return push();
+}
+#endif
+
+uint8_t accel_stream_isr(void)
+{
+	uint8_t full = (((ring_head + 1) & (ACCEL_STREAM_LEN - 1)) == ring_tail);
+
+	/* the main loop is in the middle of a register access */
+	if (!(AS_CSN_OUT & AS_CSN_PIN)) {
+		accel_stream_overruns++;
+		stalled = 1;
+		accel_stream_pending = 1;
+		return ACCEL_STREAM_WAKE;
+	}
+
+	ring[ring_head].ts = TA0R;
+
+#ifdef CONFIG_ACCELEROMETER_DMA
+	/* the sample must be read even if there is no room, otherwise
+	   INT stays high and the stream stops */
+	dropping = full;
+	if (as_get_data_async(full ? scratch : ring[ring_head].xyz, &dma_done)) {
+		/* same as above, accel_stream_drain() reads it later */
+		accel_stream_overruns++;
+		stalled = 1;
+		accel_stream_pending = 1;
+		return ACCEL_STREAM_WAKE;
+	}
+
+	return ACCEL_STREAM_SMCLK;
+#else
+	if (full) {
+		uint8_t scratch[3];
+		as_get_data(scratch);
+		accel_stream_overruns++;
+		return ACCEL_STREAM_SLEEP;
+	}
+
+	as_get_data(ring[ring_head].xyz);
+
+	return (push() ? ACCEL_STREAM_WAKE : ACCEL_STREAM_SLEEP);
+#endif
+}
+
+void accel_stream_drain(void)
+{
+	struct accel_frame f;
+	struct accel_stream_subscriber *p;
+	struct accel_sample *s;
+	uint8_t i;
+
+	accel_stream_pending = 0;
+
+	while (ring_tail != ring_head) {
+		s = &ring[ring_tail];
+
+		f.ts = s->ts;
+		for (i = 0; i < 3; i++) {
+			f.mg[i] = accel_stream_to_mg(s->xyz[i]);
+
+			if (!lp_primed)
+				lp[i] = f.mg[i];
+			else
+				lp[i] += (f.mg[i] - lp[i]) >> ACCEL_STREAM_IIR_SHIFT;
+
+			f.lp[i] = lp[i];
+		}
+		lp_primed = 1;
+
+		ring_tail = (ring_tail + 1) & (ACCEL_STREAM_LEN - 1);
+
+		f.mag = isqrt32((int32_t)lp[0] * lp[0] + (int32_t)lp[1] * lp[1]
+				+ (int32_t)lp[2] * lp[2]);
+
+		for (p = subscribers; p; p = p->next) {
+			if (++p->count < p->decimation)
+				continue;
+
+			p->count = 0;
+			p->fn(&f);
+		}
+	}
+
+	if (stalled && running && (AS_INT_IN & AS_INT_PIN)) {
+		stalled = 0;
+		__disable_interrupt();
+		accel_stream_isr();
+		__enable_interrupt();
+	}
+}
+
+#endif /* CONFIG_ACCELEROMETER */
@@ -0,0 +1,87 @@
+/*
+    libs/accel_stream.h: interrupt fed accelerometer sample stream
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBS_ACCEL_STREAM_H_
+#define LIBS_ACCEL_STREAM_H_
+
+/* Raw samples are pushed into a ring buffer from the CMA3000 data ready
+   interrupt, timestamped with TA0R (16384Hz, wraps every 4s). The main
+   loop drains the ring in batches and runs every sample through the
+   fixed point stages:
+
+	raw -> mg (range scale) -> IIR low-pass -> magnitude -> decimation
+
+   Consumers subscribe with their own decimation factor and receive a
+   pointer to a struct accel_frame, which is only valid during the call. */
+
+/* ring buffer length in samples, must be a power of two */
+#define ACCEL_STREAM_LEN	16
+
+/* wake up the main loop once this many samples are pending */
+#define ACCEL_STREAM_BATCH	5
+
+/* IIR low-pass coefficient, y += (x - y) >> ACCEL_STREAM_IIR_SHIFT */
+#define ACCEL_STREAM_IIR_SHIFT	2
+
+struct accel_frame {
+	uint16_t ts;		/* TA0R ticks at data ready */
+	int16_t mg[3];		/* X/Y/Z in mgrav */
+	int16_t lp[3];		/* X/Y/Z low-passed, in mgrav */
+	uint16_t mag;		/* magnitude of lp[], in mgrav */
+};
+
+struct accel_stream_subscriber {
+	void (*fn)(const struct accel_frame *);
+	uint8_t decimation;	/* deliver every n-th sample */
+	uint8_t count;
+	struct accel_stream_subscriber *next;
+};
+
+/* set by the ISR when a batch is ready, drained from check_events() */
+extern volatile uint8_t accel_stream_pending;
+
+/* samples lost because the ring was full or the SPI was busy */
+extern uint16_t accel_stream_overruns;
+
+/* start sampling in measurement mode at the given SAMPLING_*_HZ rate.
+   Calls nest: the first one configures the sensor, the sensor is powered
+   down when every start was matched by a stop. */
+void accel_stream_start(uint8_t sampling);
+void accel_stream_stop(void);
+uint8_t accel_stream_running(void);
+
+/* convert a raw two's complement sample to mgrav for the active range */
+int16_t accel_stream_to_mg(uint8_t raw);
+
+void accel_stream_subscribe(void (*fn)(const struct accel_frame *),
+			    uint8_t decimation);
+void accel_stream_unsubscribe(void (*fn)(const struct accel_frame *));
+
+/* what the PORT2 ISR has to do with the status register on exit */
+enum accel_stream_isr_ret {
+	ACCEL_STREAM_SLEEP = 0,	/* go back to sleep */
+	ACCEL_STREAM_WAKE,	/* batch ready, exit LPM3 */
+	ACCEL_STREAM_SMCLK	/* DMA in flight, stay in LPM0 for SMCLK */
+};
+
+/* called from the PORT2 ISR on CMA3000 data ready */
+uint8_t accel_stream_isr(void);
+
+/* called from the main loop when accel_stream_pending is set */
+void accel_stream_drain(void);
+
+#endif /* LIBS_ACCEL_STREAM_H_ */
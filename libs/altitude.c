@@ -1,9 +1,11 @@
 #include <openchronos.h>
 
 #include "libs/altitude.h"
+#include "libs/altitude_kf.h"
 #include "drivers/ps.h"
 #include "drivers/cma_ps.h"
 #include "drivers/bmp_ps.h"
+#include "drivers/battery.h"
 
 
 #ifdef CONFIG_MOD_ALTITUDE_FILTER
@@ -16,9 +18,32 @@ uint8_t altPowerMode = (CONFIG_MOD_ALTITUDE_POWER-1);
 
 struct alt sAlt;
 
+/* acquisition state machine, advanced by SYS_MSG_PS_INT */
+enum alt_state {
+	ALT_IDLE = 0,
+	ALT_WAIT_TEMP,		/* BMP085 temperature conversion running */
+	ALT_WAIT_PRESSURE,	/* pressure conversion running */
+};
+
+static enum alt_state alt_state;
+static uint8_t alt_registered;
+static uint8_t alt_reset_pending;
+
+// Completion callbacks of the pending measurement, one per user
+#define ALT_DONE_MAX (3)
+static void (*alt_done_fn[ALT_DONE_MAX])(void);
+
+static void altitude_event(enum sys_message msg);
+
+/* barometric altitude noise for the climb filter, Q20 m^2. 0.5 to 0.25m
+   RMS for the BMP085 oversampling settings, the VTI sensor gets the
+   low power figure. */
+static const int32_t alt_kf_noise[4] = { 262144, 167772, 94372, 65536 };
+
 // *************************************************************************************************
 // @fn          reset_altitude_measurement
-// @brief       Reset altitude measurement.
+// @brief       Reset altitude measurement. The statistics are reset once the
+//              first measurement has completed.
 // @param       none
 // @return      none
 // *************************************************************************************************
@@ -32,15 +57,25 @@ void reset_altitude_measurement(void)
     // Pressure sensor ok?
     if (ps_ok)
     {
+        if (!alt_registered)
+        {
+            sys_messagebus_register(&altitude_event, SYS_MSG_PS_INT);
+            alt_registered = 1;
+        }
+
         // Initialise pressure table
         init_pressure_table();
 
-        // Do single conversion
-        start_altitude_measurement();
-        stop_altitude_measurement();
-        
         sAlt.accu_threshold = CONFIG_MOD_ALTITUDE_ACCU_THRESHOLD;
-        
+
+        // Do single conversion
+        alt_reset_pending = 1;
+        start_altitude_measurement(NULL);
+    }
+}
+
+static void finish_reset(void)
+{
         sAlt.altitude_calib =  sAlt.raw_altitude;
         sAlt.altitude_offset = sAlt.raw_altitude - sAlt.altitude_calib;
         
@@ -56,23 +91,22 @@ void reset_altitude_measurement(void)
         sAlt.maxAltitude = sAlt.raw_maxAltitude - sAlt.altitude_offset;
         sAlt.altitude = sAlt.raw_altitude - sAlt.altitude_offset;
 
-        sAlt.first_pressure = sAlt.pressure;
         sAlt.climb = 0;
-        for (sAlt.history_pos = 0; sAlt.history_pos < ALT_HISTORY_LEN; sAlt.history_pos++) {
-                sAlt.history[sAlt.history_pos] = 0;
-        }
-        sAlt.history_pos = 0;
-}
 }
 
 // *************************************************************************************************
 // @fn          start_altitude_measurement
-// @brief       Start altitude measurement
-// @param       none
+// @brief       Start altitude measurement. Returns right away, the conversions
+//              run while the CPU sleeps and done_fn is called from the main
+//              loop once sAlt is updated. Requests from several users while
+//              a measurement is running share it.
+// @param       done_fn         Completion callback, may be NULL
 // @return      none
 // *************************************************************************************************
-void start_altitude_measurement(void)
+void start_altitude_measurement(void (*done_fn)(void))
 {
+    uint8_t i;
+
     // Show warning if pressure sensor was not initialised properly
     
     //TODO libs should not display errors on their own
@@ -83,44 +117,71 @@ void start_altitude_measurement(void)
         return;
     }
     */
+    if (!ps_ok)
+        return;
 
-    // Start altitude measurement if timeout has elapsed
-    if (sAlt.timeout == 0)
+    for (i = 0; done_fn && i < ALT_DONE_MAX; i++)
     {
-        // Enable EOC IRQ on rising edge
-        PS_INT_IFG &= ~PS_INT_PIN;
-        PS_INT_IE |= PS_INT_PIN;
+        if (alt_done_fn[i] == done_fn)
+            break;
+        if (!alt_done_fn[i])
+        {
+            alt_done_fn[i] = done_fn;
+            break;
+        }
+    }
 
-        // Start pressure sensor
-        if (bmp_used)
+    // Measurement already running
+    if (alt_state != ALT_IDLE)
+    {
+        // The EOC edge was lost, pick the result up now
+        if (PS_INT_IN & PS_INT_PIN)
+            altitude_event(SYS_MSG_PS_INT);
+        return;
+    }
+
+    // Enable EOC IRQ on rising edge
+    PS_INT_IFG &= ~PS_INT_PIN;
+    PS_INT_IE |= PS_INT_PIN;
+
+    // Start pressure sensor
+    if (bmp_used)
+    {
+        // Temperature is only refreshed every few seconds, sAlt.temperature
+        // keeps the last reading and the compensation uses cached coefficients
+        if (bmp_ps_need_temp())
         {
+            alt_state = ALT_WAIT_TEMP;
             bmp_ps_start();
         }
         else
         {
-            cma_ps_start();
+            alt_state = ALT_WAIT_PRESSURE;
+            bmp_ps_start_pa(altPowerMode);
         }
+    }
+    else
+    {
+        // The VTI sensor converts temperature and pressure together
+        alt_state = ALT_WAIT_PRESSURE;
+        cma_ps_start();
+    }
 
-        // Set timeout counter only if sensor status was OK
-        sAlt.timeout = ALTITUDE_MEASUREMENT_TIMEOUT;
+    battery_load_start(BATTERY_LOAD_PRESSURE);
 
-        // Get updated altitude
-        while ((PS_INT_IN & PS_INT_PIN) == 0) ;
-        do_altitude_measurement();
-    }
+    // Set timeout counter only if sensor status was OK
+    sAlt.timeout = ALTITUDE_MEASUREMENT_TIMEOUT;
 }
 
 // *************************************************************************************************
-// @fn          stop_altitude_measurement
-// @brief       Stop altitude measurement
+// @fn          altitude_idle
+// @brief       Power down the sensor and forget the running measurement
 // @param       none
 // @return      none
 // *************************************************************************************************
-void stop_altitude_measurement(void)
+static void altitude_idle(void)
 {
-    // Return if pressure sensor was not initialised properly
-    if (!ps_ok)
-        return;
+    uint8_t i;
 
     // Stop pressure sensor
     if (bmp_used)
@@ -136,53 +197,71 @@ void stop_altitude_measurement(void)
     PS_INT_IE &= ~PS_INT_PIN;
     PS_INT_IFG &= ~PS_INT_PIN;
 
+    battery_load_stop(BATTERY_LOAD_PRESSURE);
+
+    alt_state = ALT_IDLE;
+    for (i = 0; i < ALT_DONE_MAX; i++)
+        alt_done_fn[i] = NULL;
+
     // Clear timeout counter
     sAlt.timeout = 0;
 }
 
 // *************************************************************************************************
-// @fn          do_altitude_measurement
-// @brief       Perform single altitude measurement
-// @param       u8 filter       Filter option
+// @fn          stop_altitude_measurement
+// @brief       Withdraw a measurement request. The running measurement is
+//              dropped unless another user still waits for it.
+// @param       done_fn         Callback passed to start_altitude_measurement()
 // @return      none
 // *************************************************************************************************
-void do_altitude_measurement()
+void stop_altitude_measurement(void (*done_fn)(void))
 {
-    volatile uint32_t pressure;
+    uint8_t i;
 
-    // If sensor is not ready, skip data read
-    if ((PS_INT_IN & PS_INT_PIN) == 0)
+    // Return if pressure sensor was not initialised properly
+    if (!ps_ok)
         return;
 
-    // Get temperature (format is *10 K) from sensor
-    if (bmp_used)
+    for (i = 0; i < ALT_DONE_MAX; i++)
     {
-        sAlt.temperature = bmp_ps_get_temp();
+        if (alt_done_fn[i] == done_fn)
+            alt_done_fn[i] = NULL;
     }
-    else
+
+    for (i = 0; i < ALT_DONE_MAX; i++)
     {
-        sAlt.temperature = cma_ps_get_temp();
+        if (alt_done_fn[i])
+            return;
     }
 
-    // Get pressure (format is 1Pa) from sensor
-    if (bmp_used)
-    {
-        // Start sampling data in configurable power mode
-        bmp_ps_write_register(BMP_085_CTRL_MEAS_REG, BMP_085_P_MEASURE + (altPowerMode << 6));
-        // Get updated altitude
-        while ((PS_INT_IN & PS_INT_PIN) == 0) ;
+    if (!alt_reset_pending)
+        altitude_idle();
+}
 
-        pressure = bmp_ps_get_pa();
-    }
+// *************************************************************************************************
+// @fn          update_altitude
+// @brief       Store a new pressure sample and derive altitude and climb
+// @param       u32 pressure    Pressure (Pa)
+//              u16 ts          TA0R at the end of the conversion
+// @return      none
+// *************************************************************************************************
+static void update_altitude(uint32_t pressure, uint16_t ts)
+{
+    int32_t h;
+    int32_t r = alt_kf_noise[bmp_used ? altPowerMode : 0];
+
+    // The climb filter gets the unfiltered altitude in 1/1024 m, restarted
+    // after a reset as the pressure table may have changed
+    h = conv_pa_to_altitude(pressure, sAlt.temperature) << 6;
+    if (alt_reset_pending)
+        altitude_kf_reset(h, r);
     else
-    {
-        pressure = cma_ps_get_pa();
-    }
+        altitude_kf_update(h, r, ts);
 
     // Store measured pressure value
     if(useFilter && sAlt.pressure){
             // Filter only if there was a previous value (to get a good first value)
-            pressure = (u32) ((pressure * 0.7) + (sAlt.pressure * 0.3));
+            pressure = (pressure * 7 + sAlt.pressure * 3 + 5) / 10;
     }
     sAlt.pressure = pressure;
         
@@ -213,18 +292,73 @@ void do_altitude_measurement()
     sAlt.maxAltitude = sAlt.raw_maxAltitude - sAlt.altitude_offset;
     sAlt.altitude = sAlt.raw_altitude - sAlt.altitude_offset;
 
-    // Update climb value. Calibration is irrelevant, as it is just a constant sum. 
-    // We subtract first_pressure from the reading to get the numbers down to something
-    // that fits in 16 bits.
-    sAlt.history_pos = (sAlt.history_pos + 1) % ALT_HISTORY_LEN;
-    // Remove oldest value
-    sAlt.climb += sAlt.history[sAlt.history_pos];
-    // Add newest value
-    sAlt.history[sAlt.history_pos] = (pressure - sAlt.first_pressure);
-    sAlt.climb += sAlt.history[sAlt.history_pos];
-    // The time half a history ago now affects the climb with a different sign,
-    // so subtract twice
-    sAlt.climb -= 2 * sAlt.history[(sAlt.history_pos + ALT_HISTORY_LEN/2) % ALT_HISTORY_LEN];
+    sAlt.climb = altitude_kf_climb();
+}
+
+// *************************************************************************************************
+// @fn          altitude_event
+// @brief       Advance the acquisition on every sensor EOC/DRDY event:
+//              temperature -> pressure -> compute
+// @param       msg             System message
+// @return      none
+// *************************************************************************************************
+static void altitude_event(enum sys_message msg)
+{
+    void (*done_fn[ALT_DONE_MAX])(void);
+    uint32_t pressure;
+    uint16_t ts = TA0R;
+    uint8_t i;
+
+    // If sensor is not ready, skip data read
+    if ((PS_INT_IN & PS_INT_PIN) == 0)
+        return;
+
+    switch (alt_state)
+    {
+    case ALT_WAIT_TEMP:
+        // Get temperature (format is *10 K) from sensor
+        sAlt.temperature = bmp_ps_get_temp();
+
+        // Start sampling data in configurable power mode
+        alt_state = ALT_WAIT_PRESSURE;
+        PS_INT_IFG &= ~PS_INT_PIN;
+        bmp_ps_start_pa(altPowerMode);
+        return;
+
+    case ALT_WAIT_PRESSURE:
+        // Get pressure (format is 1Pa) from sensor
+        if (bmp_used)
+        {
+            pressure = bmp_ps_get_pa();
+        }
+        else
+        {
+            sAlt.temperature = cma_ps_get_temp();
+            pressure = cma_ps_get_pa();
+        }
+        break;
+
+    default:
+        return;
+    }
+
+    for (i = 0; i < ALT_DONE_MAX; i++)
+        done_fn[i] = alt_done_fn[i];
+    altitude_idle();
+
+    update_altitude(pressure, ts);
+
+    if (alt_reset_pending)
+    {
+        alt_reset_pending = 0;
+        finish_reset();
+    }
+
+    for (i = 0; i < ALT_DONE_MAX; i++)
+    {
+        if (done_fn[i])
+            done_fn[i]();
+    }
 }
 
 
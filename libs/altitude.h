@@ -8,22 +8,18 @@
 extern uint8_t useFilter;
 extern uint8_t altPowerMode;
 extern void reset_altitude_measurement(void);
-extern void start_altitude_measurement(void);
-extern void stop_altitude_measurement(void);
-extern void do_altitude_measurement(void);
+extern void start_altitude_measurement(void (*done_fn)(void));
+extern void stop_altitude_measurement(void (*done_fn)(void));
 
 extern void set_altitude_calibration(int16_t cal);
 
 extern int16_t convert_ft_to_m(int16_t ft);
 extern int16_t convert_m_to_ft(int16_t m);
 
-#define ALT_HISTORY_LEN (40)	// History length. Needs to be a multiple of two.
-
 int16_t oldAccuAltitude;
 struct alt
 {
     uint32_t pressure;                                  // Pressure (Pa)
-    uint32_t first_pressure;                            // First pressure measurement.
     uint16_t temperature;                               // Temperature (K)
     int16_t raw_altitude;                              // Altitude (m)
     int16_t raw_maxAltitude;
@@ -38,12 +34,8 @@ struct alt
     int16_t accuClimbUp;
     int16_t accuClimbDown;
 
-    int16_t climb;                                      // Current climb. The unit is
-                                                        // Pa / (s * ALT_HISTORY_LEN/2 * ALT_HISTORY_LEN/2 * 1/f)
-                                                        // where f is the update frequency
-    int16_t history[ALT_HISTORY_LEN];                   // Pressure history values (ring buffer, difference
-                                                        // in Pa between measurement and first_pressure)
-    uint8_t history_pos;                                // Position in Ring buffer
+    int16_t climb;                                      // Climb rate (cm/s) from libs/altitude_kf,
+                                                        // up is positive
 };
 extern struct alt sAlt;
 
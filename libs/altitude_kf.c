@@ -0,0 +1,342 @@
+/*
+    libs/altitude_kf.c: barometer/accelerometer altitude and climb filter
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <openchronos.h>
+
+#include "libs/altitude_kf.h"
+#include "drivers/rtca.h"
+
+#ifdef CONFIG_ACCELEROMETER
+#include "libs/accel_stream.h"
+#include "drivers/vti_as.h"
+#include "drivers/dsp.h"
+#endif
+
+/* Products are done in 64 bits: the covariance spans 1e-4 to 1e3 in SI
+   units and a prediction or update costs ~20 multiplications, well
+   below 1% of the CPU at 20Hz. The gain needs a single 32-bit division
+   per barometer sample. */
+
+/* process noise, Q20 */
+#define KF_Q_ACCEL	94372	/* (0.3m/s^2)^2, fused accelerometer */
+#define KF_Q_MANEUVER	262144	/* (0.5m/s^2)^2, constant speed model */
+#define KF_Q_BIAS	105	/* (0.01m/s^2)^2 per second */
+
+/* covariance after a reset, Q20 */
+#define KF_P_V0		1048576	/* (1m/s)^2 */
+#define KF_P_B0		94372	/* (0.3m/s^2)^2 */
+#define KF_P_V_GAP	262144	/* (0.5m/s)^2, speed change across a gap */
+
+/* caps of the diagonal, keeps long gaps within 32 bits */
+#define KF_P_HH_MAX	(1L << 28)
+#define KF_P_VV_MAX	(1L << 24)
+#define KF_P_BB_MAX	(1L << 20)
+
+/* Longest gap the filter bridges, in ticks of 1/16384s. The covariance
+   grows with dt^2 and leaves 32 bits somewhere beyond 10s, slower
+   polling restarts the filter at every sample (see kf_restart()). */
+#define KF_DT_MAX	(8L << 14)
+#define KF_GAP_MAX	120		/* seconds, beyond that the speed is 0 */
+
+/* the accelerometer is fed in at this rate */
+#define KF_ACCEL_RATE		10	/* Hz */
+#define KF_GRAVITY_SHIFT	5	/* gravity tracking, ~3s at 10Hz */
+#define KF_G_MG			1000
+/* accelerometer steps without a barometer sample before it is ignored */
+#define KF_COAST_MAX		(KF_ACCEL_RATE * 4)
+
+enum { HH, HV, HB, VV, VB, BB };
+
+struct altitude_kf altitude_kf;
+
+static int32_t mulq(int32_t a, int32_t b, uint8_t q)
+{
+	return ((int64_t)a * b + (1L << (q - 1))) >> q;
+}
+
+static int32_t cap(int32_t p, int32_t max)
+{
+	return (p > max ? max : p < 1 ? 1 : p);
+}
+
+void altitude_kf_reset(int32_t h, int32_t r)
+{
+	struct altitude_kf *kf = &altitude_kf;
+
+	kf->h = h;
+	kf->v = 0;
+	kf->b = 0;
+	kf->a = 0;
+
+	kf->p[HH] = r;
+	kf->p[HV] = 0;
+	kf->p[HB] = 0;
+	kf->p[VV] = KF_P_V0;
+	kf->p[VB] = 0;
+	kf->p[BB] = KF_P_B0;
+
+	kf->ts = TA0R;
+	kf->sys = rtca_time.sys;
+	kf->coast = 0;
+}
+
+/* Ticks of 1/16384s since the last prediction, TA0R gives the fraction
+   and rtca_time.sys the whole 4s wraps. Both run off ACLK, so their
+   phase stays put. Negative for a sample older than the last one. */
+static int32_t kf_elapsed(uint16_t ts)
+{
+	uint32_t secs = rtca_time.sys - altitude_kf.sys;
+	uint16_t d = ts - altitude_kf.ts;
+
+	if (secs > KF_GAP_MAX)
+		secs = KF_GAP_MAX;
+
+	return ((int32_t)secs << 14)
+		+ (int16_t)(d - (uint16_t)(secs << 14));
+}
+
+/* x = F x + G a, P = F P F' + Q for one step of dt (Q16 s) */
+static void kf_predict(int32_t dt)
+{
+	struct altitude_kf *kf = &altitude_kf;
+	int32_t *p = kf->p;
+	int32_t d2 = mulq(dt, dt, 17);	/* dt^2 / 2 */
+	int32_t a0, a1, a2, a11, a12, q;
+
+	if (kf->accel) {
+		a0 = kf->a - kf->b;
+		kf->h += mulq(kf->v, dt, 16) + mulq(a0, d2, 16);
+		kf->v += mulq(a0, dt, 16);
+
+		/* A = F P, the bias enters with -dt^2/2 and -dt */
+		a0 = p[HH] + mulq(p[HV], dt, 16) - mulq(p[HB], d2, 16);
+		a1 = p[HV] + mulq(p[VV], dt, 16) - mulq(p[VB], d2, 16);
+		a2 = p[HB] + mulq(p[VB], dt, 16) - mulq(p[BB], d2, 16);
+		a11 = p[VV] - mulq(p[VB], dt, 16);
+		a12 = p[VB] - mulq(p[BB], dt, 16);
+
+		/* P = A F' */
+		p[HH] = a0 + mulq(a1, dt, 16) - mulq(a2, d2, 16);
+		p[HV] = a1 - mulq(a2, dt, 16);
+		p[HB] = a2;
+		p[VV] = a11 - mulq(a12, dt, 16);
+		p[VB] = a12;
+		p[BB] += mulq(KF_Q_BIAS, dt, 16);
+
+		q = KF_Q_ACCEL;
+	} else {
+		kf->h += mulq(kf->v, dt, 16);
+
+		p[HH] += mulq(p[HV], dt, 15) + mulq(mulq(p[VV], dt, 16), dt, 16);
+		p[HV] += mulq(p[VV], dt, 16);
+
+		q = KF_Q_MANEUVER;
+	}
+
+	/* the acceleration noise enters through G = [dt^2/2 dt 0]' */
+	q = mulq(mulq(q, dt, 16), dt, 16);
+	p[VV] += q;
+	q = mulq(q, dt, 17);
+	p[HV] += q;
+	p[HH] += mulq(q, dt, 17);
+
+	p[HH] = cap(p[HH], KF_P_HH_MAX);
+	p[VV] = cap(p[VV], KF_P_VV_MAX);
+	p[BB] = cap(p[BB], KF_P_BB_MAX);
+}
+
+/* predict up to TA0R ts, returns 0 if the gap is too long to bridge */
+static uint8_t kf_advance(uint16_t ts)
+{
+	int32_t dt = kf_elapsed(ts);
+
+	if (dt > KF_DT_MAX)
+		return 0;
+
+	/* the accelerometer frames of a batch may predate a barometer
+	   sample that was already fused in */
+	if (dt <= 0)
+		return 1;
+
+	kf_predict(dt << 2);
+
+	altitude_kf.ts = ts;
+	altitude_kf.sys = rtca_time.sys;
+
+	return 1;
+}
+
+/* Start over after a gap, with the speed from the last two samples as
+   the only estimate. At one sample per minute this is all there is. */
+static void kf_restart(int32_t h, int32_t r, uint16_t ts)
+{
+	struct altitude_kf *kf = &altitude_kf;
+	int32_t dt = kf_elapsed(ts);
+	int32_t v = 0, pvv = KF_P_V0;
+	uint8_t secs;
+
+	/* P[HH] is never 0 once the filter has been reset */
+	if (kf->p[HH] && dt < KF_GAP_MAX * 16384L) {
+		secs = dt >> 14;
+		v = ((int64_t)(h - kf->h) << 14) / dt;
+		pvv = 2 * r / (secs * secs) + KF_P_V_GAP;
+	}
+
+	altitude_kf_reset(h, r);
+	kf->v = v;
+	kf->p[VV] = cap(pvv, KF_P_VV_MAX);
+}
+
+void altitude_kf_update(int32_t h, int32_t r, uint16_t ts)
+{
+	struct altitude_kf *kf = &altitude_kf;
+	int32_t *p = kf->p;
+	int32_t k0, k1, k2, y;
+	uint32_t inv;
+
+	if (!p[HH] || !kf_advance(ts)) {
+		kf_restart(h, r, ts);
+		return;
+	}
+
+	kf->coast = 0;
+
+	/* K = P H' / (H P H' + R) with H = [1 0 0], the innovation
+	   variance is >= 2^16 so dropping 6 bits keeps 0.1% */
+	inv = (1UL << 31) / ((uint32_t)(p[HH] + r) >> 6);
+	k0 = mulq(p[HH], inv, 21);	/* Q16 */
+	k1 = mulq(p[HV], inv, 21);
+	k2 = mulq(p[HB], inv, 21);
+
+	y = h - kf->h;
+	kf->h += mulq(k0, y, 16);
+	kf->v += mulq(k1, y, 16);
+	kf->b += mulq(k2, y, 16);
+
+	/* P = (I - K H) P */
+	p[BB] -= mulq(k2, p[HB], 16);
+	p[VB] -= mulq(k1, p[HB], 16);
+	p[VV] -= mulq(k1, p[HV], 16);
+	p[HB] -= mulq(k0, p[HB], 16);
+	p[HV] -= mulq(k0, p[HV], 16);
+	p[HH] -= mulq(k0, p[HH], 16);
+
+	p[HH] = cap(p[HH], KF_P_HH_MAX);
+	p[VV] = cap(p[VV], KF_P_VV_MAX);
+	p[BB] = cap(p[BB], KF_P_BB_MAX);
+}
+
+int16_t altitude_kf_climb(void)
+{
+	return mulq(altitude_kf.v, 100, 10);
+}
+
+#ifdef CONFIG_ACCELEROMETER
+
+/* vertical acceleration a (Q10 m/s^2) sampled at TA0R ts, the
+   prediction up to ts still uses the previous one */
+static void kf_accel_input(int32_t a, uint16_t ts)
+{
+	/* without the barometer the integration drifts off quickly */
+	if (!altitude_kf.p[HH] || altitude_kf.coast >= KF_COAST_MAX
+	    || !kf_advance(ts))
+		return;
+
+	altitude_kf.coast++;
+	altitude_kf.a = a;
+}
+
+/* gravity vector, low-passed further than the stream, Q4 mgrav */
+static int32_t gravity[3];
+static uint8_t gravity_primed;
+
+static void kf_accel(const struct accel_frame *f)
+{
+	int32_t dot = 0, mag = 0;
+	int16_t g;
+	uint8_t i;
+
+	for (i = 0; i < 3; i++) {
+		if (!gravity_primed)
+			gravity[i] = (int32_t)f->lp[i] << 4;
+		else
+			gravity[i] += (((int32_t)f->lp[i] << 4) - gravity[i])
+							>> KF_GRAVITY_SHIFT;
+
+		g = gravity[i] >> 4;
+		dot += (int32_t)f->lp[i] * g;
+		mag += (int32_t)g * g;
+	}
+	gravity_primed = 1;
+
+	mag = isqrt32(mag);
+	if (!mag)
+		return;
+
+	/* along gravity minus 1g, mgrav to Q10 m/s^2. What the sensor
+	   reads for 1g beyond KF_G_MG ends up in the bias state. */
+	kf_accel_input(((dot / mag - KF_G_MG) * 10283L) >> 10, f->ts);
+}
+
+void altitude_kf_accel_start(void)
+{
+	if (altitude_kf.accel)
+		return;
+
+	/* 2g gives 18mgrav per LSB, keep the range of other users */
+	if (!accel_stream_running()) {
+		as_config.range = 2;
+		accel_stream_start(SAMPLING_100_HZ);
+	} else {
+		accel_stream_start(as_config.sampling);
+	}
+
+	/* the SAMPLING_* values are the rate in units of 10Hz */
+	accel_stream_subscribe(&kf_accel,
+			       as_config.sampling * 10 / KF_ACCEL_RATE);
+
+	gravity_primed = 0;
+	altitude_kf.a = 0;
+	altitude_kf.accel = 1;
+}
+
+void altitude_kf_accel_stop(void)
+{
+	if (!altitude_kf.accel)
+		return;
+
+	/* freeze the bias, the constant speed model leaves it out */
+	altitude_kf.accel = 0;
+	altitude_kf.a = 0;
+	altitude_kf.p[HB] = 0;
+	altitude_kf.p[VB] = 0;
+
+	accel_stream_unsubscribe(&kf_accel);
+	accel_stream_stop();
+}
+
+#else
+
+void altitude_kf_accel_start(void)
+{
+}
+
+void altitude_kf_accel_stop(void)
+{
+}
+
+#endif /* CONFIG_ACCELEROMETER */
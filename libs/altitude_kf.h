@@ -0,0 +1,62 @@
+/*
+    libs/altitude_kf.h: barometer/accelerometer altitude and climb filter
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBS_ALTITUDE_KF_H_
+#define LIBS_ALTITUDE_KF_H_
+
+/* Three state Kalman filter over altitude, vertical speed and the
+   accelerometer bias along gravity, in fixed point:
+
+	h, v, b		Q10 (1/1024 m, m/s, m/s^2)
+	P		Q20 (the square of the state units)
+	dt		Q16 seconds, from TA0R or rtca_time.sys
+
+   Barometric altitude is the measurement. While the accelerometer is
+   fused in, its acceleration along the slowly tracked gravity vector is
+   the control input of the prediction, otherwise the filter runs a
+   constant speed model and the bias state is left alone. */
+
+struct altitude_kf {
+	int32_t h;		/* altitude, Q10 m */
+	int32_t v;		/* vertical speed, Q10 m/s, up is positive */
+	int32_t b;		/* accelerometer bias, Q10 m/s^2 */
+	int32_t p[6];		/* covariance: hh hv hb vv vb bb */
+	int32_t a;		/* last vertical acceleration, Q10 m/s^2 */
+	uint16_t ts;		/* TA0R of the last prediction */
+	uint32_t sys;		/* rtca_time.sys of the last prediction */
+	uint8_t accel;		/* accelerometer is fused in */
+	uint8_t coast;		/* predictions since the last measurement */
+};
+
+extern struct altitude_kf altitude_kf;
+
+/* restart the filter at altitude h (Q10 m) with variance r (Q20 m^2),
+   at rest */
+void altitude_kf_reset(int32_t h, int32_t r);
+
+/* fuse a barometric altitude h (Q10 m) with variance r (Q20 m^2),
+   measured at TA0R ts */
+void altitude_kf_update(int32_t h, int32_t r, uint16_t ts);
+
+/* climb rate in cm/s */
+int16_t altitude_kf_climb(void);
+
+/* start and stop fusing in the accelerometer, see accel_stream.h */
+void altitude_kf_accel_start(void);
+void altitude_kf_accel_stop(void);
+
+#endif /* LIBS_ALTITUDE_KF_H_ */
@@ -4,9 +4,9 @@
 #include "drivers/buzzer.h"
 
 
-note shortBip[2] = {0x4b08,0x000F};
+note shortBip[2] = {0x4b18,0x000F};
 
 void buzzer_shortBip(void)
 {
-    buzzer_play(shortBip);
+    buzzer_enqueue(shortBip, BUZZER_PRIO_CLICK);
 }
\ No newline at end of file
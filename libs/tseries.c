@@ -0,0 +1,270 @@
+/*
+    libs/tseries.c: append-only time series in main flash
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <openchronos.h>
+
+#include "libs/tseries.h"
+
+#define TSERIES_NONE		0xff
+#define TSERIES_DT_TORN		0xff00
+
+static const volatile uint8_t *seg_at(const struct tseries *ts, uint8_t s)
+{
+	return ts->log + (uint16_t)s * FLASH_SEGMENT_SIZE;
+}
+
+static uint8_t seg_records(const struct tseries *ts)
+{
+	return (FLASH_SEGMENT_SIZE - TSERIES_HEADER) / (ts->size + 2);
+}
+
+static const volatile uint8_t *rec_at(const struct tseries *ts,
+				      uint8_t s, uint8_t i)
+{
+	return seg_at(ts, s) + TSERIES_HEADER + (uint16_t)i * (ts->size + 2);
+}
+
+static uint16_t rec_dt(const struct tseries *ts, uint8_t s, uint8_t i)
+{
+	return *(const volatile uint16_t *)(rec_at(ts, s, i) + ts->size);
+}
+
+static uint32_t seg_t0(const struct tseries *ts, uint8_t s)
+{
+	return *(const volatile uint32_t *)seg_at(ts, s);
+}
+
+/* an erased check word never matches, see tseries_open() */
+static uint8_t seg_valid(const struct tseries *ts, uint8_t s)
+{
+	const volatile uint16_t *h = (const volatile uint16_t *)seg_at(ts, s);
+
+	return h[2] != 0xffff && h[2] == (uint16_t)~(h[0] ^ h[1]);
+}
+
+/* records in a segment, the dt of the first free or torn one is >= 0xff00 */
+static uint8_t seg_count(const struct tseries *ts, uint8_t s)
+{
+	uint8_t lo = 0, hi = seg_records(ts), mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (rec_dt(ts, s, mid) >= TSERIES_DT_TORN)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	return lo;
+}
+
+static uint32_t rec_time(const struct tseries *ts, uint8_t s, uint8_t i)
+{
+	return seg_t0(ts, s) + ((uint32_t)rec_dt(ts, s, i) << ts->shift);
+}
+
+/* k-th segment from the oldest one, segments never written come first */
+static uint8_t seg_age(const struct tseries *ts, uint8_t k)
+{
+	k += ts->head + 1;
+
+	return (k >= ts->segments ? k - ts->segments : k);
+}
+
+void tseries_init(struct tseries *ts)
+{
+	const volatile uint8_t *addr;
+	uint8_t s, next, n, i;
+
+	/* the newest segment is followed by an older or an unused one */
+	ts->head = TSERIES_NONE;
+	for (s = 0; s < ts->segments; s++) {
+		if (!seg_valid(ts, s))
+			continue;
+
+		next = (s + 1 == ts->segments ? 0 : s + 1);
+		ts->head = s;
+		if (!seg_valid(ts, next) || seg_t0(ts, next) < seg_t0(ts, s))
+			break;
+	}
+
+	if (ts->head == TSERIES_NONE) {
+		ts->last = 0;
+		return;
+	}
+
+	n = seg_count(ts, ts->head);
+	ts->pos = n;
+	ts->last = (n ? rec_time(ts, ts->head, n - 1) : seg_t0(ts, ts->head));
+
+	if (n == seg_records(ts))
+		return;
+
+	/* a record cut short by a power failure, leave the segment alone */
+	addr = rec_at(ts, ts->head, n);
+	for (i = 0; i < ts->size + 2; i++) {
+		if (addr[i] != 0xff) {
+			ts->pos = seg_records(ts);
+			break;
+		}
+	}
+}
+
+/* erase the segment after the head and start it at t */
+static void tseries_open(struct tseries *ts, uint32_t t)
+{
+	const volatile uint8_t *seg;
+	uint16_t h[3];
+	uint16_t i;
+
+	ts->head = (ts->head == TSERIES_NONE || ts->head + 1 == ts->segments
+						? 0 : ts->head + 1);
+	ts->pos = 0;
+	seg = seg_at(ts, ts->head);
+
+	for (i = 0; i < FLASH_SEGMENT_SIZE; i++) {
+		if (seg[i] != 0xff) {
+			flash_erase_segment(seg);
+			break;
+		}
+	}
+
+	/* the check word must not read as erased, a second earlier
+	   does not change the order of the records */
+	if ((uint16_t)t == (uint16_t)(t >> 16))
+		t--;
+
+	h[0] = t;
+	h[1] = t >> 16;
+	h[2] = ~(h[0] ^ h[1]);
+
+	/* the check word goes last, it makes the segment valid */
+	flash_write(seg, h, 4);
+	flash_write(seg + 4, &h[2], 2);
+}
+
+uint8_t tseries_append(struct tseries *ts, uint32_t t, const void *rec)
+{
+	const volatile uint8_t *addr;
+	uint32_t dt = 0;
+	uint16_t d;
+
+	if (t < ts->last)
+		return 0;
+
+	if (ts->head != TSERIES_NONE)
+		dt = (t - seg_t0(ts, ts->head)) >> ts->shift;
+
+	if (ts->head == TSERIES_NONE || ts->pos == seg_records(ts)
+	    || dt > TSERIES_DT_MAX) {
+		tseries_open(ts, t);
+		dt = (t - seg_t0(ts, ts->head)) >> ts->shift;
+	}
+
+	/* dt goes last, it makes the record valid */
+	addr = rec_at(ts, ts->head, ts->pos);
+	d = dt;
+	flash_write(addr, rec, ts->size);
+	flash_write(addr + ts->size, &d, 2);
+
+	ts->pos++;
+	ts->last = t;
+
+	return 1;
+}
+
+/* step over the end of segments, 0 past the newest record */
+static uint8_t tseries_settle(const struct tseries *ts,
+			      struct tseries_cursor *c)
+{
+	while (c->rec >= seg_count(ts, c->seg)) {
+		if (c->seg == ts->head)
+			return 0;
+
+		c->seg = (c->seg + 1 == ts->segments ? 0 : c->seg + 1);
+		c->rec = 0;
+	}
+
+	return 1;
+}
+
+uint8_t tseries_seek(const struct tseries *ts, struct tseries_cursor *c,
+		     uint32_t t)
+{
+	uint8_t lo = 0, hi = ts->segments - 1, mid, s;
+
+	if (ts->head == TSERIES_NONE)
+		return 0;
+
+	/* the oldest segment in use, the head is the last one */
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (seg_valid(ts, seg_age(ts, mid)))
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	/* the newest segment starting at or before t */
+	hi = ts->segments - 1;
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		if (seg_t0(ts, seg_age(ts, mid)) <= t)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	/* and its first record at or after t, if there is one */
+	s = seg_age(ts, lo);
+	lo = 0;
+	hi = seg_count(ts, s);
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (rec_time(ts, s, mid) >= t)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+
+	c->seg = s;
+	c->rec = lo;
+
+	return tseries_settle(ts, c);
+}
+
+uint8_t tseries_read(const struct tseries *ts, struct tseries_cursor *c,
+		     uint32_t *t, void *rec)
+{
+	const volatile uint8_t *addr;
+	uint8_t *dst = rec;
+	uint8_t i;
+
+	if (ts->head == TSERIES_NONE || !tseries_settle(ts, c))
+		return 0;
+
+	addr = rec_at(ts, c->seg, c->rec);
+	for (i = 0; i < ts->size; i++)
+		dst[i] = addr[i];
+
+	if (t)
+		*t = rec_time(ts, c->seg, c->rec);
+
+	c->rec++;
+
+	return 1;
+}
@@ -0,0 +1,85 @@
+/*
+    libs/tseries.h: append-only time series in main flash
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBS_TSERIES_H_
+#define LIBS_TSERIES_H_
+
+#include "drivers/flash.h"
+
+/* A stream keeps fixed size records in a ring of main flash segments
+   reserved at link time by TSERIES(). Every segment starts with the time
+   of its first record, the records follow in time order:
+
+	header	t0 (uint32_t, seconds since 2000-01-01), ~(t0 ^ t0 >> 16)
+	record	payload, dt (uint16_t, 2^shift seconds since t0)
+
+   The payload is programmed before dt and the check word after t0, so a
+   power failure leaves nothing that reads as valid. dt of 0xff00 and up
+   is never written, a segment is closed when dt would get there or when
+   it is full. The next segment is erased then, dropping the oldest
+   records. Looking up a time is a binary search over the segment headers
+   and then over the records of one segment, an append costs one erase
+   per segment. */
+
+/* bytes of the segment header */
+#define TSERIES_HEADER		6
+
+/* largest dt of a record, in units of 2^shift seconds */
+#define TSERIES_DT_MAX		0xfeff
+
+struct tseries {
+	const volatile uint8_t *log;
+	uint8_t segments;	/* at most 127 */
+	uint8_t size;		/* payload bytes, even */
+	uint8_t shift;		/* time resolution, 2^shift seconds */
+
+	/* filled in by tseries_init() */
+	uint8_t head;		/* segment written last, 0xff if none */
+	uint8_t pos;		/* records in it */
+	uint32_t last;		/* time of the newest record */
+};
+
+/* position of a record */
+struct tseries_cursor {
+	uint8_t seg;
+	uint8_t rec;
+};
+
+/* Reserves a stream of \b segments flash segments for records of \b size
+   bytes stamped to 2^shift seconds. A record dt spans ~18h << shift,
+   pick shift so that a segment fills up before that. Example:
+
+	TSERIES(batt_history, 2, 2, 6);	// 2 bytes, 2 segments, 64s */
+#define TSERIES(name, size, segments, shift) \
+	static FLASH_REGION(name##_log, (segments) * FLASH_SEGMENT_SIZE); \
+	static struct tseries name = { FLASH_PTR(name##_log), (segments), (size), (shift) }
+
+/* find the end of the log after a reset */
+void tseries_init(struct tseries *ts);
+
+/* append a record, 0 if t is older than the newest record */
+uint8_t tseries_append(struct tseries *ts, uint32_t t, const void *rec);
+
+/* point c to the oldest record at or after t, 0 if there is none */
+uint8_t tseries_seek(const struct tseries *ts, struct tseries_cursor *c,
+		     uint32_t t);
+
+/* copy the record at c and step to the next, 0 past the newest record */
+uint8_t tseries_read(const struct tseries *ts, struct tseries_cursor *c,
+		     uint32_t *t, void *rec);
+
+#endif /* LIBS_TSERIES_H_ */
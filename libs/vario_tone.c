@@ -0,0 +1,94 @@
+/*
+    libs/vario_tone.c: audio vario tone engine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <openchronos.h>
+
+#include "libs/vario_tone.h"
+#include "drivers/buzzer.h"
+#include "drivers/timer.h"
+
+/* climbing: f = 600Hz + 2Hz per cm/s, beep period 60000 / (climb + 90)
+   ms, i.e. 600ms at the threshold and 100ms at 5m/s, half of it on */
+#define VARIO_LIFT_F0		600
+#define VARIO_LIFT_CLIMB_MAX	700	/* 2kHz */
+#define VARIO_PERIOD_K		60000U
+#define VARIO_PERIOD_OFS	90
+
+/* sinking: f = 400Hz + climb / 4, down to 200Hz */
+#define VARIO_SINK_F0		400
+#define VARIO_SINK_F_MIN	200
+
+/* how often the climb rate is looked at while not beeping, ms */
+#define VARIO_POLL		100
+
+static volatile int16_t vario_climb;
+static volatile uint8_t vario_running;
+static uint8_t vario_beep;	/* in the audible half of a beep */
+
+/* runs from the TA0CCR2 interrupt */
+static void vario_tone_step(void)
+{
+	int16_t c = vario_climb;
+	uint16_t next = VARIO_POLL;
+	int16_t f;
+
+	if (!vario_running)
+		return;
+
+	if (c >= VARIO_TONE_LIFT) {
+		if (c > VARIO_LIFT_CLIMB_MAX)
+			c = VARIO_LIFT_CLIMB_MAX;
+
+		next = VARIO_PERIOD_K / (uint16_t)(c + VARIO_PERIOD_OFS) / 2;
+		vario_beep = !vario_beep;
+		buzzer_tone(vario_beep ? VARIO_LIFT_F0 + 2 * c : 0);
+	} else if (c <= VARIO_TONE_SINK) {
+		f = VARIO_SINK_F0 + c / 4;
+		if (f < VARIO_SINK_F_MIN)
+			f = VARIO_SINK_F_MIN;
+
+		vario_beep = 0;
+		buzzer_tone(f);
+	} else {
+		vario_beep = 0;
+		buzzer_tone(0);
+	}
+
+	timer0_delay_callback(next, &vario_tone_step);
+}
+
+void vario_tone_climb(int16_t climb)
+{
+	vario_climb = climb;
+}
+
+void vario_tone_start(void)
+{
+	if (vario_running)
+		return;
+
+	vario_running = 1;
+	vario_beep = 0;
+	timer0_delay_callback(VARIO_POLL, &vario_tone_step);
+}
+
+void vario_tone_stop(void)
+{
+	vario_running = 0;
+	timer0_delay_callback_cancel(&vario_tone_step);
+	buzzer_tone(0);
+}
@@ -0,0 +1,37 @@
+/*
+    libs/vario_tone.h: audio vario tone engine
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LIBS_VARIO_TONE_H_
+#define LIBS_VARIO_TONE_H_
+
+/* Beeps the climb rate in the background: rising pitch and a faster
+   cadence while climbing, a continuous low tone when sinking fast,
+   silence in between. The tone runs on TA1 from ACLK and the beeps are
+   keyed from the TA0CCR2 callback timer, the main loop is never held
+   up. Melodies of the buzzer sequencer mute it while they play. */
+
+/* lift and sink thresholds, cm/s */
+#define VARIO_TONE_LIFT		10
+#define VARIO_TONE_SINK		-200
+
+void vario_tone_start(void);
+void vario_tone_stop(void);
+
+/* latest climb rate in cm/s, picked up at the next beep */
+void vario_tone_climb(int16_t climb);
+
+#endif /* LIBS_VARIO_TONE_H_ */
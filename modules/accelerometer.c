@@ -23,11 +23,11 @@
 #include <drivers/rtca.h>
 #include <drivers/vti_as.h>
 #include <drivers/buzzer.h>
+
+#include <libs/accel_stream.h>
 // *************************************************************************************************
 // Defines section
 
-#define BIT(x) (1uL << (x))
-
 #define ACCEL_MODE_OFF		(0u)
 #define ACCEL_MODE_ON		(1u)
 #define ACCEL_MODE_BACKGROUND	(2u)
@@ -40,13 +40,12 @@
 // This parameter is ignored if in background mode!
 #define ACCEL_MEASUREMENT_TIMEOUT		(60u)
 
-// Conversion values from data to mgrav taken from CMA3000-D0x datasheet (rev 0.4, table 4)
-const uint16_t mgrav_per_bit[7] = { 18, 36, 71, 143, 286, 571, 1142 };
-
+// Data screen refresh rate, in samples of the 100 Hz stream (5 Hz)
+#define ACCEL_DISPLAY_DECIMATION	(20u)
 
 // *** Tunes for accelerometer synestesia
 
-static note smb[] = {0x2588, 0x000F};
+static note smb[] = {0x2598, 0x000F};
 
 // *************************************************************************************************
 // Global Variable section
@@ -60,11 +59,11 @@ struct accel
 
 
 
-	// Acceleration data in 10 * mgrav
-	uint16_t		data;
+	// Low-passed acceleration of the displayed axis in mgrav
+	int16_t			data;
 
-	// Sensor old data for FIR filter
-	uint16_t		data_prev;
+	// 1 while the ACC menu entry is on screen
+	uint8_t			active;
 
 	// Timeout: should be decreased with the 1 minute RTC event
 	uint16_t			timeout;
@@ -120,24 +119,60 @@ uint8_t acceleration_value_is_positive(uint8_t value)
 // *************************************************************************************************
 uint16_t convert_acceleration_value_to_mgrav(uint8_t value)
 {
-	uint16_t result;
-	uint8_t i;
-	
-	if (!acceleration_value_is_positive(value))
-	{
-		// Convert 2's complement negative number to positive number
-		value = ~value;
-		value += 1;
-	}
-	
-	result = 0;
-	for (i=0; i<7; i++)
-	{
+	return abs(accel_stream_to_mg(value));
+}
+
+static void frame_received(const struct accel_frame *f);
 
-		result += ((value & (BIT(i)))>>i) * mgrav_per_bit[i];
+/* 1 while we hold a reference on the sample stream */
+static uint8_t streaming;
+
+static void stream_release(void)
+{
+	if (!streaming)
+		return;
+
+	accel_stream_unsubscribe(&frame_received);
+	accel_stream_stop();
+	streaming = 0;
+}
+
+/* power down the sensor unless another module is streaming from it */
+static void sensor_stop(void)
+{
+	stream_release();
+
+	if (!accel_stream_running())
+		as_stop();
+}
+
+// *************************************************************************************************
+// @fn          set_mode
+// @brief       Switch the sensor into mode, measurement mode runs the 100 Hz stream
+// @param       u8 mode	FALL_MODE, MEASUREMENT_MODE or ACTIVITY_MODE
+// @return      none
+// *************************************************************************************************
+static void set_mode(uint8_t mode)
+{
+	stream_release();
+
+	/* the sensor is shared with another stream user, which needs it
+	   to stay in measurement mode */
+	if (accel_stream_running())
+		mode = MEASUREMENT_MODE;
+
+	as_config.mode = mode;
+
+	if (mode == MEASUREMENT_MODE) {
+		accel_stream_subscribe(&frame_received, ACCEL_DISPLAY_DECIMATION);
+		accel_stream_start(SAMPLING_100_HZ);
+		streaming = 1;
+		return;
 	}
-	
-	return (result);
+
+	as_config.sampling = (mode == ACTIVITY_MODE ? SAMPLING_10_HZ
+						    : SAMPLING_100_HZ);
+	as_start(mode);
 }
 
 void update_menu()
@@ -196,9 +231,7 @@ static void up_btn()
 	// Depending on the state what do we do?
 	switch (submenu_state) {
 		case VIEW_SET_MODE:
-			as_config.mode++;
-			as_config.mode %= 3;
-			change_mode(as_config.mode);
+			set_mode((as_config.mode + 1) % 3);
 			update_menu();
 
 			break;
@@ -213,8 +246,8 @@ static void up_btn()
 			break;
 
 		case VIEW_AXIS:
-
-			display_chars(0,LCD_SEG_L1_3_0 , "TODO", SEG_SET);
+			sAccel.view_style++;
+			sAccel.view_style %= 3;
 			break;
 
 		default:
@@ -254,41 +287,24 @@ static void star_long_pressed()
 
 void display_data(uint8_t display_id)
 {
-	uint8_t raw_data=0;
-	uint16_t accel_data=0;
-
-	// Convert X/Y/Z values to mg
 	switch (sAccel.view_style)
 	{
 		case DISPLAY_ACCEL_X: 	
-			raw_data = sAccel.xyz[0];
 			display_char(display_id,LCD_SEG_L1_3, 'X', SEG_ON);
 			break;
 		case DISPLAY_ACCEL_Y: 	
-			raw_data = sAccel.xyz[1];
 			display_char(display_id,LCD_SEG_L1_3, 'Y', SEG_ON);
 			break;
 		case DISPLAY_ACCEL_Z: 	
-			raw_data = sAccel.xyz[2];
 			display_char(display_id,LCD_SEG_L1_3, 'Z', SEG_ON);
 			break;
 	}
 
-	// Filter acceleration
-	#ifdef FIXEDPOINT
-	accel_data = (uint16_t)(((sAccel.data_prev * 2) + (sAccel.data * 8)) / 10);
-	#else
-	accel_data = (uint16_t)((sAccel.data_prev * 0.2) + (sAccel.data * 0.8));
-	#endif
-
-	// Store average acceleration
-	sAccel.data = sAccel.data_prev;
-
-	// Display acceleration in x.xx format in the second screen this is real time!
-	display_chars(display_id,LCD_SEG_L1_2_0, _sprintf("%03s", accel_data), SEG_ON);
+	// Display acceleration in x.xx g format in the second screen, already low-passed by the stream
+	_printf(display_id, LCD_SEG_L1_2_0, "%03u", abs(sAccel.data) / 10);
 
 	// Display sign
-	if (acceleration_value_is_positive(raw_data)) {
+	if (sAccel.data >= 0) {
 		display_symbol(display_id,LCD_SYMB_ARROW_UP, SEG_ON);
 		display_symbol(display_id,LCD_SYMB_ARROW_DOWN, SEG_OFF);
 	} else {
@@ -296,6 +312,20 @@ void display_data(uint8_t display_id)
 		display_symbol(display_id,LCD_SYMB_ARROW_DOWN, SEG_ON);
 	}
 }
+/* 5 Hz subscriber of the 100 Hz measurement stream */
+static void frame_received(const struct accel_frame *f)
+{
+	sAccel.data = f->lp[sAccel.view_style];
+
+	if (!sAccel.active)
+		return;
+
+	display_data(1);
+	/* refresh to accelerometer screen only if in that modality */
+	if (submenu_state == VIEW_AXIS)
+		lcd_screen_activate(1);
+}
+
 static void as_event(enum sys_message msg)
 {
 
@@ -307,7 +337,7 @@ static void as_event(enum sys_message msg)
 		if(sAccel.timeout<1)
 		{
 			//disable accelerometer to save power			
-			as_stop();
+			sensor_stop();
 			//update the mode to remember
 			sAccel.mode = ACCEL_MODE_OFF;
 		}
@@ -332,16 +362,9 @@ static void as_event(enum sys_message msg)
 			/* update menu screen */
 			lcd_screen_activate(0);
 
-		}//if we were in measurment mode do a measurement and put it in the virtual screen
-		else
-		{
-
-			//display_symbol(0, LCD_ICON_ALARM , SEG_SET | BLINK_OFF);
-			display_data(1);
-			/* refresh to accelerometer screen only if in that modality */
-			if (submenu_state== VIEW_AXIS )lcd_screen_activate(1);
-
 		}
+		/* in measurement mode the data ready interrupt is consumed
+		   by the sample stream, see frame_received() */
 	}
 	/* The 1 Hz timer is used to refresh the menu screen */
 	if ( (msg & SYS_MSG_RTC_SECOND) == SYS_MSG_RTC_SECOND)
@@ -365,6 +388,7 @@ static void acc_activated()
 
 	/* create two screens, the first is always the active one */
 	lcd_screens_create(2);
+	sAccel.active = 1;
 
 	/* screen 0 will contain the menu structure and screen 1 the raw accelerometer data */
 	
@@ -383,10 +407,6 @@ static void acc_activated()
 			sAccel.data = 0;
 			// 2 g range
 			as_config.range=2;
-			// 100 Hz sampling rate
-			as_config.sampling=SAMPLING_10_HZ;
-			// keep mode
-			as_config.mode=ACTIVITY_MODE;
 			//time window is 10 msec for free fall and 100 msec for activity
 			//2g multiple 71 mg: 0F=4 * 71 mg= 1.065 g
 			as_config.MDTHR=2;
@@ -404,8 +424,9 @@ static void acc_activated()
 			// Select Axis X
 			sAccel.view_style=DISPLAY_ACCEL_Z;
 
-			// Start sensor in motion detection mode
-			as_start(ACTIVITY_MODE);
+			// Start sensor in motion detection mode, or join the
+			// sample stream if another module is already using it
+			set_mode(ACTIVITY_MODE);
 			// After this call interrupts will be generated
 		}
 
@@ -413,8 +434,7 @@ static void acc_activated()
 		{
 			display_chars(0, LCD_SEG_L1_3_0, "FAIL", SEG_SET);
 		}
-		display_chars(0, LCD_SEG_L1_3_0 , "ACTI", SEG_SET);
-		display_chars(0, LCD_SEG_L2_4_0 , "MODE", SEG_SET);
+		update_menu();
 
 
 	}
@@ -441,6 +461,7 @@ static void acc_deactivated()
 
 
 	/* destroy virtual screens */
+	sAccel.active = 0;
 	lcd_screens_destroy();
 
 	/* clean up screen */
@@ -458,7 +479,7 @@ static void acc_deactivated()
 	** deregister from the message bus */
 	sys_messagebus_unregister(&as_event);
 	/* Stop acceleration sensor */
-	as_stop();
+	sensor_stop();
 
 	/* Clear mode */
 	sAccel.mode = ACCEL_MODE_OFF;
@@ -472,7 +493,7 @@ void mod_accelerometer_init()
 	//if this is called only one time after reboot there are some important things to initialise
 	//Initialise sAccel struct?
 	sAccel.data=0;
-	sAccel.data_prev=0;
+	sAccel.active=0;
 	// Set timeout counter
 	sAccel.timeout = ACCEL_MEASUREMENT_TIMEOUT;
 	/* Clear mode */
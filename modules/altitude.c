@@ -23,6 +23,7 @@
 #include "drivers/timer.h"
 #include <drivers/rtca.h>
 #include "libs/altitude.h"
+#include "libs/altitude_kf.h"
 #include "libs/buzzer.h"
 #include "modules/altitude.h"
 
@@ -47,12 +48,6 @@ int32_t limit_high, limit_low;
 uint8_t submenuState = 0;
 uint8_t accelerometer = 0;
 uint8_t consumption = CONFIG_MOD_ALTITUDE_CONSUMPTION;
-int16_t consumption_factor[4] = { // Multiples of 20Hz
-	60*20,
-	4 *20,
-	1 *20,
-	1
-};
 int16_t consumption_array[4] = {
 	SYS_MSG_RTC_MINUTE,
 	SYS_MSG_TIMER_4S,
@@ -65,11 +60,12 @@ char *power_mode_str[4] = {
 	"HIGH",
 	"ULTR"
 };
-char *consumption_str[4] = {
+char *consumption_str[5] = {
 	"1MIN",
 	" 4 S",
 	" 1 S",
-	"  20"
+	"  20",
+	"AUTO"
 };
 char *pre_str[5] = {
 	" PRE 1",
@@ -92,6 +88,135 @@ uint8_t useMetric = 0;
 #define ALT_SCREEN_ACC_N (4)
 #define ALT_SCREEN_ACC_P (5)
 
+/* consumption setting that picks the polling rate from the activity */
+#define ALT_AUTO (5)
+
+/* Adaptive polling levels. A level is entered once the climb rate or
+   the short term variance of the altitude reaches its threshold, and
+   left again after ALT_AUTO_HOLD seconds below half of them. */
+static const struct {
+	uint8_t rate;		/* consumption setting, 1..4 */
+	uint8_t power;		/* altPowerMode */
+	int16_t climb;		/* cm/s */
+	uint16_t var;		/* 1/256 m^2 */
+} auto_levels[] = {
+	{ 2, 0,   0,      0 },	/* standing still: 4s, low power */
+	{ 3, 1,  20,    256 },	/* walking: 1s, 1m RMS or 0.2m/s */
+	{ 4, 2, 100, 0xffff },	/* flying: 20Hz, 1m/s */
+};
+#define ALT_AUTO_LEVELS (sizeof(auto_levels) / sizeof(auto_levels[0]))
+#define ALT_AUTO_HOLD (60)
+#define ALT_AUTO_SHIFT (3)	/* variance over the last ~8 samples */
+
+static struct {
+	uint8_t level;
+	uint8_t primed;
+	int32_t mean;		/* 1/16 m */
+	uint32_t var;		/* 1/256 m^2 */
+	uint32_t calm;		/* rtca_time.sys of the last activity */
+} alt_auto;
+
+static void altitude_ready(void);
+
+/* polling rate in effect, 1..4 */
+static uint8_t poll_rate(void)
+{
+	if (consumption == ALT_AUTO)
+		return auto_levels[alt_auto.level].rate;
+	return consumption;
+}
+
+/* update() listens to every rate AUTO may pick and skips the others,
+   so changing the level never touches the message bus */
+static enum sys_message poll_msgs(void)
+{
+	enum sys_message msgs = 0;
+	uint8_t i;
+
+	if (consumption != ALT_AUTO)
+		return consumption_array[consumption-1];
+
+	for (i = 0; i < ALT_AUTO_LEVELS; i++)
+		msgs |= consumption_array[auto_levels[i].rate - 1];
+	return msgs;
+}
+
+/* the accelerometer only speeds up the climb display while the pressure
+   is polled every second or faster */
+static void vario_accel(uint8_t on)
+{
+#ifdef CONFIG_MOD_ALTITUDE_VARIO_ACCEL
+	if (on && poll_rate() >= 3)
+		altitude_kf_accel_start();
+	else
+		altitude_kf_accel_stop();
+#endif
+}
+
+/* start AUTO at the lowest level */
+static void auto_start(void)
+{
+	if (consumption != ALT_AUTO)
+		return;
+
+	alt_auto.level = 0;
+	alt_auto.primed = 0;
+	alt_auto.var = 0;
+	altPowerMode = auto_levels[0].power;
+}
+
+/* pick the polling level from the last measurement */
+static void auto_adapt(void)
+{
+	int16_t climb = sAlt.climb < 0 ? -sAlt.climb : sAlt.climb;
+	int32_t d = ((int32_t)sAlt.altitude << 4) - alt_auto.mean;
+	uint8_t level = alt_auto.level;
+	uint8_t i;
+
+	if (consumption != ALT_AUTO)
+		return;
+
+	if (!alt_auto.primed) {
+		alt_auto.mean = (int32_t)sAlt.altitude << 4;
+		alt_auto.calm = rtca_time.sys;
+		alt_auto.primed = 1;
+		return;
+	}
+
+	/* exponentially weighted mean and variance */
+	alt_auto.mean += d >> ALT_AUTO_SHIFT;
+	if (d > 0x7fff || d < -0x7fff)
+		d = 0x7fff;
+	alt_auto.var += ((uint32_t)(d * d) >> ALT_AUTO_SHIFT)
+			- (alt_auto.var >> ALT_AUTO_SHIFT);
+
+	/* step up right away, as far as needed */
+	for (i = ALT_AUTO_LEVELS - 1; i > level; i--) {
+		if (climb >= auto_levels[i].climb
+		    || alt_auto.var >= auto_levels[i].var) {
+			level = i;
+			break;
+		}
+	}
+
+	/* step down one level after a calm while */
+	if (level > alt_auto.level
+	    || climb >= auto_levels[level].climb / 2
+	    || alt_auto.var >= auto_levels[level].var / 2) {
+		alt_auto.calm = rtca_time.sys;
+	} else if (level
+		   && rtca_time.sys - alt_auto.calm >= ALT_AUTO_HOLD) {
+		level--;
+		alt_auto.calm = rtca_time.sys;
+	}
+
+	if (level == alt_auto.level)
+		return;
+
+	alt_auto.level = level;
+	altPowerMode = auto_levels[level].power;
+	vario_accel(1);
+}
 
 static void altitude_activate(void)
 {
@@ -100,7 +225,9 @@ static void altitude_activate(void)
 	display_chars(0, LCD_SEG_L1_3_0, "----", SEG_SET);
     update(SYS_MSG_FAKE);
 
-	sys_messagebus_register(&update, consumption_array[consumption-1]);
+	auto_start();
+	sys_messagebus_register(&update, poll_msgs());
+	vario_accel(1);
     
     sys_messagebus_register(&time_callback, SYS_MSG_RTC_MINUTE
                         | SYS_MSG_RTC_HOUR
@@ -123,6 +250,8 @@ static void altitude_deactivate(void)
 {
 	sys_messagebus_unregister(&update);
     sys_messagebus_unregister(&time_callback);
+	stop_altitude_measurement(&altitude_ready);
+	vario_accel(0);
 	
 	
 	// Clean up function-specific segments before leaving function
@@ -172,10 +301,9 @@ void mod_altitude_init(void)
 // Extern section
 
 
-void update(enum sys_message msg)
+/* called by libs/altitude once a measurement has completed */
+static void altitude_ready(void)
 {
-	read_altitude();
-    
 	display_altitude(sAlt.altitude, 0);
     
     display_climb(sAlt.climb, ALT_SCREEN_CLIMB);
@@ -192,13 +320,23 @@ void update(enum sys_message msg)
     }
     
     time_callback(SYS_MSG_RTC_HOUR  | SYS_MSG_RTC_MINUTE);
+
+    auto_adapt();
+}
+
+void update(enum sys_message msg)
+{
+	// AUTO listens to all of its rates, only poll at the current one
+	if (!(msg & (consumption_array[poll_rate()-1] | SYS_MSG_FAKE)))
+		return;
+
+	read_altitude();
 }
 
 void read_altitude(void)
 {
-	// Start measurement
-	start_altitude_measurement();
-	stop_altitude_measurement();
+	// Start measurement, the display is refreshed when it completes
+	start_altitude_measurement(&altitude_ready);
 }
 
 // *************************************************************************************************
@@ -271,19 +409,12 @@ void display_climb(int16_t climb, uint8_t scr)
 	uint16_t value;
 	value = climb > 0 ? climb  : climb * (-1);
 
-	// value needs to be 
-	//  * averaged by ALT_HISTORY_LEN / 2 to get the pressure difference between now
-	//    and (ALT_HISTORY_LEN / 2) * sample rate ago
-	//  * time delta between two measurements is consumption_factor[consumption_factor] / 20 seconds 
-	//  * delta Pa to delta dm is -(10/12)
-	// the factors are thus (20 * 2 * 2 * 10 / 12) = 200/3
-	// hence:
-	value = value * 200 / (3 * ALT_HISTORY_LEN * ALT_HISTORY_LEN * consumption_factor[consumption-1]);
+	// climb is in cm/s, the display shows dm/s
+	value = (value + 5) / 10;
 
 	// Shown arrows only when the value is larger than 0.5 m/s
-	// Note the sign inversion (lower pressure -- higher climb)
-	display_symbol(scr, LCD_SYMB_ARROW_UP,   climb < 0 && value >= 5 ? SEG_ON : SEG_OFF);
-	display_symbol(scr, LCD_SYMB_ARROW_DOWN, climb > 0 && value >= 5 ? SEG_ON : SEG_OFF);
+	display_symbol(scr, LCD_SYMB_ARROW_UP,   climb > 0 && value >= 5 ? SEG_ON : SEG_OFF);
+	display_symbol(scr, LCD_SYMB_ARROW_DOWN, climb < 0 && value >= 5 ? SEG_ON : SEG_OFF);
 
 	_printf(scr, LCD_SEG_L1_3_0, "%4u", value);
 }
@@ -323,7 +454,7 @@ void edit_consumption_dsel(uint8_t pos)
 }
 void edit_consumption_set(uint8_t pos, int8_t step)
 {
-	helpers_loop(&consumption, 1, 4, step);
+	helpers_loop(&consumption, 1, ALT_AUTO, step);
     
 	display_chars(0, LCD_SEG_L1_3_0, consumption_str[consumption-1], SEG_SET);
 	display_symbol(0, LCD_UNIT_L1_PER_S, consumption == 4 ? SEG_ON : SEG_OFF);
@@ -432,7 +563,9 @@ void edit_filter_set(uint8_t pos, int8_t step)
 
 static void edit_save()
 {
-	sys_messagebus_register(&update, consumption_array[consumption-1]);
+	auto_start();
+	sys_messagebus_register(&update, poll_msgs());
+	vario_accel(1);
     
     sys_messagebus_register(&time_callback, SYS_MSG_RTC_MINUTE
                         | SYS_MSG_RTC_HOUR
@@ -465,6 +598,8 @@ void edit_mode_callback(void)
     lcd_screen_activate(0);
 	sys_messagebus_unregister(&update);
     sys_messagebus_unregister(&time_callback);
+	stop_altitude_measurement(&altitude_ready);
+	vario_accel(0);
     display_symbol(0, LCD_SEG_L2_COL0, SEG_OFF);
 	menu_editmode_start(&edit_save, edit_items);
 }
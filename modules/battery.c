@@ -22,8 +22,25 @@
 #include "drivers/display.h"
 #include "drivers/battery.h"
 
+#ifdef CONFIG_BATTERY_GAUGE
+/* UP steps through the gauge: days left, then uAh per day of each load */
+enum { SCR_PCT, SCR_DAYS, SCR_LOAD, SCR_COUNT = SCR_LOAD + BATTERY_LOADS };
+
+static const char *load_names[BATTERY_LOADS] = {
+	"  CPU", " BUZZ", "RADIO", "PRESS", "ACCEL"
+};
+#endif
+
 static void display_battery(void)
 {
+#ifdef CONFIG_BATTERY_GAUGE
+	uint8_t i;
+
+	/* the gauge knows better once it has been through an hour */
+	if (battery_gauge.days)
+		_printf(0, LCD_SEG_L1_2_0, "%3u", battery_gauge.percent);
+	else
+#endif
 	/* display battery percentage on line one */
 	display_chars(0, LCD_SEG_L1_2_0, _itopct(BATTERY_EMPTY_THRESHOLD,
 		   BATTERY_FULL_THRESHOLD, battery_info.voltage), SEG_SET);
@@ -32,6 +49,21 @@ static void display_battery(void)
 	/* display battery voltage in line two (xx.x format) */
 	_printf(0, LCD_SEG_L2_3_0, "%4u", battery_info.voltage);
 #endif
+
+#ifdef CONFIG_BATTERY_GAUGE
+	if (battery_gauge.days)
+		_printf(SCR_DAYS, LCD_SEG_L1_3_0, "%4u", battery_gauge.days);
+	else
+		display_chars(SCR_DAYS, LCD_SEG_L1_3_0, "----", SEG_SET);
+	display_chars(SCR_DAYS, LCD_SEG_L2_4_0, " DAYS", SEG_SET);
+
+	for (i = 0; i < BATTERY_LOADS; i++) {
+		_printf(SCR_LOAD + i, LCD_SEG_L1_3_0, "%4u",
+			battery_gauge.uah[i]);
+		display_chars(SCR_LOAD + i, LCD_SEG_L2_4_0, load_names[i],
+			      SEG_SET);
+	}
+#endif
 }
 
 static void battery_event(enum sys_message event)
@@ -45,6 +77,10 @@ static void battery_activate(void)
 
 	sys_messagebus_register(&battery_event, SYS_MSG_BATT);
 
+#ifdef CONFIG_BATTERY_GAUGE
+	lcd_screens_create(SCR_COUNT);
+#endif
+
 	/* display static symbols */
 #ifdef CONFIG_MOD_BATTERY_SHOW_VOLTAGE
 	display_symbol(0, LCD_SEG_L2_DP,    SEG_ON);
@@ -60,6 +96,11 @@ static void battery_deactivate(void)
 {
 	sys_messagebus_unregister(&battery_event);
 
+#ifdef CONFIG_BATTERY_GAUGE
+	lcd_screens_destroy();
+	display_clear(0, 2);
+#endif
+
 	/* cleanup screen */
 	display_clear(0, 1);
 #ifdef CONFIG_MOD_BATTERY_SHOW_VOLTAGE
@@ -74,8 +115,20 @@ static void battery_deactivate(void)
 	display_symbol(0, LCD_SYMB_BATTERY, SEG_OFF);
 }
 
+#ifdef CONFIG_BATTERY_GAUGE
+static void battery_up(void)
+{
+	lcd_screen_activate(0xff);
+}
+#endif
+
 void mod_battery_init(void)
 {
+#ifdef CONFIG_BATTERY_GAUGE
+	menu_add_entry(" BATT", &battery_up, NULL, NULL, NULL, NULL, NULL,
+		&battery_activate, &battery_deactivate);
+#else
 	menu_add_entry(" BATT", NULL, NULL, NULL, NULL, NULL, NULL,
 		&battery_activate, &battery_deactivate);
+#endif
 }
@@ -25,19 +25,37 @@
 #include <drivers/display.h>
 #include <drivers/buzzer.h>
 
-/* tunes generated using contrib/rtttl2bin.py */
-/* super mario bros tune */
-static note smb[] = {0x2588, 0x4b08, 0x4b08, 0x258c, 0x4b08, 0x4b0b, 0x4b04, 0x4b04, 0x4b04, 0x3204, 0x258f, 0x4b04, 0x4b0c, 0x2584, 0x4b05, 0x4b07, 0x2586, 0x2585, 0x2584, 0x258f, 0x4b08, 0x258b, 0x4b09, 0x2588, 0x4b0b, 0x4b08, 0x258c, 0x2588, 0x3207, 0x3204, 0x258f, 0x4b04, 0x4b0c, 0x2584, 0x4b05, 0x4b07, 0x2586, 0x2585, 0x2584, 0x258f, 0x4b08, 0x258b, 0x4b09, 0x2588, 0x4b0b, 0x4b08, 0x000F};
+/* generated at build time from melodies/ by contrib/rtttl2bin.py */
+#include <modules/melodies.h>
 
-static void num_press()
+static uint8_t melody;
+
+static void music_show(void)
+{
+	display_chars(0, LCD_SEG_L2_4_0, melodies[melody].name, SEG_SET);
+}
+
+static void up_press(void)
+{
+	melody = (melody + 1) % MELODIES_COUNT;
+	music_show();
+}
+
+static void down_press(void)
+{
+	melody = (melody ? melody : MELODIES_COUNT) - 1;
+	music_show();
+}
+
+static void num_press(void)
 {
-	buzzer_play(smb);
+	buzzer_enqueue_melody(melodies[melody].melody, BUZZER_PRIO_NORMAL);
 }
 
 
 static void music_activate()
 {
-	display_chars(0, LCD_SEG_L2_4_0, "MUSIC", SEG_ON);
+	music_show();
 }
 
 static void music_deactivate()
@@ -47,7 +65,8 @@ static void music_deactivate()
 
 void mod_music_init(void)
 {
-	menu_add_entry("MUSIC", NULL, NULL, &num_press, NULL, NULL, NULL,
+	menu_add_entry("MUSIC", &up_press, &down_press, &num_press,
+						NULL, NULL, NULL,
 						&music_activate,
 						&music_deactivate);
 }
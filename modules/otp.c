@@ -24,6 +24,9 @@
 
 #include <drivers/rtca.h>
 #include <drivers/display.h>
+#ifdef CONFIG_INFOMEM
+#include <drivers/infomem.h>
+#endif
 
 /* C is used as variable below */
 #undef C 
@@ -41,16 +44,12 @@
 #define SHA1_BLOCKSIZE     64
 #define SHA1_DIGEST_LENGTH 20
 
-/*in this implementation: MAX = 63*/
-#define HMAC_KEY_LENGTH 10
+/* longer keys are hashed by tools/field_encodings.py, MAX = 64 */
 #define HMAC_DATA_LENGTH 8
 
-static uint8_t  hmac_key[HMAC_KEY_LENGTH];
-static uint32_t sha1_digest[8];
-static uint32_t sha1_count;
+static uint32_t sha1_digest[5];
 static uint8_t  sha1_data[SHA1_BLOCKSIZE];
-static uint32_t sha1_W[80];
-static uint8_t  hmac_tmp_key[64 + HMAC_DATA_LENGTH];
+static uint32_t sha1_W[16];
 static uint8_t  hmac_sha[SHA1_DIGEST_LENGTH];
 
 /* SHA f()-functions */
@@ -70,30 +69,35 @@ static uint8_t  hmac_sha[SHA1_DIGEST_LENGTH];
 #define R32(x,n)    T32(((x << n) | (x >> (32 - n))))
 
 /* The generic case, for when the overall rotation is not unraveled */
-#define FG(n)       T = T32(R32(A,5) + f##n(B,C,D) + E + *WP++ + CONST##n);	\
+#define FG(n)       T = T32(R32(A,5) + f##n(B,C,D) + E + sha1_w(i) + CONST##n);	\
                 	E = D; D = C; C = R32(B,30); B = A; A = T
 
+/* word i of the message schedule, the last 16 are kept in a ring */
+static uint32_t sha1_w(uint8_t i)
+{
+	uint32_t w;
+
+	if (i < 16)
+		return sha1_W[i];
+
+	w = sha1_W[(i - 3) & 15] ^ sha1_W[(i - 8) & 15]
+		^ sha1_W[(i - 14) & 15] ^ sha1_W[i & 15];
+
+	return sha1_W[i & 15] = R32(w, 1);
+}
+
 static void sha1_transform()
 {
-	int i;
+	uint8_t i;
 	uint8_t *dp;
-	uint32_t T, A, B, C, D, E, *WP;
+	uint32_t T, A, B, C, D, E;
 
 	dp = sha1_data;
 
-    #define SWAP_DONE
 	for (i = 0; i < 16; ++i) {
-		T = *((uint32_t *) dp);
+		sha1_W[i] = ((uint32_t)dp[0] << 24) | ((uint32_t)dp[1] << 16)
+			| ((uint16_t)dp[2] << 8) | dp[3];
 		dp += 4;
-		sha1_W[i] =
-			((T << 24) & 0xff000000) |
-			((T <<  8) & 0x00ff0000) |
-			((T >>  8) & 0x0000ff00) | ((T >> 24) & 0x000000ff);
-	}
-
-	for (i = 16; i < 80; ++i) {
-		sha1_W[i] = sha1_W[i-3] ^ sha1_W[i-8] ^ sha1_W[i-14] ^ sha1_W[i-16];
-		sha1_W[i] = R32(sha1_W[i], 1);
 	}
 
 	A = sha1_digest[0];
@@ -101,7 +105,6 @@ static void sha1_transform()
 	C = sha1_digest[2];
 	D = sha1_digest[3];
 	E = sha1_digest[4];
-	WP = sha1_W;
 
 	for (i =  0; i < 20; ++i) { FG(1); }
 	for (i = 20; i < 40; ++i) { FG(2); }
@@ -116,112 +119,150 @@ static void sha1_transform()
 
 }
 
-static void sha1(const uint8_t* data, uint32_t len, uint8_t digest[20])
+/* Hash the last block, len bytes in sha1_data, continuing from state.
+   total is the length of the whole message, a key block and this one. */
+static void sha1_final(const uint32_t state[5], uint8_t len, uint16_t total)
 {
-	int i;
-	int count;
-	uint32_t lo_bit_count;
-
-	sha1_digest[0] = 0x67452301L;
-	sha1_digest[1] = 0xefcdab89L;
-	sha1_digest[2] = 0x98badcfeL;
-	sha1_digest[3] = 0x10325476L;
-	sha1_digest[4] = 0xc3d2e1f0L;
-	sha1_count = 0L;
-
-	sha1_count = T32(((uint32_t) len << 3));
+	uint8_t i, count;
 
-	while (len >= SHA1_BLOCKSIZE) {
-		memcpy(sha1_data, data, SHA1_BLOCKSIZE);
-		data += SHA1_BLOCKSIZE;
-		len -= SHA1_BLOCKSIZE;
-		sha1_transform();
-	}
-	memcpy(sha1_data, data, len);
-
-	lo_bit_count = sha1_count;
-
-	count = (int) ((lo_bit_count >> 3) & 0x3f);
-	((uint8_t *) sha1_data)[count++] = 0x80;
-	if (count > SHA1_BLOCKSIZE - 8) {
-		memset(((uint8_t *) sha1_data) + count, 0, SHA1_BLOCKSIZE - count);
-		sha1_transform();
-		memset((uint8_t *) sha1_data, 0, SHA1_BLOCKSIZE - 8);
-	} else {
-		memset(((uint8_t *) sha1_data) + count, 0,
-		       SHA1_BLOCKSIZE - 8 - count);
-	}
+	memcpy(sha1_digest, state, sizeof(sha1_digest));
 
-	sha1_data[56] = 0;
-	sha1_data[57] = 0;
-	sha1_data[58] = 0;
-	sha1_data[59] = 0;
-	sha1_data[60] = (uint8_t)((lo_bit_count >> 24) & 0xff);
-	sha1_data[61] = (uint8_t)((lo_bit_count >> 16) & 0xff);
-	sha1_data[62] = (uint8_t)((lo_bit_count >>  8) & 0xff);
-	sha1_data[63] = (uint8_t)((lo_bit_count >>  0) & 0xff);
+	sha1_data[len++] = 0x80;
+	memset(sha1_data + len, 0, SHA1_BLOCKSIZE - 2 - len);
+	sha1_data[62] = (uint8_t)(total >> 5);
+	sha1_data[63] = (uint8_t)(total << 3);
 
 	sha1_transform();
 
-	//memcpy(digest, sha1_digest, 20);
-
 	count = 0;
 	for(i = 0; i<5; i++) {
-		digest[count++] = (unsigned char) ((sha1_digest[i] >> 24) & 0xff);
-		digest[count++] = (unsigned char) ((sha1_digest[i] >> 16) & 0xff);
-		digest[count++] = (unsigned char) ((sha1_digest[i] >> 8) & 0xff);
-		digest[count++] = (unsigned char) ((sha1_digest[i]) & 0xff);
+		hmac_sha[count++] = (unsigned char) ((sha1_digest[i] >> 24) & 0xff);
+		hmac_sha[count++] = (unsigned char) ((sha1_digest[i] >> 16) & 0xff);
+		hmac_sha[count++] = (unsigned char) ((sha1_digest[i] >> 8) & 0xff);
+		hmac_sha[count++] = (unsigned char) ((sha1_digest[i]) & 0xff);
 	}
-
 }
 
-//data is in hmac_tmp_key + 64
-static uint8_t* hmac_sha1(uint8_t *data)
+/* state after hashing the key padded to the full 64 bytes and XOR'ed
+   with pad */
+static void hmac_sha1_pad(const uint8_t *key, uint8_t key_len, uint8_t pad,
+			  uint32_t state[5])
 {
-	int i;
+	uint8_t i;
 
+	for (i = 0; i < SHA1_BLOCKSIZE; ++i) {
+		sha1_data[i] = (i < key_len ? key[i] : 0) ^ pad;
+	}
+
+	sha1_digest[0] = 0x67452301L;
+	sha1_digest[1] = 0xefcdab89L;
+	sha1_digest[2] = 0x98badcfeL;
+	sha1_digest[3] = 0x10325476L;
+	sha1_digest[4] = 0xc3d2e1f0L;
+
+	sha1_transform();
+
+	memcpy(state, sha1_digest, sizeof(sha1_digest));
+}
+
+/* SHA1 state after the inner and outer key block, they only depend on the
+   key so every code starts from there */
+static void hmac_sha1_key(const uint8_t *key, uint8_t key_len,
+			  uint32_t inner[5], uint32_t outer[5])
+{
 	// The key for the inner digest is derived from our key, by padding the key
 	// the full length of 64 bytes, and then XOR'ing each byte with 0x36.
-	for (i = 0; i < HMAC_KEY_LENGTH; ++i) {
-		hmac_tmp_key[i] = hmac_key[i] ^ 0x36;
-	}
-	memset(hmac_tmp_key + HMAC_KEY_LENGTH, 0x36, 64 - HMAC_KEY_LENGTH);
-	memcpy(hmac_tmp_key + 64, data, HMAC_DATA_LENGTH);
-	sha1(hmac_tmp_key, 64 + HMAC_DATA_LENGTH, hmac_sha);
+	hmac_sha1_pad(key, key_len, 0x36, inner);
 
 	// The key for the outer digest is derived from our key, by padding the key
 	// the full length of 64 bytes, and then XOR'ing each byte with 0x5C.
-	for (i = 0; i < HMAC_KEY_LENGTH; ++i) {
-		hmac_tmp_key[i] = hmac_key[i] ^ 0x5C;
-	}
-	memset(hmac_tmp_key +  HMAC_KEY_LENGTH, 0x5C, 64 - HMAC_KEY_LENGTH);
-	memcpy(hmac_tmp_key + 64, hmac_sha, SHA1_DIGEST_LENGTH);
-	sha1(hmac_tmp_key, 64 + SHA1_DIGEST_LENGTH, hmac_sha);
+	hmac_sha1_pad(key, key_len, 0x5C, outer);
+}
+
+/* one block for the inner and one for the outer digest */
+static uint8_t* hmac_sha1(const uint32_t inner[5], const uint32_t outer[5],
+			  uint8_t *data)
+{
+	memcpy(sha1_data, data, HMAC_DATA_LENGTH);
+	sha1_final(inner, HMAC_DATA_LENGTH, SHA1_BLOCKSIZE + HMAC_DATA_LENGTH);
+
+	memcpy(sha1_data, hmac_sha, SHA1_DIGEST_LENGTH);
+	sha1_final(outer, SHA1_DIGEST_LENGTH, SHA1_BLOCKSIZE + SHA1_DIGEST_LENGTH);
 
 	return hmac_sha;
 }
 
-static int days[12] ={0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334};
+/* 2000-01-01 00:00 in Unix time */
+#define OTP_UNIX_2000 946684800UL
 
-uint32_t simple_mktime(int year, int month, int day, int hour, int minute, int second)
-{
-	//only works for year 2000 - 2032
-	uint32_t	result;
-
-	year += month / 12;
-	month %= 12;
-	result = (year - 1970) * 365 + days[month];
-	if (month <= 1) year--;
 
-	result += (year - 1968) / 4;
-	result += day - 1;
-	result  = ((result * 24 + hour) * 60 + minute) * 60 + second;
+/* The accounts of the configuration: CONFIG_MOD_OTP_KEY is the first one
+   and CONFIG_MOD_OTP_ACCOUNTS adds more, see otp_accounts() in
+   tools/field_encodings.py. They only seed the stored accounts. */
+struct otp_account {
+	const char *name;	/* 5 characters, shown on line 2 */
+	const char *key;
+	uint8_t key_len;	/* 0 if the account is unused */
+	uint8_t digits;		/* 6 to 8 */
+	uint8_t period;		/* seconds */
+};
 
-	return result;
-}
+static const struct otp_account otp_seeds[] = {
+	{ "  OTP", CONFIG_MOD_OTP_KEY, sizeof(CONFIG_MOD_OTP_KEY) - 1, 6, 30 },
+#ifdef CONFIG_MOD_OTP_ACCOUNTS
+	CONFIG_MOD_OTP_ACCOUNTS
+#endif
+};
 
-const  char     *key          = CONFIG_MOD_OTP_KEY;
-static uint32_t  last_time    = 0;
+#define OTP_SEEDS (sizeof(otp_seeds) / sizeof(otp_seeds[0]))
+
+/* accounts kept in RAM, the key only while its midstates are computed */
+#define OTP_ACCOUNTS 4
+
+/* Under CONFIG_INFOMEM the accounts are stored as
+	selected account, number of accounts, checksum of the seeds, records
+   with a record of
+	name (6 bytes), digits, period, key length, pad, key (padded to words)
+   The configuration writes them when there are none stored or when the
+   firmware comes with other seeds. */
+#define OTP_HEAD	3
+#define OTP_REC_DIGITS	6
+#define OTP_REC_PERIOD	7
+#define OTP_REC_KEY_LEN	8
+#define OTP_REC_KEY	10
+#define OTP_REC_HEAD	(OTP_REC_KEY / 2)
+#define OTP_REC_WORDS(key_len) (OTP_REC_HEAD + ((key_len) + 1) / 2)
+
+/* Codes are computed in the background, one HMAC per second at most: the
+   code of the current window first and in the last OTP_LEAD seconds the
+   one of the next window, which takes over at the boundary. */
+#define OTP_LEAD (otp_count + 1)
+
+#define OTP_HAVE_CODE 0x01
+#define OTP_HAVE_NEXT 0x02
+
+/* seconds the account name is shown after switching */
+#define OTP_NAME_TICKS 2
+
+#define OTP_INFOMEM_ID 0x11
+
+static struct otp_state {
+	char name[6];
+	uint8_t key_len;	/* 0 if the account is unused */
+	uint8_t digits;
+	uint8_t period;
+	uint32_t inner[5];
+	uint32_t outer[5];
+	uint32_t window;	/* of code, next is for window + 1 */
+	uint32_t code;
+	uint32_t next;
+	uint8_t have;
+} otp_state[OTP_ACCOUNTS];
+
+static uint8_t   otp_count    = 0;
+static uint8_t   otp_selected = 0;
+static uint8_t   otp_active   = 0;
+static uint8_t   otp_name     = 0;
 static uint8_t   otp_data[]   = {0,0,0,0,0,0,0,0};
 static uint8_t   indicator[]  = {
     SEG_A+SEG_F+SEG_E+SEG_D+SEG_C+SEG_B, SEG_B,
@@ -231,20 +272,20 @@ static uint8_t   indicator[]  = {
     SEG_A+SEG_F,                         SEG_F,
     SEG_A,                               SEG_A
 };
+static const uint32_t otp_modulo[] = { 1000000, 10000000, 100000000 };
 
-static uint32_t calculate_otp(uint32_t time)
+static uint32_t calculate_otp(uint8_t acc, uint32_t time)
 {
+	struct otp_state *st = &otp_state[acc];
 	uint32_t val = 0;
     int i;
 
-	memcpy(hmac_key, key, HMAC_KEY_LENGTH);
-
 	otp_data[4] = (time >> 24) & 0xff;
 	otp_data[5] = (time >> 16) & 0xff;
 	otp_data[6] = (time >> 8 ) & 0xff;
 	otp_data[7] = (time      ) & 0xff;
 
-	hmac_sha1(otp_data);
+	hmac_sha1(st->inner, st->outer, otp_data);
 
 	int off = hmac_sha[SHA1_DIGEST_LENGTH - 1] & 0x0f;
 
@@ -253,52 +294,308 @@ static uint32_t calculate_otp(uint32_t time)
 		cc[3-i] = hmac_sha[off+i];
 	}
 	val &= 0x7fffffff;
-	val %= 1000000;
+	val %= otp_modulo[st->digits - 6];
 
 	return val;
 }
 
+static uint32_t otp_now(void)
+{
+	return rtca_seconds() + OTP_UNIX_2000 - CONFIG_MOD_OTP_OFFSET * 3600L;
+}
+
+/* move every account to the window of time */
+static void otp_advance(uint32_t time)
+{
+	struct otp_state *st;
+	uint32_t window;
+	uint8_t i;
+
+	for (i = 0; i < otp_count; i++) {
+		st = &otp_state[i];
+		window = time / st->period;
+
+		if (window == st->window)
+			continue;
+
+		if ((st->have & OTP_HAVE_NEXT) && window == st->window + 1) {
+			st->code = st->next;
+			st->have = OTP_HAVE_CODE;
+		} else {
+			st->have = 0;
+		}
+		st->window = window;
+	}
+}
+
+/* compute at most one missing code, 0 if there was nothing to do */
+static uint8_t otp_prepare(uint32_t time)
+{
+	struct otp_state *st;
+	uint8_t i;
+
+	for (i = 0; i < otp_count; i++) {
+		st = &otp_state[i];
+
+		if (!st->key_len)
+			continue;
+
+		if (!(st->have & OTP_HAVE_CODE)) {
+			st->code = calculate_otp(i, st->window);
+			st->have |= OTP_HAVE_CODE;
+			return 1;
+		}
+
+		if (!(st->have & OTP_HAVE_NEXT)
+		    && st->period - time % st->period <= OTP_LEAD) {
+			st->next = calculate_otp(i, st->window + 1);
+			st->have |= OTP_HAVE_NEXT;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static void otp_show(uint32_t time)
+{
+	struct otp_state *st = &otp_state[otp_selected];
+	uint8_t lo, hi, segment;
+	uint16_t split;
+
+	if (!st->key_len) {
+		display_chars(0, LCD_SEG_L1_3_0, "----", SEG_SET);
+		display_chars(0, LCD_SEG_L2_4_0, st->name, SEG_SET);
+		return;
+	}
+
+	// Only right after a reset or a change of the time
+	if (!(st->have & OTP_HAVE_CODE)) {
+		st->code = calculate_otp(otp_selected, st->window);
+		st->have |= OTP_HAVE_CODE;
+	}
+
+	// Split the digits over both lines, the top line gets the odd one
+	lo = st->digits / 2;
+	hi = st->digits - lo;
+	split = (lo == 4 ? 10000 : 1000);
+
+	_printf(0, hi == 4 ? LCD_SEG_L1_3_0 : LCD_SEG_L1_2_0,
+		hi == 4 ? "%04u" : "%03u", st->code / split);
+
+	if (otp_name) {
+		otp_name--;
+		display_bits(0, LCD_SEG_L2_4, 0, BLINK_SET);
+		display_chars(0, LCD_SEG_L2_4_0, st->name, SEG_SET);
+		return;
+	}
+
+	// Check how long the current code is valid
+	segment = (uint16_t)(time % st->period) * 6 / st->period;
+
+	// Draw indicator in lower-left corner
+	display_bits(0, LCD_SEG_L2_4, indicator[2*segment  ], SEG_SET);
+	display_bits(0, LCD_SEG_L2_4, indicator[2*segment+1], BLINK_SET);
+
+	_printf(0, lo == 4 ? LCD_SEG_L2_3_0 : LCD_SEG_L2_2_0,
+		lo == 4 ? "%04u" : "%03u", st->code % split);
+}
+
+/* take an account record into otp_state[i], 0 if it makes no sense */
+static uint8_t otp_use(uint8_t i, const uint16_t *rec)
+{
+	const uint8_t *b = (const uint8_t *)rec;
+	struct otp_state *st = &otp_state[i];
+
+	if (b[OTP_REC_DIGITS] < 6 || b[OTP_REC_DIGITS] > 8
+	    || !b[OTP_REC_PERIOD] || b[OTP_REC_KEY_LEN] > SHA1_BLOCKSIZE)
+		return 0;
+
+	memcpy(st->name, b, 5);
+	st->name[5] = '\0';
+	st->digits = b[OTP_REC_DIGITS];
+	st->period = b[OTP_REC_PERIOD];
+	st->key_len = b[OTP_REC_KEY_LEN];
+	st->have = 0;
+
+	hmac_sha1_key(b + OTP_REC_KEY, st->key_len, st->inner, st->outer);
+
+	return 1;
+}
+
+#ifdef CONFIG_INFOMEM
+/* tells the seeds of one firmware from those of another */
+static uint16_t otp_seed_sum(void)
+{
+	const struct otp_account *acc;
+	uint16_t sum = OTP_SEEDS;
+	uint8_t i;
+
+	for (acc = otp_seeds; acc < otp_seeds + OTP_SEEDS; acc++) {
+		for (i = 0; i < 5; i++)
+			sum = (sum << 1 | sum >> 15) + acc->name[i];
+		for (i = 0; i < acc->key_len; i++)
+			sum = (sum << 1 | sum >> 15) + (uint8_t)acc->key[i];
+		sum = (sum << 1 | sum >> 15) + (acc->digits << 8 | acc->period);
+	}
+
+	return sum;
+}
+#endif
+
+/* the accounts of the configuration, stored under CONFIG_INFOMEM. The
+   number of accounts goes last, a store cut short is seeded again. */
+static void otp_seed(void)
+{
+	uint16_t rec[OTP_REC_WORDS(SHA1_BLOCKSIZE)];
+	uint8_t *b = (uint8_t *)rec;
+	const struct otp_account *acc;
+	uint8_t i;
+#ifdef CONFIG_INFOMEM
+	uint16_t head[OTP_HEAD] = { otp_selected, 0, otp_seed_sum() };
+	uint8_t off = OTP_HEAD;
+	int16_t ok = infomem_app_replace(OTP_INFOMEM_ID, head, OTP_HEAD);
+#endif
+
+	otp_count = 0;
+
+	for (i = 0; i < OTP_SEEDS && otp_count < OTP_ACCOUNTS; i++) {
+		acc = &otp_seeds[i];
+
+		memset(rec, 0, sizeof(rec));
+		memcpy(b, acc->name, 5);
+		b[OTP_REC_DIGITS] = acc->digits;
+		b[OTP_REC_PERIOD] = acc->period;
+		b[OTP_REC_KEY_LEN] = acc->key_len;
+		memcpy(b + OTP_REC_KEY, acc->key, acc->key_len);
+
+		if (!otp_use(otp_count, rec))
+			continue;
+		otp_count++;
+
+#ifdef CONFIG_INFOMEM
+		if (ok >= 0)
+			ok = infomem_app_modify(OTP_INFOMEM_ID, rec,
+						OTP_REC_WORDS(acc->key_len), off);
+		off += OTP_REC_WORDS(acc->key_len);
+#endif
+	}
+
+#ifdef CONFIG_INFOMEM
+	head[1] = otp_count;
+	if (ok >= 0)
+		infomem_app_modify(OTP_INFOMEM_ID, &head[1], 1, 1);
+#endif
+}
+
+/* the stored accounts, the configuration when there are none */
+static void otp_load(void)
+{
+#ifdef CONFIG_INFOMEM
+	uint16_t rec[OTP_REC_WORDS(SHA1_BLOCKSIZE)];
+	uint16_t head[OTP_HEAD];
+	uint8_t i, off = OTP_HEAD, words;
+	int16_t n;
+
+	// Before the accounts were stored only the selected one was
+	n = infomem_app_read(OTP_INFOMEM_ID, head, OTP_HEAD, 0);
+	if (n >= 1)
+		otp_selected = head[0];
+	if (n != OTP_HEAD || head[2] != otp_seed_sum())
+		head[1] = 0;
+
+	for (i = 0; i < head[1] && otp_count < OTP_ACCOUNTS; i++) {
+		if (infomem_app_read(OTP_INFOMEM_ID, rec, OTP_REC_HEAD, off)
+		    != OTP_REC_HEAD)
+			break;
+
+		words = OTP_REC_WORDS(((uint8_t *)rec)[OTP_REC_KEY_LEN]);
+		if (words > OTP_REC_WORDS(SHA1_BLOCKSIZE)
+		    || infomem_app_read(OTP_INFOMEM_ID, rec + OTP_REC_HEAD,
+			    words - OTP_REC_HEAD, off + OTP_REC_HEAD)
+		       != words - OTP_REC_HEAD)
+			break;
+
+		if (otp_use(otp_count, rec))
+			otp_count++;
+		off += words;
+	}
+
+	if (otp_count)
+		return;
+#endif
+
+	otp_seed();
+}
+
 static void clock_event(enum sys_message msg)
 {
-    // Check how long the current code is valid 
-    uint8_t segment = (rtca_time.sec / 5) % 6;
-        
-    // Draw indicator in lower-left corner
-    display_bits(0, LCD_SEG_L2_4, indicator[2*segment  ], SEG_SET);
-    display_bits(0, LCD_SEG_L2_4, indicator[2*segment+1], BLINK_SET);
-
-    // Calculate timestamp
-	uint32_t time = simple_mktime(rtca_time.year, rtca_time.mon - 1, rtca_time.day,
-                                  rtca_time.hour, rtca_time.min    , rtca_time.sec);
-	time = (time - CONFIG_MOD_OTP_OFFSET * 3600) / 30;
-
-    // Check if new code must be calculated
-    if(time != last_time) {
-        last_time = time;
-        uint32_t otp_value = calculate_otp(time);
-
-        // Draw first half on the top line
-        uint16_t v = (otp_value / 1000) % 1000;
-        _printf(0, LCD_SEG_L1_2_0, "%03u", v);
-        
-        // Draw second half on the bottom line
-        v = (otp_value % 1000);
-        _printf(0, LCD_SEG_L2_2_0,"%03u", v);
-    }
+	uint32_t time = otp_now();
+
+	otp_advance(time);
+
+	// The code on screen goes first, the background work after it
+	if (otp_active)
+		otp_show(time);
+
+	otp_prepare(time);
+}
+
+/* the first account with a key from i + step on in steps of step, or of
+   one for step 0, i if there is none */
+static uint8_t otp_next(uint8_t i, uint8_t step)
+{
+	uint8_t j = (i + step) % otp_count;
+	uint8_t n;
+
+	for (n = 0; n < otp_count; n++) {
+		if (otp_state[j].key_len)
+			return j;
+		j = (j + (step ? step : 1)) % otp_count;
+	}
+
+	return i;
+}
+
+static void otp_switch(uint8_t step)
+{
+	otp_selected = otp_next(otp_selected, step);
+	otp_name = OTP_NAME_TICKS;
+
+	display_clear(0, 1);
+	display_clear(0, 2);
+	otp_show(otp_now());
+
+#ifdef CONFIG_INFOMEM
+	uint16_t sel = otp_selected;
+	infomem_app_modify(OTP_INFOMEM_ID, &sel, 1, 0);
+#endif
+}
+
+static void otp_up()
+{
+	otp_switch(1);
+}
+
+static void otp_down()
+{
+	otp_switch(otp_count - 1);
 }
 
 static void otp_activated()
 {
-    sys_messagebus_register(&clock_event, SYS_MSG_RTC_SECOND);
+	uint32_t time = otp_now();
 
-    // Force generate & display a new OTP 
-    last_time = 0;
-    clock_event(RTCA_EV_SECOND);
+	otp_active = 1;
+	otp_name = OTP_NAME_TICKS;
+
+	otp_advance(time);
+	otp_show(time);
 }
 
 static void otp_deactivated()
 {
-    sys_messagebus_unregister(&clock_event);
+    otp_active = 0;
 
     /* clean up screen */
     display_clear(0, 1);
@@ -307,9 +604,17 @@ static void otp_deactivated()
 
 void mod_otp_init()
 {
+    otp_load();
+    if (otp_selected >= otp_count)
+        otp_selected = 0;
+    otp_selected = otp_next(otp_selected, 0);
+
+    // Codes are kept up to date while the module is closed as well
+    sys_messagebus_register(&clock_event, SYS_MSG_RTC_SECOND);
+
     menu_add_entry("  OTP",
-        NULL,               /* up         */
-        NULL,               /* down       */
+        &otp_up,            /* up         */
+        &otp_down,          /* down       */
         NULL,               /* num        */
         NULL,               /* long star  */ 
         NULL,               /* long num   */
@@ -318,4 +623,3 @@ void mod_otp_init()
         &otp_deactivated    /* deactivate */
     );
 }
-
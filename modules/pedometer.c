@@ -0,0 +1,247 @@
+/*
+    modules/pedometer.c: step counter for openchronos-ng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <openchronos.h>
+#include <string.h>
+
+/* drivers */
+#include <drivers/display.h>
+#include <drivers/vti_as.h>
+
+#include <libs/accel_stream.h>
+
+/* The detector runs on the magnitude of the low-passed acceleration at
+   about 25Hz, the stream decimated from whatever rate it runs at (100Hz
+   by 4, 40Hz by 2, 400Hz by 16):
+
+   - a slow IIR tracks gravity + sensor offset, the rest is the walking
+     signal
+   - a step is a swing above the adaptive threshold that comes back
+     below zero, the threshold follows half of the mean step amplitude
+   - steps closer than PEDO_MIN_INTERVAL are bounces and are ignored,
+     a gap longer than PEDO_MAX_INTERVAL ends the walk
+   - steps are only counted once PEDO_RUN_START of them came in a row
+     at a plausible cadence, so arm waving and tapping are rejected
+
+   It costs roughly 80 cycles per 25Hz sample, all 16 bit arithmetic
+   except for the 32 bit baseline accumulator. */
+
+#define PEDO_RATE		25	/* Hz, the intervals below are at it */
+#define PEDO_MIN_INTERVAL	8	/* samples, 0.32s ~ 190 steps/min */
+#define PEDO_MAX_INTERVAL	50	/* samples, 2s ~ 30 steps/min */
+#define PEDO_RUN_START		4	/* consecutive steps before counting */
+#define PEDO_BASE_SHIFT		5	/* gravity tracker, ~1.3s at 25Hz */
+#define PEDO_AMP_SHIFT		3	/* step amplitude average */
+
+#define PEDO_HISTORY		60	/* minutes of cadence history */
+
+static struct {
+	uint8_t enabled;
+
+	/* detector state */
+	int32_t base;		/* gravity estimate, mgrav << PEDO_BASE_SHIFT */
+	int16_t amp;		/* mean step amplitude, mgrav */
+	int16_t peak;		/* peak of the current swing */
+	uint8_t above;		/* currently above the threshold */
+	uint8_t since;		/* samples since the last step */
+	uint8_t run;		/* steps in a row at a valid interval */
+	uint8_t min_interval;	/* PEDO_MIN_INTERVAL at the decimated rate */
+	uint8_t max_interval;	/* PEDO_MAX_INTERVAL at the decimated rate */
+
+	/* counters */
+	uint32_t steps;		/* steps today */
+	uint8_t minute_steps;	/* steps in the running minute */
+	uint8_t cadence[PEDO_HISTORY]; /* steps per minute, [0] is last */
+} pedo;
+
+static uint8_t active;
+
+static void display_steps(void)
+{
+	if (!pedo.enabled) {
+		display_chars(0, LCD_SEG_L1_3_0, " OFF", SEG_SET);
+		display_chars(0, LCD_SEG_L2_4_0, NULL, SEG_OFF);
+		return;
+	}
+
+	_printf(0, LCD_SEG_L1_2_0, "%3u", pedo.cadence[0]);
+
+	/* _sprintf() takes 16bit signed numbers, so split at the thousands */
+	if (pedo.steps >= 1000)
+		_printf(0, LCD_SEG_L2_4_3, "%2u", (uint16_t)(pedo.steps / 1000));
+	else
+		display_chars(0, LCD_SEG_L2_4_3, "  ", SEG_SET);
+
+	_printf(0, LCD_SEG_L2_2_0, pedo.steps >= 1000 ? "%03u" : "%3u",
+		(uint16_t)(pedo.steps % 1000));
+}
+
+static void count_step(void)
+{
+	if (pedo.since > pedo.max_interval)
+		pedo.run = 0;
+
+	pedo.since = 0;
+
+	if (pedo.run < PEDO_RUN_START) {
+		if (++pedo.run < PEDO_RUN_START)
+			return;
+
+		/* the walk is confirmed, credit the steps held back */
+		pedo.steps += PEDO_RUN_START - 1;
+		pedo.minute_steps += PEDO_RUN_START - 1;
+	}
+
+	pedo.steps++;
+	pedo.minute_steps++;
+}
+
+static void pedo_sample(const struct accel_frame *f)
+{
+	int16_t ac, thr;
+
+	pedo.base += f->mag - (pedo.base >> PEDO_BASE_SHIFT);
+	ac = f->mag - (pedo.base >> PEDO_BASE_SHIFT);
+
+	if (pedo.since < 255)
+		pedo.since++;
+
+	thr = pedo.amp >> 1;
+	if (thr < CONFIG_MOD_PEDOMETER_THRESHOLD)
+		thr = CONFIG_MOD_PEDOMETER_THRESHOLD;
+
+	if (ac > thr) {
+		if (!pedo.above || ac > pedo.peak)
+			pedo.peak = ac;
+		pedo.above = 1;
+		return;
+	}
+
+	/* wait for the swing to cross zero before taking the step */
+	if (!pedo.above || ac > 0)
+		return;
+
+	pedo.above = 0;
+
+	if (pedo.since < pedo.min_interval)
+		return;
+
+	pedo.amp += (pedo.peak - pedo.amp) >> PEDO_AMP_SHIFT;
+	count_step();
+}
+
+static void pedo_start(void)
+{
+	uint8_t decimation, rate;
+
+	pedo.base = (int32_t)1000 << PEDO_BASE_SHIFT;
+	pedo.amp = CONFIG_MOD_PEDOMETER_THRESHOLD * 2;
+	pedo.above = 0;
+	pedo.since = 255;
+	pedo.run = 0;
+
+	/* 2g gives 18mgrav per LSB, keep the rate of other users */
+	if (!accel_stream_running()) {
+		as_config.range = 2;
+		accel_stream_start(SAMPLING_100_HZ);
+	} else {
+		accel_stream_start(as_config.sampling);
+	}
+
+	/* the SAMPLING_* values are the rate in units of 10Hz, 40Hz comes
+	   closest to PEDO_RATE at 20Hz */
+	decimation = (as_config.sampling * 10 + PEDO_RATE / 2) / PEDO_RATE;
+	if (!decimation)
+		decimation = 1;
+	rate = as_config.sampling * 10 / decimation;
+
+	pedo.min_interval = PEDO_MIN_INTERVAL * rate / PEDO_RATE;
+	pedo.max_interval = PEDO_MAX_INTERVAL * rate / PEDO_RATE;
+
+	accel_stream_subscribe(&pedo_sample, decimation);
+}
+
+static void pedo_stop(void)
+{
+	accel_stream_unsubscribe(&pedo_sample);
+	accel_stream_stop();
+}
+
+static void pedo_event(enum sys_message msg)
+{
+	if (msg & SYS_MSG_RTC_MINUTE) {
+		memmove(&pedo.cadence[1], &pedo.cadence[0], PEDO_HISTORY - 1);
+		pedo.cadence[0] = pedo.minute_steps;
+		pedo.minute_steps = 0;
+	}
+
+	if (msg & SYS_MSG_RTC_DAY)
+		pedo.steps = 0;
+
+	if (active)
+		display_steps();
+}
+
+/************************** menu callbacks ********************************/
+
+static void pedo_activate(void)
+{
+	active = 1;
+	display_steps();
+}
+
+static void pedo_deactivate(void)
+{
+	active = 0;
+	display_clear(0, 1);
+	display_clear(0, 2);
+}
+
+/* long STAR switches the step counter on and off */
+static void pedo_toggle(void)
+{
+	pedo.enabled = !pedo.enabled;
+
+	if (pedo.enabled)
+		pedo_start();
+	else
+		pedo_stop();
+
+	display_clear(0, 1);
+	display_clear(0, 2);
+	display_steps();
+}
+
+/* UP&DOWN clears today's count */
+static void pedo_reset(void)
+{
+	pedo.steps = 0;
+	pedo.minute_steps = 0;
+	display_steps();
+}
+
+/* The counter starts switched off: the stream keeps the accelerometer in
+   measurement mode at 100Hz, so CONFIG_IDLE cannot arm the motion
+   interrupt and the watch stays out of idle for as long as it runs. */
+void mod_pedometer_init(void)
+{
+	sys_messagebus_register(&pedo_event,
+				SYS_MSG_RTC_MINUTE | SYS_MSG_RTC_DAY);
+
+	menu_add_entry("STEPS", NULL, NULL, NULL, &pedo_toggle, NULL,
+		       &pedo_reset, &pedo_activate, &pedo_deactivate);
+}
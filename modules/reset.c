@@ -23,8 +23,17 @@
 
 #include <drivers/display.h>
 
+#ifdef CONFIG_INFOMEM
+#include <drivers/infomem.h>
+#endif
+
 static void num_press()
 {
+#ifdef CONFIG_INFOMEM
+	/* the cached application data would be lost */
+	infomem_flush();
+#endif
+
 	/* reset microcontroller */
 	WDTCTL = 0;
 }
@@ -0,0 +1,233 @@
+/*
+    modules/sleep.c: sleep actigraphy recorder for openchronos-ng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <openchronos.h>
+
+/* drivers */
+#include <drivers/display.h>
+#include <drivers/rtca.h>
+#include <drivers/vti_as.h>
+
+#include <libs/accel_stream.h>
+#include <libs/tseries.h>
+
+/* This is the movement score of logic/phase_clock.c computed on the watch
+   instead of streaming the windows over the radio: the sum over all axes
+   of the sample to sample differences, with differences below two LSB
+   dropped as noise.
+
+   The sensor runs at its slowest measurement rate (40Hz at 8g) and the
+   stream is decimated to 10Hz, so the CPU wakes 8 times per second for
+   a batch and spends ~30 cycles per sample here. The scores of two
+   minutes make a record of the time series in main flash, stamped with
+   the start of the first one (see libs/tseries.h):
+
+	0x00 ... 0xfe		movement score of one minute
+	0xff			no second minute, the session ended
+
+   A session starts where the records are more than two minutes apart,
+   contrib/sleep2csv.py reads the log out of a flash dump. */
+
+#define SLEEP_RATE		10	/* Hz, after decimation */
+#define SLEEP_SCORE_SHIFT	6	/* mgrav per minute to log units */
+#define SLEEP_SCORE_MAX		0xfe
+#define SLEEP_NONE		0xff
+
+/* 7 segments of 126 records, one of them is erased when the ring wraps,
+   leave > 24h of minutes */
+TSERIES(sleep_minutes, 2, 7, 0);
+
+static struct {
+	uint8_t recording;
+
+	int16_t prev[3];	/* last sample, mgrav */
+	uint8_t primed;
+	int16_t noise;		/* two LSB of the active range, mgrav */
+	uint32_t sum;		/* movement of the running minute */
+
+	uint8_t pair[2];	/* scores of the record being filled */
+	uint32_t t0;		/* start of its first minute */
+	uint16_t minutes;	/* minutes logged in this session */
+	uint16_t quiet;		/* minutes with no movement at all */
+	uint8_t last;		/* last logged score */
+} slp;
+
+static uint8_t active;
+
+static void display_sleep(void)
+{
+	if (slp.recording) {
+		display_symbol(0, LCD_ICON_RECORD, SEG_SET | BLINK_ON);
+		_printf(0, LCD_SEG_L1_3_0, "%4u", slp.minutes);
+		_printf(0, LCD_SEG_L2_2_0, "%3u", slp.last);
+		return;
+	}
+
+	display_symbol(0, LCD_ICON_RECORD, SEG_OFF);
+
+	if (!slp.minutes) {
+		display_chars(0, LCD_SEG_L1_3_0, " OFF", SEG_SET);
+		return;
+	}
+
+	/* summary of the last session: length and share of quiet minutes */
+	_printf(0, LCD_SEG_L1_3_0, "%4u", slp.minutes);
+	_printf(0, LCD_SEG_L2_2_0, "%3u",
+		(uint16_t)((uint32_t)slp.quiet * 100 / slp.minutes));
+	display_symbol(0, LCD_SYMB_PERCENT, SEG_SET);
+}
+
+/* append the pending record, the second minute may be missing */
+static void log_flush(void)
+{
+	if (slp.pair[0] == SLEEP_NONE)
+		return;
+
+	tseries_append(&sleep_minutes, slp.t0, slp.pair);
+	slp.pair[0] = SLEEP_NONE;
+	slp.pair[1] = SLEEP_NONE;
+}
+
+static void sleep_sample(const struct accel_frame *f)
+{
+	uint8_t i;
+	int16_t d;
+
+	for (i = 0; i < 3; i++) {
+		d = f->mg[i] - slp.prev[i];
+		slp.prev[i] = f->mg[i];
+
+		if (!slp.primed)
+			continue;
+
+		if (d < 0)
+			d = -d;
+
+		/* high pass, as diff() in logic/phase_clock.c */
+		if (d >= slp.noise)
+			slp.sum += d;
+	}
+
+	slp.primed = 1;
+}
+
+static void sleep_minute(void)
+{
+	uint32_t score = slp.sum >> SLEEP_SCORE_SHIFT;
+
+	slp.sum = 0;
+	slp.last = (score > SLEEP_SCORE_MAX ? SLEEP_SCORE_MAX : score);
+
+	if (slp.pair[0] == SLEEP_NONE) {
+		/* the minute that just ended */
+		slp.t0 = rtca_seconds() - 60;
+		slp.pair[0] = slp.last;
+	} else {
+		slp.pair[1] = slp.last;
+		log_flush();
+	}
+
+	slp.minutes++;
+	if (!slp.last)
+		slp.quiet++;
+}
+
+static void sleep_event(enum sys_message msg)
+{
+	if (slp.recording)
+		sleep_minute();
+
+	if (active)
+		display_sleep();
+}
+
+static void sleep_start(void)
+{
+	slp.pair[0] = SLEEP_NONE;
+	slp.pair[1] = SLEEP_NONE;
+	slp.sum = 0;
+	slp.primed = 0;
+	slp.minutes = 0;
+	slp.quiet = 0;
+	slp.last = 0;
+
+	/* the slowest measurement rate needs the 8g range, keep whatever
+	   the other stream users have configured */
+	if (!accel_stream_running()) {
+		as_config.range = 8;
+		accel_stream_start(SAMPLING_40_HZ);
+	} else {
+		accel_stream_start(as_config.sampling);
+	}
+
+	/* the SAMPLING_* values are the rate in units of 10Hz */
+	accel_stream_subscribe(&sleep_sample,
+			       as_config.sampling * 10 / SLEEP_RATE);
+	slp.noise = accel_stream_to_mg(2);
+
+	sys_messagebus_register(&sleep_event, SYS_MSG_RTC_MINUTE);
+	slp.recording = 1;
+}
+
+static void sleep_stop(void)
+{
+	slp.recording = 0;
+	sys_messagebus_unregister(&sleep_event);
+	log_flush();
+
+	accel_stream_unsubscribe(&sleep_sample);
+	accel_stream_stop();
+}
+
+/************************** menu callbacks ********************************/
+
+static void sleep_activate(void)
+{
+	active = 1;
+	display_sleep();
+}
+
+static void sleep_deactivate(void)
+{
+	active = 0;
+	display_symbol(0, LCD_ICON_RECORD, slp.recording ? SEG_SET : SEG_OFF);
+	display_symbol(0, LCD_SYMB_PERCENT, SEG_OFF);
+	display_clear(0, 1);
+	display_clear(0, 2);
+}
+
+/* long STAR starts and stops a recording session */
+static void sleep_toggle(void)
+{
+	if (slp.recording)
+		sleep_stop();
+	else
+		sleep_start();
+
+	display_symbol(0, LCD_SYMB_PERCENT, SEG_OFF);
+	display_clear(0, 1);
+	display_clear(0, 2);
+	display_sleep();
+}
+
+void mod_sleep_init(void)
+{
+	tseries_init(&sleep_minutes);
+
+	menu_add_entry("SLEEP", NULL, NULL, NULL, &sleep_toggle, NULL,
+		       NULL, &sleep_activate, &sleep_deactivate);
+}
@@ -39,8 +39,7 @@ static void display_temperature(void)
 
 static void measure_temp(enum sys_message msg)
 {
-	temperature_measurement();
-	display_temperature();
+	temperature_measurement(&display_temperature);
 }
 
 /********************* edit mode callbacks ********************************/
@@ -23,6 +23,350 @@
 #include <drivers/rtca.h>
 #include <drivers/display.h>
 
+
+/* The tide is predicted from the harmonic constants of a station, see
+   [TIDE_CONSTITUENTS] in tide.cfg:
+
+	h(t) = Z0 + sum f H cos(V(t) + u - g)
+
+   V is a sum of the astronomical arguments T, s, h and p, each of them
+   linear in time. The phases V + u - g are 32 bit binary angles that are
+   advanced by a constant step every minute and computed from the epoch
+   once a day only, when the nodal factors f and u are updated as well.
+   The cosine comes from a Q15 table. The next high and low waters are
+   found by stepping the slope of h(t) ahead and bisecting the interval
+   where it changes sign, this is done again once one of them is passed. */
+
+enum tide_constituent_index {
+	TIDE_M2 = 0,
+	TIDE_S2,
+	TIDE_N2,
+	TIDE_K2,
+	TIDE_K1,
+	TIDE_O1,
+	TIDE_P1,
+	TIDE_Q1,
+	TIDE_M4,
+	TIDE_MS4,
+	TIDE_CONSTITUENTS
+};
+
+/* nodal corrections, rows of tide_nodal_factors[] */
+enum tide_nodal {
+	TIDE_NODAL_M2 = 0,
+	TIDE_NODAL_K2,
+	TIDE_NODAL_K1,
+	TIDE_NODAL_O1,
+	TIDE_NODAL_NONE
+};
+
+struct tide_constituent {
+	int8_t arg[4];		/* multiples of T, s, h and p */
+	uint8_t quarters;	/* constant phase, 90 degrees */
+	uint8_t nodal;		/* enum tide_nodal */
+	uint8_t power;		/* of the nodal correction */
+};
+
+static const struct tide_constituent tide_constituents[TIDE_CONSTITUENTS] = {
+	[TIDE_M2]  = { { 2, -2,  2,  0 }, 0, TIDE_NODAL_M2,   1 },
+	[TIDE_S2]  = { { 2,  0,  0,  0 }, 0, TIDE_NODAL_NONE, 1 },
+	[TIDE_N2]  = { { 2, -3,  2,  1 }, 0, TIDE_NODAL_M2,   1 },
+	[TIDE_K2]  = { { 2,  0,  2,  0 }, 0, TIDE_NODAL_K2,   1 },
+	[TIDE_K1]  = { { 1,  0,  1,  0 }, 3, TIDE_NODAL_K1,   1 },
+	[TIDE_O1]  = { { 1, -2,  1,  0 }, 1, TIDE_NODAL_O1,   1 },
+	[TIDE_P1]  = { { 1,  0, -1,  0 }, 1, TIDE_NODAL_NONE, 1 },
+	[TIDE_Q1]  = { { 1, -3,  1,  1 }, 1, TIDE_NODAL_O1,   1 },
+	[TIDE_M4]  = { { 4, -4,  4,  0 }, 0, TIDE_NODAL_M2,   2 },
+	[TIDE_MS4] = { { 4, -2,  2,  0 }, 0, TIDE_NODAL_M2,   1 },
+};
+
+/* f = c0 + c1 cos N + c2 cos 2N + c3 cos 3N (Q14)
+   u = d1 sin N + d2 sin 2N + d3 sin 3N (65536 = 360 degrees) */
+static const int16_t tide_nodal_factors[TIDE_NODAL_NONE][7] = {
+	[TIDE_NODAL_M2] = { 16391,  -611,    3,   0,  -390,    0,   0 },
+	[TIDE_NODAL_K2] = { 16779,  4691,  136, -25, -3229,  124,  -7 },
+	[TIDE_NODAL_K1] = { 16482,  1884, -144,  10, -1613,  124, -13 },
+	[TIDE_NODAL_O1] = { 16530,  3065, -241,  23,  1966, -244,  35 },
+};
+
+/* astronomical arguments T, s, h, p and N as 32 bit binary angles at
+   2000-01-01 00:00 UTC and their rates per day and per minute, in 2^48 per
+   turn so that they add up over the years without drifting */
+#define TIDE_ARGUMENTS 5
+#define TIDE_ARG_N 4
+
+static const uint32_t tide_arg_base[TIDE_ARGUMENTS] = {
+	0x80000000UL,		/* T 180.000000 */
+	0x968ff608UL,		/* s 211.728302 */
+	0xc717945dUL,		/* h 279.973276 */
+	0x3b3be6c2UL,		/* p  83.297798 */
+	0x58f079fcUL,		/* N 125.070977 */
+};
+
+static const uint64_t tide_arg_per_day[TIDE_ARGUMENTS] = {
+	0x000000000000ULL,	/* T 360.00000000 */
+	0x095eb0953968ULL,	/* s  13.17639648 */
+	0x00b36e7f0bccULL,	/* h   0.98564736 */
+	0x001447c7e224ULL,	/* p   0.11140353 */
+	0xfff65c2cea6bULL,	/* N  -0.05295377 */
+};
+
+static const uint64_t tide_arg_per_minute[TIDE_ARGUMENTS] = {
+	0x002d82d82d83ULL,
+	0x0001aa6f0976ULL,
+	0x00001fe621f7ULL,
+	0x0000039afbb6ULL,
+	0xfffffe494690ULL,
+};
+
+/* harmonic constants of the station, amplitude in mm and phase lag g to
+   Greenwich in 0.01 degrees, see tide_constituents() in tools/field_encodings.py */
+struct tide_station {
+	int16_t amplitude;
+	uint16_t phase;
+};
+
+static const struct tide_station tide_station[TIDE_CONSTITUENTS] = {
+	CONFIG_MOD_TIDE_CONSTITUENTS
+};
+
+/* cos(i * 90 / 64 degrees) in Q15 */
+static const int16_t tide_cos_table[65] = {
+	32767, 32757, 32728, 32678, 32609, 32521, 32412, 32285, 32137, 31971,
+	31785, 31580, 31356, 31113, 30852, 30571, 30273, 29956, 29621, 29268,
+	28898, 28510, 28105, 27683, 27245, 26790, 26319, 25832, 25329, 24811,
+	24279, 23731, 23170, 22594, 22005, 21403, 20787, 20159, 19519, 18868,
+	18204, 17530, 16846, 16151, 15446, 14732, 14010, 13279, 12539, 11793,
+	11039, 10278,  9512,  8739,  7962,  7179,  6393,  5602,  4808,  4011,
+	 3212,  2410,  1608,   804,     0
+};
+
+/* minutes between two looks at the slope and how far ahead to look */
+#define TIDE_SEARCH_STEP 16
+#define TIDE_SEARCH_MINUTES (26 * 60)
+
+#define TIDE_NONE 0xffffffffUL
+
+static struct {
+	uint32_t minute;	/* UTC minutes since 2000 of phase[] */
+	uint32_t anchor;	/* minute phase[] was computed from the epoch */
+	uint32_t phase[TIDE_CONSTITUENTS];
+	uint32_t step[TIDE_CONSTITUENTS];	/* phase per minute */
+	int16_t amplitude[TIDE_CONSTITUENTS];	/* f H, mm */
+	uint8_t count;		/* constituents in phase[] */
+
+	uint32_t high;		/* minute of the next high water */
+	uint32_t low;		/* minute of the next low water */
+	int32_t level;		/* now, mm */
+	uint8_t rising;
+} tide;
+
+/* MARK: Harmonic Engine */
+
+/* a is a binary angle, 65536 per turn */
+static int16_t tideCosQuarter(uint16_t a)
+{
+	uint8_t i = a >> 8;
+	int16_t c = tide_cos_table[i];
+
+	if (i == 64)
+		return c;
+
+	return c + (int16_t)(((int32_t)(tide_cos_table[i + 1] - c)
+						* (a & 0xff)) >> 8);
+}
+
+static int16_t tideCos(uint16_t a)
+{
+	uint16_t x = a & 0x3fff;
+
+	switch (a >> 14) {
+	case 0:
+		return tideCosQuarter(x);
+	case 1:
+		return -tideCosQuarter(0x4000 - x);
+	case 2:
+		return -tideCosQuarter(x);
+	default:
+		return tideCosQuarter(0x4000 - x);
+	}
+}
+
+static int16_t tideSin(uint16_t a)
+{
+	return tideCos(a - 0x4000);
+}
+
+/* an astronomical argument at minute m */
+static uint32_t tideArgument(uint8_t arg, uint32_t m)
+{
+	uint16_t day = m / 1440;
+	uint16_t minute = m - (uint32_t)day * 1440;
+
+	return tide_arg_base[arg] + (uint32_t)(((uint64_t)day
+		* tide_arg_per_day[arg] + (uint64_t)minute
+		* tide_arg_per_minute[arg]) >> 16);
+}
+
+/* compute the phases at minute m from the epoch */
+static void tideAnchor(uint32_t m)
+{
+	const struct tide_constituent *c;
+	const int16_t *nf;
+	uint32_t arg[TIDE_ARGUMENTS - 1], rate[TIDE_ARGUMENTS - 1];
+	uint32_t phase, step;
+	uint16_t n = tideArgument(TIDE_ARG_N, m) >> 16;
+	int32_t f, u;
+	uint8_t i, j, k;
+
+	for (j = 0; j < TIDE_ARG_N; j++) {
+		arg[j] = tideArgument(j, m);
+		rate[j] = (tide_arg_per_minute[j] + 0x8000) >> 16;
+	}
+
+	k = 0;
+	for (i = 0; i < TIDE_CONSTITUENTS; i++) {
+		if (!tide_station[i].amplitude)
+			continue;
+
+		c = &tide_constituents[i];
+		phase = (uint32_t)c->quarters << 30;
+		step = 0;
+		for (j = 0; j < TIDE_ARG_N; j++) {
+			phase += c->arg[j] * arg[j];
+			step += c->arg[j] * rate[j];
+		}
+
+		f = 16384;
+		u = 0;
+		if (c->nodal != TIDE_NODAL_NONE) {
+			nf = tide_nodal_factors[c->nodal];
+			f = nf[0] + (((int32_t)nf[1] * tideCos(n)
+				+ (int32_t)nf[2] * tideCos(2 * n)
+				+ (int32_t)nf[3] * tideCos(3 * n)) >> 15);
+			u = ((int32_t)nf[4] * tideSin(n)
+				+ (int32_t)nf[5] * tideSin(2 * n)
+				+ (int32_t)nf[6] * tideSin(3 * n)) >> 15;
+			if (c->power == 2) {
+				f = (f * f) >> 14;
+				u *= 2;
+			}
+		}
+
+		/* 0.01 degrees to 2^32 per turn */
+		phase += (uint32_t)u << 16;
+		phase -= (uint32_t)tide_station[i].phase * 119305UL;
+
+		tide.phase[k] = phase;
+		tide.step[k] = step;
+		tide.amplitude[k] = ((int32_t)tide_station[i].amplitude * f) >> 14;
+		k++;
+	}
+
+	tide.count = k;
+	tide.minute = m;
+	tide.anchor = m;
+}
+
+/* height k minutes ahead, mm */
+static int32_t tideLevel(uint16_t k)
+{
+	int32_t h = CONFIG_MOD_TIDE_DATUM;
+	uint8_t i;
+
+	for (i = 0; i < tide.count; i++) {
+		h += ((int32_t)tide.amplitude[i] * tideCos((tide.phase[i]
+				+ k * tide.step[i]) >> 16) + 0x4000) >> 15;
+	}
+
+	return h;
+}
+
+/* slope k minutes ahead, only the sign is of interest */
+static int32_t tideSlope(uint16_t k)
+{
+	int32_t d = 0;
+	uint8_t i;
+
+	for (i = 0; i < tide.count; i++) {
+		d -= (((int32_t)tide.amplitude[i] * tideSin((tide.phase[i]
+				+ k * tide.step[i]) >> 16)) >> 15)
+				* (int16_t)(tide.step[i] >> 14);
+	}
+
+	return d;
+}
+
+/* find the next high and low water */
+static void tideSearch(void)
+{
+	uint16_t k, lo, hi, mid;
+	uint8_t rising = tideSlope(0) > 0;
+
+	tide.high = TIDE_NONE;
+	tide.low = TIDE_NONE;
+
+	for (k = TIDE_SEARCH_STEP; k <= TIDE_SEARCH_MINUTES; k += TIDE_SEARCH_STEP) {
+		if ((tideSlope(k) > 0) == rising)
+			continue;
+
+		/* the turn is within the last step */
+		lo = k - TIDE_SEARCH_STEP;
+		hi = k;
+		while (hi - lo > 1) {
+			mid = (lo + hi) / 2;
+			if ((tideSlope(mid) > 0) == rising)
+				lo = mid;
+			else
+				hi = mid;
+		}
+
+		if (rising && tide.high == TIDE_NONE)
+			tide.high = tide.minute + hi;
+		else if (!rising && tide.low == TIDE_NONE)
+			tide.low = tide.minute + hi;
+
+		if (tide.high != TIDE_NONE && tide.low != TIDE_NONE)
+			return;
+
+		rising = !rising;
+	}
+}
+
+/* UTC minutes since 2000 */
+static uint32_t tideNow(void)
+{
+	return rtca_seconds() / 60 - CONFIG_MOD_TIDE_OFFSET * 60;
+}
+
+/* advance the phases to now and look for the next high and low water once
+   one of them has passed */
+static void tideUpdate(void)
+{
+	uint32_t m = tideNow();
+	uint8_t i;
+
+	if (m == tide.minute + 1 && m - tide.anchor < 1440) {
+		for (i = 0; i < tide.count; i++)
+			tide.phase[i] += tide.step[i];
+		tide.minute = m;
+	} else if (m != tide.minute) {
+		/* once a day and after the time was set */
+		if (m != tide.minute + 1)
+			tide.high = TIDE_NONE;
+		tideAnchor(m);
+	}
+
+	tide.level = tideLevel(0);
+	tide.rising = tideSlope(0) > 0;
+
+	if (tide.high != TIDE_NONE && tide.low != TIDE_NONE
+	    && m < tide.high && m < tide.low)
+		return;
+
+	tideSearch();
+}
+
 struct Tide {
 	uint8_t hoursLeft;	/* hours left to next low tide */
 	uint8_t minutesLeft; /* minutes left to next low tide */
@@ -32,20 +376,12 @@ enum tide_display_state {
 	TIDE_DISPLAY_STATE_GRAPH = 0,
 	TIDE_DISPLAY_STATE_TOLOWCOUNTER,
 	TIDE_DISPLAY_STATE_TOHIGHCOUNTER,
-	/* editing mode */
-	TIDE_DISPLAY_STATE_EDITING,
 };
 
-/* time to the next low tide */
-static struct Tide tide;
-
 static const uint16_t twentyFourHoursInMinutes = (uint32_t)1440;
-static const uint16_t fullTideTime = (uint16_t)754;
-static const uint16_t halfTideTime = (uint16_t)372; /* .5; */
 
 /* state of the display */
 static uint8_t moduleActivated;
-static uint8_t editModeActivated;
 static enum tide_display_state activeDisplay = TIDE_DISPLAY_STATE_GRAPH;
 
 static const char *graphs[4] = {
@@ -56,28 +392,7 @@ static const char *graphs[4] = {
 };
 static uint8_t graphOffset;
 
-/* editing state */
-static struct Tide enteredTimeOfNextLow;
-
 /* MARK: Helper Functions */
-uint16_t timeInMinutes(struct Tide aTide)
-{
-	uint16_t result = (uint16_t)aTide.minutesLeft;
-	result += (uint16_t)aTide.hoursLeft * (uint16_t)60;
-	return result;
-}
-
-uint16_t timeNowInMinutes(void)
-{
-	struct Tide timeNow;
-
-	timeNow.hoursLeft = rtca_time.hour;
-	timeNow.minutesLeft = rtca_time.min;
-	if (rtca_time.sec > 30)
-		timeNow.minutesLeft++;
-	return timeInMinutes(timeNow);
-}
-
 struct Tide timeFromMinutes(uint16_t minutes)
 {
 	struct Tide newTide;
@@ -109,184 +424,86 @@ void blinkCol(uint8_t screen, uint8_t line)
 	}
 }
 
+/* time left until and clock time of minute m on line 1 and 2 */
+void drawEvent(uint8_t screen, uint32_t m, uint8_t line2)
+{
+	uint16_t left = m - tide.minute;
+	struct Tide time = timeFromMinutes(left);
+
+	_printf(screen, LCD_SEG_L1_3_2, "%02u", time.hoursLeft);
+	_printf(screen, LCD_SEG_L1_1_0, "%02u", time.minutesLeft);
+	blinkCol(screen, 1);
+
+	if (!line2)
+		return;
+
+	time = timeFromMinutes((rtca_time.hour * 60 + rtca_time.min + left)
+						% twentyFourHoursInMinutes);
+	_printf(screen, LCD_SEG_L2_3_2, "%02u", time.hoursLeft);
+	_printf(screen, LCD_SEG_L2_1_0, "%02u", time.minutesLeft);
+	blinkCol(screen, 2);
+}
+
 void drawScreen(void)
 {
 	/* do nothing if not visible */
-	if (!moduleActivated || editModeActivated)
+	if (!moduleActivated)
 		return;
 
 	display_clear(0, 0);
 	display_clear(1, 0);
 	display_clear(2, 0);
 
-	uint16_t nowInMinutes = timeNowInMinutes();
-	uint16_t leftUntilLow = timeInMinutes(tide);
-	uint16_t leftUntilHigh = halfTideTime;
-
-	if (leftUntilLow > leftUntilHigh)
-		leftUntilHigh = leftUntilLow - leftUntilHigh;
-	else
-		leftUntilHigh = leftUntilLow + leftUntilHigh;
-
-	struct Tide lowTide = tide;
-	struct Tide highTide = timeFromMinutes(leftUntilHigh);
+	if (tide.high == TIDE_NONE || tide.low == TIDE_NONE) {
+		display_chars(0, LCD_SEG_L1_3_0, "----", SEG_SET);
+		display_chars(1, LCD_SEG_L1_3_0, "----", SEG_SET);
+		display_chars(2, LCD_SEG_L1_3_0, "----", SEG_SET);
+		return;
+	}
 
 	/* screen 0 //graph + time till next peak */
 	/* line1 time */
-	if (leftUntilHigh < leftUntilLow) {
+	if (tide.high < tide.low) {
 		/* show time till high */
-		_printf(0, LCD_SEG_L1_3_2, "%02u", highTide.hoursLeft);
-		_printf(0, LCD_SEG_L1_1_0, "%02u", highTide.minutesLeft);
-
+		drawEvent(0, tide.high, 0);
 		display_symbol(0, LCD_SYMB_MAX, SEG_ON);
-
 	} else {
 		/* show time till low */
-		_printf(0, LCD_SEG_L1_3_2, "%02u", lowTide.hoursLeft);
-		_printf(0, LCD_SEG_L1_1_0, "%02u", lowTide.minutesLeft);
-
+		drawEvent(0, tide.low, 0);
 		display_symbol(0, LCD_UNIT_L2_MI, SEG_ON);
 	}
-	blinkCol(0, 1);
 	display_symbol(0, LCD_SEG_L2_COL1, SEG_ON);
 
 	/* line 2 graph */
 	display_chars(0, LCD_SEG_L2_4_0, graphs[graphOffset], SEG_SET);
 
 	/** screen 1 **/
-	/* line 1 time till low */
-	_printf(1, LCD_SEG_L1_3_2, "%02u", lowTide.hoursLeft);
-	_printf(1, LCD_SEG_L1_1_0, "%02u", lowTide.minutesLeft);
-
+	/* line 1 time till low, line 2 time of next low */
+	drawEvent(1, tide.low, 1);
 	display_symbol(1, LCD_UNIT_L2_MI, SEG_ON);
 
-	/* line 2 calculate time of next high */
-	uint16_t lowTideTimeInMinutes = (nowInMinutes + leftUntilLow)
-												% twentyFourHoursInMinutes;
-	struct Tide lowTideTime = timeFromMinutes(lowTideTimeInMinutes);
-
-	_printf(1, LCD_SEG_L2_3_2, "%02u", lowTideTime.hoursLeft);
-	_printf(1, LCD_SEG_L2_1_0, "%02u", lowTideTime.minutesLeft);
-
-	blinkCol(1, 1);
-	blinkCol(1, 2);
-
-
 	/** screen 2 **/
-	/* Line 1 time high */
-	_printf(2, LCD_SEG_L1_3_2, "%02u", highTide.hoursLeft);
-	_printf(2, LCD_SEG_L1_1_0, "%02u", highTide.minutesLeft);
+	/* line 1 time till high, line 2 time of next high */
+	drawEvent(2, tide.high, 1);
 	display_symbol(2, LCD_SYMB_MAX, SEG_ON);
-
-	/* line 2 calculate time of next high */
-	uint16_t highTideTimeInMinutes = (nowInMinutes + leftUntilHigh)
-												% twentyFourHoursInMinutes;
-	struct Tide highTideTime = timeFromMinutes(highTideTimeInMinutes);
-
-	_printf(2, LCD_SEG_L2_3_2, "%02u", highTideTime.hoursLeft);
-	_printf(2, LCD_SEG_L2_1_0, "%02u", highTideTime.minutesLeft);
-
-	blinkCol(2, 1);
-	blinkCol(2, 2);
 }
 
 /* MARK: System Bus Events */
 void minuteTick()
 {
-	uint32_t tideInMinutes =  timeInMinutes(tide);
-	graphOffset = (fullTideTime - tideInMinutes)/((uint16_t)186);
-	graphOffset = graphOffset % 4;
-
-	/* count down the timer */
-	if (tide.minutesLeft == 0) {
-		tide.minutesLeft = 60;
-		if (tide.hoursLeft == 0) {
-			/* TODO: change to full tide time */
-			tide = timeFromMinutes(fullTideTime+1);
-			return;
-		}
-		tide.hoursLeft--;
-	}
-	tide.minutesLeft--;
-
-	/* draw screens */
-	drawScreen();
-}
-
-/* MARK: - Time Setup */
-void editHHSelect(uint8_t pos)
-{
-	display_chars(0, LCD_SEG_L1_3_2, NULL, BLINK_ON);
-}
-
-void editHHDeselect(uint8_t pos)
-{
-	display_chars(0, LCD_SEG_L1_3_2, NULL, BLINK_OFF);
-}
-
-void editHHSet(uint8_t pos, int8_t step)
-{
-	helpers_loop(&(enteredTimeOfNextLow.hoursLeft), 0, 23, step);
-	_printf(0, LCD_SEG_L1_3_2, "%02u", enteredTimeOfNextLow.hoursLeft);
-}
-
-void editMMSelect(uint8_t pos)
-{
-	display_chars(0, LCD_SEG_L1_1_0, NULL, BLINK_ON);
-}
-
-void editMMDeselect(uint8_t pos)
-{
-	display_chars(0, LCD_SEG_L1_1_0, NULL, BLINK_OFF);
-}
-
-void editMMSet(uint8_t pos, int8_t step)
-{
-	helpers_loop(&(enteredTimeOfNextLow.minutesLeft), 0, 59, step);
-	_printf(0, LCD_SEG_L1_1_0, "%02u", enteredTimeOfNextLow.minutesLeft);
-}
+	tideUpdate();
 
-static struct menu_editmode_item editModeItems[] = {
-	{&editHHSelect, &editHHDeselect, &editHHSet},
-	{&editMMSelect, &editMMDeselect, &editMMSet},
-	{ NULL }
-};
-
-void endEditing(void)
-{
-	/* calculate minutes left for next low */
-	uint16_t nextLowMinutes = timeInMinutes(enteredTimeOfNextLow);
-	uint16_t nowInMinutes = timeNowInMinutes();
-	uint16_t diff = nextLowMinutes - nowInMinutes;
-	if (diff < 0) {
-		/* the next low is tomorrow! */
-		diff = (twentyFourHoursInMinutes - nowInMinutes) + nextLowMinutes;
-	}
+	/* quarters of the cycle, starting at low water */
+	if (tide.rising)
+		graphOffset = (tide.level < CONFIG_MOD_TIDE_DATUM ? 0 : 1);
+	else
+		graphOffset = (tide.level < CONFIG_MOD_TIDE_DATUM ? 3 : 2);
 
-	tide = timeFromMinutes(diff);
-	editModeActivated = 0;
-	display_clear(0, 0);
+	/* draw screens */
 	drawScreen();
 }
 
 /* MARK:  - Buttons */
-void longStarButton(void)
-{
-	/* clear screen */
-	display_clear(0, 0);
-	lcd_screen_activate(0);
-
-	uint16_t nowInMinutes = timeNowInMinutes();
-	uint16_t leftUntilLow = timeInMinutes(tide);
-	enteredTimeOfNextLow = timeFromMinutes((nowInMinutes + leftUntilLow) % twentyFourHoursInMinutes);
-
-	editModeActivated = 1;
-	_printf(0, LCD_SEG_L1_3_2, "%02u", enteredTimeOfNextLow.hoursLeft);
-	_printf(0, LCD_SEG_L1_1_0, "%02u", enteredTimeOfNextLow.minutesLeft);
-	blinkCol(0, 1);
-	menu_editmode_start(&endEditing, editModeItems);
-}
-
 void buttonUp(void)
 {
 	lcd_screen_activate(0xff);
@@ -328,7 +545,6 @@ void deactivate(void)
 void mod_tide_init(void)
 {
 	sys_messagebus_register(&minuteTick, SYS_MSG_RTC_MINUTE);
-	menu_add_entry("TIDE", &buttonUp, &buttonDown, NULL, &longStarButton, NULL, NULL, &activate, &deactivate);
-	tide = timeFromMinutes(90); /* fullTideTime); */
-	minuteTick(); /* initla display setup */
+	menu_add_entry("TIDE", &buttonUp, &buttonDown, NULL, NULL, NULL, NULL, &activate, &deactivate);
+	minuteTick(); /* initial prediction */
 }
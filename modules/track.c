@@ -0,0 +1,466 @@
+/*
+    modules/track.c: altitude track recorder for openchronos-ng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <openchronos.h>
+#include <string.h>
+
+/* drivers */
+#include <drivers/display.h>
+#include <drivers/rtca.h>
+#include <drivers/flash.h>
+
+#include <libs/altitude.h>
+
+/* Samples the altitude every CONFIG_MOD_TRACK_INTERVAL minutes into a
+   ring log in main flash. Every sample is a delta to the previous one,
+   one byte for most of them:
+
+	0x00 ... 0xdf		altitude delta, zigzag coded, -112..111m
+	0xe0 ... 0xef		2..17 samples with no altitude change
+	0xf0 yy mm dd hh mi aa aa tt tt ii
+				keyframe: time of this sample (yy is year
+				- 2000), altitude in m and temperature in
+				0.1 degC (little endian, 0x8000 if not
+				logged), sample interval in minutes
+	0xf1 <varint>		altitude delta beyond one byte
+	0xf2 <varint>		temperature delta, applies from here on
+	0xff			erased, no more records in this segment
+
+   varints are zigzag coded, 7 bits per byte, least significant first.
+
+   Records never cross a segment and every segment begins with a
+   keyframe, so the oldest segment can be erased without breaking the
+   rest. The segment after the one being written is always kept erased,
+   one erase per 512 bytes, which is more than eight hours at one
+   sample per minute. Records are collected in RAM and programmed in
+   batches of TRACK_BUF bytes. contrib/track2csv.py decodes a raw dump
+   of track_flash. */
+
+#define TRACK_ZERO_RUN		0xe0
+#define TRACK_RUN_MAX		17
+#define TRACK_KEY		0xf0
+#define TRACK_DELTA		0xf1
+#define TRACK_TEMP		0xf2
+#define TRACK_ERASED		0xff
+#define TRACK_SHORT_MAX		111
+
+#define TRACK_KEY_LEN		11
+/* pending zero run, long delta and temperature */
+#define TRACK_SAMPLE_MAX	(1 + 4 + 4)
+#define TRACK_NO_TEMP		((int16_t)0x8000)
+#define TRACK_TEMP_STEP		5	/* log temperature changes >= 0.5 degC */
+#define TRACK_CLIMB_STEP	3	/* m, noise threshold of the summary */
+
+#define TRACK_BUF		16
+#define TRACK_LOG_SIZE		(CONFIG_MOD_TRACK_SEGMENTS * FLASH_SEGMENT_SIZE)
+
+static FLASH_REGION(track_flash, TRACK_LOG_SIZE);
+static const volatile uint8_t *const track_log = FLASH_PTR(track_flash);
+
+static struct {
+	uint8_t recording;
+	uint8_t tick;		/* minutes until the next sample */
+
+	uint16_t pos;		/* next free byte of track_log */
+	uint8_t buf[TRACK_BUF];	/* records not yet programmed */
+	uint8_t len;
+	uint8_t run;		/* samples with no change not yet coded */
+
+	uint8_t keyed;		/* a keyframe opened this session */
+	int16_t alt;		/* last logged altitude, m */
+	int16_t temp;		/* last logged temperature, 0.1 degC */
+	uint16_t mod;		/* minute of the day of the last sample */
+} trk;
+
+static struct {
+	uint32_t samples;
+	int16_t min;
+	int16_t max;
+	uint16_t up;
+	uint16_t down;
+} sum;
+
+/******************************* encoder **********************************/
+
+static void track_flush(void)
+{
+	if (!trk.len)
+		return;
+
+	flash_write(&track_log[trk.pos], trk.buf, trk.len);
+	trk.pos += trk.len;
+	trk.len = 0;
+
+	if (trk.pos == TRACK_LOG_SIZE)
+		trk.pos = 0;
+}
+
+static void track_put(uint8_t b)
+{
+	trk.buf[trk.len++] = b;
+
+	if (trk.len == TRACK_BUF)
+		track_flush();
+}
+
+static void track_put_varint(int16_t v)
+{
+	uint16_t z = (v < 0 ? ~((uint16_t)v << 1) : (uint16_t)v << 1);
+
+	while (z > 0x7f) {
+		track_put(0x80 | (z & 0x7f));
+		z >>= 7;
+	}
+	track_put(z);
+}
+
+static void track_put_run(void)
+{
+	if (trk.run == 1)
+		track_put(0);
+	else if (trk.run)
+		track_put(TRACK_ZERO_RUN + trk.run - 2);
+
+	trk.run = 0;
+}
+
+/* bytes still free in the segment being written, 0 at the start of a
+   segment as that has to begin with a keyframe */
+static uint16_t track_room(void)
+{
+	uint16_t used = (trk.pos + trk.len + (trk.run ? 1 : 0))
+						& (FLASH_SEGMENT_SIZE - 1);
+
+	return (used ? FLASH_SEGMENT_SIZE - used : 0);
+}
+
+static uint8_t track_seg_erased(uint16_t seg)
+{
+	uint16_t i;
+
+	for (i = seg; i < seg + FLASH_SEGMENT_SIZE; i++) {
+		if (track_log[i] != TRACK_ERASED)
+			return 0;
+	}
+
+	return 1;
+}
+
+/* move on to the next segment and make sure the one after it is erased,
+   dropping the oldest part of the log. A session that starts on a
+   segment boundary finds it erased already */
+static void track_next_segment(void)
+{
+	uint16_t next;
+
+	track_put_run();
+	track_flush();
+
+	if (trk.pos & (FLASH_SEGMENT_SIZE - 1))
+		trk.pos = (trk.pos | (FLASH_SEGMENT_SIZE - 1)) + 1;
+	if (trk.pos == TRACK_LOG_SIZE)
+		trk.pos = 0;
+
+	next = trk.pos + FLASH_SEGMENT_SIZE;
+	if (next == TRACK_LOG_SIZE)
+		next = 0;
+	if (!track_seg_erased(next))
+		flash_erase_segment(&track_log[next]);
+}
+
+static void track_put_key(int16_t alt, int16_t temp)
+{
+	track_put_run();
+
+	if (track_room() < TRACK_KEY_LEN)
+		track_next_segment();
+
+	track_put(TRACK_KEY);
+	track_put(rtca_time.year - 2000);
+	track_put(rtca_time.mon);
+	track_put(rtca_time.day);
+	track_put(rtca_time.hour);
+	track_put(rtca_time.min);
+	track_put(alt);
+	track_put(alt >> 8);
+	track_put(temp);
+	track_put(temp >> 8);
+	track_put(CONFIG_MOD_TRACK_INTERVAL);
+
+	trk.keyed = 1;
+}
+
+static void track_put_delta(int16_t d, int16_t temp)
+{
+	if (d == 0) {
+		if (++trk.run == TRACK_RUN_MAX)
+			track_put_run();
+	} else {
+		track_put_run();
+		if (d >= -TRACK_SHORT_MAX - 1 && d <= TRACK_SHORT_MAX) {
+			track_put(d < 0 ? -2 * d - 1 : 2 * d);
+		} else {
+			track_put(TRACK_DELTA);
+			track_put_varint(d);
+		}
+	}
+
+#ifdef CONFIG_MOD_TRACK_TEMPERATURE
+	if (temp - trk.temp >= TRACK_TEMP_STEP
+	    || trk.temp - temp >= TRACK_TEMP_STEP) {
+		track_put_run();
+		track_put(TRACK_TEMP);
+		track_put_varint(temp - trk.temp);
+		trk.temp = temp;
+	}
+#endif
+}
+
+/* altitude measurement done */
+static void track_sample(void)
+{
+	int16_t alt = sAlt.altitude;
+	uint16_t mod = rtca_time.hour * 60 + rtca_time.min;
+#ifdef CONFIG_MOD_TRACK_TEMPERATURE
+	int16_t temp = sAlt.temperature - 2732;
+#else
+	int16_t temp = TRACK_NO_TEMP;
+#endif
+
+	if (!trk.recording)
+		return;
+
+	/* a key at the start of each segment, and whenever the samples
+	   no longer follow the interval (missed sample, clock set) */
+	if (!trk.keyed || track_room() < TRACK_SAMPLE_MAX
+	    || (mod + 1440 - trk.mod) % 1440 != CONFIG_MOD_TRACK_INTERVAL) {
+		track_put_key(alt, temp);
+		trk.temp = temp;
+	} else {
+		track_put_delta(alt - trk.alt, temp);
+	}
+
+	trk.alt = alt;
+	trk.mod = mod;
+}
+
+/******************************* decoder **********************************/
+
+static uint8_t track_rec_len(uint16_t i)
+{
+	uint8_t tag = track_log[i];
+	uint8_t n = 1;
+
+	if (tag < TRACK_KEY)
+		return 1;
+	if (tag == TRACK_KEY)
+		return TRACK_KEY_LEN;
+
+	/* 0xf1, 0xf2 and a varint */
+	while (n < 4 && (track_log[i + n] & 0x80))
+		n++;
+	return n + 1;
+}
+
+static int16_t track_get_varint(uint16_t i)
+{
+	uint16_t z = 0;
+	uint8_t s = 0;
+
+	do {
+		z |= (uint16_t)(track_log[i] & 0x7f) << s;
+		s += 7;
+	} while (track_log[i++] & 0x80);
+
+	return (z & 1 ? ~(z >> 1) : z >> 1);
+}
+
+/* end of the records in the segment starting at seg */
+static uint16_t track_seg_end(uint16_t seg)
+{
+	uint16_t i = seg;
+
+	while (i < seg + FLASH_SEGMENT_SIZE && track_log[i] != TRACK_ERASED)
+		i += track_rec_len(i);
+
+	return i;
+}
+
+/* find the end of the log after a reset: the written segment that is
+   followed by an erased one */
+static void track_seek(void)
+{
+	uint16_t seg, next;
+
+	trk.pos = 0;
+
+	for (seg = 0; seg < TRACK_LOG_SIZE; seg += FLASH_SEGMENT_SIZE) {
+		next = seg + FLASH_SEGMENT_SIZE;
+		if (next == TRACK_LOG_SIZE)
+			next = 0;
+
+		if (track_log[seg] != TRACK_ERASED
+		    && track_log[next] == TRACK_ERASED) {
+			trk.pos = track_seg_end(seg);
+			if (trk.pos == TRACK_LOG_SIZE)
+				trk.pos = 0;
+			return;
+		}
+	}
+}
+
+static void track_summarize(void)
+{
+	uint16_t seg, last, i, end;
+	int16_t alt = 0, ref = 0;
+	uint8_t tag, n;
+
+	memset(&sum, 0, sizeof(sum));
+
+	/* oldest segment first, the erased ones are empty */
+	seg = trk.pos & ~(FLASH_SEGMENT_SIZE - 1);
+	last = seg;
+	do {
+		seg += FLASH_SEGMENT_SIZE;
+		if (seg >= TRACK_LOG_SIZE)
+			seg -= TRACK_LOG_SIZE;
+
+		end = track_seg_end(seg);
+		for (i = seg; i < end; i += track_rec_len(i)) {
+			tag = track_log[i];
+			n = 1;
+
+			if (tag == TRACK_KEY) {
+				alt = track_log[i + 6]
+					| ((uint16_t)track_log[i + 7] << 8);
+				ref = alt;
+				if (!sum.samples)
+					sum.min = sum.max = alt;
+			} else if (tag == TRACK_DELTA) {
+				alt += track_get_varint(i + 1);
+			} else if (tag == TRACK_TEMP) {
+				continue;
+			} else if (tag >= TRACK_ZERO_RUN) {
+				n = tag - TRACK_ZERO_RUN + 2;
+			} else if (tag) {
+				alt += (tag & 1 ? -(tag >> 1) - 1 : tag >> 1);
+			}
+
+			sum.samples += n;
+			if (alt < sum.min)
+				sum.min = alt;
+			if (alt > sum.max)
+				sum.max = alt;
+
+			/* climb and descent beyond the sensor noise */
+			if (alt - ref >= TRACK_CLIMB_STEP) {
+				sum.up += alt - ref;
+				ref = alt;
+			} else if (ref - alt >= TRACK_CLIMB_STEP) {
+				sum.down += ref - alt;
+				ref = alt;
+			}
+		}
+	} while (seg != last);
+}
+
+/************************** menu callbacks ********************************/
+
+enum { SCR_TIME, SCR_MAX, SCR_MIN, SCR_UP, SCR_DOWN, SCR_COUNT };
+
+static void track_display(void)
+{
+	uint32_t minutes = (uint32_t)sum.samples * CONFIG_MOD_TRACK_INTERVAL;
+
+	display_symbol(0, LCD_ICON_RECORD, trk.recording ? SEG_SET : SEG_OFF);
+
+	/* hours logged, then the extremes and the climb of the log */
+	_printf(SCR_TIME, LCD_SEG_L1_3_0, "%4u", (uint16_t)(minutes / 60));
+	display_chars(SCR_TIME, LCD_SEG_L2_5_0, " HOURS", SEG_SET);
+	_printf(SCR_MAX, LCD_SEG_L1_3_0, "%4s", sum.max);
+	display_chars(SCR_MAX, LCD_SEG_L2_5_0, " MAX  ", SEG_SET);
+	_printf(SCR_MIN, LCD_SEG_L1_3_0, "%4s", sum.min);
+	display_chars(SCR_MIN, LCD_SEG_L2_5_0, " MIN  ", SEG_SET);
+	_printf(SCR_UP, LCD_SEG_L1_3_0, "%4u", sum.up);
+	display_chars(SCR_UP, LCD_SEG_L2_5_0, " UP   ", SEG_SET);
+	_printf(SCR_DOWN, LCD_SEG_L1_3_0, "%4u", sum.down);
+	display_chars(SCR_DOWN, LCD_SEG_L2_5_0, " DOWN ", SEG_SET);
+}
+
+static void track_event(enum sys_message msg)
+{
+	if (--trk.tick)
+		return;
+
+	trk.tick = CONFIG_MOD_TRACK_INTERVAL;
+	start_altitude_measurement(&track_sample);
+}
+
+static void track_activate(void)
+{
+	uint8_t i;
+
+	/* show what is in flash, including the buffered records */
+	track_put_run();
+	track_flush();
+	track_summarize();
+
+	lcd_screens_create(SCR_COUNT);
+	for (i = SCR_MAX; i < SCR_COUNT; i++)
+		display_symbol(i, LCD_UNIT_L1_M, SEG_ON);
+	track_display();
+}
+
+static void track_deactivate(void)
+{
+	lcd_screens_destroy();
+	display_symbol(0, LCD_ICON_RECORD, trk.recording ? SEG_SET : SEG_OFF);
+	display_clear(0, 1);
+	display_clear(0, 2);
+}
+
+static void track_up(void)
+{
+	lcd_screen_activate(0xff);
+}
+
+/* long STAR starts and stops recording */
+static void track_toggle(void)
+{
+	if (trk.recording) {
+		trk.recording = 0;
+		sys_messagebus_unregister(&track_event);
+		stop_altitude_measurement(&track_sample);
+		track_put_run();
+		track_flush();
+	} else {
+		trk.recording = 1;
+		trk.keyed = 0;
+		trk.tick = 1;
+		sys_messagebus_register(&track_event, SYS_MSG_RTC_MINUTE);
+	}
+
+	display_symbol(0, LCD_ICON_RECORD, trk.recording ? SEG_SET : SEG_OFF);
+}
+
+void mod_track_init(void)
+{
+	track_seek();
+
+	menu_add_entry("TRACK", &track_up, NULL, NULL, &track_toggle, NULL,
+		       NULL, &track_activate, &track_deactivate);
+}
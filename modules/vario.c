@@ -0,0 +1,118 @@
+/*
+    modules/vario.c: audio variometer for openchronos-ng
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <openchronos.h>
+
+/* drivers */
+#include "drivers/display.h"
+
+#include "libs/altitude.h"
+#include "libs/vario_tone.h"
+
+/* Climb rate in m/s on the first line, altitude on the second. The
+   pressure is converted every other 20Hz tick while the tone engine
+   beeps from timer interrupts, neither waits for the other. NUM turns
+   the sound on and off. */
+
+#define VARIO_POLL_DIV (2)
+
+static uint8_t vario_sound = 1;
+static uint8_t vario_div;
+
+static void vario_sound_symbols(void)
+{
+	enum display_segstate s = vario_sound ? SEG_ON : SEG_OFF;
+
+	display_symbol(0, LCD_ICON_BEEPER1, s);
+	display_symbol(0, LCD_ICON_BEEPER2, s);
+	display_symbol(0, LCD_ICON_BEEPER3, s);
+}
+
+/* called by libs/altitude once a measurement has completed */
+static void vario_ready(void)
+{
+	int16_t climb = sAlt.climb;
+
+	vario_tone_climb(climb);
+
+	/* cm/s to dm/s, rounded away from zero */
+	climb = (climb < 0 ? climb - 5 : climb + 5) / 10;
+	_printf(0, LCD_SEG_L1_3_0, "%03s", climb);
+	_printf(0, LCD_SEG_L2_4_0, "%4s", sAlt.altitude);
+}
+
+static void vario_update(enum sys_message msg)
+{
+	if (++vario_div < VARIO_POLL_DIV)
+		return;
+
+	vario_div = 0;
+	start_altitude_measurement(&vario_ready);
+}
+
+/************************** menu callbacks ********************************/
+
+static void vario_num(void)
+{
+	vario_sound = !vario_sound;
+
+	if (vario_sound)
+		vario_tone_start();
+	else
+		vario_tone_stop();
+
+	vario_sound_symbols();
+}
+
+static void vario_activate(void)
+{
+	display_chars(0, LCD_SEG_L1_3_0, "----", SEG_SET);
+	display_symbol(0, LCD_SEG_L1_DP0, SEG_ON);
+	display_symbol(0, LCD_UNIT_L1_PER_S, SEG_ON);
+	display_symbol(0, LCD_UNIT_L1_M, SEG_ON);
+	vario_sound_symbols();
+
+	vario_tone_climb(0);
+	if (vario_sound)
+		vario_tone_start();
+
+	vario_div = 0;
+	sys_messagebus_register(&vario_update, SYS_MSG_TIMER_20HZ);
+}
+
+static void vario_deactivate(void)
+{
+	sys_messagebus_unregister(&vario_update);
+	stop_altitude_measurement(&vario_ready);
+	vario_tone_stop();
+
+	/* cleanup screen */
+	display_symbol(0, LCD_SEG_L1_DP0, SEG_OFF);
+	display_symbol(0, LCD_UNIT_L1_PER_S, SEG_OFF);
+	display_symbol(0, LCD_UNIT_L1_M, SEG_OFF);
+	display_symbol(0, LCD_ICON_BEEPER1, SEG_OFF);
+	display_symbol(0, LCD_ICON_BEEPER2, SEG_OFF);
+	display_symbol(0, LCD_ICON_BEEPER3, SEG_OFF);
+	display_clear(0, 1);
+	display_clear(0, 2);
+}
+
+void mod_vario_init(void)
+{
+	menu_add_entry("VARIO", NULL, NULL, &vario_num, NULL, NULL, NULL,
+		       &vario_activate, &vario_deactivate);
+}
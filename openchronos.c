@@ -78,6 +78,16 @@
 #include <drivers/rtca.h>
 #include <drivers/temperature.h>
 #include <drivers/battery.h>
+#include <drivers/adc12.h>
+#ifdef CONFIG_INFOMEM
+#include <drivers/infomem.h>
+#endif
+
+#include <libs/accel_stream.h>
+
+#ifdef CONFIG_ACCELEROMETER
+extern uint8_t as_ok;
+#endif
 
 #define BIT_IS_SET(F, B)  ((F) | (B)) == (F)
 
@@ -166,6 +176,112 @@ void sys_messagebus_unregister(void (*callback)(enum sys_message))
 	}
 }
 
+#ifdef CONFIG_IDLE
+/***************************************************************************
+ ************************* STATIONARY IDLE MODE ****************************
+ **************************************************************************/
+
+/* events not delivered while idle, everything slower than a minute
+   still goes through so clocks and alarms stay right. Their interrupts
+   are stopped too, so the CPU stays asleep between the minutes */
+#define IDLE_MASKED_MSGS (SYS_MSG_RTC_SECOND | SYS_MSG_TIMER_4S \
+			  | SYS_MSG_TIMER_PROG)
+
+static uint8_t idle_minutes;
+static uint8_t sys_idle;
+
+#ifdef CONFIG_ACCELEROMETER
+/* the configuration of the accelerometer before it was armed */
+static struct As_Param idle_as_config;
+static uint8_t idle_armed;
+
+/* keep the CMA3000 in motion detection mode (10Hz) while nobody else
+   uses it, its interrupt is what wakes us up */
+static void idle_arm_motion(void)
+{
+	if (!as_ok || (AS_PWR_OUT & AS_PWR_PIN))
+		return;
+
+	idle_as_config = as_config;
+	idle_armed = 1;
+
+	as_config.range = 2;
+	as_config.sampling = SAMPLING_10_HZ;
+	as_config.MDTHR = 2;
+	as_config.MDFFTMR = 1;
+	as_config.mode = ACTIVITY_MODE;
+	as_start(ACTIVITY_MODE);
+}
+
+/* give the configuration back to the modules */
+static void idle_disarm_motion(void)
+{
+	if (!idle_armed)
+		return;
+
+	idle_armed = 0;
+
+	/* unless somebody started a stream on it since */
+	if (as_config.mode == ACTIVITY_MODE)
+		as_config = idle_as_config;
+}
+#endif
+
+static void idle_enter(void)
+{
+	sys_idle = 1;
+	rtca_disable_second();
+	timer0_suspend();
+#ifdef CONFIG_IDLE_BLANK_LCD
+	lcd_power(0);
+#endif
+}
+
+/* returns 1 if the watch was idle */
+static uint8_t idle_leave(void)
+{
+	idle_minutes = 0;
+
+#ifdef CONFIG_ACCELEROMETER
+	idle_disarm_motion();
+#endif
+
+	if (!sys_idle)
+		return 0;
+
+	sys_idle = 0;
+	rtca_enable_second();
+	timer0_resume();
+#ifdef CONFIG_IDLE_BLANK_LCD
+	lcd_power(1);
+#endif
+	return 1;
+}
+
+static enum sys_message idle_filter(enum sys_message msg)
+{
+	if (msg & SYS_MSG_AS_INT)
+		idle_leave();
+
+	if (msg & SYS_MSG_RTC_MINUTE) {
+#ifdef CONFIG_ACCELEROMETER
+		/* no motion interrupts while somebody streams samples */
+		if (accel_stream_running())
+			idle_leave();
+		else
+			idle_arm_motion();
+#endif
+		if (!sys_idle && ++idle_minutes >= CONFIG_IDLE_TIMEOUT)
+			idle_enter();
+	}
+
+	if (sys_idle)
+		msg &= ~IDLE_MASKED_MSGS;
+
+	return msg;
+}
+#endif /* CONFIG_IDLE */
+
 void check_events(void)
 {
 	enum sys_message msg = 0;
@@ -188,12 +304,56 @@ void check_events(void)
 		as_last_interrupt = 0;
 	}
 
+	/* drivers/ps */
+	if (ps_last_interrupt) {
+		msg |= SYS_MSG_PS_INT;
+		ps_last_interrupt = 0;
+	}
+
+#ifdef CONFIG_ACCELEROMETER
+	/* libs/accel_stream */
+	if (accel_stream_pending)
+		accel_stream_drain();
+#endif
+
+	/* drivers/adc12 */
+	if (adc12_last_event) {
+		adc12_last_event = 0;
+		adc12_dispatch();
+	}
+
+#ifdef CONFIG_BATTERY_GAUGE
+	/* drivers/battery, the gauge follows the hourly measurement */
+	if ((msg & SYS_MSG_RTC_HOUR) == SYS_MSG_RTC_HOUR)
+		battery_gauge_request();
+#endif
+
+#ifdef CONFIG_INFOMEM
+	/* drivers/infomem, write back what the applications changed */
+	if ((msg & SYS_MSG_RTC_HOUR) == SYS_MSG_RTC_HOUR
+	    && rtca_time.hour % CONFIG_INFOMEM_FLUSH_HOURS == 0)
+		infomem_flush();
+#endif
+
 #ifdef CONFIG_BATTERY_MONITOR
-	/* drivers/battery */
-	if ((msg & SYS_MSG_RTC_MINUTE) == SYS_MSG_RTC_MINUTE) {
-		msg |= SYS_MSG_BATT;
+	/* drivers/battery, the result comes in on a later pass */
+	if ((msg & SYS_MSG_RTC_MINUTE) == SYS_MSG_RTC_MINUTE)
 		battery_measurement();
+#endif
+
+	if (battery_last_event) {
+		msg |= SYS_MSG_BATT;
+		battery_last_event = 0;
+	}
+
+	/* drivers/buzzer */
+	if (buzzer_last_event) {
+		msg |= SYS_MSG_BUZZER;
+		buzzer_last_event = 0;
 	}
+
+#ifdef CONFIG_IDLE
+	msg = idle_filter(msg);
 #endif
 
 	{
@@ -210,6 +370,14 @@ void check_events(void)
 		}
 	}
 
+#if defined(CONFIG_IDLE) && defined(CONFIG_ACCELEROMETER)
+	/* if no listener read the motion status, clear it here, otherwise
+	   INT stays high and the next motion won't raise a new edge */
+	if ((msg & SYS_MSG_AS_INT) && !accel_stream_running()
+	    && (AS_INT_IN & AS_INT_PIN))
+		as_get_status();
+#endif
+
 
 }
 
@@ -299,6 +467,19 @@ static void menumode_enable(void)
 
 static void check_buttons(void)
 {
+#ifdef CONFIG_IDLE
+#ifdef CONFIG_IDLE_BLANK_LCD
+	/* the display was off, this press only wakes us up */
+	if (ports_buttons_pending() && idle_leave()) {
+		ports_buttons_clear();
+		return;
+	}
+#else
+	if (ports_buttons_pending())
+		idle_leave();
+#endif
+#endif
+
 	if (menu_editmode.enabled) {
 		editmode_handler();
 
@@ -500,7 +681,7 @@ void init_application(void)
 
 #ifdef CONFIG_INFOMEM
 	if (infomem_ready() == -2) {
-		infomem_init(INFOMEM_C, INFOMEM_C + 2 * INFOMEM_SEGMENT_SIZE);
+		infomem_init();
 	}
 #endif
 }
@@ -527,9 +708,17 @@ int main(void)
 
 	/* main loop */
 	while (1) {
-		/* Go to LPM3, wait for interrupts */
-		_BIS_SR(LPM3_bits + GIE);
+		/* Go to LPM3, wait for interrupts. A melody needs SMCLK unless
+		   it is played from ACLK, LPM1 keeps it running. */
+		battery_load_stop(BATTERY_LOAD_CPU);
+#ifndef CONFIG_BUZZER_ACLK
+		if (buzzer_playing())
+			_BIS_SR(LPM1_bits + GIE);
+		else
+#endif
+			_BIS_SR(LPM3_bits + GIE);
 		__no_operation();
+		battery_load_start(BATTERY_LOAD_CPU);
 
 		/* service watchdog on wakeup */
 		#ifdef USE_WATCHDOG
@@ -542,6 +731,9 @@ int main(void)
 
 		/* check for button presses, drive the menu */
 		check_buttons();
+
+		/* convert what was requested from the ADC in this pass */
+		adc12_flush();
 	}
 }
 
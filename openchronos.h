@@ -126,6 +126,8 @@ enum sys_message {
 	SYS_MSG_PS_INT =	BITB,
 	SYS_MSG_BATT =    BITC,
     SYS_MSG_FAKE =    BITD,
+	/* drivers/buzzer */
+	SYS_MSG_BUZZER =  BITE, /*!< a melody has ended. */
 };
 
 /*!
@@ -40,6 +40,35 @@ DATA["USE_WATCHDOG"] = {
 	"help": "Protects the clock against deadlocks by rebooting it.",
 }
 
+# IDLE MODE ##################################################################
+
+DATA["TEXT_IDLE"] = {
+	"name": "Stationary idle mode",
+	"type": "info",
+}
+
+DATA["CONFIG_IDLE"] = {
+	"name": "Enter idle mode when not moving",
+	"default": False,
+	"help": "After some minutes without buttons or motion, stop the per second and sensor events (colon blink, 1Hz redraws, 4s polling). Motion on the accelerometer or any button wakes it up.",
+}
+
+DATA["CONFIG_IDLE_TIMEOUT"] = {
+	"name": "Minutes before entering idle mode",
+	"type": "text",
+	"default": "30",
+	"ifndef": True,
+	'depends': [ 'CONFIG_IDLE' ],
+	"help": "Minutes without motion or button presses before entering idle mode",
+}
+
+DATA["CONFIG_IDLE_BLANK_LCD"] = {
+	"name": "Blank the LCD while idle",
+	"default": False,
+	'depends': [ 'CONFIG_IDLE' ],
+	"help": "Switches the LCD off in idle mode. The first button press only wakes the watch up.",
+}
+
 # RTC DRIVER #################################################################
 
 DATA["TEXT_RTC"] = {
@@ -110,6 +139,57 @@ DATA["CONFIG_BUTTONS_SHORT_PRESS_TIME"] = {
 	"help": "Short button press time (in multiples of 1/20 second)",
 }
 
+# INFOMEM DRIVER #############################################################
+
+DATA["TEXT_INFOMEM"] = {
+	"name": "Information memory driver",
+	"type": "info",
+}
+
+DATA["CONFIG_INFOMEM"] = {
+	"name": "Persistent application data",
+	"default": False,
+	"help": "Keeps application data in information memory segments D to B as a log of small records, so that an update costs a few bytes of flash instead of rewriting whole segments.",
+}
+
+DATA["CONFIG_INFOMEM_MAIN_SEGMENTS"] = {
+	"name": "Spare main flash segments",
+	"type": "text",
+	"default": "0",
+	"ifndef": True,
+	'depends': [ 'CONFIG_INFOMEM' ],
+	"help": "Number of 512 byte main flash segments added to the log, more space and fewer erases per update.",
+}
+
+DATA["CONFIG_INFOMEM_FLUSH_HOURS"] = {
+	"name": "Hours between write backs",
+	"type": "text",
+	"default": "1",
+	"ifndef": True,
+	'depends': [ 'CONFIG_INFOMEM' ],
+	"help": "Changed application data is kept in RAM and written to flash at this interval, on a low battery and before a reset. Use a divisor of 24.",
+}
+
+# BUZZER DRIVER ##############################################################
+
+DATA["TEXT_BUZZER"] = {
+	"name": "Buzzer driver",
+	"type": "info",
+}
+
+DATA["CONFIG_BUZZER_ACLK"] = {
+	"name": "Play melodies from the 32kHz ACLK",
+	"default": False,
+	"help": "Clocks the buzzer PWM from ACLK instead of SMCLK, so the CPU sleeps in LPM3 instead of LPM1 while a melody plays. With only a few clock ticks per half period the notes come out up to a semitone off unless dithered.",
+}
+
+DATA["CONFIG_BUZZER_ACLK_DITHER"] = {
+	"name": "Dither the pitch of ACLK melodies",
+	"default": True,
+	'depends': [ 'CONFIG_BUZZER_ACLK' ],
+	"help": "Alternates the half periods between two lengths so the notes are in tune on average. Takes a short interrupt per half period, a few thousand per second.",
+}
+
 # BATTERY DRIVER #############################################################
 
 DATA["TEXT_BATTERY"] = {
@@ -124,12 +204,32 @@ DATA["CONFIG_BATTERY_MONITOR"] = {
 	"help": "Monitors the battery voltage every minute and displays a warning on low battery. Also used by the battery to auto-refresh display, if enabled.",
 }
 
+DATA["CONFIG_BATTERY_GAUGE"] = {
+	"name": "Battery fuel gauge",
+	"default": False,
+	'depends': [ 'CONFIG_BATTERY_MONITOR' ],
+	"help": "Estimates the charge left from the temperature compensated battery voltage and the time the CPU, buzzer, radio and sensors are switched on, and from that the days until the battery is empty. Updated hourly, the battery module shows the estimate and what each of them costs per day.",
+}
+
 DATA["CONFIG_BATTERY_DISABLE_FILTER"] = {
 	"name": "Disables battery filter [FOR TESTING]",
 	"default": True,
 	"help": "Reports the straight voltage value from measurement instead of the 'smoothed' one.",
 }
 
+# ACCELEROMETER DRIVER #######################################################
+
+DATA["TEXT_ACCELEROMETER"] = {
+	"name": "Accelerometer driver",
+	"type": "info"
+}
+
+DATA["CONFIG_ACCELEROMETER_DMA"] = {
+	"name": "Read X/Y/Z using DMA",
+	"default": False,
+	"help": "Uses DMA channels 0 and 1 to read the three axes from the CMA3000 while the CPU sleeps in LPM0, instead of busy-polling the SPI for every register.",
+}
+
 # TEMPERATURE SENSOR DRIVER ##################################################
 
 DATA["TEXT_TEMPERATURE"] = {
@@ -140,9 +240,9 @@ DATA["TEXT_TEMPERATURE"] = {
 DATA["CONFIG_TEMPERATURE_OFFSET"] = {
 	"name": "Compensation offset",
     "type": "text",
-	"default": "-260",
+	"default": "0",
 	"ifndef": True,
-	"help": "Compensate the sensor raw output value with this offset",
+	"help": "Added to the factory calibrated temperature, in 0.1 degrees C",
 }
 
 DATA["CONFIG_TEMPERATURE_METRIC"] = {
@@ -170,6 +270,12 @@ DATA["CONFIG_PRESSURE_BUILD_BOSCH_PS"] = {
 	"help": "",
 }
 
+DATA["CONFIG_PRESSURE_I2C_ISR"] = {
+	"name": "Clock the sensor I2C bus from a timer interrupt",
+	"default": False,
+	"help": "Drives SCL/SDA from Timer0 CCR1 at ~4kHz so the CPU sleeps in LPM3 between bus edges, instead of bit-banging at full speed. Transactions take a few milliseconds instead of a few hundred microseconds.",
+}
+
 # AUTOMATICALLY GENERATED MODULE LIST ########################################
 
 DATA["TEXT_MODULES"] = {
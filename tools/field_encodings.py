@@ -3,6 +3,8 @@
 # vim: ts=4 noexpandtab
 
 import base64
+import hashlib
+import re
 
 def b32encode(string, encode):
 	if encode:
@@ -13,3 +15,62 @@ def b32encode(string, encode):
 		return  base64.b32encode(s)
 
 
+
+def otp_accounts(string, encode):
+	"""
+		NAME:DIGITS:PERIOD:KEY,... with a base32 KEY to the initializers of
+		struct otp_account in modules/otp.c and back
+	"""
+	if encode:
+		if not isinstance(string, str):
+			return ""
+		accounts = []
+		for account in string.split(","):
+			if not account.strip():
+				continue
+			name, digits, period, key = [x.strip() for x in account.split(":")]
+			key = key.upper().replace(" ", "")
+			key = bytearray(base64.b32decode(key + "=" * (-len(key) % 8)))
+			# RFC 2104, keys longer than a block are hashed first
+			if len(key) > 64:
+				key = bytearray(hashlib.sha1(key).digest())
+			accounts.append('{"%5s", "%s", %d, %d, %d},' % (
+				name.replace('"', '').upper()[:5],
+				"".join(["\\x%02x" % x for x in key]), len(key),
+				min(max(int(digits), 6), 8), min(max(int(period), 1), 255)))
+		return " ".join(accounts)
+	else:
+		if not isinstance(string, str):
+			return ""
+		accounts = []
+		for m in re.finditer(r'\{"(.{5})", "((?:\\x[0-9a-f]{2})*)", \d+, (\d+), (\d+)\}', string):
+			key = bytearray([int(x, 16) for x in m.group(2).split("\\x")[1:]])
+			key = base64.b32encode(bytes(key)).decode("ascii").rstrip("=")
+			accounts.append("%s:%s:%s:%s" % (m.group(1).strip(), m.group(3), m.group(4), key))
+		return ", ".join(accounts)
+
+TIDE_CONSTITUENTS = ["M2", "S2", "N2", "K2", "K1", "O1", "P1", "Q1", "M4", "MS4"]
+
+def tide_constituents(string, encode):
+	"""
+		NAME:AMPLITUDE:PHASE,... to the initializers of tide_station[] in
+		modules/tide.c and back, PHASE in degrees is kept in 0.01 degrees
+	"""
+	if not isinstance(string, str):
+		return ""
+	constituents = []
+	if encode:
+		for constituent in string.split(","):
+			if not constituent.strip():
+				continue
+			name, amplitude, phase = [x.strip() for x in constituent.split(":")]
+			if name.upper() not in TIDE_CONSTITUENTS:
+				continue
+			constituents.append("[TIDE_%s] = { %d, %d }," % (name.upper(),
+				int(amplitude), int(round(float(phase) * 100)) % 36000))
+		return " ".join(constituents)
+	else:
+		for m in re.finditer(r'\[TIDE_([A-Z0-9]+)\] = \{ (-?\d+), (\d+) \}', string):
+			constituents.append("%s:%s:%.2f" % (m.group(1), m.group(2),
+				int(m.group(3)) / 100.0))
+		return ", ".join(constituents)